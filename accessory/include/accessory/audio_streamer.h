@@ -2,19 +2,28 @@
 #define ACCESSORY_AUDIO_STREAMER_H
 
 #include "protocol.h"
+#include "timer_wheel.h"
+#include "latency_trace.h"
+#include "audio_codec.h"
+#include "session_cipher.h"
+#include "accessory/oscillator.h"
+#include "accessory/retransmit_buffer.h"
+#include "accessory/rate_controller.h"
+#include "accessory/frame_ring.h"
 #include <atomic>
-#include <thread>
-#include <queue>
 #include <mutex>
-#include <condition_variable>
+#include <memory>
+#include <vector>
 
 namespace accessory {
 
 class Transport;
+class Telemetry;
+class FileSource;
 
 class AudioStreamer {
 public:
-    explicit AudioStreamer(Transport* transport);
+    AudioStreamer(Transport* transport, common::TimerWheel* scheduler);
     ~AudioStreamer();
     
     // Streaming control
@@ -22,31 +31,257 @@ public:
     void stop_streaming();
     bool is_streaming() const { return streaming_.load(); }
     
-    // Audio generation (simulated)
+    // Audio generation (simulated). Configure before start_streaming().
+    // generate_audio_packet() fills `size` bytes with test signal frames in
+    // the stream format.
+    void set_test_signal(Waveform waveform, double frequency_hz, uint32_t seed = 1);
     void generate_audio_packet(uint8_t* buffer, size_t size);
     
+    // Stream from files instead of the test signal (nullptr: test signal).
+    // The source is switched to the stream's sample rate at
+    // start_streaming() and must outlive streaming. Its mono output is
+    // copied to every channel.
+    void set_file_source(FileSource* source) { file_source_ = source; }
+    
+    // Stream format (negotiated at connect): channels, sample rate and
+    // sample type. Invalid formats fall back to mono 48kHz INT16. Set before
+    // set_encoding(), which creates the codec for it.
+    void set_stream_format(const protocol::StreamFormat& format);
+    const protocol::StreamFormat& get_stream_format() const { return format_; }
+    
+    // Payload encoding (negotiated at connect). Encodings the stream format
+    // does not support fall back to raw PCM. Configure before start_streaming().
+    void set_encoding(protocol::AudioEncoding encoding);
+    protocol::AudioEncoding get_encoding() const { return codec_->encoding(); }
+    
+    // Frame duration and aggregation (negotiated at connect). The frame
+    // duration is fixed for a stream; frames per packet may change while
+    // streaming and takes effect at the next packet.
+    void set_frame_format(uint16_t frame_samples, uint8_t frames_per_packet);
+    void set_frames_per_packet(uint8_t frames_per_packet);
+    uint16_t get_frame_samples() const { return frame_samples_; }
+    uint8_t get_frames_per_packet() const { return frames_per_packet_.load(); }
+    
+    // Selective retransmission: sent packets are kept for this many packets
+    // and resent from there on AUDIO_RETRANSMIT. Configure before
+    // start_streaming().
+    void set_retransmit_history(size_t packets) { retransmit_buffer_.reset(packets); }
+    void on_retransmit_request(const protocol::Packet& packet);
+    
+    // Forward error correction, configured by the host (AUDIO_FEC_CONFIG).
+    // Parity for each group of data packets is sent right after the group's
+    // last packet; a new configuration applies from the next group.
+    void on_fec_config(const protocol::Packet& packet);
+    void set_fec(protocol::FecScheme scheme, uint8_t data_count, uint8_t parity_count);
+    
+    // Batched acknowledgements from the host (AUDIO_ACK). Each one gives an
+    // RTT sample (from the send time of its highest sequence, less the
+    // host's hold time) and the loss since the previous one.
+    void on_ack(const protocol::Packet& packet);
+    
+    // Rate control (on by default): every 250ms a RateController picks the
+    // codec, frames per packet and parity cap from ACK feedback and battery.
+    // The negotiated format (as of start_streaming()) is the top of its
+    // ladder; `fallback` must be decodable by the host. Configure before
+    // start_streaming().
+    void set_rate_control(bool enabled,
+                          protocol::AudioEncoding fallback = protocol::AudioEncoding::IMA_ADPCM);
+    
+    // Battery input for rate control (nullptr: treated as mains powered)
+    void set_telemetry(const Telemetry* telemetry) { telemetry_ = telemetry; }
+    
+    // Pacing (on by default): audio, parity and resends leave through a
+    // token bucket refilled at twice the stream's media rate, so catch-up
+    // ticks and parity groups are spread out instead of bursting.
+    void set_pacing(bool enabled) { pacing_enabled_.store(enabled); }
+    
+    // Pre-rendering (on by default): a render task on the scheduler
+    // generates and encodes frames ahead of time into a FrameRing, so the
+    // frame tick only timestamps, packs and sends them. Off: the tick
+    // renders its own frames. Configure before start_streaming().
+    void set_prerender(bool enabled) { prerender_enabled_.store(enabled); }
+    
+    // Session key agreed at pairing (nullptr: send in the clear). Audio
+    // packets are then sealed in place before they are sent, kept for
+    // resends or covered by parity: AES-128-CCM by default, or an HMAC tag
+    // over a clear payload in AUTHENTICATE mode. Configure before
+    // start_streaming().
+    void set_session_key(const uint8_t* key) { cipher_.set_key(key); }
+    void set_protection_mode(common::SessionCipher::Mode mode) { cipher_.set_mode(mode); }
+    bool is_encrypted() const { return cipher_.has_key(); }
+    
+    // A resumed session carries on from where its stream stopped: the next
+    // start_streaming() begins at this sequence and sample position instead
+    // of zero. Used once. Configure before start_streaming().
+    void set_resume_point(uint32_t sequence, uint64_t sample_position);
+    // Where a stopped stream would carry on
+    uint32_t get_next_sequence() const { return sequence_number_; }
+    uint64_t get_sample_position() const { return sample_position_; }
+    
+    // Optional per-frame audio path tracing (nullptr disables)
+    void set_latency_trace(common::LatencyTrace* trace) { latency_trace_ = trace; }
+    
     // Statistics
     struct Stats {
         uint64_t packets_sent;
+        uint64_t frames_sent;
         uint64_t packets_acked;
-        uint64_t retransmissions;
-        uint32_t avg_latency_us;
+        uint64_t acks_received;
+        uint64_t packets_lost;          // Sent but not received by the host (first transmissions)
+        double loss_rate;               // Smoothed over recent ACKs, 0-1
+        uint64_t retransmit_requests;   // Sequences NACKed by the host
+        uint64_t retransmissions;       // Resent from history (recoverable)
+        uint64_t retransmit_misses;     // No longer in history (unrecoverable)
+        uint64_t fec_packets_sent;
+        uint64_t fec_groups_skipped;    // Blocks too large for a parity packet
+        uint32_t avg_latency_us;        // Smoothed round-trip time
         uint32_t max_latency_us;
+        uint32_t min_rtt_us;
+        uint32_t last_rtt_us;
+        uint32_t avg_timing_error_us;   // Frame tick vs ideal schedule
+        uint32_t max_timing_error_us;
+        uint64_t ticks_skipped;
+        uint64_t audio_bytes_sent;      // Encoded audio, excluding headers
+        uint64_t encode_failures;
+        uint8_t quality_level;          // RateController level in effect
+        uint64_t quality_changes;
+        uint64_t packets_paced;         // Held back by the pacer
+        uint32_t max_pacing_delay_us;
+        uint64_t pacing_overflows;      // Sent unpaced, queue full
+        uint32_t avg_tick_work_ns;      // Frame tick, start to end
+        uint32_t max_tick_work_ns;
+        uint32_t avg_render_work_ns;    // Per frame: generate and encode
+        uint32_t max_render_work_ns;
+        uint64_t render_underruns;      // Ticks that found frames not yet rendered
+        uint64_t packets_encrypted;
     };
     
     Stats get_stats() const;
     
 private:
-    void streaming_loop();
-    void send_audio_packet();
+    void send_audio_frame();
+    bool take_frame(uint64_t capture_time, uint64_t* audio_bytes);
+    void render_frames(size_t max_frames);
+    const void* render_pcm();
+    void send_pending_packet();
+    void add_fec_block(const protocol::Packet& packet);
+    void send_fec_parity();
+    void run_rate_control(uint64_t now);
+    void select_codec();
+    bool send_paced(const protocol::Packet& packet);
+    void update_pacing_rate(size_t bytes, uint64_t duration_us);
+    void refill_pacing_tokens(uint64_t now);
+    void schedule_pacing_drain();
+    void drain_pacing_queue();
+    void record_send(uint32_t sequence, uint64_t send_us);
+    void mark_retransmitted(uint32_t sequence);
     
     Transport* transport_;
+    common::TimerWheel* scheduler_;
     std::atomic<bool> streaming_;
-    std::thread streaming_thread_;
+    common::TimerWheel::TimerId audio_timer_;
     
     // Sequence tracking
     uint32_t sequence_number_;
+    uint32_t first_sequence_;           // Of this stream
+    uint64_t sample_position_;
+    bool resume_pending_;
+    uint32_t resume_sequence_;
+    uint64_t resume_position_;
     uint64_t stream_start_time_;
+    uint64_t next_deadline_us_;
+    uint64_t owed_frames_;              // Due but not yet rendered
+    
+    // Frame and stream format. channel_samples_ is samples per channel in
+    // a frame at the stream's rate.
+    uint16_t frame_samples_;
+    protocol::StreamFormat format_;
+    uint32_t channel_samples_;
+    std::atomic<uint8_t> frames_per_packet_;
+    uint8_t max_frames_per_packet_;     // Fits one datagram with the packet's codec
+    
+    // Packet being filled with frames (only the frame tick touches it)
+    protocol::Packet pending_packet_;
+    protocol::AudioPayload pending_audio_;
+    size_t pending_size_;
+    uint8_t pending_target_frames_;
+    common::SessionCipher cipher_;
+    
+    RetransmitBuffer retransmit_buffer_;
+    
+    // Send times of recent packets for RTT sampling, indexed by sequence
+    struct SentRecord {
+        uint32_t sequence;
+        uint64_t send_us;
+        bool acked;
+        bool retransmitted;             // Ambiguous RTT, not sampled
+    };
+    std::mutex ack_mutex_;
+    std::vector<SentRecord> sent_history_;
+    bool ack_valid_;
+    uint32_t ack_highest_;
+    uint32_t ack_last_sent_;            // Counters at the previous ACK
+    uint32_t ack_last_received_;
+    
+    // FEC group being filled (only the frame tick touches it). The host's
+    // configuration is packed scheme | data_count << 8 | parity_count << 16.
+    std::atomic<uint32_t> fec_config_;
+    protocol::FecScheme fec_scheme_;
+    uint8_t fec_data_count_;
+    uint8_t fec_parity_count_;
+    uint8_t fec_filled_;
+    uint8_t fec_send_parity_;               // Parity packets sent this group
+    uint32_t fec_base_sequence_;
+    uint32_t fec_sequence_;
+    size_t fec_block_size_;                 // Longest block of the group
+    size_t fec_block_lengths_[protocol::FEC_MAX_DATA_PACKETS];
+    std::vector<uint8_t> fec_blocks_;       // data_count x FEC_MAX_BLOCK_SIZE
+    
+    // Frames rendered ahead of the tick. The render side owns the signal
+    // source and the encoders, and follows render_encoding_ (set by rate
+    // control) from its next frame.
+    FrameRing frame_ring_;
+    std::atomic<bool> prerender_enabled_;
+    std::atomic<uint8_t> render_encoding_;
+    common::TimerWheel::TimerId render_timer_;
+    
+    // Test signal generator and encoders (per stream). active_codec_ is the
+    // negotiated codec_ or, on a weak link, fallback_codec_. One frame of
+    // samples is rendered into render_buffer_ (int32 keeps any sample type
+    // aligned); file audio is read into file_buffer_ first.
+    Oscillator oscillator_;
+    Waveform waveform_;
+    double frequency_hz_;
+    FileSource* file_source_;
+    std::vector<int32_t> render_buffer_;
+    std::vector<int16_t> file_buffer_;
+    std::unique_ptr<common::AudioCodec> codec_;
+    std::unique_ptr<common::AudioCodec> fallback_codec_;
+    common::AudioCodec* active_codec_;
+    
+    // Rate control (only the frame tick touches it)
+    std::atomic<bool> rate_control_enabled_;
+    protocol::AudioEncoding fallback_encoding_;
+    RateController rate_controller_;
+    uint64_t next_control_us_;
+    uint8_t max_parity_;
+    std::atomic<uint64_t> last_ack_us_;
+    const Telemetry* telemetry_;
+    
+    // Pacing queue and token bucket (under pacing_mutex_; packets are sent
+    // under it so they leave in order)
+    std::mutex pacing_mutex_;
+    std::atomic<bool> pacing_enabled_;
+    std::vector<protocol::Packet> pacing_queue_;
+    std::vector<uint64_t> pacing_enqueued_us_;
+    size_t pacing_head_;
+    size_t pacing_count_;
+    double pacing_tokens_;                  // Bytes, negative when in debt
+    double pacing_rate_;                    // Bytes per microsecond, 0 until measured
+    uint64_t pacing_refill_us_;
+    common::TimerWheel::TimerId pacing_timer_;
+    
+    common::LatencyTrace* latency_trace_;
     
     // Statistics
     mutable std::mutex stats_mutex_;
@@ -2,52 +2,72 @@
 #define ACCESSORY_CONNECTION_FSM_H
 
 #include "protocol.h"
+#include "timer_wheel.h"
+#include "session_ticket.h"
+#include "accessory/event_queue.h"
 #include <functional>
+#include <memory>
 #include <mutex>
-#include <atomic>
+#include <condition_variable>
 #include <thread>
+#include <atomic>
 
 namespace accessory {
 
 class Transport;
 
+// Connection state machine. Packet handlers, timers and the application
+// only queue events (see event_queue.h); the events run one at a time, in
+// order, on a scheduler worker, each looked up in a constant
+// (state, event) -> (next state, action) table. No handler sleeps: timed
+// steps (DISCONNECTING -> IDLE, the reconnect backoff) are timers that
+// queue events. State change callbacks run on that worker with no lock
+// held, so they may call back into the FSM; what they queue runs next.
 class ConnectionFSM {
 public:
     using StateChangeCallback = std::function<void(protocol::ConnectionState, protocol::ConnectionState)>;
     
-    explicit ConnectionFSM(Transport* transport);
+    struct Stats {
+        uint64_t events;                // Run through the table
+        uint64_t ignored;               // No transition from the state they found
+        uint64_t dropped;               // Queue full
+        uint64_t max_queue_us;          // Longest wait between queueing and running
+    };
+    
+    ConnectionFSM(Transport* transport, common::TimerWheel* scheduler);
     ~ConnectionFSM();
     
-    // State management
+    // State management. stop() returns once every event queued before it
+    // has run and the FSM is IDLE, with its timers cancelled.
     void start();
     void stop();
     protocol::ConnectionState get_state() const { return state_.load(); }
     
-    // Event handlers
+    // Packet handlers: copy the payload into an event and return. Keepalives
+    // and time sync change no state and are answered at once.
     void on_discover_request(const protocol::Packet& packet);
     void on_pair_request(const protocol::Packet& packet);
     void on_connect_request(const protocol::Packet& packet);
     void on_disconnect(const protocol::Packet& packet);
     void on_keepalive(const protocol::Packet& packet);
+    void on_time_sync_request(const protocol::Packet& packet);
+    void on_resume_request(const protocol::Packet& packet);
     
-    // State transitions
-    void enter_discovering();
-    void enter_pairing();
+    // Application events: CONNECTED without a handshake (from IDLE; load
+    // generation) and CONNECTED -> STREAMING
     void enter_connected();
     void enter_streaming();
-    void enter_disconnecting();
-    void enter_idle();
-    void enter_error();
     
-    // Connection management
+    // The link is gone: ERROR, then IDLE after a growing backoff
     void handle_connection_loss();
-    void attempt_reconnection();
     
     // Callbacks
     void set_state_change_callback(StateChangeCallback callback) {
         state_change_callback_ = callback;
     }
     
+    Stats get_stats() const;
+    
     bool is_connected() const {
         auto state = state_.load();
         return state == protocol::ConnectionState::CONNECTED ||
@@ -58,32 +78,128 @@ public:
         return state_.load() == protocol::ConnectionState::STREAMING;
     }
     
+    // Device identity
+    const uint8_t* get_device_id() const { return device_id_; }
+    const char* get_device_name() const { return device_name_; }
+    
+    // Audio codecs advertised at discovery, and the stream format the host
+    // picked at connect
+    void set_codec_capabilities(uint16_t capabilities) { codec_capabilities_ = capabilities; }
+    protocol::AudioEncoding get_audio_encoding() const { return audio_encoding_.load(); }
+    uint16_t get_frame_samples() const { return frame_samples_.load(); }
+    uint8_t get_frames_per_packet() const { return frames_per_packet_.load(); }
+    protocol::StreamFormat get_stream_format() const { return stream_format_.load(); }
+    
+    // A host that negotiated a format decodes every codec advertised to it,
+    // so the stream may switch between them; a legacy host (no CONNECT
+    // payload) only takes PCM16
+    bool host_decodes_codecs() const { return host_decodes_codecs_.load(); }
+    
+    // AES-128 key for the audio payloads, agreed at pairing. False before
+    // the first pairing.
+    bool get_session_key(uint8_t* key) const;
+    
+    // X25519 key pair (32-byte keys) for the next pairing, generated ahead
+    // of time (in a batch, say) so answering PAIR_REQUEST costs one scalar
+    // multiplication. Used once; later pairings generate their own.
+    void set_pairing_keypair(const uint8_t* public_key, const uint8_t* private_key);
+    
+    // Session resumption (see protocol.h). Each connect with a session key
+    // issues a ticket. Record where the audio stopped whenever streaming
+    // stops (the IDLE transition), so a resume carries on from there.
+    // After a resume the FSM goes IDLE -> CONNECTED at once with the
+    // ticket's parameters and key; start streaming without the usual
+    // settling delay, from get_resume_point().
+    void set_resume_point(uint32_t next_sequence, uint64_t sample_position);
+    bool is_resumed() const { return resumed_.load(); }
+    // False unless the current session was resumed
+    bool get_resume_point(uint32_t* next_sequence, uint64_t* sample_position) const;
+    uint32_t get_resume_count() const { return resumes_.load(); }
+    
 private:
-    void transition_state(protocol::ConnectionState new_state);
+    // Executor: queue an event and make sure a worker runs the queue;
+    // exactly one thread owns the queue's consumer side at a time
+    void post(FsmEventType type, const protocol::Packet* packet = nullptr);
+    void schedule_run();
+    void acquire_executor();
+    void run_events();
+    void release_executor();
+    bool on_executor() const { return executor_thread_.load() == std::this_thread::get_id(); }
+    void dispatch(const FsmEvent& event);
+    void change_state(protocol::ConnectionState new_state);
+    
+    // Actions, on the executor. False keeps the current state.
+    bool start_timers();
+    bool stop_timers();
+    bool answer_discovery();
+    bool pair(const FsmEvent& event);
+    bool accept_connect(const FsmEvent& event);
+    bool resume(const FsmEvent& event);
+    bool begin_disconnect();
+    bool schedule_reconnect();
+    
     void send_discover_response();
-    void send_pair_response(const protocol::Packet& request);
-    void send_connect_response();
-    void start_keepalive_thread();
-    void stop_keepalive_thread();
-    void keepalive_loop();
+    void send_pair_response(const FsmEvent& request);
+    void send_connect_response(const protocol::ConnectPayload& accepted);
+    void issue_ticket(const protocol::ConnectPayload& accepted, bool negotiated);
+    void send_resume_response(const protocol::ResumeResponsePayload& response);
+    void check_keepalive();
     
     Transport* transport_;
+    common::TimerWheel* scheduler_;
     std::atomic<protocol::ConnectionState> state_;
     StateChangeCallback state_change_callback_;
     
-    // Connection tracking
-    uint64_t last_keepalive_time_;
+    // Events and who runs them. Runs queued on the scheduler hold the
+    // executor state, not the FSM, so one left queued after the FSM is
+    // gone finds it retired and returns.
+    EventQueue events_;
+    std::shared_ptr<std::atomic<uint8_t>> executor_;
+    std::atomic<std::thread::id> executor_thread_;
+    std::mutex executor_mutex_;
+    std::condition_variable executor_cv_;
+    
+    // Connection tracking (reconnect state on the executor)
+    std::atomic<uint64_t> last_keepalive_time_;
     uint32_t reconnect_attempts_;
     uint32_t reconnect_delay_ms_;
     
     // Device info
     uint8_t device_id_[8];
     char device_name_[32];
+    uint16_t codec_capabilities_;
+    std::atomic<protocol::AudioEncoding> audio_encoding_;
+    std::atomic<uint16_t> frame_samples_;
+    std::atomic<uint8_t> frames_per_packet_;
+    std::atomic<protocol::StreamFormat> stream_format_;
+    std::atomic<bool> host_decodes_codecs_;
+    
+    // Session key (receive thread writes at pairing; the streamer reads it)
+    // and the prepared pairing key pair
+    mutable std::mutex key_mutex_;
+    uint8_t session_key_[protocol::SESSION_KEY_SIZE];
+    bool has_session_key_;
+    uint8_t pairing_public_key_[32];
+    uint8_t pairing_private_key_[32];
+    bool has_pairing_keypair_;
+    
+    // Resumption: tickets issued, the current session's (under key_mutex_)
+    // and where a resumed stream carries on
+    common::TicketStore tickets_;
+    uint8_t ticket_id_[protocol::TICKET_ID_SIZE];
+    bool has_ticket_;
+    uint32_t resume_sequence_;
+    uint64_t resume_position_;
+    std::atomic<bool> resumed_;
+    std::atomic<uint32_t> resumes_;
+    
+    // Timers, started and cancelled on the executor
+    common::TimerWheel::TimerId keepalive_timer_;
+    common::TimerWheel::TimerId reconnect_timer_;
+    common::TimerWheel::TimerId disconnect_timer_;
     
-    // Threading
-    std::thread keepalive_thread_;
-    std::atomic<bool> keepalive_running_;
-    std::mutex state_mutex_;
+    mutable std::mutex stats_mutex_;
+    Stats stats_;
 };
 
 } // namespace accessory
@@ -6,20 +6,24 @@
 
 namespace accessory {
 
-// Simulated cryptographic operations
-// In production, use hardware crypto or library like mbedTLS
+// Cryptographic operations over the common primitives: X25519
+// (common/key_exchange.h), AES (common/aes.h), HMAC-SHA256
+// (common/sha256.h) and the per-thread ChaCha20 generator (common/csprng.h).
 
 class Crypto {
 public:
-    // Key generation (simulated ECDH)
+    // X25519 key pair from fresh random bytes (32-byte keys)
     static void generate_keypair(uint8_t* public_key, uint8_t* private_key);
     
-    // Shared secret derivation (simulated)
-    static void derive_shared_secret(const uint8_t* private_key,
+    // `count` key pairs at once, consecutive 32-byte keys; cheaper per pair
+    static void generate_keypairs(uint8_t* public_keys, uint8_t* private_keys, size_t count);
+    
+    // X25519 shared secret. False if the peer's key is a low-order point.
+    static bool derive_shared_secret(const uint8_t* private_key,
                                      const uint8_t* peer_public_key,
                                      uint8_t* shared_secret);
     
-    // AES-128 simulation (XOR with key stream for demo)
+    // AES-128-CTR with a 16-byte initial counter block; in may equal out
     static void encrypt_aes128(const uint8_t* plaintext, size_t length,
                                const uint8_t* key, const uint8_t* iv,
                                uint8_t* ciphertext);
@@ -28,12 +32,13 @@ public:
                                const uint8_t* key, const uint8_t* iv,
                                uint8_t* plaintext);
     
-    // HMAC-SHA256 simulation (simplified)
+    // HMAC-SHA256, 32-byte tag. For many messages under one key,
+    // common::HmacSha256 keeps the key schedule instead of redoing it.
     static void compute_hmac(const uint8_t* data, size_t length,
                             const uint8_t* key, size_t key_length,
                             uint8_t* hmac);
     
-    // Random number generation
+    // Cryptographically secure random bytes; safe from any thread
     static void generate_random(uint8_t* buffer, size_t length);
 };
 
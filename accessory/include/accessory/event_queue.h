@@ -0,0 +1,77 @@
+#ifndef ACCESSORY_EVENT_QUEUE_H
+#define ACCESSORY_EVENT_QUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+namespace accessory {
+
+// What drives the connection FSM (see connection_fsm.h): host packets,
+// its own timers and the application
+enum class FsmEventType : uint8_t {
+    START,
+    STOP,
+    DISCOVER_REQUEST,
+    PAIR_REQUEST,
+    CONNECT_REQUEST,
+    RESUME_REQUEST,
+    DISCONNECT,
+    DISCONNECT_SETTLED,         // Timer, after DISCONNECT
+    STREAM,                     // enter_streaming()
+    FORCE_CONNECTED,            // enter_connected(): no handshake
+    LINK_LOST,                  // Keepalive timeout, or handle_connection_loss()
+    RECONNECT,                  // Backoff timer, after LINK_LOST
+    COUNT
+};
+
+// An event and the packet payload it came with, copied: the receive
+// buffer is reused as soon as the packet handler returns
+struct FsmEvent {
+    static constexpr size_t MAX_PAYLOAD = 64;   // The largest handshake payload
+
+    FsmEventType type;
+    uint16_t payload_length;                    // As received, before capping
+    uint64_t posted_us;
+    uint8_t payload[MAX_PAYLOAD];
+};
+
+// Bounded multi-producer, single-consumer event ring. Producers (the
+// receive thread, timers, the application) claim a slot with one CAS on the
+// tail and publish it through the slot's sequence number, so none of them
+// ever waits on another or on the consumer; a full ring refuses the event.
+// Slots are allocated once.
+class EventQueue {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 64;     // Rounded up to a power of two
+
+    explicit EventQueue(size_t capacity = DEFAULT_CAPACITY);
+
+    EventQueue(const EventQueue&) = delete;
+    EventQueue& operator=(const EventQueue&) = delete;
+
+    // Any thread. False when full.
+    bool push(const FsmEvent& event);
+    // The consumer only. False when empty (or the oldest event is still
+    // being written).
+    bool pop(FsmEvent* event);
+    // Whether pop() would return an event; ordered against push() so the
+    // consumer's last look before going idle cannot miss one
+    bool has_pending() const;
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        FsmEvent event;
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_;      // Next to consume
+    alignas(64) std::atomic<size_t> tail_;      // Next to claim
+};
+
+} // namespace accessory
+
+#endif // ACCESSORY_EVENT_QUEUE_H
@@ -0,0 +1,118 @@
+#ifndef ACCESSORY_FILE_SOURCE_H
+#define ACCESSORY_FILE_SOURCE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace accessory {
+
+// Interleaved little-endian integer PCM
+struct PcmFormat {
+    uint32_t sample_rate;
+    uint16_t channels;          // 1 or 2
+    uint16_t bits_per_sample;   // 16 or 24
+};
+
+// Read-only memory map of a WAV (PCM or WAVE_FORMAT_EXTENSIBLE) or raw PCM
+// file. Opening parses the header chunks only; audio pages are faulted in
+// as they are played, so multi-GB files open instantly.
+class AudioFile {
+public:
+    AudioFile();
+    ~AudioFile();
+
+    AudioFile(const AudioFile&) = delete;
+    AudioFile& operator=(const AudioFile&) = delete;
+
+    // Files not ending in .wav are raw PCM in raw_format
+    bool open(const std::string& path, const PcmFormat& raw_format);
+    void close();
+
+    const std::string& path() const { return path_; }
+    const PcmFormat& format() const { return format_; }
+    size_t frames() const { return frames_; }
+    size_t frame_bytes() const { return frame_bytes_; }
+    const uint8_t* frame(size_t index) const { return data_ + index * frame_bytes_; }
+
+private:
+    bool parse_wav();
+
+    std::string path_;
+    void* map_;
+    size_t map_size_;
+    const uint8_t* data_;       // First audio frame
+    size_t frames_;
+    size_t frame_bytes_;
+    PcmFormat format_;
+};
+
+// Convert interleaved PCM to mono 16-bit: stereo is averaged, 24-bit keeps
+// the top 16 bits. SSE2/SSSE3 (picked at run time) with a scalar fallback.
+void convert_to_mono16(const uint8_t* src, const PcmFormat& format, size_t frames, int16_t* out);
+
+// Audio source that plays a list of files in order, optionally looping,
+// as mono 16-bit at the stream rate. Files in other formats are converted
+// and linearly resampled on the fly; frames already in the stream format
+// are served straight from the mapping. Files that fail to open are
+// skipped. Not thread-safe; each stream owns its own instance.
+class FileSource {
+public:
+    static constexpr PcmFormat DEFAULT_RAW_FORMAT = {48000, 1, 16};
+
+    FileSource();
+    ~FileSource();
+
+    // Paths ending in .m3u or .txt are playlists: one path per line,
+    // relative to the playlist, '#' starts a comment. Returns false if no
+    // file can be opened.
+    bool open(const std::vector<std::string>& paths, uint32_t sample_rate);
+    void set_loop(bool loop) { loop_ = loop; }
+    void set_raw_format(const PcmFormat& format) { raw_format_ = format; }
+
+    // Output rate; the current file's resampler restarts at the new rate
+    void set_sample_rate(uint32_t sample_rate);
+    uint32_t sample_rate() const { return sample_rate_; }
+    void rewind();
+
+    // num_samples of audio. Returns a pointer into the file mapping when
+    // possible, otherwise into `scratch` (num_samples long). After the
+    // last file (not looping) the rest is silence.
+    const int16_t* read(int16_t* scratch, size_t num_samples);
+
+    bool finished() const { return !file_; }
+    size_t file_index() const { return index_; }
+    size_t file_count() const { return paths_.size(); }
+    const char* current_path() const;
+
+private:
+    bool open_file(size_t index);
+    void reset_resampler();
+    bool advance();
+    size_t render_file(int16_t* out, size_t num_samples);
+    size_t resample(int16_t* out, size_t num_samples);
+
+    std::vector<std::string> paths_;
+    PcmFormat raw_format_;
+    uint32_t sample_rate_;
+    bool loop_;
+
+    // Current file and read position (frames)
+    std::unique_ptr<AudioFile> file_;
+    size_t index_;
+    size_t position_;
+    bool native_;               // Mono 16-bit at the stream rate
+
+    // Linear resampler: 32.32 fixed-point input position relative to
+    // carry_, the last input sample consumed
+    uint64_t step_;
+    uint64_t phase_;
+    int16_t carry_;
+    std::vector<int16_t> window_;
+};
+
+} // namespace accessory
+
+#endif // ACCESSORY_FILE_SOURCE_H
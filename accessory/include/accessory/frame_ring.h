@@ -0,0 +1,58 @@
+#ifndef ACCESSORY_FRAME_RING_H
+#define ACCESSORY_FRAME_RING_H
+
+#include "protocol.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace accessory {
+
+// Encoded audio frames rendered ahead of the send tick. Single producer
+// (the render task) and single consumer (the frame tick); each side owns
+// one index and publishes it with release ordering, so neither ever waits
+// on the other. Slots are allocated once and reused.
+class FrameRing {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 8;     // Rounded up to a power of two
+
+    // One frame without the aggregation size prefix
+    static constexpr size_t MAX_FRAME_BYTES =
+        protocol::MAX_PAYLOAD_SIZE - sizeof(protocol::AudioPayload);
+
+    struct Frame {
+        protocol::AudioEncoding encoding;
+        uint16_t size;              // Encoded bytes, 0 if encoding failed
+        uint8_t data[MAX_FRAME_BYTES];
+    };
+
+    explicit FrameRing(size_t capacity = DEFAULT_CAPACITY);
+
+    FrameRing(const FrameRing&) = delete;
+    FrameRing& operator=(const FrameRing&) = delete;
+
+    // Empties the ring; neither side may be running
+    void clear();
+    size_t capacity() const { return slots_.size(); }
+    size_t size() const;
+
+    // Producer: the next free slot (nullptr when full); publish() hands it
+    // to the consumer
+    Frame* claim();
+    void publish();
+
+    // Consumer: the oldest frame (nullptr when empty); release() frees it
+    const Frame* peek() const;
+    void release();
+
+private:
+    std::vector<Frame> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_;      // Next to consume
+    alignas(64) std::atomic<size_t> tail_;      // Next to fill
+};
+
+} // namespace accessory
+
+#endif // ACCESSORY_FRAME_RING_H
@@ -0,0 +1,93 @@
+#ifndef ACCESSORY_OSCILLATOR_H
+#define ACCESSORY_OSCILLATOR_H
+
+#include "sample_format.h"
+#include <cstdint>
+#include <cstddef>
+
+namespace accessory {
+
+// Test signal shapes
+enum class Waveform : uint8_t {
+    SINE,
+    SQUARE,
+    TRIANGLE,
+    SAWTOOTH,
+    MULTI_TONE,     // Sum of up to MAX_TONES sines
+    NOISE,          // Uniform white noise
+    SILENCE
+};
+
+const char* waveform_to_string(Waveform waveform);
+bool waveform_from_string(const char* name, Waveform* waveform);
+
+// Per-stream test signal generator producing PCM four samples at a time
+// with SSE2 (scalar fallback elsewhere), rendered in float and converted to
+// the stream's sample type. There are no per-sample transcendental calls:
+// - Sines are recursive quadrature oscillators: two interleaved vectors of
+//   four unit phasors (samples n..n+7), each rotated by eight sample steps
+//   per pair of blocks so the two multiply chains overlap. The phasors are
+//   re-seeded from an exact 64-bit phase accumulator on every render()
+//   call, so float rounding can neither drift the pitch nor the amplitude.
+// - Square, triangle and sawtooth are computed from a 32-bit phase
+//   accumulator. They are not band-limited, which is fine for test tones.
+// - Noise is a per-lane xorshift32.
+// Output is continuous across render() calls of any length.
+//
+// Not thread-safe; each stream owns its own instance.
+class Oscillator {
+public:
+    static constexpr size_t LANES = 4;
+    static constexpr size_t MAX_TONES = 4;
+
+    Oscillator();
+
+    // Configuration. Each call restarts the signal at phase 0.
+    void set_waveform(Waveform waveform, double frequency_hz, uint32_t sample_rate);
+    void set_tones(const double* frequencies_hz, size_t count, uint32_t sample_rate);
+    void set_amplitude(float amplitude) { amplitude_ = amplitude; }
+    void set_seed(uint32_t seed);
+
+    Waveform waveform() const { return waveform_; }
+
+    // Append num_samples mono int16 samples
+    void render(int16_t* samples, size_t num_samples);
+
+    // Append `frames` frames of format F with the signal copied to each of
+    // `channels` interleaved channels. Instantiated for each SampleFormat.
+    template <protocol::SampleFormat F>
+    void render(typename common::SampleTraits<F>::Type* out, size_t frames, size_t channels);
+
+private:
+    void resync_tones();
+    void render_blocks(float* out, size_t blocks);
+
+    Waveform waveform_;
+    float amplitude_;
+
+    // Quadrature oscillators: lane k holds e^(i(phase + k*w))
+    static constexpr size_t TONE_LANES = 2 * LANES;
+    size_t tone_count_;
+    alignas(16) float re_[MAX_TONES][TONE_LANES];
+    alignas(16) float im_[MAX_TONES][TONE_LANES];
+    double lane_re_[MAX_TONES][TONE_LANES];  // e^(i*k*w)
+    double lane_im_[MAX_TONES][TONE_LANES];
+    float step_re_[MAX_TONES];               // e^(i*TONE_LANES*w)
+    float step_im_[MAX_TONES];
+    uint64_t tone_phase_[MAX_TONES];    // Next block, full circle = 2^64
+    uint64_t tone_increment_[MAX_TONES];
+
+    // Phase accumulator (full circle = 2^32)
+    alignas(16) uint32_t phase_[LANES];
+    uint32_t phase_step_;       // LANES samples
+
+    alignas(16) uint32_t noise_[LANES];
+
+    // Samples rendered but not yet returned (render() lengths not a multiple of LANES)
+    alignas(16) float pending_[LANES];
+    size_t pending_offset_;
+};
+
+} // namespace accessory
+
+#endif // ACCESSORY_OSCILLATOR_H
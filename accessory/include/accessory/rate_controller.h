@@ -0,0 +1,73 @@
+#ifndef ACCESSORY_RATE_CONTROLLER_H
+#define ACCESSORY_RATE_CONTROLLER_H
+
+#include "protocol.h"
+#include <cstdint>
+
+namespace accessory {
+
+// Link and power inputs, sampled once per control interval
+struct LinkFeedback {
+    double loss_rate;           // Recent first-transmission loss, 0-1
+    uint32_t srtt_us;           // Smoothed RTT, 0 until measured
+    uint32_t min_rtt_us;        // Lowest RTT this stream (no queueing)
+    uint64_t since_ack_us;      // Since the last AUDIO_ACK; UINT64_MAX if none yet
+    uint8_t battery_level;      // 0-100%
+    bool charging;
+};
+
+struct QualitySettings {
+    protocol::AudioEncoding encoding;
+    uint8_t frames_per_packet;
+    uint8_t max_parity;         // FEC parity packets sent per group, at most
+};
+
+// Congestion and quality controller for one stream. Walks a ladder of
+// settings from the negotiated ones (top) down to the fallback codec with
+// heavier aggregation and less parity:
+//   3: negotiated codec, negotiated frames per packet
+//   2: negotiated codec, 2x frames per packet (fewer, larger packets)
+//   1: fallback codec, 2x frames per packet
+//   0: fallback codec, 4x frames per packet, one parity packet per group
+// Queueing delay (SRTT - min RTT), heavy loss or silence from a host that
+// has been acknowledging steps down one level at a time; a clean link
+// steps back up slowly. Low battery caps the level and, when critical,
+// stops parity.
+class RateController {
+public:
+    static constexpr uint8_t TOP_LEVEL = 3;
+
+    RateController();
+
+    // New stream: the negotiated settings are the top of the ladder. The
+    // fallback codec is only used if the host decodes it in this format.
+    void reset(protocol::AudioEncoding encoding, uint16_t frame_samples,
+               uint8_t frames_per_packet, protocol::AudioEncoding fallback,
+               const protocol::StreamFormat& format = protocol::DEFAULT_STREAM_FORMAT);
+
+    // Returns true when the settings changed
+    bool update(const LinkFeedback& feedback, uint64_t now_us);
+
+    const QualitySettings& settings() const { return settings_; }
+    uint8_t level() const { return level_; }
+    uint8_t level_cap() const { return level_cap_; }
+
+private:
+    QualitySettings settings_for(uint8_t level) const;
+
+    protocol::AudioEncoding encoding_;
+    protocol::AudioEncoding fallback_;
+    uint16_t frame_samples_;
+    protocol::StreamFormat format_;
+    uint8_t frames_per_packet_;
+    uint8_t level_;
+    uint8_t level_cap_;                 // From battery
+    bool parity_allowed_;
+    uint64_t last_change_us_;
+    uint64_t last_down_us_;
+    QualitySettings settings_;
+};
+
+} // namespace accessory
+
+#endif // ACCESSORY_RATE_CONTROLLER_H
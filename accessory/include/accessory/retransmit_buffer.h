@@ -0,0 +1,46 @@
+#ifndef ACCESSORY_RETRANSMIT_BUFFER_H
+#define ACCESSORY_RETRANSMIT_BUFFER_H
+
+#include "protocol.h"
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace accessory {
+
+// History of the last `capacity` audio packets, keyed by sequence number
+// (slot = sequence % capacity), so a NACKed packet is resent exactly as it
+// was built instead of being re-rendered and re-encoded. Slots keep only
+// header + payload and reuse their storage, so steady-state stores do not
+// allocate.
+class RetransmitBuffer {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 64;
+
+    explicit RetransmitBuffer(size_t capacity = DEFAULT_CAPACITY);
+
+    // Drops the history
+    void reset(size_t capacity);
+    void clear();
+    size_t capacity() const { return slots_.size(); }
+
+    void store(const protocol::Packet& packet);
+
+    // False if the sequence was never stored or has been overwritten
+    bool fetch(uint32_t sequence, protocol::Packet* packet) const;
+
+private:
+    struct Slot {
+        bool valid;
+        uint32_t sequence;
+        std::vector<uint8_t> bytes;     // Header followed by payload
+    };
+
+    std::vector<Slot> slots_;
+    mutable std::mutex mutex_;
+};
+
+} // namespace accessory
+
+#endif // ACCESSORY_RETRANSMIT_BUFFER_H
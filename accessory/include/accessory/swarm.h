@@ -0,0 +1,216 @@
+#ifndef ACCESSORY_SWARM_H
+#define ACCESSORY_SWARM_H
+
+#include "protocol.h"
+#include "timer_wheel.h"
+#include "accessory/transport.h"
+#include "accessory/connection_fsm.h"
+#include "accessory/audio_streamer.h"
+#include "accessory/telemetry.h"
+#include <memory>
+#include <vector>
+#include <random>
+
+namespace accessory {
+
+class SwarmSocket;
+
+// Traffic each simulated accessory generates once connected
+enum class TrafficProfile : uint8_t {
+    AUDIO,      // Audio stream + telemetry on every device
+    IDLE,       // Telemetry and keepalives only
+    MIXED,      // Every other device streams audio
+    BURSTY      // Audio toggled on/off every burst period
+};
+
+const char* traffic_profile_to_string(TrafficProfile profile);
+bool traffic_profile_from_string(const char* name, TrafficProfile* profile);
+
+struct SwarmConfig {
+    size_t num_devices = 100;
+    size_t num_sockets = 4;
+    uint16_t base_port = 8888;          // Sockets bind base_port + i
+    uint32_t ramp_up_ms = 5000;         // Device starts spread over this window
+    double churn_per_sec = 0.0;         // Random disconnects per second
+    uint32_t churn_downtime_ms = 2000;  // Time a churned device stays down
+    uint32_t burst_period_ms = 2000;    // BURSTY on/off half-period
+    TrafficProfile profile = TrafficProfile::AUDIO;
+    Waveform waveform = Waveform::SINE;  // Device i plays 220Hz + i semitones (mod 2 octaves)
+    bool autonomous = false;            // Skip the host handshake
+    protocol::AudioEncoding encoding = protocol::AudioEncoding::PCM16;  // Autonomous only; else negotiated
+    std::string target_host;            // Explicit peer (else learned)
+    uint16_t target_port = 0;
+    size_t datagram_size = protocol::DEFAULT_DATAGRAM_SIZE;   // Larger packets are fragmented
+};
+
+// Per-device view of a shared swarm socket. Components see an ordinary
+// Transport; sends are queued on the shared socket instead of a private one.
+class SwarmChannel : public Transport {
+public:
+    explicit SwarmChannel(SwarmSocket* socket);
+
+    bool send_packet(const protocol::Packet& packet) override;
+    uint64_t get_packets_sent() const override { return sent_.load(); }
+    uint64_t get_packets_received() const override { return received_.load(); }
+
+    void count_received() { received_++; }
+
+private:
+    SwarmSocket* socket_;
+    std::atomic<uint64_t> sent_;
+    std::atomic<uint64_t> received_;
+};
+
+// One simulated accessory: its own FSM, audio stream and telemetry
+class SwarmDevice {
+public:
+    SwarmDevice(size_t index, SwarmSocket* socket, common::TimerWheel* scheduler,
+                const SwarmConfig& config);
+    ~SwarmDevice();
+
+    void start();
+    void stop();
+    bool is_active() const { return active_.load(); }
+
+    // Inbound packet routed here by the owning socket
+    void on_packet(const protocol::Packet& packet);
+
+    protocol::ConnectionState get_state() const { return fsm_.get_state(); }
+    bool matches(const uint8_t* device_id) const;
+    void set_pairing_keypair(const uint8_t* public_key, const uint8_t* private_key) {
+        fsm_.set_pairing_keypair(public_key, private_key);
+    }
+    AudioStreamer::Stats get_audio_stats() const { return streamer_.get_stats(); }
+    uint64_t get_packets_sent() const { return channel_.get_packets_sent(); }
+
+private:
+    void on_state_change(protocol::ConnectionState old_state,
+                         protocol::ConnectionState new_state);
+    bool wants_audio() const;
+    void begin_streaming();
+    void toggle_burst();
+
+    const size_t index_;
+    const SwarmConfig& config_;
+    common::TimerWheel* scheduler_;
+    SwarmChannel channel_;
+    ConnectionFSM fsm_;
+    AudioStreamer streamer_;
+    Telemetry telemetry_;
+
+    std::atomic<bool> active_;
+    std::mutex lifecycle_mutex_;
+    common::TimerWheel::TimerId burst_timer_;
+};
+
+// Shared UDP socket carrying many devices. Inbound packets are demultiplexed:
+// discovery goes to every device, PAIR_REQUEST by device id, CONNECT_REQUEST
+// to devices mid-pairing, everything else to connected devices.
+class SwarmSocket {
+public:
+    using PeerCallback = std::function<void(const sockaddr_in&)>;
+
+    SwarmSocket();
+    ~SwarmSocket();
+
+    bool start(uint16_t port);
+    void stop();
+
+    void add_device(SwarmDevice* device);
+    void set_peer(const sockaddr_in& peer);
+    bool has_peer() const { return peer_known_.load(); }
+    void set_peer_callback(PeerCallback callback) { peer_callback_ = callback; }
+
+    // Split into datagrams on the caller's thread
+    bool enqueue(const protocol::Packet& packet);
+    void set_datagram_size(size_t bytes) { fragmenter_.set_datagram_size(bytes); }
+
+    // Statistics
+    uint64_t get_datagrams_sent() const { return datagrams_sent_.load(); }
+    uint64_t get_bytes_sent() const { return bytes_sent_.load(); }
+    uint64_t get_datagrams_received() const { return datagrams_received_.load(); }
+    uint64_t get_send_drops() const { return send_drops_.load(); }
+
+private:
+    void receive_loop();
+    void send_loop();
+    void route_packet(const protocol::Packet& packet);
+
+#ifdef _WIN32
+    SOCKET socket_fd_;
+#else
+    int socket_fd_;
+#endif
+    sockaddr_in peer_addr_;
+    std::atomic<bool> peer_known_;
+    std::mutex peer_mutex_;
+    PeerCallback peer_callback_;
+
+    std::vector<SwarmDevice*> devices_;
+
+    std::thread receive_thread_;
+    std::thread send_thread_;
+    std::atomic<bool> running_;
+
+    common::Fragmenter fragmenter_;
+    common::Reassembler reassembler_;
+    std::queue<common::Datagram> send_queue_;
+    std::mutex send_mutex_;
+    std::condition_variable send_cv_;
+
+    std::atomic<uint64_t> datagrams_sent_;
+    std::atomic<uint64_t> bytes_sent_;
+    std::atomic<uint64_t> datagrams_received_;
+    std::atomic<uint64_t> send_drops_;
+};
+
+// N accessories over a few sockets with ramp-up, churn and traffic profiles
+class Swarm {
+public:
+    Swarm(const SwarmConfig& config, common::TimerWheel* scheduler);
+    ~Swarm();
+
+    bool start();
+    void stop();
+
+    // Aggregate statistics across all devices and sockets
+    struct Report {
+        size_t devices_active;
+        size_t devices_connected;
+        size_t devices_streaming;
+        uint64_t audio_packets_sent;
+        uint64_t packets_sent;          // All packet types, at the channels
+        uint64_t datagrams_sent;        // Actually handed to sendto()
+        uint64_t bytes_sent;
+        uint64_t datagrams_received;
+        uint64_t send_drops;            // No peer address or sendto() failure
+        uint64_t ticks_skipped;
+        uint32_t avg_timing_error_us;   // Mean of per-device averages
+        uint32_t max_timing_error_us;
+        uint32_t avg_tick_work_ns;      // Mean of per-device averages
+        uint32_t max_tick_work_ns;
+        uint64_t render_underruns;
+        uint64_t churn_events;
+    };
+
+    Report collect() const;
+
+private:
+    void churn_tick();
+
+    SwarmConfig config_;
+    common::TimerWheel* scheduler_;
+    std::vector<std::unique_ptr<SwarmSocket>> sockets_;
+    std::vector<std::unique_ptr<SwarmDevice>> devices_;
+
+    std::vector<common::TimerWheel::TimerId> ramp_timers_;
+    std::vector<common::TimerWheel::TimerId> restart_timers_;
+    common::TimerWheel::TimerId churn_timer_;
+    double churn_credit_;
+    std::mt19937 churn_rng_;
+    std::atomic<uint64_t> churn_events_;
+};
+
+} // namespace accessory
+
+#endif // ACCESSORY_SWARM_H
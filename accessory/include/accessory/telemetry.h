@@ -2,17 +2,18 @@
 #define ACCESSORY_TELEMETRY_H
 
 #include "protocol.h"
+#include "timer_wheel.h"
 #include <atomic>
-#include <thread>
 #include <mutex>
 
 namespace accessory {
 
 class Transport;
+class AudioStreamer;
 
 class Telemetry {
 public:
-    explicit Telemetry(Transport* transport);
+    Telemetry(Transport* transport, common::TimerWheel* scheduler);
     ~Telemetry();
     
     // Telemetry control
@@ -22,19 +23,28 @@ public:
     // Battery simulation
     void set_battery_level(uint8_t level);
     uint8_t get_battery_level() const { return battery_level_.load(); }
+    bool is_charging() const { return charging_.load(); }
     
     // Diagnostics
     void update_diagnostics(const protocol::DiagnosticsPayload& diag);
     
+    // Link loss, retransmissions and RTT for diagnostics are taken from the
+    // streamer's ACK statistics (nullptr disables)
+    void set_audio_streamer(const AudioStreamer* streamer) { audio_streamer_ = streamer; }
+    
 private:
-    void telemetry_loop();
     void send_battery_status();
     void send_diagnostics();
     void simulate_battery_drain();
     
     Transport* transport_;
+    common::TimerWheel* scheduler_;
     std::atomic<bool> running_;
-    std::thread telemetry_thread_;
+    
+    // Report timers (1 Hz battery, 0.2 Hz diagnostics, 0.1 Hz drain)
+    common::TimerWheel::TimerId battery_timer_;
+    common::TimerWheel::TimerId diagnostics_timer_;
+    common::TimerWheel::TimerId drain_timer_;
     
     // Battery state
     std::atomic<uint8_t> battery_level_;
@@ -42,10 +52,12 @@ private:
     uint16_t voltage_mv_;
     int16_t current_ma_;
     uint16_t temperature_c_;
+    std::mutex battery_mutex_;
     
     // Diagnostics
     std::mutex diag_mutex_;
     protocol::DiagnosticsPayload diagnostics_;
+    const AudioStreamer* audio_streamer_;
 };
 
 } // namespace accessory
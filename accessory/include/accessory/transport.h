@@ -2,6 +2,8 @@
 #define ACCESSORY_TRANSPORT_H
 
 #include "protocol.h"
+#include "latency_trace.h"
+#include "fragment.h"
 #include <functional>
 #include <thread>
 #include <atomic>
@@ -23,12 +25,15 @@
 
 namespace accessory {
 
+// UDP transport owning one socket. Components only use send_packet() and
+// the counters, which are virtual so a subclass can carry a device over a
+// different link (see SwarmChannel, which multiplexes many devices).
 class Transport {
 public:
     using PacketCallback = std::function<void(const protocol::Packet&)>;
     
     Transport();
-    ~Transport();
+    virtual ~Transport();
     
     // Connection management
     bool start(uint16_t port = 8888);
@@ -36,16 +41,26 @@ public:
     bool is_running() const { return running_.load(); }
     
     // Packet transmission
-    bool send_packet(const protocol::Packet& packet);
+    virtual bool send_packet(const protocol::Packet& packet);
     
     // Packet reception callback
     void set_packet_callback(PacketCallback callback) {
         packet_callback_ = callback;
     }
     
+    // Optional per-frame audio path tracing (nullptr disables)
+    void set_latency_trace(common::LatencyTrace* trace) { latency_trace_ = trace; }
+    
+    // Largest datagram sent (path MTU less IPv4 and UDP headers); larger
+    // packets go out as fragments and are reassembled by the peer
+    void set_datagram_size(size_t bytes) { fragmenter_.set_datagram_size(bytes); }
+    size_t get_datagram_size() const { return fragmenter_.datagram_size(); }
+    
     // Statistics
-    uint64_t get_packets_sent() const { return packets_sent_.load(); }
-    uint64_t get_packets_received() const { return packets_received_.load(); }
+    virtual uint64_t get_packets_sent() const { return packets_sent_.load(); }
+    virtual uint64_t get_packets_received() const { return packets_received_.load(); }
+    uint64_t get_datagrams_sent() const { return datagrams_sent_.load(); }
+    common::Reassembler::Stats get_reassembly_stats() const { return reassembler_.get_stats(); }
     
 private:
     void receive_loop();
@@ -68,17 +83,22 @@ private:
     std::thread send_thread_;
     std::atomic<bool> running_;
     
-    // Send queue
-    std::queue<protocol::Packet> send_queue_;
+    // Send queue, already split into datagrams
+    common::Fragmenter fragmenter_;
+    std::queue<common::Datagram> send_queue_;
     std::mutex send_mutex_;
     std::condition_variable send_cv_;
     
-    // Packet callback
+    // Packet callback, fed by the (single) receive thread's reassembler
     PacketCallback packet_callback_;
+    common::Reassembler reassembler_;
+    
+    common::LatencyTrace* latency_trace_;
     
     // Statistics
     std::atomic<uint64_t> packets_sent_;
     std::atomic<uint64_t> packets_received_;
+    std::atomic<uint64_t> datagrams_sent_;
 };
 
 } // namespace accessory
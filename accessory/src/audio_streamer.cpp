@@ -1,20 +1,117 @@
 #include "accessory/audio_streamer.h"
 #include "accessory/transport.h"
+#include "accessory/telemetry.h"
+#include "accessory/file_source.h"
+#include "fec.h"
 #include <iostream>
 #include <cstring>
-#include <cmath>
-#include <thread>
+#include <algorithm>
 #include <chrono>
 
 namespace accessory {
 
-AudioStreamer::AudioStreamer(Transport* transport)
+namespace {
+
+// Frames a single late tick may catch up on
+constexpr uint64_t MAX_CATCH_UP_FRAMES = 8;
+
+// The render task runs once per this many frame periods and tops the frame
+// ring up, so the tick always finds at least this many frames ready
+constexpr uint64_t RENDER_BATCH_FRAMES = 4;
+
+// Rate controller evaluation period
+constexpr uint64_t CONTROL_INTERVAL_US = 250000;
+
+// Pacing: the bucket refills at this multiple of the media rate (audio plus
+// parity), holds at most two full datagrams, and queues this many packets.
+// A fragmented packet larger than the bucket leaves once it is full and
+// runs it into debt.
+constexpr double PACING_GAIN = 2.0;
+constexpr double PACING_BURST_BYTES = 2.0 * protocol::DEFAULT_DATAGRAM_SIZE;
+constexpr size_t PACING_QUEUE_PACKETS = 32;
+
+// Send times kept for RTT sampling; more than an ACK batch plus the
+// selective window
+constexpr size_t ACK_HISTORY_PACKETS = 128;
+
+// A protected block: header timestamp, payload length, payload
+constexpr size_t FEC_MAX_BLOCK_SIZE = protocol::FEC_BLOCK_HEADER_SIZE + protocol::MAX_PAYLOAD_SIZE;
+
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+uint32_t pack_fec_config(protocol::FecScheme scheme, uint8_t data_count, uint8_t parity_count) {
+    return static_cast<uint32_t>(scheme) | (static_cast<uint32_t>(data_count) << 8) |
+           (static_cast<uint32_t>(parity_count) << 16);
+}
+
+} // namespace
+
+AudioStreamer::AudioStreamer(Transport* transport, common::TimerWheel* scheduler)
     : transport_(transport)
+    , scheduler_(scheduler)
     , streaming_(false)
+    , audio_timer_(common::TimerWheel::INVALID_TIMER)
     , sequence_number_(0)
-    , stream_start_time_(0) {
+    , first_sequence_(0)
+    , sample_position_(0)
+    , resume_pending_(false)
+    , resume_sequence_(0)
+    , resume_position_(0)
+    , stream_start_time_(0)
+    , next_deadline_us_(0)
+    , owed_frames_(0)
+    , frame_samples_(protocol::AUDIO_SAMPLES_PER_PACKET)
+    , format_(protocol::DEFAULT_STREAM_FORMAT)
+    , channel_samples_(protocol::AUDIO_SAMPLES_PER_PACKET)
+    , frames_per_packet_(1)
+    , max_frames_per_packet_(1)
+    , pending_size_(0)
+    , pending_target_frames_(0)
+    , sent_history_(ACK_HISTORY_PACKETS)
+    , ack_valid_(false)
+    , ack_highest_(0)
+    , ack_last_sent_(0)
+    , ack_last_received_(0)
+    , fec_config_(0)
+    , fec_scheme_(protocol::FecScheme::NONE)
+    , fec_data_count_(0)
+    , fec_parity_count_(0)
+    , fec_filled_(0)
+    , fec_send_parity_(0)
+    , fec_base_sequence_(0)
+    , fec_sequence_(0)
+    , fec_block_size_(0)
+    , prerender_enabled_(true)
+    , render_encoding_(static_cast<uint8_t>(protocol::AudioEncoding::PCM16))
+    , render_timer_(common::TimerWheel::INVALID_TIMER)
+    , waveform_(Waveform::SINE)
+    , frequency_hz_(0.0)
+    , file_source_(nullptr)
+    , active_codec_(nullptr)
+    , rate_control_enabled_(true)
+    , fallback_encoding_(protocol::AudioEncoding::IMA_ADPCM)
+    , next_control_us_(0)
+    , max_parity_(protocol::FEC_MAX_PARITY_PACKETS)
+    , last_ack_us_(0)
+    , telemetry_(nullptr)
+    , pacing_enabled_(true)
+    , pacing_queue_(PACING_QUEUE_PACKETS)
+    , pacing_enqueued_us_(PACING_QUEUE_PACKETS)
+    , pacing_head_(0)
+    , pacing_count_(0)
+    , pacing_tokens_(PACING_BURST_BYTES)
+    , pacing_rate_(0.0)
+    , pacing_refill_us_(0)
+    , pacing_timer_(common::TimerWheel::INVALID_TIMER)
+    , latency_trace_(nullptr) {
     
     memset(&stats_, 0, sizeof(stats_));
+    memset(&pending_audio_, 0, sizeof(pending_audio_));
+    set_test_signal(Waveform::SINE, 440.0);  // "A" note
+    set_encoding(protocol::AudioEncoding::PCM16);
 }
 
 AudioStreamer::~AudioStreamer() {
@@ -26,12 +123,108 @@ void AudioStreamer::start_streaming() {
         return;
     }
     
-    std::cout << "[Accessory] Starting audio streaming" << std::endl;
+    // 44.1kHz has no whole frame at 2.5 or 5ms
+    if (protocol::stream_frame_samples(format_, frame_samples_) == 0) {
+        std::cout << "[Accessory] No whole " << format_.sample_rate << "Hz frame in "
+                  << frame_samples_ << " samples" << std::endl;
+        set_stream_format(protocol::DEFAULT_STREAM_FORMAT);
+    }
+    
+    // Rate control starts from the negotiated format
+    active_codec_ = codec_.get();
+    fallback_codec_.reset();
+    protocol::AudioEncoding fallback = codec_->encoding();
+    if (rate_control_enabled_.load() && fallback_encoding_ != codec_->encoding()) {
+        fallback_codec_ = common::create_audio_codec(fallback_encoding_, format_);
+        if (fallback_codec_) {
+            fallback = fallback_encoding_;
+        }
+    }
+    rate_controller_.reset(codec_->encoding(), frame_samples_, frames_per_packet_.load(), fallback,
+                           format_);
+    max_parity_ = protocol::FEC_MAX_PARITY_PACKETS;
+    last_ack_us_.store(0);
+    
+    // Sources run at the stream's rate; one frame of samples for them
+    channel_samples_ = protocol::stream_frame_samples(format_, frame_samples_);
+    render_buffer_.assign(channel_samples_ * format_.channels, 0);
+    file_buffer_.assign(channel_samples_, 0);
+    oscillator_.set_waveform(waveform_, frequency_hz_, format_.sample_rate);
+    if (file_source_) {
+        file_source_->set_sample_rate(format_.sample_rate);
+    }
+    protocol::pack_stream_format(format_, &pending_audio_.channels, &pending_audio_.format);
+    
+    max_frames_per_packet_ = common::max_frames_per_packet(codec_->encoding(), frame_samples_, format_);
+    std::cout << "[Accessory] Starting audio streaming ("
+              << protocol::audio_encoding_to_string(codec_->encoding()) << ", "
+              << static_cast<int>(format_.channels) << "ch "
+              << format_.sample_rate << "Hz "
+              << protocol::sample_format_to_string(format_.sample_format) << ", "
+              << protocol::samples_to_us(frame_samples_) / 1000.0 << "ms frames x "
+              << static_cast<int>(std::min(frames_per_packet_.load(), max_frames_per_packet_))
+              << " per packet)" << std::endl;
     streaming_.store(true);
-    sequence_number_ = 0;
-    stream_start_time_ = protocol::get_timestamp_us();
+    sequence_number_ = resume_pending_ ? resume_sequence_ : 0;
+    first_sequence_ = sequence_number_;
+    sample_position_ = resume_pending_ ? resume_position_ : 0;
+    pending_target_frames_ = 0;
+    retransmit_buffer_.clear();
+    fec_filled_ = 0;
+    {
+        std::lock_guard<std::mutex> lock(ack_mutex_);
+        for (SentRecord& record : sent_history_) {
+            record.send_us = 0;
+        }
+        ack_valid_ = false;
+        ack_last_sent_ = 0;
+        ack_last_received_ = 0;
+    }
+    codec_->reset();
+    render_encoding_.store(static_cast<uint8_t>(codec_->encoding()));
+    frame_ring_.clear();
+    owed_frames_ = 0;
+    const uint64_t start_us = protocol::get_timestamp_us();
+    next_deadline_us_ = start_us;
+    next_control_us_ = start_us + CONTROL_INTERVAL_US;
+    // A resumed stream's timestamps carry on from its sample position
+    stream_start_time_ = start_us - (resume_pending_ ? protocol::samples_to_us(sample_position_) : 0);
+    resume_pending_ = false;
+    {
+        std::lock_guard<std::mutex> lock(pacing_mutex_);
+        pacing_head_ = 0;
+        pacing_count_ = 0;
+        pacing_tokens_ = PACING_BURST_BYTES;
+        pacing_rate_ = 0.0;
+        pacing_refill_us_ = start_us;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.quality_level = RateController::TOP_LEVEL;
+    }
+    
+    // Render a full ring up front, then top it up every few frames,
+    // offset from the frame ticks
+    const uint64_t interval_us = protocol::samples_to_us(frame_samples_);
+    if (prerender_enabled_.load()) {
+        render_frames(frame_ring_.capacity());
+        render_timer_ = scheduler_->schedule_periodic(
+            RENDER_BATCH_FRAMES * interval_us,
+            [this] { render_frames(frame_ring_.capacity()); },
+            RENDER_BATCH_FRAMES * interval_us / 2);
+    }
     
-    streaming_thread_ = std::thread(&AudioStreamer::streaming_loop, this);
+    // One tick per frame on the shared scheduler, first frame immediately
+    audio_timer_ = scheduler_->schedule_periodic(
+        interval_us,
+        [this] { send_audio_frame(); },
+        0);
+}
+
+void AudioStreamer::set_resume_point(uint32_t sequence, uint64_t sample_position) {
+    resume_sequence_ = sequence;
+    resume_position_ = sample_position;
+    resume_pending_ = true;
 }
 
 void AudioStreamer::stop_streaming() {
@@ -42,92 +235,720 @@ void AudioStreamer::stop_streaming() {
     std::cout << "[Accessory] Stopping audio streaming" << std::endl;
     streaming_.store(false);
     
-    if (streaming_thread_.joinable()) {
-        streaming_thread_.join();
+    scheduler_->cancel(audio_timer_);
+    audio_timer_ = common::TimerWheel::INVALID_TIMER;
+    scheduler_->cancel(render_timer_);
+    render_timer_ = common::TimerWheel::INVALID_TIMER;
+    
+    // Queued packets are dropped; cancel outside pacing_mutex_, which the
+    // drain callback takes
+    common::TimerWheel::TimerId pacing_timer;
+    {
+        std::lock_guard<std::mutex> lock(pacing_mutex_);
+        pacing_count_ = 0;
+        pacing_timer = pacing_timer_;
+        pacing_timer_ = common::TimerWheel::INVALID_TIMER;
+    }
+    scheduler_->cancel(pacing_timer);
+}
+
+void AudioStreamer::send_audio_frame() {
+    auto work_start = std::chrono::steady_clock::now();
+    
+    // Timing error against the ideal schedule (only this tick touches it)
+    const uint64_t interval_us = protocol::samples_to_us(frame_samples_);
+    uint64_t now = protocol::get_timestamp_us();
+    uint64_t timing_error_us = now > next_deadline_us_ ? now - next_deadline_us_ : 0;
+    uint64_t skipped = 0;
+    next_deadline_us_ += interval_us;
+    if (next_deadline_us_ <= now) {
+        skipped = (now - next_deadline_us_) / interval_us + 1;
+        next_deadline_us_ += skipped * interval_us;
+    }
+    
+    if (rate_control_enabled_.load() && now >= next_control_us_) {
+        run_rate_control(now);
+        next_control_us_ = now + CONTROL_INTERVAL_US;
+    }
+    
+    // A late tick also sends the frames of the ticks it skipped, so the
+    // stream's sample clock keeps pace with real time. Frames the render
+    // task has not produced yet are owed to the next tick.
+    uint64_t frames = std::min<uint64_t>(1 + skipped + owed_frames_, 1 + MAX_CATCH_UP_FRAMES);
+    if (!prerender_enabled_.load()) {
+        render_frames(frames);
+    }
+    uint64_t capture_time = protocol::get_timestamp_us();
+    uint64_t taken = 0;
+    uint64_t audio_bytes = 0;
+    while (taken < frames &&
+           take_frame(capture_time - (frames - taken - 1) * interval_us, &audio_bytes)) {
+        taken++;
+    }
+    owed_frames_ = frames - taken;
+    uint64_t work_ns = elapsed_ns(work_start);
+    
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.ticks_skipped += skipped;
+    stats_.audio_bytes_sent += audio_bytes;
+    if (owed_frames_ > 0) {
+        stats_.render_underruns++;
+    }
+    stats_.avg_timing_error_us = static_cast<uint32_t>(
+        (stats_.avg_timing_error_us * 15ull + timing_error_us) / 16);  // EWMA
+    if (timing_error_us > stats_.max_timing_error_us) {
+        stats_.max_timing_error_us = static_cast<uint32_t>(timing_error_us);
+    }
+    uint32_t work = static_cast<uint32_t>(std::min<uint64_t>(work_ns, UINT32_MAX));
+    stats_.avg_tick_work_ns = stats_.avg_tick_work_ns == 0
+        ? work : static_cast<uint32_t>((stats_.avg_tick_work_ns * 15ull + work) / 16);  // EWMA
+    stats_.max_tick_work_ns = std::max(stats_.max_tick_work_ns, work);
+}
+
+bool AudioStreamer::take_frame(uint64_t capture_time, uint64_t* audio_bytes) {
+    const FrameRing::Frame* frame = frame_ring_.peek();
+    if (!frame) {
+        return false;
+    }
+    
+    // A packet carries one codec; the first frame after a codec change
+    // starts a new one
+    if (pending_target_frames_ > 0 &&
+        static_cast<uint8_t>(frame->encoding) != pending_audio_.encoding) {
+        send_pending_packet();
+    }
+    
+    // Header timestamp is the capture time of the packet's first frame on
+    // the accessory clock
+    if (pending_target_frames_ == 0) {
+        if (latency_trace_) {
+            latency_trace_->stamp(common::LatencyTrace::Stage::GENERATE, sequence_number_);
+        }
+        uint8_t target_frames = rate_control_enabled_.load()
+            ? rate_controller_.settings().frames_per_packet : frames_per_packet_.load();
+        max_frames_per_packet_ = common::max_frames_per_packet(frame->encoding, frame_samples_, format_);
+        pending_target_frames_ = std::min(target_frames, max_frames_per_packet_);
+        pending_packet_.set_timestamp(capture_time);
+        pending_audio_.stream_timestamp = capture_time - stream_start_time_;
+        pending_audio_.sample_position = sample_position_;
+        pending_audio_.sample_count = frame_samples_;
+        pending_audio_.encoding = static_cast<uint8_t>(frame->encoding);
+        pending_audio_.frame_count = 0;
+        pending_size_ = sizeof(protocol::AudioPayload);
+    }
+    sample_position_ += frame_samples_;
+    
+    // Aggregated frames carry a size prefix
+    size_t prefix = pending_target_frames_ > 1 ? sizeof(uint16_t) : 0;
+    size_t encoded_size = frame->size;
+    bool fits = pending_size_ + prefix + encoded_size <=
+                protocol::MAX_PAYLOAD_SIZE - protocol::AUTH_TAG_SIZE;
+    if (encoded_size > 0 && fits) {
+        uint8_t* out = pending_packet_.payload + pending_size_;
+        if (prefix > 0) {
+            uint16_t frame_size = static_cast<uint16_t>(encoded_size);
+            memcpy(out, &frame_size, sizeof(frame_size));
+        }
+        memcpy(out + prefix, frame->data, encoded_size);
+        frame_ring_.release();
+        pending_size_ += prefix + encoded_size;
+        pending_audio_.frame_count++;
+        *audio_bytes += encoded_size;
+        if (pending_audio_.frame_count == pending_target_frames_) {
+            send_pending_packet();
+        }
+    } else {
+        frame_ring_.release();
+        pending_target_frames_ = 0;     // Drop the partial packet
+        if (encoded_size > 0) {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            stats_.encode_failures++;
+        }
     }
+    return true;
 }
 
-void AudioStreamer::streaming_loop() {
-    auto next_packet_time = std::chrono::steady_clock::now();
-    const auto packet_interval = std::chrono::milliseconds(protocol::AUDIO_PACKET_DURATION_MS);
+void AudioStreamer::render_frames(size_t max_frames) {
+    if (!streaming_.load()) {
+        return;
+    }
     
-    while (streaming_.load()) {
-        auto now = std::chrono::steady_clock::now();
+    uint64_t rendered = 0;
+    uint64_t failures = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+    while (rendered < max_frames) {
+        FrameRing::Frame* frame = frame_ring_.claim();
+        if (!frame) {
+            break;
+        }
+        auto work_start = std::chrono::steady_clock::now();
+        select_codec();
         
-        if (now >= next_packet_time) {
-            send_audio_packet();
-            next_packet_time += packet_interval;
+        const void* pcm = render_pcm();
+        frame->encoding = active_codec_->encoding();
+        frame->size = static_cast<uint16_t>(
+            active_codec_->encode(pcm, channel_samples_ * format_.channels,
+                                  frame->data, FrameRing::MAX_FRAME_BYTES));
+        if (frame->size == 0) {
+            failures++;
+        }
+        frame_ring_.publish();
+        
+        uint64_t work_ns = elapsed_ns(work_start);
+        total_ns += work_ns;
+        max_ns = std::max(max_ns, work_ns);
+        rendered++;
+    }
+    if (rendered == 0) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.encode_failures += failures;
+    uint32_t work = static_cast<uint32_t>(std::min<uint64_t>(total_ns / rendered, UINT32_MAX));
+    stats_.avg_render_work_ns = stats_.avg_render_work_ns == 0
+        ? work : static_cast<uint32_t>((stats_.avg_render_work_ns * 15ull + work) / 16);  // EWMA
+    stats_.max_render_work_ns = std::max(stats_.max_render_work_ns,
+                                         static_cast<uint32_t>(std::min<uint64_t>(max_ns, UINT32_MAX)));
+}
+
+const void* AudioStreamer::render_pcm() {
+    // Simulated audio, or the file source
+    if (!file_source_) {
+        generate_audio_packet(reinterpret_cast<uint8_t*>(render_buffer_.data()),
+                              channel_samples_ * format_.channels * common::sample_size(format_.sample_format));
+        return render_buffer_.data();
+    }
+    
+    // File audio is mono int16, often read in place from its mapping, and
+    // widened to the stream format
+    const int16_t* pcm = file_source_->read(file_buffer_.data(), channel_samples_);
+    if (format_ == protocol::DEFAULT_STREAM_FORMAT) {
+        return pcm;
+    }
+    common::with_sample_format(format_.sample_format, [&](auto traits) {
+        using Traits = decltype(traits);
+        common::samples_from_int16<Traits::FORMAT>(
+            pcm, channel_samples_, format_.channels,
+            reinterpret_cast<typename Traits::Type*>(render_buffer_.data()));
+    });
+    return render_buffer_.data();
+}
+
+void AudioStreamer::send_pending_packet() {
+    uint8_t frames = pending_audio_.frame_count;
+    pending_target_frames_ = 0;
+    
+    pending_packet_.set_type(protocol::PacketType::AUDIO_DATA);
+    pending_packet_.set_sequence(sequence_number_++);
+    pending_packet_.set_flags(protocol::FLAG_ACK_REQUIRED);
+    memcpy(pending_packet_.payload, &pending_audio_, sizeof(pending_audio_));
+    pending_packet_.set_payload(nullptr, static_cast<uint16_t>(pending_size_));
+    
+    // Sealed in place, so resends and parity carry the ciphertext as sent
+    bool sealed = cipher_.seal(&pending_packet_);
+    
+    // Pace at the media rate of this packet plus its share of parity
+    size_t wire_bytes = pending_packet_.total_size();
+    if (fec_scheme_ != protocol::FecScheme::NONE && fec_data_count_ > 0) {
+        wire_bytes += wire_bytes * fec_send_parity_ / fec_data_count_;
+    }
+    update_pacing_rate(wire_bytes, frames * protocol::samples_to_us(frame_samples_));
+    
+    record_send(pending_packet_.header.sequence, protocol::get_timestamp_us());
+    bool sent = send_paced(pending_packet_);
+    retransmit_buffer_.store(pending_packet_);
+    
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.packets_encrypted += sealed ? 1 : 0;
+        if (sent) {
+            stats_.packets_sent++;
+            stats_.frames_sent += frames;
             
-            // Catch up if we're behind
-            if (next_packet_time < now) {
-                next_packet_time = now + packet_interval;
+            if (stats_.packets_sent % 100 == 0) {
+                std::cout << "[Accessory] Audio packets sent: " << stats_.packets_sent << std::endl;
             }
         }
-        
-        // Sleep until next packet time
-        std::this_thread::sleep_until(next_packet_time);
     }
+    
+    add_fec_block(pending_packet_);
+}
+
+void AudioStreamer::run_rate_control(uint64_t now) {
+    LinkFeedback feedback;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        feedback.loss_rate = stats_.loss_rate;
+        feedback.srtt_us = stats_.avg_latency_us;
+        feedback.min_rtt_us = stats_.min_rtt_us;
+    }
+    uint64_t last_ack = last_ack_us_.load();
+    feedback.since_ack_us = last_ack == 0 ? UINT64_MAX : (now > last_ack ? now - last_ack : 0);
+    feedback.battery_level = telemetry_ ? telemetry_->get_battery_level() : 100;
+    feedback.charging = telemetry_ ? telemetry_->is_charging() : true;
+    
+    if (!rate_controller_.update(feedback, now)) {
+        return;
+    }
+    const QualitySettings& settings = rate_controller_.settings();
+    max_parity_ = settings.max_parity;
+    render_encoding_.store(static_cast<uint8_t>(settings.encoding));
+    uint8_t level = std::min(rate_controller_.level(), rate_controller_.level_cap());
+    std::cout << "[Accessory] Quality level " << static_cast<int>(level) << ": "
+              << protocol::audio_encoding_to_string(settings.encoding) << ", "
+              << static_cast<int>(settings.frames_per_packet) << " frames/packet, parity <= "
+              << static_cast<int>(settings.max_parity) << " (RTT " << feedback.srtt_us
+              << "us, min " << feedback.min_rtt_us << "us, loss "
+              << feedback.loss_rate * 100.0 << "%, battery "
+              << static_cast<int>(feedback.battery_level) << "%)" << std::endl;
+    
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.quality_level = level;
+    stats_.quality_changes++;
+}
+
+void AudioStreamer::select_codec() {
+    // Codec changes take effect from the next rendered frame; the frame
+    // tick starts a new packet there
+    protocol::AudioEncoding encoding = static_cast<protocol::AudioEncoding>(render_encoding_.load());
+    if (encoding == active_codec_->encoding()) {
+        return;
+    }
+    common::AudioCodec* codec = encoding == codec_->encoding() ? codec_.get() : fallback_codec_.get();
+    if (!codec) {
+        return;
+    }
+    active_codec_ = codec;
+    active_codec_->reset();
+}
+
+bool AudioStreamer::send_paced(const protocol::Packet& packet) {
+    if (!pacing_enabled_.load()) {
+        return transport_->send_packet(packet);
+    }
+    
+    std::lock_guard<std::mutex> lock(pacing_mutex_);
+    uint64_t now = protocol::get_timestamp_us();
+    refill_pacing_tokens(now);
+    double size = static_cast<double>(packet.total_size());
+    
+    // Straight out while the bucket covers it (or before the rate is known)
+    if (pacing_count_ == 0 && (pacing_tokens_ >= std::min(size, PACING_BURST_BYTES) ||
+                               pacing_rate_ <= 0.0)) {
+        pacing_tokens_ -= size;
+        return transport_->send_packet(packet);
+    }
+    
+    // Queue full: the link is not keeping up at this quality, so adding
+    // delay no longer helps
+    if (pacing_count_ == pacing_queue_.size()) {
+        pacing_tokens_ -= size;
+        {
+            std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+            stats_.pacing_overflows++;
+        }
+        return transport_->send_packet(packet);
+    }
+    
+    size_t slot = (pacing_head_ + pacing_count_) % pacing_queue_.size();
+    protocol::Packet& queued = pacing_queue_[slot];
+    queued.header = packet.header;
+    memcpy(queued.payload, packet.payload, packet.header.payload_length);
+    pacing_enqueued_us_[slot] = now;
+    pacing_count_++;
+    schedule_pacing_drain();
+    return true;
+}
+
+void AudioStreamer::update_pacing_rate(size_t bytes, uint64_t duration_us) {
+    if (duration_us == 0) {
+        return;
+    }
+    double rate = PACING_GAIN * static_cast<double>(bytes) / static_cast<double>(duration_us);
+    
+    std::lock_guard<std::mutex> lock(pacing_mutex_);
+    refill_pacing_tokens(protocol::get_timestamp_us());
+    pacing_rate_ = pacing_rate_ <= 0.0 ? rate : pacing_rate_ + (rate - pacing_rate_) / 8;  // EWMA
+}
+
+void AudioStreamer::refill_pacing_tokens(uint64_t now) {
+    if (now > pacing_refill_us_) {
+        pacing_tokens_ += static_cast<double>(now - pacing_refill_us_) * pacing_rate_;
+        pacing_tokens_ = std::min(pacing_tokens_, PACING_BURST_BYTES);
+        pacing_refill_us_ = now;
+    }
+}
+
+void AudioStreamer::schedule_pacing_drain() {
+    if (pacing_timer_ != common::TimerWheel::INVALID_TIMER || pacing_count_ == 0) {
+        return;
+    }
+    double deficit = std::min(static_cast<double>(pacing_queue_[pacing_head_].total_size()),
+                              PACING_BURST_BYTES) - pacing_tokens_;
+    uint64_t wait_us = deficit > 0.0 && pacing_rate_ > 0.0
+        ? static_cast<uint64_t>(deficit / pacing_rate_) + 1 : 0;
+    pacing_timer_ = scheduler_->schedule_after(wait_us, [this] { drain_pacing_queue(); });
 }
 
-void AudioStreamer::send_audio_packet() {
-    protocol::Packet packet;
-    packet.set_type(protocol::PacketType::AUDIO_DATA);
-    packet.set_sequence(sequence_number_++);
-    packet.set_timestamp(static_cast<uint32_t>(protocol::get_timestamp_us()));
-    packet.set_flags(protocol::FLAG_ACK_REQUIRED);
+void AudioStreamer::drain_pacing_queue() {
+    std::lock_guard<std::mutex> lock(pacing_mutex_);
+    pacing_timer_ = common::TimerWheel::INVALID_TIMER;
+    if (!streaming_.load()) {
+        pacing_count_ = 0;
+        return;
+    }
     
-    // Prepare audio payload
-    protocol::AudioPayload audio_payload;
-    audio_payload.stream_timestamp = static_cast<uint32_t>(
-        protocol::get_timestamp_us() - stream_start_time_);
-    audio_payload.sample_count = protocol::AUDIO_SAMPLES_PER_PACKET;
-    audio_payload.encoding = 0;  // PCM16
-    audio_payload.reserved = 0;
+    uint64_t now = protocol::get_timestamp_us();
+    refill_pacing_tokens(now);
+    uint64_t sent = 0;
+    uint64_t max_delay_us = 0;
+    while (pacing_count_ > 0) {
+        const protocol::Packet& packet = pacing_queue_[pacing_head_];
+        double size = static_cast<double>(packet.total_size());
+        if (pacing_tokens_ < std::min(size, PACING_BURST_BYTES)) {
+            break;
+        }
+        pacing_tokens_ -= size;
+        transport_->send_packet(packet);
+        max_delay_us = std::max(max_delay_us, now - pacing_enqueued_us_[pacing_head_]);
+        pacing_head_ = (pacing_head_ + 1) % pacing_queue_.size();
+        pacing_count_--;
+        sent++;
+    }
+    schedule_pacing_drain();
+    
+    std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+    stats_.packets_paced += sent;
+    stats_.max_pacing_delay_us = std::max(stats_.max_pacing_delay_us,
+                                          static_cast<uint32_t>(max_delay_us));
+}
+
+void AudioStreamer::set_rate_control(bool enabled, protocol::AudioEncoding fallback) {
+    rate_control_enabled_.store(enabled);
+    fallback_encoding_ = fallback;
+}
+
+void AudioStreamer::record_send(uint32_t sequence, uint64_t send_us) {
+    std::lock_guard<std::mutex> lock(ack_mutex_);
+    SentRecord& record = sent_history_[sequence % sent_history_.size()];
+    record.sequence = sequence;
+    record.send_us = send_us;
+    record.acked = false;
+    record.retransmitted = false;
+}
+
+void AudioStreamer::mark_retransmitted(uint32_t sequence) {
+    std::lock_guard<std::mutex> lock(ack_mutex_);
+    SentRecord& record = sent_history_[sequence % sent_history_.size()];
+    if (record.sequence == sequence) {
+        record.retransmitted = true;
+    }
+}
+
+void AudioStreamer::on_ack(const protocol::Packet& packet) {
+    if (!streaming_.load() || packet.header.payload_length < sizeof(protocol::AckPayload)) {
+        return;
+    }
+    protocol::AckPayload ack;
+    memcpy(&ack, packet.payload, sizeof(ack));
+    uint64_t now = protocol::get_timestamp_us();
+    last_ack_us_.store(now);
     
-    // Generate simulated audio data (sine wave)
-    uint8_t audio_buffer[protocol::AUDIO_PACKET_SIZE];
-    generate_audio_packet(audio_buffer, protocol::AUDIO_PACKET_SIZE);
+    uint64_t newly_acked = 0;
+    int64_t rtt_us = -1;
+    int64_t lost = -1;
+    double interval_loss = -1.0;
+    {
+        std::lock_guard<std::mutex> lock(ack_mutex_);
+        // Ignore ACKs overtaken by a newer one
+        if (ack_valid_ && static_cast<int32_t>(ack.highest_sequence - ack_highest_) < 0) {
+            return;
+        }
+        
+        // Highest sequence, then one per set bit below it
+        uint64_t pending = (static_cast<uint64_t>(ack.received_bitmap) << 1) | 1;
+        while (pending != 0) {
+            unsigned offset = static_cast<unsigned>(__builtin_ctzll(pending));
+            pending &= pending - 1;
+            uint32_t sequence = ack.highest_sequence - offset;
+            SentRecord& record = sent_history_[sequence % sent_history_.size()];
+            if (record.send_us == 0 || record.sequence != sequence || record.acked) {
+                continue;
+            }
+            record.acked = true;
+            newly_acked++;
+            
+            // Karn: no sample from a packet that was also retransmitted
+            if (offset == 0 && !record.retransmitted) {
+                int64_t sample = static_cast<int64_t>(now - record.send_us) - ack.ack_delay_us;
+                rtt_us = std::max<int64_t>(sample, 0);
+            }
+        }
+        
+        // Each stream starts at first_sequence_ (0 unless resumed), so
+        // this many were sent by the time the host acknowledged highest
+        uint32_t sent = ack.highest_sequence - first_sequence_ + 1;
+        if (ack.packets_received <= sent) {
+            lost = sent - ack.packets_received;
+            uint32_t sent_delta = sent - ack_last_sent_;
+            uint32_t received_delta = ack.packets_received - ack_last_received_;
+            if (sent_delta > 0 && received_delta <= sent_delta) {
+                interval_loss = static_cast<double>(sent_delta - received_delta) / sent_delta;
+            }
+            ack_last_sent_ = sent;
+            ack_last_received_ = ack.packets_received;
+        }
+        ack_valid_ = true;
+        ack_highest_ = ack.highest_sequence;
+    }
     
-    // Combine payload header and audio data
-    size_t total_payload_size = sizeof(audio_payload) + protocol::AUDIO_PACKET_SIZE;
-    uint8_t* combined_payload = new uint8_t[total_payload_size];
-    memcpy(combined_payload, &audio_payload, sizeof(audio_payload));
-    memcpy(combined_payload + sizeof(audio_payload), audio_buffer, protocol::AUDIO_PACKET_SIZE);
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.acks_received++;
+    stats_.packets_acked += newly_acked;
+    if (rtt_us >= 0) {
+        uint32_t rtt = static_cast<uint32_t>(std::min<int64_t>(rtt_us, UINT32_MAX));
+        stats_.last_rtt_us = rtt;
+        if (stats_.min_rtt_us == 0 || rtt < stats_.min_rtt_us) {
+            stats_.min_rtt_us = rtt;
+        }
+        stats_.max_latency_us = std::max(stats_.max_latency_us, rtt);
+        stats_.avg_latency_us = stats_.avg_latency_us == 0
+            ? rtt : static_cast<uint32_t>((stats_.avg_latency_us * 7ull + rtt) / 8);  // EWMA
+    }
+    if (lost >= 0) {
+        stats_.packets_lost = static_cast<uint64_t>(lost);
+    }
+    if (interval_loss >= 0.0) {
+        stats_.loss_rate += (interval_loss - stats_.loss_rate) / 16;
+    }
+}
+
+void AudioStreamer::add_fec_block(const protocol::Packet& packet) {
+    if (fec_filled_ == 0) {
+        // Configuration changes take effect at group boundaries
+        uint32_t config = fec_config_.load();
+        fec_scheme_ = static_cast<protocol::FecScheme>(config & 0xFF);
+        fec_data_count_ = static_cast<uint8_t>(config >> 8);
+        fec_parity_count_ = static_cast<uint8_t>(config >> 16);
+        fec_base_sequence_ = packet.header.sequence;
+        fec_block_size_ = 0;
+        
+        // The rate controller may send fewer parity packets than the host
+        // configured; the host treats the rest as lost
+        fec_send_parity_ = std::min(fec_parity_count_, max_parity_);
+        if (fec_scheme_ == protocol::FecScheme::NONE || fec_send_parity_ == 0) {
+            return;
+        }
+        if (fec_blocks_.size() < fec_data_count_ * FEC_MAX_BLOCK_SIZE) {
+            fec_blocks_.resize(fec_data_count_ * FEC_MAX_BLOCK_SIZE);
+        }
+    }
     
-    packet.set_payload(combined_payload, static_cast<uint16_t>(total_payload_size));
-    delete[] combined_payload;
+    uint8_t* block = &fec_blocks_[fec_filled_ * FEC_MAX_BLOCK_SIZE];
+    uint16_t payload_length = packet.header.payload_length;
+    memcpy(block, &packet.header.timestamp_us, sizeof(uint64_t));
+    memcpy(block + sizeof(uint64_t), &payload_length, sizeof(payload_length));
+    memcpy(block + protocol::FEC_BLOCK_HEADER_SIZE, packet.payload, payload_length);
+    fec_block_lengths_[fec_filled_] = protocol::FEC_BLOCK_HEADER_SIZE + payload_length;
+    fec_block_size_ = std::max(fec_block_size_, fec_block_lengths_[fec_filled_]);
     
-    // Send packet
-    if (transport_->send_packet(packet)) {
+    if (++fec_filled_ == fec_data_count_) {
+        send_fec_parity();
+        fec_filled_ = 0;
+    }
+}
+
+void AudioStreamer::send_fec_parity() {
+    if (sizeof(protocol::FecPayload) + fec_block_size_ > protocol::MAX_PAYLOAD_SIZE) {
         std::lock_guard<std::mutex> lock(stats_mutex_);
-        stats_.packets_sent++;
+        stats_.fec_groups_skipped++;
+        return;
+    }
+    
+    // Shorter blocks are zero-padded to the group's block size
+    const uint8_t* data[protocol::FEC_MAX_DATA_PACKETS];
+    for (size_t i = 0; i < fec_data_count_; i++) {
+        uint8_t* block = &fec_blocks_[i * FEC_MAX_BLOCK_SIZE];
+        memset(block + fec_block_lengths_[i], 0, fec_block_size_ - fec_block_lengths_[i]);
+        data[i] = block;
+    }
+    
+    protocol::Packet parity_packets[protocol::FEC_MAX_PARITY_PACKETS];
+    uint8_t* parity[protocol::FEC_MAX_PARITY_PACKETS];
+    for (size_t j = 0; j < fec_send_parity_; j++) {
+        parity[j] = parity_packets[j].payload + sizeof(protocol::FecPayload);
+    }
+    if (!common::fec_encode(fec_scheme_, data, fec_data_count_, parity, fec_send_parity_,
+                            fec_block_size_)) {
+        return;
+    }
+    
+    uint64_t sent = 0;
+    for (size_t j = 0; j < fec_send_parity_; j++) {
+        protocol::FecPayload fec;
+        fec.base_sequence = fec_base_sequence_;
+        fec.scheme = static_cast<uint8_t>(fec_scheme_);
+        fec.data_count = fec_data_count_;
+        fec.parity_count = fec_parity_count_;
+        fec.parity_index = static_cast<uint8_t>(j);
+        fec.block_size = static_cast<uint16_t>(fec_block_size_);
         
-        if (stats_.packets_sent % 100 == 0) {
-            std::cout << "[Accessory] Audio packets sent: " << stats_.packets_sent << std::endl;
+        protocol::Packet& packet = parity_packets[j];
+        packet.set_type(protocol::PacketType::AUDIO_FEC);
+        packet.set_sequence(fec_sequence_++);
+        packet.set_timestamp(protocol::get_timestamp_us());
+        memcpy(packet.payload, &fec, sizeof(fec));
+        packet.set_payload(nullptr, static_cast<uint16_t>(sizeof(fec) + fec_block_size_));
+        if (send_paced(packet)) {
+            sent++;
         }
     }
+    
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.fec_packets_sent += sent;
 }
 
-void AudioStreamer::generate_audio_packet(uint8_t* buffer, size_t size) {
-    // Generate a simple sine wave (440Hz "A" note)
-    constexpr double frequency = 440.0;  // Hz
-    constexpr double amplitude = 16000.0;  // Max value for 16-bit audio
+void AudioStreamer::on_fec_config(const protocol::Packet& packet) {
+    if (packet.header.payload_length < sizeof(protocol::FecConfigPayload)) {
+        return;
+    }
+    protocol::FecConfigPayload config;
+    memcpy(&config, packet.payload, sizeof(config));
+    set_fec(static_cast<protocol::FecScheme>(config.scheme), config.data_count, config.parity_count);
+}
+
+void AudioStreamer::set_fec(protocol::FecScheme scheme, uint8_t data_count, uint8_t parity_count) {
+    bool valid = false;
+    switch (scheme) {
+        case protocol::FecScheme::NONE:
+            valid = true;
+            data_count = 0;
+            parity_count = 0;
+            break;
+        case protocol::FecScheme::XOR:
+            valid = parity_count == 1;
+            break;
+        case protocol::FecScheme::REED_SOLOMON:
+            valid = parity_count >= 1 && parity_count <= protocol::FEC_MAX_PARITY_PACKETS;
+            break;
+    }
+    if (scheme != protocol::FecScheme::NONE) {
+        valid = valid && data_count >= 1 && data_count <= protocol::FEC_MAX_DATA_PACKETS;
+    }
+    if (!valid) {
+        std::cout << "[Accessory] Ignoring invalid FEC configuration" << std::endl;
+        return;
+    }
     
-    int16_t* samples = reinterpret_cast<int16_t*>(buffer);
-    size_t num_samples = size / sizeof(int16_t);
+    uint32_t config = pack_fec_config(scheme, data_count, parity_count);
+    if (fec_config_.exchange(config) != config) {
+        std::cout << "[Accessory] FEC " << protocol::fec_scheme_to_string(scheme);
+        if (scheme != protocol::FecScheme::NONE) {
+            std::cout << " " << static_cast<int>(data_count) << "+" << static_cast<int>(parity_count);
+        }
+        std::cout << std::endl;
+    }
+}
+
+void AudioStreamer::on_retransmit_request(const protocol::Packet& packet) {
+    if (!streaming_.load()) {
+        return;
+    }
     
-    static double phase = 0.0;
-    const double phase_increment = 2.0 * M_PI * frequency / protocol::AUDIO_SAMPLE_RATE;
+    size_t entry_count = packet.header.payload_length / sizeof(protocol::NackEntry);
+    entry_count = std::min(entry_count, protocol::MAX_NACK_ENTRIES);
+    uint64_t requested = 0;
+    uint64_t resent = 0;
+    uint64_t missed = 0;
     
-    for (size_t i = 0; i < num_samples; i++) {
-        samples[i] = static_cast<int16_t>(amplitude * std::sin(phase));
-        phase += phase_increment;
+    protocol::Packet retransmit;
+    for (size_t i = 0; i < entry_count; i++) {
+        protocol::NackEntry entry;
+        memcpy(&entry, packet.payload + i * sizeof(entry), sizeof(entry));
         
-        // Wrap phase to prevent numerical drift
-        if (phase >= 2.0 * M_PI) {
-            phase -= 2.0 * M_PI;
+        // Base sequence first, then one per set bit
+        uint64_t pending = (static_cast<uint64_t>(entry.bitmap) << 1) | 1;
+        while (pending != 0) {
+            unsigned offset = static_cast<unsigned>(__builtin_ctzll(pending));
+            pending &= pending - 1;
+            requested++;
+            
+            if (!retransmit_buffer_.fetch(entry.base_sequence + offset, &retransmit)) {
+                missed++;
+                continue;
+            }
+            // Same bytes as the original; only the flag (and so the checksum) differ
+            retransmit.set_flags(retransmit.header.flags | protocol::FLAG_RETRANSMIT);
+            mark_retransmitted(retransmit.header.sequence);
+            retransmit.set_payload(nullptr, retransmit.header.payload_length);
+            if (send_paced(retransmit)) {
+                resent++;
+            }
         }
     }
+    
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.retransmit_requests += requested;
+    stats_.retransmissions += resent;
+    stats_.retransmit_misses += missed;
+}
+
+void AudioStreamer::set_test_signal(Waveform waveform, double frequency_hz, uint32_t seed) {
+    // Re-applied at the stream's rate by start_streaming()
+    waveform_ = waveform;
+    frequency_hz_ = frequency_hz;
+    oscillator_.set_waveform(waveform, frequency_hz, format_.sample_rate);
+    oscillator_.set_seed(seed);
+}
+
+void AudioStreamer::set_stream_format(const protocol::StreamFormat& format) {
+    if (!protocol::is_valid_stream_format(format)) {
+        std::cout << "[Accessory] Unsupported stream format, using mono "
+                  << protocol::AUDIO_SAMPLE_RATE << "Hz int16" << std::endl;
+        format_ = protocol::DEFAULT_STREAM_FORMAT;
+    } else {
+        format_ = format;
+    }
+    set_encoding(codec_->encoding());
+}
+
+void AudioStreamer::set_encoding(protocol::AudioEncoding encoding) {
+    std::unique_ptr<common::AudioCodec> codec = common::create_audio_codec(encoding, format_);
+    if (!codec) {
+        std::cout << "[Accessory] Unsupported encoding "
+                  << protocol::audio_encoding_to_string(encoding) << " for "
+                  << protocol::sample_format_to_string(format_.sample_format) << " x"
+                  << static_cast<int>(format_.channels) << ", using raw PCM" << std::endl;
+        codec = common::create_audio_codec(protocol::AudioEncoding::PCM16, format_);
+    }
+    codec_ = std::move(codec);
+}
+
+void AudioStreamer::set_frame_format(uint16_t frame_samples, uint8_t frames_per_packet) {
+    if (!protocol::is_valid_frame_samples(frame_samples)) {
+        std::cout << "[Accessory] Unsupported frame size " << frame_samples << ", using "
+                  << protocol::AUDIO_SAMPLES_PER_PACKET << " samples" << std::endl;
+        frame_samples = protocol::AUDIO_SAMPLES_PER_PACKET;
+    }
+    frame_samples_ = frame_samples;
+    set_frames_per_packet(frames_per_packet);
+}
+
+void AudioStreamer::set_frames_per_packet(uint8_t frames_per_packet) {
+    frames_per_packet = std::max<uint8_t>(frames_per_packet, 1);
+    frames_per_packet_.store(std::min(frames_per_packet, protocol::MAX_FRAMES_PER_PACKET));
+}
+
+void AudioStreamer::generate_audio_packet(uint8_t* buffer, size_t size) {
+    // One branch on the format per call; the render loop is per type
+    const size_t frames = size / (common::sample_size(format_.sample_format) * format_.channels);
+    common::with_sample_format(format_.sample_format, [&](auto traits) {
+        using Traits = decltype(traits);
+        oscillator_.render<Traits::FORMAT>(reinterpret_cast<typename Traits::Type*>(buffer),
+                                           frames, format_.channels);
+    });
 }
 
 AudioStreamer::Stats AudioStreamer::get_stats() const {
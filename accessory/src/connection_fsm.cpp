@@ -1,48 +1,362 @@
 #include "accessory/connection_fsm.h"
 #include "accessory/transport.h"
 #include "accessory/crypto.h"
+#include "audio_codec.h"
+#include "key_exchange.h"
+#include "secure_zero.h"
 #include <iostream>
 #include <iomanip>
 #include <cstring>
-#include <chrono>
-#include <thread>
+#include <cstddef>
+#include <algorithm>
+#include <array>
 
 namespace accessory {
 
-ConnectionFSM::ConnectionFSM(Transport* transport)
+namespace {
+
+using protocol::ConnectionState;
+
+constexpr uint32_t DISCONNECT_SETTLE_MS = 100;
+
+// Who owns the event queue's consumer side
+constexpr uint8_t EXECUTOR_IDLE = 0;
+constexpr uint8_t EXECUTOR_SCHEDULED = 1;   // A run is queued on the scheduler
+constexpr uint8_t EXECUTOR_RUNNING = 2;
+constexpr uint8_t EXECUTOR_RETIRED = 3;     // The FSM is gone
+
+// Transition table: a row per state (ERROR last), a column per event
+constexpr size_t STATE_COUNT = 7;
+constexpr size_t EVENT_COUNT = static_cast<size_t>(FsmEventType::COUNT);
+
+constexpr size_t state_index(ConnectionState state) {
+    return state == ConnectionState::ERROR ? STATE_COUNT - 1 : static_cast<size_t>(state);
+}
+
+constexpr uint8_t in(ConnectionState state) {
+    return static_cast<uint8_t>(1u << state_index(state));
+}
+
+constexpr uint8_t ANY_STATE = (1u << STATE_COUNT) - 1;
+constexpr uint8_t CONNECTED_STATES = in(ConnectionState::CONNECTED) | in(ConnectionState::STREAMING);
+
+enum class Action : uint8_t {
+    NONE,
+    START_TIMERS,
+    STOP_TIMERS,
+    ANSWER_DISCOVERY,
+    PAIR,
+    ACCEPT_CONNECT,
+    RESUME,             // May refuse: no transition
+    BEGIN_DISCONNECT,
+    SCHEDULE_RECONNECT
+};
+
+struct Transition {
+    bool handled;
+    bool moves;                 // Else the state stays as it is
+    ConnectionState next;
+    Action action;
+};
+
+struct Rule {
+    uint8_t from;               // in() of each state it applies to
+    FsmEventType event;
+    bool moves;
+    ConnectionState next;
+    Action action;
+};
+
+// Every transition; an event with no rule for the current state is ignored
+constexpr Rule RULES[] = {
+    {ANY_STATE, FsmEventType::START, true, ConnectionState::IDLE, Action::START_TIMERS},
+    {ANY_STATE, FsmEventType::STOP, true, ConnectionState::IDLE, Action::STOP_TIMERS},
+    // Discovery is always answered, but does not drop a connection
+    {ANY_STATE & ~CONNECTED_STATES, FsmEventType::DISCOVER_REQUEST, true,
+     ConnectionState::DISCOVERING, Action::ANSWER_DISCOVERY},
+    {CONNECTED_STATES, FsmEventType::DISCOVER_REQUEST, false,
+     ConnectionState::IDLE, Action::ANSWER_DISCOVERY},
+    // The host may pair, connect or resume at any point, disconnecting included
+    {ANY_STATE, FsmEventType::PAIR_REQUEST, true, ConnectionState::PAIRING, Action::PAIR},
+    {ANY_STATE, FsmEventType::CONNECT_REQUEST, true, ConnectionState::CONNECTED, Action::ACCEPT_CONNECT},
+    {ANY_STATE, FsmEventType::RESUME_REQUEST, true, ConnectionState::CONNECTED, Action::RESUME},
+    {ANY_STATE & ~in(ConnectionState::IDLE), FsmEventType::DISCONNECT, true,
+     ConnectionState::DISCONNECTING, Action::BEGIN_DISCONNECT},
+    {in(ConnectionState::DISCONNECTING), FsmEventType::DISCONNECT_SETTLED, true,
+     ConnectionState::IDLE, Action::NONE},
+    {in(ConnectionState::IDLE), FsmEventType::FORCE_CONNECTED, true,
+     ConnectionState::CONNECTED, Action::NONE},
+    {in(ConnectionState::CONNECTED), FsmEventType::STREAM, true,
+     ConnectionState::STREAMING, Action::NONE},
+    {CONNECTED_STATES, FsmEventType::LINK_LOST, true, ConnectionState::ERROR, Action::SCHEDULE_RECONNECT},
+    {in(ConnectionState::ERROR), FsmEventType::RECONNECT, true, ConnectionState::IDLE, Action::NONE},
+};
+
+using TransitionTable = std::array<std::array<Transition, EVENT_COUNT>, STATE_COUNT>;
+
+constexpr TransitionTable build_transitions() {
+    TransitionTable table{};
+    for (const Rule& rule : RULES) {
+        for (size_t state = 0; state < STATE_COUNT; state++) {
+            if (rule.from & (1u << state)) {
+                table[state][static_cast<size_t>(rule.event)] =
+                    Transition{true, rule.moves, rule.next, rule.action};
+            }
+        }
+    }
+    return table;
+}
+
+constexpr TransitionTable TRANSITIONS = build_transitions();
+
+constexpr const Transition& transition_for(ConnectionState state, FsmEventType event) {
+    return TRANSITIONS[state_index(state)][static_cast<size_t>(event)];
+}
+
+static_assert(transition_for(ConnectionState::STREAMING, FsmEventType::STOP).next ==
+              ConnectionState::IDLE, "STOP must reach IDLE from every state");
+static_assert(!transition_for(ConnectionState::STREAMING, FsmEventType::DISCOVER_REQUEST).moves,
+              "Discovery must not drop a connection");
+static_assert(!transition_for(ConnectionState::PAIRING, FsmEventType::STREAM).handled,
+              "Streaming starts from CONNECTED only");
+static_assert(sizeof(protocol::PairPayload) <= FsmEvent::MAX_PAYLOAD &&
+              sizeof(protocol::ConnectPayload) <= FsmEvent::MAX_PAYLOAD &&
+              sizeof(protocol::ResumeRequestPayload) <= FsmEvent::MAX_PAYLOAD,
+              "Handshake payloads must fit an event");
+
+const uint16_t FRAME_DURATIONS[] = {
+    protocol::AUDIO_FRAME_SAMPLES_2_5MS, protocol::AUDIO_FRAME_SAMPLES_5MS,
+    protocol::AUDIO_FRAME_SAMPLES_10MS, protocol::AUDIO_FRAME_SAMPLES_20MS
+};
+
+bool frame_fits(protocol::AudioEncoding encoding, uint16_t frame_samples,
+                const protocol::StreamFormat& format) {
+    return protocol::stream_frame_samples(format, frame_samples) > 0 &&
+           common::max_encoded_frame_size(encoding, frame_samples, format) <=
+               protocol::MAX_PAYLOAD_SIZE - sizeof(protocol::AudioPayload) - protocol::AUTH_TAG_SIZE;
+}
+
+// Frame duration closest to the requested one that is whole at the
+// stream's rate and fits one AUDIO_DATA: the longest no longer than asked,
+// else the shortest longer one. 0 if the format fits no frame.
+uint16_t fit_frame_samples(protocol::AudioEncoding encoding, uint16_t requested,
+                           const protocol::StreamFormat& format) {
+    for (size_t i = sizeof(FRAME_DURATIONS) / sizeof(FRAME_DURATIONS[0]); i-- > 0;) {
+        if (FRAME_DURATIONS[i] <= requested && frame_fits(encoding, FRAME_DURATIONS[i], format)) {
+            return FRAME_DURATIONS[i];
+        }
+    }
+    for (uint16_t frame_samples : FRAME_DURATIONS) {
+        if (frame_samples > requested && frame_fits(encoding, frame_samples, format)) {
+            return frame_samples;
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+ConnectionFSM::ConnectionFSM(Transport* transport, common::TimerWheel* scheduler)
     : transport_(transport)
+    , scheduler_(scheduler)
     , state_(protocol::ConnectionState::IDLE)
     , last_keepalive_time_(0)
     , reconnect_attempts_(0)
     , reconnect_delay_ms_(protocol::RECONNECT_BASE_DELAY_MS)
-    , keepalive_running_(false) {
+    , codec_capabilities_(common::supported_codec_capabilities())
+    , audio_encoding_(protocol::AudioEncoding::PCM16)
+    , frame_samples_(protocol::AUDIO_SAMPLES_PER_PACKET)
+    , frames_per_packet_(1)
+    , stream_format_(protocol::DEFAULT_STREAM_FORMAT)
+    , host_decodes_codecs_(false)
+    , has_session_key_(false)
+    , has_pairing_keypair_(false)
+    , has_ticket_(false)
+    , resume_sequence_(0)
+    , resume_position_(0)
+    , resumed_(false)
+    , resumes_(0)
+    , keepalive_timer_(common::TimerWheel::INVALID_TIMER)
+    , reconnect_timer_(common::TimerWheel::INVALID_TIMER)
+    , disconnect_timer_(common::TimerWheel::INVALID_TIMER) {
     
     // Generate device ID
     Crypto::generate_random(device_id_, sizeof(device_id_));
+    memset(ticket_id_, 0, sizeof(ticket_id_));
     snprintf(device_name_, sizeof(device_name_), "AudioSim-%02X%02X",
              device_id_[0], device_id_[1]);
+    memset(&stats_, 0, sizeof(stats_));
+    executor_ = std::make_shared<std::atomic<uint8_t>>(EXECUTOR_IDLE);
 }
 
 ConnectionFSM::~ConnectionFSM() {
     stop();
+    // Runs still queued on the scheduler find the executor retired
+    acquire_executor();
+    executor_thread_.store(std::thread::id());
+    executor_->store(EXECUTOR_RETIRED);
+    common::secure_zero(session_key_, sizeof(session_key_));
+    common::secure_zero(pairing_private_key_, sizeof(pairing_private_key_));
 }
 
 void ConnectionFSM::start() {
     std::cout << "[Accessory] Starting connection FSM" << std::endl;
-    transition_state(protocol::ConnectionState::IDLE);
-    start_keepalive_thread();
+    post(FsmEventType::START);
 }
 
 void ConnectionFSM::stop() {
     std::cout << "[Accessory] Stopping connection FSM" << std::endl;
-    stop_keepalive_thread();
-    transition_state(protocol::ConnectionState::IDLE);
+    if (on_executor()) {
+        // From a state change callback: after the event being handled
+        post(FsmEventType::STOP);
+        return;
+    }
+    
+    // Run what is queued and then the STOP here, rather than wait for a
+    // worker that may be busy (or be the caller)
+    acquire_executor();
+    FsmEvent event;
+    while (events_.pop(&event)) {
+        dispatch(event);
+    }
+    event.type = FsmEventType::STOP;
+    event.payload_length = 0;
+    event.posted_us = protocol::get_timestamp_us();
+    dispatch(event);
+    release_executor();
 }
 
-void ConnectionFSM::transition_state(protocol::ConnectionState new_state) {
-    std::lock_guard<std::mutex> lock(state_mutex_);
-    auto old_state = state_.load();
+void ConnectionFSM::post(FsmEventType type, const protocol::Packet* packet) {
+    FsmEvent event;
+    event.type = type;
+    event.payload_length = 0;
+    event.posted_us = protocol::get_timestamp_us();
+    if (packet) {
+        event.payload_length = packet->header.payload_length;
+        memcpy(event.payload, packet->payload,
+               std::min<size_t>(packet->header.payload_length, sizeof(event.payload)));
+    }
     
+    if (!events_.push(event)) {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.dropped++;
+        return;
+    }
+    schedule_run();
+}
+
+void ConnectionFSM::schedule_run() {
+    uint8_t idle = EXECUTOR_IDLE;
+    if (!executor_->compare_exchange_strong(idle, EXECUTOR_SCHEDULED)) {
+        return;     // Queued or running already; it will reach the new event
+    }
+    
+    // The run holds the executor state, and touches the FSM only once it
+    // has claimed it
+    std::shared_ptr<std::atomic<uint8_t>> executor = executor_;
+    auto run = [this, executor] {
+        uint8_t scheduled = EXECUTOR_SCHEDULED;
+        if (executor->compare_exchange_strong(scheduled, EXECUTOR_RUNNING)) {
+            run_events();
+        }
+    };
+    if (!scheduler_->post(run)) {
+        run();      // Scheduler stopped (shutdown): run them here
+    }
+}
+
+void ConnectionFSM::acquire_executor() {
+    std::unique_lock<std::mutex> lock(executor_mutex_);
+    while (true) {
+        // Taking over from a queued run is fine: it finds the executor taken
+        uint8_t state = executor_->load();
+        if ((state == EXECUTOR_IDLE || state == EXECUTOR_SCHEDULED) &&
+            executor_->compare_exchange_strong(state, EXECUTOR_RUNNING)) {
+            break;
+        }
+        // A worker is running events; it finishes without needing another
+        executor_cv_.wait(lock, [this] { return executor_->load() != EXECUTOR_RUNNING; });
+    }
+    executor_thread_.store(std::this_thread::get_id());
+}
+
+void ConnectionFSM::run_events() {
+    executor_thread_.store(std::this_thread::get_id());
+    FsmEvent event;
+    while (events_.pop(&event)) {
+        dispatch(event);
+    }
+    release_executor();
+}
+
+void ConnectionFSM::release_executor() {
+    executor_thread_.store(std::thread::id());
+    {
+        std::lock_guard<std::mutex> lock(executor_mutex_);
+        executor_->store(EXECUTOR_IDLE);
+    }
+    executor_cv_.notify_all();
+    
+    // An event queued after the last pop found the executor still taken
+    if (events_.has_pending()) {
+        schedule_run();
+    }
+}
+
+void ConnectionFSM::dispatch(const FsmEvent& event) {
+    const Transition& transition = transition_for(state_.load(), event.type);
+    uint64_t now = protocol::get_timestamp_us();
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        if (transition.handled) {
+            stats_.events++;
+        } else {
+            stats_.ignored++;
+        }
+        if (now > event.posted_us) {
+            stats_.max_queue_us = std::max(stats_.max_queue_us, now - event.posted_us);
+        }
+    }
+    if (!transition.handled) {
+        return;
+    }
+    
+    bool proceed = true;
+    switch (transition.action) {
+        case Action::NONE:
+            break;
+        case Action::START_TIMERS:
+            proceed = start_timers();
+            break;
+        case Action::STOP_TIMERS:
+            proceed = stop_timers();
+            break;
+        case Action::ANSWER_DISCOVERY:
+            proceed = answer_discovery();
+            break;
+        case Action::PAIR:
+            proceed = pair(event);
+            break;
+        case Action::ACCEPT_CONNECT:
+            proceed = accept_connect(event);
+            break;
+        case Action::RESUME:
+            proceed = resume(event);
+            break;
+        case Action::BEGIN_DISCONNECT:
+            proceed = begin_disconnect();
+            break;
+        case Action::SCHEDULE_RECONNECT:
+            proceed = schedule_reconnect();
+            break;
+    }
+    if (proceed && transition.moves) {
+        change_state(transition.next);
+    }
+}
+
+void ConnectionFSM::change_state(protocol::ConnectionState new_state) {
+    auto old_state = state_.load();
     if (old_state == new_state) {
         return;
     }
@@ -60,22 +374,31 @@ void ConnectionFSM::transition_state(protocol::ConnectionState new_state) {
     }
 }
 
+ConnectionFSM::Stats ConnectionFSM::get_stats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
 void ConnectionFSM::on_discover_request(const protocol::Packet& packet) {
     std::cout << "[Accessory] Received DISCOVER_REQUEST" << std::endl;
-    transition_state(protocol::ConnectionState::DISCOVERING);
+    post(FsmEventType::DISCOVER_REQUEST, &packet);
+}
+
+bool ConnectionFSM::answer_discovery() {
     send_discover_response();
+    return true;
 }
 
 void ConnectionFSM::send_discover_response() {
     protocol::Packet response;
     response.set_type(protocol::PacketType::DISCOVER_RESPONSE);
-    response.set_timestamp(static_cast<uint32_t>(protocol::get_timestamp_us()));
+    response.set_timestamp(protocol::get_timestamp_us());
     
     protocol::DiscoverPayload payload;
     memset(&payload, 0, sizeof(payload));
     strncpy(payload.device_name, device_name_, sizeof(payload.device_name) - 1);
     memcpy(payload.device_id, device_id_, sizeof(device_id_));
-    payload.capabilities = 0x0001;  // Audio streaming capable
+    payload.capabilities = protocol::CAP_AUDIO_STREAMING | codec_capabilities_;
     payload.battery_level = 85;     // Simulated battery level
     
     response.set_payload(&payload, sizeof(payload));
@@ -86,52 +409,319 @@ void ConnectionFSM::send_discover_response() {
 
 void ConnectionFSM::on_pair_request(const protocol::Packet& packet) {
     std::cout << "[Accessory] Received PAIR_REQUEST" << std::endl;
-    transition_state(protocol::ConnectionState::PAIRING);
-    send_pair_response(packet);
+    post(FsmEventType::PAIR_REQUEST, &packet);
 }
 
-void ConnectionFSM::send_pair_response(const protocol::Packet& request) {
+bool ConnectionFSM::pair(const FsmEvent& event) {
+    send_pair_response(event);
+    return true;
+}
+
+void ConnectionFSM::send_pair_response(const FsmEvent& request) {
     protocol::Packet response;
     response.set_type(protocol::PacketType::PAIR_RESPONSE);
-    response.set_timestamp(static_cast<uint32_t>(protocol::get_timestamp_us()));
+    response.set_timestamp(protocol::get_timestamp_us());
     
     protocol::PairPayload payload;
     memcpy(payload.device_id, device_id_, sizeof(device_id_));
     
-    // Generate simulated ECDH key pair
-    uint8_t private_key[32];
-    Crypto::generate_keypair(payload.public_key, private_key);
+    // Ephemeral X25519 key pair: the one prepared ahead, else a new one
+    uint8_t private_key[common::X25519_KEY_SIZE];
+    {
+        std::lock_guard<std::mutex> lock(key_mutex_);
+        if (has_pairing_keypair_) {
+            memcpy(payload.public_key, pairing_public_key_, sizeof(payload.public_key));
+            memcpy(private_key, pairing_private_key_, sizeof(private_key));
+            common::secure_zero(pairing_private_key_, sizeof(pairing_private_key_));
+            has_pairing_keypair_ = false;
+        } else {
+            Crypto::generate_keypair(payload.public_key, private_key);
+        }
+    }
     Crypto::generate_random(payload.nonce, sizeof(payload.nonce));
     
+    // Session key from the host's half of the exchange, when it sent one
+    if (request.payload_length >= sizeof(protocol::PairPayload)) {
+        protocol::PairPayload host;
+        memcpy(&host, request.payload, sizeof(host));
+        uint8_t shared_secret[common::X25519_KEY_SIZE];
+        bool agreed = Crypto::derive_shared_secret(private_key, host.public_key, shared_secret);
+        
+        std::lock_guard<std::mutex> lock(key_mutex_);
+        if (agreed) {
+            common::derive_session_key(shared_secret, host.nonce, payload.nonce, session_key_);
+        } else {
+            std::cout << "[Accessory] Rejected low-order host public key" << std::endl;
+        }
+        has_session_key_ = agreed;
+        common::secure_zero(shared_secret, sizeof(shared_secret));
+    }
+    common::secure_zero(private_key, sizeof(private_key));
+    
     response.set_payload(&payload, sizeof(payload));
     transport_->send_packet(response);
     
     std::cout << "[Accessory] Sent PAIR_RESPONSE with key exchange" << std::endl;
 }
 
+void ConnectionFSM::set_pairing_keypair(const uint8_t* public_key, const uint8_t* private_key) {
+    std::lock_guard<std::mutex> lock(key_mutex_);
+    memcpy(pairing_public_key_, public_key, sizeof(pairing_public_key_));
+    memcpy(pairing_private_key_, private_key, sizeof(pairing_private_key_));
+    has_pairing_keypair_ = true;
+}
+
+bool ConnectionFSM::get_session_key(uint8_t* key) const {
+    std::lock_guard<std::mutex> lock(key_mutex_);
+    if (has_session_key_) {
+        memcpy(key, session_key_, sizeof(session_key_));
+    }
+    return has_session_key_;
+}
+
 void ConnectionFSM::on_connect_request(const protocol::Packet& packet) {
     std::cout << "[Accessory] Received CONNECT_REQUEST" << std::endl;
-    send_connect_response();
-    transition_state(protocol::ConnectionState::CONNECTED);
+    post(FsmEventType::CONNECT_REQUEST, &packet);
+}
+
+bool ConnectionFSM::accept_connect(const FsmEvent& packet) {
+    // Hosts without codec support send no payload: PCM16, 10ms frames.
+    // Hosts that predate stream formats leave them out: mono 48kHz INT16.
+    protocol::ConnectPayload request;
+    memset(&request, 0, sizeof(request));
+    bool negotiated = packet.payload_length >= offsetof(protocol::ConnectPayload, channels);
+    if (negotiated) {
+        memcpy(&request, packet.payload,
+               std::min<size_t>(packet.payload_length, sizeof(request)));
+    }
+    
+    protocol::AudioEncoding encoding = protocol::AudioEncoding::PCM16;
+    auto requested = static_cast<protocol::AudioEncoding>(request.encoding);
+    if (common::codec_supported(requested, codec_capabilities_)) {
+        encoding = requested;
+    }
+    uint16_t frame_samples = protocol::is_valid_frame_samples(request.frame_samples)
+        ? request.frame_samples : protocol::AUDIO_SAMPLES_PER_PACKET;
+    
+    // The compressing codecs are mono INT16; other formats go raw. Frames
+    // larger than a datagram are fragmented by the transport; formats too
+    // large for any frame to fit one packet shorten their frames, or fall
+    // back to the default.
+    protocol::StreamFormat format = protocol::DEFAULT_STREAM_FORMAT;
+    if (!protocol::unpack_stream_format(request.channels, request.format, &format)) {
+        format = protocol::DEFAULT_STREAM_FORMAT;
+    }
+    if (!common::create_audio_codec(encoding, format)) {
+        encoding = protocol::AudioEncoding::PCM16;
+    }
+    uint16_t fitted = fit_frame_samples(encoding, frame_samples, format);
+    if (fitted == 0) {
+        std::cout << "[Accessory] Stream format too large for one packet, using mono "
+                  << protocol::AUDIO_SAMPLE_RATE << "Hz int16" << std::endl;
+        format = protocol::DEFAULT_STREAM_FORMAT;
+    } else {
+        frame_samples = fitted;
+    }
+    
+    // Aggregate no more frames than fit one datagram with this codec
+    uint8_t frames_per_packet = std::max<uint8_t>(request.frames_per_packet, 1);
+    frames_per_packet = std::min(frames_per_packet,
+                                 common::max_frames_per_packet(encoding, frame_samples, format));
+    
+    audio_encoding_.store(encoding);
+    frame_samples_.store(frame_samples);
+    frames_per_packet_.store(frames_per_packet);
+    stream_format_.store(format);
+    host_decodes_codecs_.store(negotiated);
+    
+    protocol::ConnectPayload accepted;
+    accepted.encoding = static_cast<uint8_t>(encoding);
+    accepted.frames_per_packet = frames_per_packet;
+    accepted.frame_samples = frame_samples;
+    protocol::pack_stream_format(format, &accepted.channels, &accepted.format);
+    send_connect_response(accepted);
+    resumed_.store(false);
+    issue_ticket(accepted, negotiated);
+    last_keepalive_time_ = protocol::get_timestamp_us();
+    reconnect_attempts_ = 0;
+    reconnect_delay_ms_ = protocol::RECONNECT_BASE_DELAY_MS;
+    return true;
+}
+
+void ConnectionFSM::issue_ticket(const protocol::ConnectPayload& accepted, bool negotiated) {
+    common::SessionTicket ticket;
+    memset(&ticket, 0, sizeof(ticket));
+    Crypto::generate_random(ticket.id, sizeof(ticket.id));
+    memcpy(ticket.device_id, device_id_, sizeof(ticket.device_id));
+    {
+        std::lock_guard<std::mutex> lock(key_mutex_);
+        if (!has_session_key_) {
+            return;     // Nothing to resume without a key
+        }
+        memcpy(ticket.session_key, session_key_, sizeof(ticket.session_key));
+        memcpy(ticket_id_, ticket.id, sizeof(ticket_id_));
+        has_ticket_ = true;
+    }
+    ticket.params = accepted;
+    ticket.negotiated = negotiated;
+    ticket.expires_us = protocol::get_timestamp_us() + protocol::TICKET_LIFETIME_S * 1000000ull;
+    tickets_.store(ticket);
+    common::secure_zero(ticket.session_key, sizeof(ticket.session_key));
+    
+    protocol::TicketPayload payload;
+    memcpy(payload.ticket_id, ticket.id, sizeof(payload.ticket_id));
+    payload.lifetime_s = protocol::TICKET_LIFETIME_S;
+    
+    protocol::Packet packet;
+    packet.set_type(protocol::PacketType::SESSION_TICKET);
+    packet.set_timestamp(protocol::get_timestamp_us());
+    packet.set_payload(&payload, sizeof(payload));
+    transport_->send_packet(packet);
+}
+
+void ConnectionFSM::on_resume_request(const protocol::Packet& packet) {
+    post(FsmEventType::RESUME_REQUEST, &packet);
+}
+
+bool ConnectionFSM::resume(const FsmEvent& packet) {
+    if (packet.payload_length < sizeof(protocol::ResumeRequestPayload)) {
+        return false;
+    }
+    protocol::ResumeRequestPayload request;
+    memcpy(&request, packet.payload, sizeof(request));
+    
+    protocol::ResumeResponsePayload response;
+    memset(&response, 0, sizeof(response));
+    common::SessionTicket ticket;
+    auto status = protocol::ResumeStatus::OK;
+    if (memcmp(request.device_id, device_id_, sizeof(device_id_)) != 0 ||
+        !tickets_.find(request.ticket_id, &ticket)) {
+        status = protocol::ResumeStatus::UNKNOWN_TICKET;
+    } else {
+        uint8_t expected[protocol::RESUME_MAC_SIZE];
+        common::resume_request_mac(ticket.session_key, request, expected);
+        if (!common::resume_mac_equal(expected, request.mac)) {
+            status = protocol::ResumeStatus::BAD_MAC;
+        }
+    }
+    if (status != protocol::ResumeStatus::OK) {
+        std::cout << "[Accessory] Rejected RESUME_REQUEST ("
+                  << (status == protocol::ResumeStatus::BAD_MAC ? "bad MAC" : "unknown ticket")
+                  << ")" << std::endl;
+        common::secure_zero(ticket.session_key, sizeof(ticket.session_key));
+        response.status = static_cast<uint8_t>(status);
+        send_resume_response(response);
+        return false;
+    }
+    
+    // Stop whatever runs now; leaving for IDLE records where the audio
+    // stopped in the ticket, so read it again after
+    change_state(protocol::ConnectionState::IDLE);
+    tickets_.find(request.ticket_id, &ticket);
+    
+    response.status = static_cast<uint8_t>(protocol::ResumeStatus::OK);
+    Crypto::generate_random(response.nonce, sizeof(response.nonce));
+    response.accepted = ticket.params;
+    response.next_sequence = ticket.next_sequence;
+    common::resume_response_mac(ticket.session_key, request.nonce, response, response.mac);
+    
+    // The ticket moves on to the new key, so this request cannot be replayed
+    common::derive_resumed_key(ticket.session_key, request.nonce, response.nonce,
+                               ticket.session_key);
+    ticket.expires_us = protocol::get_timestamp_us() + protocol::TICKET_LIFETIME_S * 1000000ull;
+    tickets_.store(ticket);
+    
+    const protocol::ConnectPayload& params = ticket.params;
+    protocol::StreamFormat format;
+    if (!protocol::unpack_stream_format(params.channels, params.format, &format)) {
+        format = protocol::DEFAULT_STREAM_FORMAT;
+    }
+    audio_encoding_.store(static_cast<protocol::AudioEncoding>(params.encoding));
+    frame_samples_.store(params.frame_samples);
+    frames_per_packet_.store(params.frames_per_packet);
+    stream_format_.store(format);
+    host_decodes_codecs_.store(ticket.negotiated);
+    {
+        std::lock_guard<std::mutex> lock(key_mutex_);
+        memcpy(session_key_, ticket.session_key, sizeof(session_key_));
+        has_session_key_ = true;
+        memcpy(ticket_id_, ticket.id, sizeof(ticket_id_));
+        has_ticket_ = true;
+        resume_sequence_ = ticket.next_sequence;
+        resume_position_ = ticket.sample_position;
+    }
+    common::secure_zero(ticket.session_key, sizeof(ticket.session_key));
+    resumed_.store(true);
+    resumes_++;
+    
+    last_keepalive_time_ = protocol::get_timestamp_us();
     reconnect_attempts_ = 0;
     reconnect_delay_ms_ = protocol::RECONNECT_BASE_DELAY_MS;
+    send_resume_response(response);
+    std::cout << "[Accessory] Resumed session at sequence " << response.next_sequence << std::endl;
+    return true;
+}
+
+void ConnectionFSM::send_resume_response(const protocol::ResumeResponsePayload& response) {
+    protocol::Packet packet;
+    packet.set_type(protocol::PacketType::RESUME_RESPONSE);
+    packet.set_timestamp(protocol::get_timestamp_us());
+    packet.set_payload(&response, sizeof(response));
+    transport_->send_packet(packet);
 }
 
-void ConnectionFSM::send_connect_response() {
+void ConnectionFSM::set_resume_point(uint32_t next_sequence, uint64_t sample_position) {
+    uint8_t id[protocol::TICKET_ID_SIZE];
+    {
+        std::lock_guard<std::mutex> lock(key_mutex_);
+        if (!has_ticket_) {
+            return;
+        }
+        memcpy(id, ticket_id_, sizeof(id));
+    }
+    common::SessionTicket ticket;
+    if (tickets_.find(id, &ticket)) {
+        ticket.next_sequence = next_sequence;
+        ticket.sample_position = sample_position;
+        tickets_.store(ticket);
+        common::secure_zero(ticket.session_key, sizeof(ticket.session_key));
+    }
+}
+
+bool ConnectionFSM::get_resume_point(uint32_t* next_sequence, uint64_t* sample_position) const {
+    std::lock_guard<std::mutex> lock(key_mutex_);
+    *next_sequence = resume_sequence_;
+    *sample_position = resume_position_;
+    return resumed_.load();
+}
+
+void ConnectionFSM::send_connect_response(const protocol::ConnectPayload& accepted) {
     protocol::Packet response;
     response.set_type(protocol::PacketType::CONNECT_RESPONSE);
-    response.set_timestamp(static_cast<uint32_t>(protocol::get_timestamp_us()));
-    response.set_payload(nullptr, 0);
+    response.set_timestamp(protocol::get_timestamp_us());
+    response.set_payload(&accepted, sizeof(accepted));
     
     transport_->send_packet(response);
-    std::cout << "[Accessory] Sent CONNECT_RESPONSE" << std::endl;
+    std::cout << "[Accessory] Sent CONNECT_RESPONSE (audio: "
+              << protocol::audio_encoding_to_string(static_cast<protocol::AudioEncoding>(accepted.encoding))
+              << ", " << protocol::samples_to_us(accepted.frame_samples) / 1000.0 << "ms x "
+              << static_cast<int>(accepted.frames_per_packet) << ", "
+              << static_cast<int>(accepted.channels) << "ch)" << std::endl;
 }
 
 void ConnectionFSM::on_disconnect(const protocol::Packet& packet) {
     std::cout << "[Accessory] Received DISCONNECT" << std::endl;
-    transition_state(protocol::ConnectionState::DISCONNECTING);
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    transition_state(protocol::ConnectionState::IDLE);
+    post(FsmEventType::DISCONNECT, &packet);
+}
+
+bool ConnectionFSM::begin_disconnect() {
+    // DISCONNECTING settles into IDLE on a timer; requests in between are
+    // taken as from IDLE
+    scheduler_->cancel(disconnect_timer_);
+    disconnect_timer_ = scheduler_->schedule_after(DISCONNECT_SETTLE_MS * 1000ull, [this] {
+        post(FsmEventType::DISCONNECT_SETTLED);
+    });
+    return true;
 }
 
 void ConnectionFSM::on_keepalive(const protocol::Packet& packet) {
@@ -140,71 +730,93 @@ void ConnectionFSM::on_keepalive(const protocol::Packet& packet) {
     // Send keepalive response
     protocol::Packet response;
     response.set_type(protocol::PacketType::KEEPALIVE);
-    response.set_timestamp(static_cast<uint32_t>(protocol::get_timestamp_us()));
+    response.set_timestamp(protocol::get_timestamp_us());
     response.set_payload(nullptr, 0);
     transport_->send_packet(response);
 }
 
+void ConnectionFSM::on_time_sync_request(const protocol::Packet& packet) {
+    // Stamp arrival first; everything before the response is sent widens
+    // the measured round trip but cancels out of the offset estimate
+    uint64_t receive_us = protocol::get_timestamp_us();
+    
+    if (packet.header.payload_length < sizeof(protocol::TimeSyncPayload)) {
+        return;
+    }
+    
+    protocol::TimeSyncPayload sync;
+    memcpy(&sync, packet.payload, sizeof(sync));
+    sync.receive_us = receive_us;
+    
+    protocol::Packet response;
+    response.set_type(protocol::PacketType::TIME_SYNC_RESPONSE);
+    response.set_sequence(packet.header.sequence);
+    sync.transmit_us = protocol::get_timestamp_us();
+    response.set_timestamp(sync.transmit_us);
+    response.set_payload(&sync, sizeof(sync));
+    transport_->send_packet(response);
+}
+
 void ConnectionFSM::handle_connection_loss() {
-    std::cout << "[Accessory] Connection lost! Entering fast-reconnect mode" << std::endl;
-    transition_state(protocol::ConnectionState::ERROR);
-    attempt_reconnection();
+    post(FsmEventType::LINK_LOST);
 }
 
-void ConnectionFSM::attempt_reconnection() {
+bool ConnectionFSM::schedule_reconnect() {
+    std::cout << "[Accessory] Connection lost! Entering fast-reconnect mode" << std::endl;
     reconnect_attempts_++;
     
     std::cout << "[Accessory] Reconnection attempt #" << reconnect_attempts_
               << " (delay: " << reconnect_delay_ms_ << "ms)" << std::endl;
     
-    std::this_thread::sleep_for(std::chrono::milliseconds(reconnect_delay_ms_));
+    // ERROR -> IDLE when the backoff ends
+    scheduler_->cancel(reconnect_timer_);
+    reconnect_timer_ = scheduler_->schedule_after(reconnect_delay_ms_ * 1000ull, [this] {
+        post(FsmEventType::RECONNECT);
+    });
     
     // Exponential backoff
     reconnect_delay_ms_ = std::min(reconnect_delay_ms_ * 2,
                                    static_cast<uint32_t>(protocol::RECONNECT_MAX_DELAY_MS));
-    
-    transition_state(protocol::ConnectionState::IDLE);
+    return true;
+}
+
+void ConnectionFSM::enter_connected() {
+    post(FsmEventType::FORCE_CONNECTED);
 }
 
 void ConnectionFSM::enter_streaming() {
     std::cout << "[Accessory] Entering STREAMING state" << std::endl;
-    transition_state(protocol::ConnectionState::STREAMING);
+    post(FsmEventType::STREAM);
 }
 
-void ConnectionFSM::start_keepalive_thread() {
-    keepalive_running_.store(true);
-    keepalive_thread_ = std::thread(&ConnectionFSM::keepalive_loop, this);
+bool ConnectionFSM::start_timers() {
+    last_keepalive_time_ = protocol::get_timestamp_us();
+    scheduler_->cancel(keepalive_timer_);
+    keepalive_timer_ = scheduler_->schedule_periodic(
+        protocol::KEEPALIVE_INTERVAL_MS * 1000ull,
+        [this] { check_keepalive(); });
+    return true;
 }
 
-void ConnectionFSM::stop_keepalive_thread() {
-    keepalive_running_.store(false);
-    if (keepalive_thread_.joinable()) {
-        keepalive_thread_.join();
-    }
+bool ConnectionFSM::stop_timers() {
+    scheduler_->cancel(keepalive_timer_);
+    scheduler_->cancel(reconnect_timer_);
+    scheduler_->cancel(disconnect_timer_);
+    keepalive_timer_ = common::TimerWheel::INVALID_TIMER;
+    reconnect_timer_ = common::TimerWheel::INVALID_TIMER;
+    disconnect_timer_ = common::TimerWheel::INVALID_TIMER;
+    return true;
 }
 
-void ConnectionFSM::keepalive_loop() {
-    last_keepalive_time_ = protocol::get_timestamp_us();
-    
-    while (keepalive_running_.load()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(protocol::KEEPALIVE_INTERVAL_MS));
+void ConnectionFSM::check_keepalive() {
+    if (is_connected()) {
+        uint64_t now = protocol::get_timestamp_us();
+        uint64_t elapsed_ms = (now - last_keepalive_time_) / 1000;
         
-        if (is_connected()) {
-            uint64_t now = protocol::get_timestamp_us();
-            uint64_t elapsed_ms = (now - last_keepalive_time_) / 1000;
-            
-            if (elapsed_ms > protocol::CONNECTION_TIMEOUT_MS) {
-                handle_connection_loss();
-            }
+        if (elapsed_ms > protocol::CONNECTION_TIMEOUT_MS) {
+            post(FsmEventType::LINK_LOST);
         }
     }
 }
 
-void ConnectionFSM::enter_discovering() { transition_state(protocol::ConnectionState::DISCOVERING); }
-void ConnectionFSM::enter_pairing() { transition_state(protocol::ConnectionState::PAIRING); }
-void ConnectionFSM::enter_connected() { transition_state(protocol::ConnectionState::CONNECTED); }
-void ConnectionFSM::enter_disconnecting() { transition_state(protocol::ConnectionState::DISCONNECTING); }
-void ConnectionFSM::enter_idle() { transition_state(protocol::ConnectionState::IDLE); }
-void ConnectionFSM::enter_error() { transition_state(protocol::ConnectionState::ERROR); }
-
 } // namespace accessory
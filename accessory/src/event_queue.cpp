@@ -0,0 +1,71 @@
+#include "accessory/event_queue.h"
+
+namespace accessory {
+
+namespace {
+
+size_t round_up_pow2(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+} // namespace
+
+EventQueue::EventQueue(size_t capacity)
+    : slots_(new Slot[round_up_pow2(capacity > 0 ? capacity : 1)])
+    , mask_(round_up_pow2(capacity > 0 ? capacity : 1) - 1)
+    , head_(0)
+    , tail_(0) {
+
+    // Slot i is free for the producer claiming position i
+    for (size_t i = 0; i <= mask_; i++) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool EventQueue::push(const FsmEvent& event) {
+    size_t position = tail_.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &slots_[position & mask_];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        auto lag = static_cast<std::ptrdiff_t>(sequence - position);
+        if (lag == 0) {
+            if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (lag < 0) {
+            return false;   // The consumer has not freed it yet: full
+        } else {
+            position = tail_.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->event = event;
+    slot->sequence.store(position + 1, std::memory_order_seq_cst);
+    return true;
+}
+
+bool EventQueue::pop(FsmEvent* event) {
+    size_t position = head_.load(std::memory_order_relaxed);
+    Slot& slot = slots_[position & mask_];
+    if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+        return false;
+    }
+
+    *event = slot.event;
+    // Free for the producer one lap later
+    slot.sequence.store(position + mask_ + 1, std::memory_order_release);
+    head_.store(position + 1, std::memory_order_relaxed);
+    return true;
+}
+
+bool EventQueue::has_pending() const {
+    size_t position = head_.load(std::memory_order_relaxed);
+    return slots_[position & mask_].sequence.load(std::memory_order_seq_cst) == position + 1;
+}
+
+} // namespace accessory
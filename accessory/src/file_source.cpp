@@ -0,0 +1,480 @@
+#include "accessory/file_source.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FILE_SOURCE_X86_DISPATCH 1
+#endif
+
+namespace accessory {
+
+namespace {
+
+// Input samples converted per resampler pass
+constexpr size_t RESAMPLE_WINDOW = 4096;
+
+// WAVE format tags
+constexpr uint16_t WAVE_FORMAT_PCM = 1;
+constexpr uint16_t WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+uint16_t read_le16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t read_le32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+bool ends_with(const std::string& text, const char* suffix) {
+    size_t length = strlen(suffix);
+    if (text.size() < length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        char c = text[text.size() - length + i];
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+        if (c != suffix[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool valid_format(const PcmFormat& format) {
+    return format.sample_rate > 0 && (format.channels == 1 || format.channels == 2) &&
+           (format.bits_per_sample == 16 || format.bits_per_sample == 24);
+}
+
+int16_t sample16(const uint8_t* p) {
+    return static_cast<int16_t>(read_le16(p));
+}
+
+int16_t top16(const uint8_t* p) {
+    return static_cast<int16_t>(p[1] | (p[2] << 8));
+}
+
+void convert_scalar(const uint8_t* src, const PcmFormat& format, size_t frames, int16_t* out) {
+    size_t bytes = format.bits_per_sample / 8;
+    for (size_t i = 0; i < frames; i++) {
+        const uint8_t* frame = src + i * bytes * format.channels;
+        int32_t left = bytes == 2 ? sample16(frame) : top16(frame);
+        if (format.channels == 2) {
+            int32_t right = bytes == 2 ? sample16(frame + bytes) : top16(frame + bytes);
+            left = (left + right) >> 1;
+        }
+        out[i] = static_cast<int16_t>(left);
+    }
+}
+
+#if defined(__SSE2__)
+// Stereo 16-bit, eight frames at a time: (L + R) >> 1 via PMADDWD
+size_t downmix16_sse2(const uint8_t* src, size_t frames, int16_t* out) {
+    const __m128i ones = _mm_set1_epi16(1);
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4 + 16));
+        __m128i sum_a = _mm_srai_epi32(_mm_madd_epi16(a, ones), 1);
+        __m128i sum_b = _mm_srai_epi32(_mm_madd_epi16(b, ones), 1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(sum_a, sum_b));
+    }
+    return i;
+}
+#endif
+
+#if defined(FILE_SOURCE_X86_DISPATCH)
+// Top 16 bits of eight packed 24-bit samples (24 bytes), two PSHUFBs over
+// overlapping loads so nothing past the group is read
+__attribute__((target("ssse3")))
+__m128i extract24_ssse3(const uint8_t* src) {
+    const __m128i low_mask = _mm_setr_epi8(1, 2, 4, 5, 7, 8, 10, 11,
+                                           -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i high_mask = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+                                            5, 6, 8, 9, 11, 12, 14, 15);
+    __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 8));
+    return _mm_or_si128(_mm_shuffle_epi8(low, low_mask), _mm_shuffle_epi8(high, high_mask));
+}
+
+__attribute__((target("ssse3")))
+size_t convert24_ssse3(const uint8_t* src, uint16_t channels, size_t frames, int16_t* out) {
+    size_t i = 0;
+    if (channels == 1) {
+        for (; i + 8 <= frames; i += 8) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), extract24_ssse3(src + i * 3));
+        }
+        return i;
+    }
+    const __m128i ones = _mm_set1_epi16(1);
+    for (; i + 8 <= frames; i += 8) {
+        __m128i a = extract24_ssse3(src + i * 6);
+        __m128i b = extract24_ssse3(src + i * 6 + 24);
+        __m128i sum_a = _mm_srai_epi32(_mm_madd_epi16(a, ones), 1);
+        __m128i sum_b = _mm_srai_epi32(_mm_madd_epi16(b, ones), 1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(sum_a, sum_b));
+    }
+    return i;
+}
+
+bool has_ssse3() {
+    static const bool supported = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("ssse3") != 0;
+    }();
+    return supported;
+}
+#endif
+
+} // namespace
+
+void convert_to_mono16(const uint8_t* src, const PcmFormat& format, size_t frames, int16_t* out) {
+    size_t done = 0;
+    if (format.bits_per_sample == 16) {
+        if (format.channels == 1) {
+            memcpy(out, src, frames * sizeof(int16_t));
+            return;
+        }
+#if defined(__SSE2__)
+        done = downmix16_sse2(src, frames, out);
+#endif
+    } else {
+#if defined(FILE_SOURCE_X86_DISPATCH)
+        if (has_ssse3()) {
+            done = convert24_ssse3(src, format.channels, frames, out);
+        }
+#endif
+    }
+    size_t frame_bytes = static_cast<size_t>(format.bits_per_sample / 8) * format.channels;
+    convert_scalar(src + done * frame_bytes, format, frames - done, out + done);
+}
+
+// ---------------------------------------------------------------------------
+// AudioFile
+
+AudioFile::AudioFile()
+    : map_(nullptr)
+    , map_size_(0)
+    , data_(nullptr)
+    , frames_(0)
+    , frame_bytes_(0) {
+
+    memset(&format_, 0, sizeof(format_));
+}
+
+AudioFile::~AudioFile() {
+    close();
+}
+
+bool AudioFile::open(const std::string& path, const PcmFormat& raw_format) {
+    close();
+    path_ = path;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "[Accessory] Cannot open audio file " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        std::cout << "[Accessory] Empty audio file " << path << std::endl;
+        return false;
+    }
+    map_size_ = static_cast<size_t>(st.st_size);
+    map_ = mmap(nullptr, map_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);    // The mapping keeps the file
+    if (map_ == MAP_FAILED) {
+        map_ = nullptr;
+        std::cout << "[Accessory] Cannot map audio file " << path << std::endl;
+        return false;
+    }
+    madvise(map_, map_size_, MADV_SEQUENTIAL);
+
+    const uint8_t* base = static_cast<const uint8_t*>(map_);
+    if (ends_with(path, ".wav")) {
+        if (!parse_wav()) {
+            std::cout << "[Accessory] Unsupported WAV file " << path
+                      << " (16/24-bit PCM, mono or stereo)" << std::endl;
+            close();
+            return false;
+        }
+    } else {
+        if (!valid_format(raw_format)) {
+            close();
+            return false;
+        }
+        format_ = raw_format;
+        data_ = base;
+        frame_bytes_ = static_cast<size_t>(format_.bits_per_sample / 8) * format_.channels;
+        frames_ = map_size_ / frame_bytes_;
+    }
+    if (frames_ == 0) {
+        std::cout << "[Accessory] No audio in " << path << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool AudioFile::parse_wav() {
+    const uint8_t* base = static_cast<const uint8_t*>(map_);
+    if (map_size_ < 12 || memcmp(base, "RIFF", 4) != 0 || memcmp(base + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    // Walk the chunks; only their headers are touched
+    bool have_format = false;
+    size_t offset = 12;
+    while (offset + 8 <= map_size_) {
+        const uint8_t* chunk = base + offset;
+        size_t size = read_le32(chunk + 4);
+        const uint8_t* body = chunk + 8;
+        size_t available = map_size_ - offset - 8;
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16 && size <= available) {
+            uint16_t tag = read_le16(body);
+            if (tag == WAVE_FORMAT_EXTENSIBLE && size >= 40) {
+                tag = read_le16(body + 24);     // Sub-format GUID starts with the tag
+            }
+            if (tag != WAVE_FORMAT_PCM) {
+                return false;
+            }
+            format_.channels = read_le16(body + 2);
+            format_.sample_rate = read_le32(body + 4);
+            format_.bits_per_sample = read_le16(body + 14);
+            if (!valid_format(format_)) {
+                return false;
+            }
+            frame_bytes_ = static_cast<size_t>(format_.bits_per_sample / 8) * format_.channels;
+            have_format = true;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!have_format) {
+                return false;
+            }
+            // Streaming writers leave the size unset; take the rest of the file
+            data_ = body;
+            frames_ = std::min(size, available) / frame_bytes_;
+            return true;
+        }
+        offset += 8 + size + (size & 1);    // Chunks are word aligned
+    }
+    return false;
+}
+
+void AudioFile::close() {
+    if (map_) {
+        munmap(map_, map_size_);
+    }
+    map_ = nullptr;
+    map_size_ = 0;
+    data_ = nullptr;
+    frames_ = 0;
+}
+
+// ---------------------------------------------------------------------------
+// FileSource
+
+FileSource::FileSource()
+    : raw_format_(DEFAULT_RAW_FORMAT)
+    , sample_rate_(DEFAULT_RAW_FORMAT.sample_rate)
+    , loop_(true)
+    , index_(0)
+    , position_(0)
+    , native_(false)
+    , step_(0)
+    , phase_(0)
+    , carry_(0)
+    , window_(RESAMPLE_WINDOW + 1) {
+}
+
+FileSource::~FileSource() = default;
+
+bool FileSource::open(const std::vector<std::string>& paths, uint32_t sample_rate) {
+    paths_.clear();
+    file_.reset();
+    sample_rate_ = sample_rate;
+
+    for (const std::string& path : paths) {
+        if (!ends_with(path, ".m3u") && !ends_with(path, ".txt")) {
+            paths_.push_back(path);
+            continue;
+        }
+        std::ifstream playlist(path);
+        if (!playlist.is_open()) {
+            std::cout << "[Accessory] Cannot open playlist " << path << std::endl;
+            continue;
+        }
+        size_t slash = path.find_last_of('/');
+        std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+        std::string line;
+        while (std::getline(playlist, line)) {
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+                line.pop_back();
+            }
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            paths_.push_back(line[0] == '/' ? line : directory + line);
+        }
+    }
+
+    // Only the first playable file is opened now; the rest as they come up
+    for (size_t i = 0; i < paths_.size(); i++) {
+        if (open_file(i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FileSource::rewind() {
+    file_.reset();
+    for (size_t i = 0; i < paths_.size(); i++) {
+        if (open_file(i)) {
+            return;
+        }
+    }
+}
+
+const char* FileSource::current_path() const {
+    return file_ ? file_->path().c_str() : "";
+}
+
+bool FileSource::open_file(size_t index) {
+    std::unique_ptr<AudioFile> file(new AudioFile());
+    if (!file->open(paths_[index], raw_format_)) {
+        return false;
+    }
+    const PcmFormat& format = file->format();
+    file_ = std::move(file);
+    index_ = index;
+    position_ = 0;
+    reset_resampler();
+
+    std::cout << "[Accessory] Playing " << file_->path() << " (" << format.sample_rate << "Hz, "
+              << format.channels << "ch, " << format.bits_per_sample << "-bit, "
+              << file_->frames() / format.sample_rate << "s)" << std::endl;
+    return true;
+}
+
+void FileSource::set_sample_rate(uint32_t sample_rate) {
+    if (sample_rate == sample_rate_) {
+        return;
+    }
+    sample_rate_ = sample_rate;
+    if (file_) {
+        reset_resampler();
+    }
+}
+
+void FileSource::reset_resampler() {
+    const PcmFormat& format = file_->format();
+    native_ = format.channels == 1 && format.bits_per_sample == 16 &&
+              format.sample_rate == sample_rate_;
+    step_ = (static_cast<uint64_t>(format.sample_rate) << 32) / sample_rate_;
+    phase_ = 1ull << 32;    // First output lands on the first input sample
+    carry_ = 0;
+}
+
+bool FileSource::advance() {
+    // Next playable file, wrapping when looping; gives up after one round
+    for (size_t tried = 0; tried < paths_.size(); tried++) {
+        size_t next = index_ + 1 + tried;
+        if (next >= paths_.size()) {
+            if (!loop_) {
+                break;
+            }
+            next %= paths_.size();
+        }
+        if (next == index_ && file_) {
+            // Looping a single file: keep the mapping
+            position_ = 0;
+            phase_ = 1ull << 32;
+            carry_ = 0;
+            return true;
+        }
+        if (open_file(next)) {
+            return true;
+        }
+    }
+    file_.reset();
+    return false;
+}
+
+const int16_t* FileSource::read(int16_t* scratch, size_t num_samples) {
+    // Straight from the mapping when nothing needs converting
+    if (file_ && native_ && position_ + num_samples <= file_->frames()) {
+        const int16_t* samples = reinterpret_cast<const int16_t*>(file_->frame(position_));
+        position_ += num_samples;
+        return samples;
+    }
+
+    size_t done = 0;
+    while (done < num_samples && file_) {
+        done += render_file(scratch + done, num_samples - done);
+        if (done < num_samples && !advance()) {
+            break;
+        }
+    }
+    std::fill(scratch + done, scratch + num_samples, 0);
+    return scratch;
+}
+
+size_t FileSource::render_file(int16_t* out, size_t num_samples) {
+    const PcmFormat& format = file_->format();
+    if (format.sample_rate != sample_rate_) {
+        return resample(out, num_samples);
+    }
+    size_t count = std::min(num_samples, file_->frames() - position_);
+    convert_to_mono16(file_->frame(position_), format, count, out);
+    position_ += count;
+    return count;
+}
+
+size_t FileSource::resample(int16_t* out, size_t num_samples) {
+    const PcmFormat& format = file_->format();
+    size_t produced = 0;
+    while (produced < num_samples && position_ < file_->frames()) {
+        // Convert the input the rest of the request needs (window[0] is the
+        // carried sample, window[k] input position_ + k - 1)
+        uint64_t last = (phase_ + (num_samples - produced - 1) * step_) >> 32;
+        size_t count = static_cast<size_t>(std::min<uint64_t>(last + 1, RESAMPLE_WINDOW));
+        count = std::min(count, file_->frames() - position_);
+        window_[0] = carry_;
+        convert_to_mono16(file_->frame(position_), format, count, &window_[1]);
+
+        while (produced < num_samples) {
+            uint64_t index = phase_ >> 32;
+            if (index + 1 > count) {
+                break;
+            }
+            int32_t a = window_[index];
+            int32_t b = window_[index + 1];
+            int32_t fraction = static_cast<int32_t>((phase_ >> 17) & 0x7FFF);
+            out[produced++] = static_cast<int16_t>(a + (((b - a) * fraction) >> 15));
+            phase_ += step_;
+        }
+
+        size_t consumed = static_cast<size_t>(std::min<uint64_t>(phase_ >> 32, count));
+        carry_ = window_[consumed];
+        phase_ -= static_cast<uint64_t>(consumed) << 32;
+        position_ += consumed;
+    }
+    return produced;
+}
+
+} // namespace accessory
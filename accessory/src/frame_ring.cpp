@@ -0,0 +1,57 @@
+#include "accessory/frame_ring.h"
+
+namespace accessory {
+
+namespace {
+
+size_t round_up_pow2(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+} // namespace
+
+FrameRing::FrameRing(size_t capacity)
+    : slots_(round_up_pow2(capacity > 0 ? capacity : 1))
+    , mask_(slots_.size() - 1)
+    , head_(0)
+    , tail_(0) {
+}
+
+void FrameRing::clear() {
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
+}
+
+size_t FrameRing::size() const {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+}
+
+FrameRing::Frame* FrameRing::claim() {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+        return nullptr;
+    }
+    return &slots_[tail & mask_];
+}
+
+void FrameRing::publish() {
+    tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+const FrameRing::Frame* FrameRing::peek() const {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    return &slots_[head & mask_];
+}
+
+void FrameRing::release() {
+    head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+} // namespace accessory
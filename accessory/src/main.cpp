@@ -2,11 +2,17 @@
 #include "accessory/audio_streamer.h"
 #include "accessory/telemetry.h"
 #include "accessory/transport.h"
+#include "accessory/file_source.h"
+#include "timer_wheel.h"
+#include "pacer.h"
 #include <iostream>
 #include <csignal>
+#include <cstdlib>
 #include <atomic>
 #include <thread>
 #include <chrono>
+#include <string>
+#include <vector>
 
 std::atomic<bool> g_running(true);
 
@@ -15,7 +21,31 @@ void signal_handler(int signal) {
     g_running.store(false);
 }
 
-int main() {
+int main(int argc, char** argv) {
+    // Optional audio files or playlists instead of the test tone
+    std::vector<std::string> audio_files;
+    bool loop_audio = true;
+    common::PacerStrategy pacer = common::PacerStrategy::SLEEP;
+    uint32_t spin_us = common::Pacer::DEFAULT_SPIN_US;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = (i + 1 < argc);
+        if (arg == "--audio-file" && has_value) {
+            audio_files.push_back(argv[++i]);
+        } else if (arg == "--no-loop") {
+            loop_audio = false;
+        } else if (arg == "--pacer" && has_value &&
+                   common::pacer_strategy_from_string(argv[i + 1], &pacer)) {
+            i++;
+        } else if (arg == "--spin-us" && has_value) {
+            spin_us = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--audio-file PATH]... [--no-loop]"
+                      << " [--pacer sleep|spin|nanosleep|timerfd] [--spin-us US]" << std::endl;
+            return 1;
+        }
+    }
+    
     std::cout << "=== Wireless Audio Accessory Simulator ===" << std::endl;
     std::cout << "Simulating AirPods-like accessory behavior" << std::endl;
     std::cout << "==========================================\n" << std::endl;
@@ -24,6 +54,11 @@ int main() {
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
     
+    // Shared scheduler for all periodic work (audio, telemetry, keepalive)
+    common::TimerWheel scheduler;
+    scheduler.set_pacer(pacer, spin_us);
+    scheduler.start();
+    
     // Create transport layer
     accessory::Transport transport;
     if (!transport.start(8888)) {
@@ -32,13 +67,24 @@ int main() {
     }
     
     // Create connection FSM
-    accessory::ConnectionFSM connection_fsm(&transport);
+    accessory::ConnectionFSM connection_fsm(&transport, &scheduler);
     
-    // Create audio streamer
-    accessory::AudioStreamer audio_streamer(&transport);
+    // Create audio streamer (the file source outlives it)
+    accessory::FileSource file_source;
+    accessory::AudioStreamer audio_streamer(&transport, &scheduler);
+    if (!audio_files.empty()) {
+        file_source.set_loop(loop_audio);
+        if (!file_source.open(audio_files, protocol::AUDIO_SAMPLE_RATE)) {
+            std::cerr << "[Accessory] No playable audio file" << std::endl;
+            return 1;
+        }
+        audio_streamer.set_file_source(&file_source);
+    }
     
     // Create telemetry
-    accessory::Telemetry telemetry(&transport);
+    accessory::Telemetry telemetry(&transport, &scheduler);
+    telemetry.set_audio_streamer(&audio_streamer);
+    audio_streamer.set_telemetry(&telemetry);
     
     // Set up packet routing
     transport.set_packet_callback([&](const protocol::Packet& packet) {
@@ -55,6 +101,10 @@ int main() {
                 connection_fsm.on_connect_request(packet);
                 break;
                 
+            case protocol::PacketType::RESUME_REQUEST:
+                connection_fsm.on_resume_request(packet);
+                break;
+                
             case protocol::PacketType::DISCONNECT:
                 connection_fsm.on_disconnect(packet);
                 audio_streamer.stop_streaming();
@@ -64,6 +114,22 @@ int main() {
                 connection_fsm.on_keepalive(packet);
                 break;
                 
+            case protocol::PacketType::TIME_SYNC_REQUEST:
+                connection_fsm.on_time_sync_request(packet);
+                break;
+                
+            case protocol::PacketType::AUDIO_RETRANSMIT:
+                audio_streamer.on_retransmit_request(packet);
+                break;
+                
+            case protocol::PacketType::AUDIO_ACK:
+                audio_streamer.on_ack(packet);
+                break;
+                
+            case protocol::PacketType::AUDIO_FEC_CONFIG:
+                audio_streamer.on_fec_config(packet);
+                break;
+                
             default:
                 break;
         }
@@ -73,21 +139,32 @@ int main() {
     connection_fsm.set_state_change_callback([&](protocol::ConnectionState old_state,
                                                   protocol::ConnectionState new_state) {
         if (new_state == protocol::ConnectionState::CONNECTED) {
-            // Start telemetry when connected
+            // Start telemetry when connected and stream straight away: the
+            // CONNECT_RESPONSE is already on its way
             telemetry.start();
-            
-            // Auto-transition to streaming after a brief delay
-            std::thread([&]() {
-                std::this_thread::sleep_for(std::chrono::milliseconds(500));
-                if (connection_fsm.get_state() == protocol::ConnectionState::CONNECTED) {
-                    connection_fsm.enter_streaming();
-                    audio_streamer.start_streaming();
-                }
-            }).detach();
-        } else if (new_state == protocol::ConnectionState::IDLE ||
-                   new_state == protocol::ConnectionState::DISCONNECTING) {
-            // Stop streaming and telemetry when disconnected
+            connection_fsm.enter_streaming();
+        } else if (new_state == protocol::ConnectionState::STREAMING) {
+            audio_streamer.set_stream_format(connection_fsm.get_stream_format());
+            audio_streamer.set_encoding(connection_fsm.get_audio_encoding());
+            audio_streamer.set_frame_format(connection_fsm.get_frame_samples(),
+                                            connection_fsm.get_frames_per_packet());
+            uint8_t key[protocol::SESSION_KEY_SIZE];
+            audio_streamer.set_session_key(connection_fsm.get_session_key(key) ? key : nullptr);
+            audio_streamer.set_rate_control(true, connection_fsm.host_decodes_codecs()
+                ? protocol::AudioEncoding::IMA_ADPCM : protocol::AudioEncoding::PCM16);
+            uint32_t sequence;
+            uint64_t position;
+            if (connection_fsm.get_resume_point(&sequence, &position)) {
+                audio_streamer.set_resume_point(sequence, position);
+            }
+            audio_streamer.start_streaming();
+        } else if (old_state == protocol::ConnectionState::CONNECTED ||
+                   old_state == protocol::ConnectionState::STREAMING) {
+            // Stop streaming and telemetry when disconnected, remembering
+            // where the audio stopped for a resume
             audio_streamer.stop_streaming();
+            connection_fsm.set_resume_point(audio_streamer.get_next_sequence(),
+                                            audio_streamer.get_sample_position());
             telemetry.stop();
         }
     });
@@ -121,7 +198,19 @@ int main() {
     telemetry.stop();
     connection_fsm.stop();
     transport.stop();
+    scheduler.stop();
     
+    common::Pacer::Stats pacer_stats = scheduler.get_pacer_stats();
+    common::TimingHistogram dispatch = scheduler.get_dispatch_histogram();
+    std::cout << "[Accessory] Timing (" << common::pacer_strategy_to_string(pacer)
+              << "): tick wake error p50 " << pacer_stats.wake_error.percentile_us(0.5)
+              << "us, p99 " << pacer_stats.wake_error.percentile_us(0.99) << "us, "
+              << pacer_stats.ticks_skipped << " late ticks; dispatch error p99 "
+              << dispatch.percentile_us(0.99) << "us, max " << dispatch.max_us() << "us" << std::endl;
+    accessory::ConnectionFSM::Stats fsm_stats = connection_fsm.get_stats();
+    std::cout << "[Accessory] Connection FSM: " << fsm_stats.events << " events, "
+              << fsm_stats.ignored << " ignored, " << fsm_stats.dropped << " dropped; max queue delay "
+              << fsm_stats.max_queue_us << "us" << std::endl;
     std::cout << "[Accessory] Shutdown complete" << std::endl;
     return 0;
 }
@@ -0,0 +1,341 @@
+#include "accessory/oscillator.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace accessory {
+
+namespace {
+
+constexpr float PHASE_SCALE = 1.0f / 4294967296.0f;     // 2^-32
+constexpr float NOISE_SCALE = 1.0f / 2147483648.0f;     // 2^-31
+constexpr double TWO_PI = 2.0 * M_PI;
+constexpr size_t SCRATCH_BLOCKS = 64;
+
+} // namespace
+
+const char* waveform_to_string(Waveform waveform) {
+    switch (waveform) {
+        case Waveform::SINE: return "sine";
+        case Waveform::SQUARE: return "square";
+        case Waveform::TRIANGLE: return "triangle";
+        case Waveform::SAWTOOTH: return "sawtooth";
+        case Waveform::MULTI_TONE: return "multitone";
+        case Waveform::NOISE: return "noise";
+        case Waveform::SILENCE: return "silence";
+        default: return "unknown";
+    }
+}
+
+bool waveform_from_string(const char* name, Waveform* waveform) {
+    const Waveform all[] = {
+        Waveform::SINE, Waveform::SQUARE, Waveform::TRIANGLE, Waveform::SAWTOOTH,
+        Waveform::MULTI_TONE, Waveform::NOISE, Waveform::SILENCE
+    };
+    for (Waveform w : all) {
+        if (strcmp(name, waveform_to_string(w)) == 0) {
+            *waveform = w;
+            return true;
+        }
+    }
+    return false;
+}
+
+Oscillator::Oscillator()
+    : waveform_(Waveform::SINE)
+    , amplitude_(16000.0f)
+    , tone_count_(0)
+    , phase_step_(0)
+    , pending_offset_(LANES) {
+
+    memset(re_, 0, sizeof(re_));
+    memset(im_, 0, sizeof(im_));
+    memset(lane_re_, 0, sizeof(lane_re_));
+    memset(lane_im_, 0, sizeof(lane_im_));
+    memset(step_re_, 0, sizeof(step_re_));
+    memset(step_im_, 0, sizeof(step_im_));
+    memset(tone_phase_, 0, sizeof(tone_phase_));
+    memset(tone_increment_, 0, sizeof(tone_increment_));
+    memset(phase_, 0, sizeof(phase_));
+    memset(pending_, 0, sizeof(pending_));
+    set_seed(1);
+    set_waveform(Waveform::SINE, 440.0, 48000);
+}
+
+void Oscillator::set_waveform(Waveform waveform, double frequency_hz, uint32_t sample_rate) {
+    if (waveform == Waveform::MULTI_TONE) {
+        // Major chord with octave
+        const double chord[MAX_TONES] = {
+            frequency_hz, frequency_hz * 5.0 / 4.0, frequency_hz * 3.0 / 2.0, frequency_hz * 2.0
+        };
+        set_tones(chord, MAX_TONES, sample_rate);
+        return;
+    }
+
+    set_tones(&frequency_hz, 1, sample_rate);
+    waveform_ = waveform;
+}
+
+void Oscillator::set_tones(const double* frequencies_hz, size_t count, uint32_t sample_rate) {
+    waveform_ = Waveform::MULTI_TONE;
+    tone_count_ = std::min(count, MAX_TONES);
+
+    for (size_t t = 0; t < tone_count_; t++) {
+        double cycles = frequencies_hz[t] / sample_rate;
+        double w = TWO_PI * cycles;
+        for (size_t k = 0; k < TONE_LANES; k++) {
+            lane_re_[t][k] = std::cos(w * k);
+            lane_im_[t][k] = std::sin(w * k);
+        }
+        step_re_[t] = static_cast<float>(std::cos(w * TONE_LANES));
+        step_im_[t] = static_cast<float>(std::sin(w * TONE_LANES));
+
+        // Cycles per sample as a 0.64 fixed-point fraction
+        double fraction = cycles - std::floor(cycles);
+        tone_increment_[t] = static_cast<uint64_t>(std::ldexp(fraction, 63)) << 1;
+        tone_phase_[t] = 0;
+    }
+
+    // Phase accumulator follows the first tone
+    uint32_t increment = tone_count_ > 0 ? static_cast<uint32_t>(tone_increment_[0] >> 32) : 0;
+    for (size_t k = 0; k < LANES; k++) {
+        phase_[k] = increment * static_cast<uint32_t>(k);
+    }
+    phase_step_ = increment * static_cast<uint32_t>(LANES);
+
+    pending_offset_ = LANES;
+}
+
+void Oscillator::set_seed(uint32_t seed) {
+    // splitmix-style scramble so adjacent seeds give unrelated lanes
+    for (size_t k = 0; k < LANES; k++) {
+        uint32_t x = seed * 0x9E3779B9u + static_cast<uint32_t>(k + 1) * 0x85EBCA6Bu;
+        x ^= x >> 16;
+        x *= 0x7FEB352Du;
+        x ^= x >> 15;
+        noise_[k] = x != 0 ? x : 0x6D2B79F5u;  // xorshift must not start at 0
+    }
+}
+
+void Oscillator::render(int16_t* samples, size_t num_samples) {
+    render<protocol::SampleFormat::INT16>(samples, num_samples, 1);
+}
+
+template <protocol::SampleFormat F>
+void Oscillator::render(typename common::SampleTraits<F>::Type* out, size_t frames,
+                        size_t channels) {
+    using Traits = common::SampleTraits<F>;
+    size_t i = 0;
+
+    // Leftover samples from the previous call keep the signal continuous
+    while (i < frames && pending_offset_ < LANES) {
+        typename Traits::Type value = Traits::from_float(pending_[pending_offset_++]);
+        for (size_t c = 0; c < channels; c++) {
+            out[i * channels + c] = value;
+        }
+        i++;
+    }
+
+    if (waveform_ == Waveform::SINE || waveform_ == Waveform::MULTI_TONE) {
+        resync_tones();
+    }
+
+    alignas(16) float scratch[SCRATCH_BLOCKS * LANES];
+    while (frames - i >= LANES) {
+        size_t blocks = std::min((frames - i) / LANES, SCRATCH_BLOCKS);
+        render_blocks(scratch, blocks);
+        common::samples_from_float<F>(scratch, blocks * LANES, channels, out + i * channels);
+        i += blocks * LANES;
+    }
+
+    if (i < frames) {
+        render_blocks(pending_, 1);
+        pending_offset_ = 0;
+        while (i < frames) {
+            typename Traits::Type value = Traits::from_float(pending_[pending_offset_++]);
+            for (size_t c = 0; c < channels; c++) {
+                out[i * channels + c] = value;
+            }
+            i++;
+        }
+    }
+}
+
+template void Oscillator::render<protocol::SampleFormat::INT16>(int16_t*, size_t, size_t);
+template void Oscillator::render<protocol::SampleFormat::INT24>(int32_t*, size_t, size_t);
+template void Oscillator::render<protocol::SampleFormat::FLOAT32>(float*, size_t, size_t);
+
+void Oscillator::resync_tones() {
+    // Two transcendental calls per tone per render(); everything else is
+    // a complex multiply
+    for (size_t t = 0; t < tone_count_; t++) {
+        double angle = std::ldexp(static_cast<double>(tone_phase_[t] >> 11), -53) * TWO_PI;
+        double c = std::cos(angle);
+        double s = std::sin(angle);
+        for (size_t k = 0; k < TONE_LANES; k++) {
+            re_[t][k] = static_cast<float>(c * lane_re_[t][k] - s * lane_im_[t][k]);
+            im_[t][k] = static_cast<float>(s * lane_re_[t][k] + c * lane_im_[t][k]);
+        }
+    }
+}
+
+void Oscillator::render_blocks(float* out, size_t blocks) {
+    float gain = amplitude_;
+    if (waveform_ == Waveform::MULTI_TONE && tone_count_ > 0) {
+        gain /= static_cast<float>(tone_count_);
+    }
+
+    switch (waveform_) {
+        case Waveform::SINE:
+        case Waveform::MULTI_TONE:
+            for (size_t t = 0; t < tone_count_; t++) {
+                // First tone stores, the rest accumulate
+                const bool accumulate = t > 0;
+#if defined(__SSE2__)
+                // a = samples n..n+3, b = n+4..n+7
+                __m128 a_re = _mm_load_ps(re_[t]);
+                __m128 a_im = _mm_load_ps(im_[t]);
+                __m128 b_re = _mm_load_ps(re_[t] + LANES);
+                __m128 b_im = _mm_load_ps(im_[t] + LANES);
+                const __m128 c = _mm_set1_ps(step_re_[t]);
+                const __m128 s = _mm_set1_ps(step_im_[t]);
+                const __m128 g = _mm_set1_ps(gain);
+                size_t b = 0;
+                for (; b + 2 <= blocks; b += 2) {
+                    __m128 a_value = _mm_mul_ps(a_im, g);
+                    __m128 b_value = _mm_mul_ps(b_im, g);
+                    if (accumulate) {
+                        a_value = _mm_add_ps(a_value, _mm_load_ps(out + b * LANES));
+                        b_value = _mm_add_ps(b_value, _mm_load_ps(out + (b + 1) * LANES));
+                    }
+                    _mm_store_ps(out + b * LANES, a_value);
+                    _mm_store_ps(out + (b + 1) * LANES, b_value);
+                    __m128 next_re = _mm_sub_ps(_mm_mul_ps(a_re, c), _mm_mul_ps(a_im, s));
+                    a_im = _mm_add_ps(_mm_mul_ps(a_re, s), _mm_mul_ps(a_im, c));
+                    a_re = next_re;
+                    next_re = _mm_sub_ps(_mm_mul_ps(b_re, c), _mm_mul_ps(b_im, s));
+                    b_im = _mm_add_ps(_mm_mul_ps(b_re, s), _mm_mul_ps(b_im, c));
+                    b_re = next_re;
+                }
+                if (b < blocks) {
+                    // Odd block: emit a, then b moves up and a rotates past it
+                    __m128 a_value = _mm_mul_ps(a_im, g);
+                    if (accumulate) {
+                        a_value = _mm_add_ps(a_value, _mm_load_ps(out + b * LANES));
+                    }
+                    _mm_store_ps(out + b * LANES, a_value);
+                    __m128 next_re = _mm_sub_ps(_mm_mul_ps(a_re, c), _mm_mul_ps(a_im, s));
+                    __m128 next_im = _mm_add_ps(_mm_mul_ps(a_re, s), _mm_mul_ps(a_im, c));
+                    a_re = b_re;
+                    a_im = b_im;
+                    b_re = next_re;
+                    b_im = next_im;
+                }
+                _mm_store_ps(re_[t], a_re);
+                _mm_store_ps(im_[t], a_im);
+                _mm_store_ps(re_[t] + LANES, b_re);
+                _mm_store_ps(im_[t] + LANES, b_im);
+#else
+                for (size_t b = 0; b < blocks; b++) {
+                    for (size_t k = 0; k < LANES; k++) {
+                        float value = im_[t][k] * gain;
+                        out[b * LANES + k] = accumulate ? out[b * LANES + k] + value : value;
+                    }
+                    // Same odd-block shuffle as the SSE path, one block at a time
+                    for (size_t k = 0; k < LANES; k++) {
+                        float re = re_[t][k];
+                        float im = im_[t][k];
+                        re_[t][k] = re_[t][k + LANES];
+                        im_[t][k] = im_[t][k + LANES];
+                        re_[t][k + LANES] = re * step_re_[t] - im * step_im_[t];
+                        im_[t][k + LANES] = re * step_im_[t] + im * step_re_[t];
+                    }
+                }
+#endif
+                tone_phase_[t] += tone_increment_[t] * (blocks * LANES);
+            }
+            break;
+
+        case Waveform::SQUARE:
+        case Waveform::TRIANGLE:
+        case Waveform::SAWTOOTH: {
+            // Phase as a signed fraction of a cycle in [-0.5, 0.5)
+#if defined(__SSE2__)
+            __m128i phase = _mm_load_si128(reinterpret_cast<const __m128i*>(phase_));
+            const __m128i step = _mm_set1_epi32(static_cast<int32_t>(phase_step_));
+            const __m128 scale = _mm_set1_ps(PHASE_SCALE);
+            const __m128 sign_mask = _mm_set1_ps(-0.0f);
+            const __m128 g = _mm_set1_ps(gain);
+            for (size_t b = 0; b < blocks; b++) {
+                __m128 frac = _mm_mul_ps(_mm_cvtepi32_ps(phase), scale);
+                __m128 value;
+                if (waveform_ == Waveform::SQUARE) {
+                    value = _mm_or_ps(_mm_and_ps(frac, sign_mask), _mm_set1_ps(1.0f));
+                } else if (waveform_ == Waveform::TRIANGLE) {
+                    __m128 magnitude = _mm_andnot_ps(sign_mask, frac);
+                    value = _mm_sub_ps(_mm_mul_ps(magnitude, _mm_set1_ps(4.0f)), _mm_set1_ps(1.0f));
+                } else {
+                    value = _mm_add_ps(frac, frac);
+                }
+                _mm_store_ps(out + b * LANES, _mm_mul_ps(value, g));
+                phase = _mm_add_epi32(phase, step);
+            }
+            _mm_store_si128(reinterpret_cast<__m128i*>(phase_), phase);
+#else
+            for (size_t b = 0; b < blocks; b++) {
+                for (size_t k = 0; k < LANES; k++) {
+                    float frac = static_cast<float>(static_cast<int32_t>(phase_[k])) * PHASE_SCALE;
+                    float value;
+                    if (waveform_ == Waveform::SQUARE) {
+                        value = frac < 0.0f ? -1.0f : 1.0f;
+                    } else if (waveform_ == Waveform::TRIANGLE) {
+                        value = std::fabs(frac) * 4.0f - 1.0f;
+                    } else {
+                        value = frac * 2.0f;
+                    }
+                    out[b * LANES + k] = value * gain;
+                    phase_[k] += phase_step_;
+                }
+            }
+#endif
+            break;
+        }
+
+        case Waveform::NOISE: {
+#if defined(__SSE2__)
+            __m128i x = _mm_load_si128(reinterpret_cast<const __m128i*>(noise_));
+            const __m128 scale = _mm_set1_ps(NOISE_SCALE * gain);
+            for (size_t b = 0; b < blocks; b++) {
+                x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+                x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+                x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+                _mm_store_ps(out + b * LANES, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+            }
+            _mm_store_si128(reinterpret_cast<__m128i*>(noise_), x);
+#else
+            for (size_t b = 0; b < blocks; b++) {
+                for (size_t k = 0; k < LANES; k++) {
+                    uint32_t x = noise_[k];
+                    x ^= x << 13;
+                    x ^= x >> 17;
+                    x ^= x << 5;
+                    noise_[k] = x;
+                    out[b * LANES + k] = static_cast<float>(static_cast<int32_t>(x)) * NOISE_SCALE * gain;
+                }
+            }
+#endif
+            break;
+        }
+
+        case Waveform::SILENCE:
+        default:
+            memset(out, 0, blocks * LANES * sizeof(float));
+            break;
+    }
+}
+
+} // namespace accessory
@@ -0,0 +1,116 @@
+#include "accessory/rate_controller.h"
+#include "audio_codec.h"
+#include <algorithm>
+
+namespace accessory {
+
+namespace {
+
+// Congested: queueing delay or loss above these, or no ACK for a while
+constexpr uint32_t QUEUE_DELAY_HIGH_US = 20000;
+constexpr double LOSS_HIGH = 0.10;
+constexpr uint64_t ACK_SILENCE_US = 500000;
+
+// Clear: both below these
+constexpr uint32_t QUEUE_DELAY_LOW_US = 5000;
+constexpr double LOSS_LOW = 0.02;
+
+// A step down needs a second of feedback on the previous change; a step up
+// needs five clear seconds since the last step down
+constexpr uint64_t DOWN_HOLD_US = 1000000;
+constexpr uint64_t UP_HOLD_US = 5000000;
+
+// Battery thresholds (percent, when not charging)
+constexpr uint8_t BATTERY_LOW = 20;         // Level capped at 1
+constexpr uint8_t BATTERY_CRITICAL = 10;    // Level 0, no parity
+
+} // namespace
+
+RateController::RateController()
+    : encoding_(protocol::AudioEncoding::PCM16)
+    , fallback_(protocol::AudioEncoding::PCM16)
+    , frame_samples_(protocol::AUDIO_SAMPLES_PER_PACKET)
+    , format_(protocol::DEFAULT_STREAM_FORMAT)
+    , frames_per_packet_(1)
+    , level_(TOP_LEVEL)
+    , level_cap_(TOP_LEVEL)
+    , parity_allowed_(true)
+    , last_change_us_(0)
+    , last_down_us_(0) {
+
+    settings_ = settings_for(TOP_LEVEL);
+}
+
+void RateController::reset(protocol::AudioEncoding encoding, uint16_t frame_samples,
+                           uint8_t frames_per_packet, protocol::AudioEncoding fallback,
+                           const protocol::StreamFormat& format) {
+    encoding_ = encoding;
+    fallback_ = fallback;
+    frame_samples_ = frame_samples;
+    format_ = format;
+    frames_per_packet_ = std::max<uint8_t>(frames_per_packet, 1);
+    level_ = TOP_LEVEL;
+    level_cap_ = TOP_LEVEL;
+    parity_allowed_ = true;
+    last_change_us_ = 0;
+    last_down_us_ = 0;
+    settings_ = settings_for(TOP_LEVEL);
+}
+
+bool RateController::update(const LinkFeedback& feedback, uint64_t now_us) {
+    // Power: trade quality for airtime and encoder work
+    level_cap_ = TOP_LEVEL;
+    parity_allowed_ = true;
+    if (!feedback.charging) {
+        if (feedback.battery_level <= BATTERY_CRITICAL) {
+            level_cap_ = 0;
+            parity_allowed_ = false;
+        } else if (feedback.battery_level <= BATTERY_LOW) {
+            level_cap_ = 1;
+        }
+    }
+
+    // Link: queueing delay is the part of the RTT above its minimum
+    uint32_t queue_delay_us = feedback.srtt_us > feedback.min_rtt_us
+        ? feedback.srtt_us - feedback.min_rtt_us : 0;
+    bool silent = feedback.since_ack_us != UINT64_MAX && feedback.since_ack_us >= ACK_SILENCE_US;
+    bool congested = silent || queue_delay_us >= QUEUE_DELAY_HIGH_US ||
+                     feedback.loss_rate >= LOSS_HIGH;
+    bool clear = !silent && queue_delay_us < QUEUE_DELAY_LOW_US && feedback.loss_rate < LOSS_LOW;
+
+    if (congested && level_ > 0 && now_us - last_change_us_ >= DOWN_HOLD_US) {
+        level_--;
+        last_change_us_ = now_us;
+        last_down_us_ = now_us;
+    } else if (clear && level_ < TOP_LEVEL && now_us - last_down_us_ >= UP_HOLD_US &&
+               now_us - last_change_us_ >= UP_HOLD_US) {
+        level_++;
+        last_change_us_ = now_us;
+    }
+
+    QualitySettings settings = settings_for(std::min(level_, level_cap_));
+    bool changed = settings.encoding != settings_.encoding ||
+                   settings.frames_per_packet != settings_.frames_per_packet ||
+                   settings.max_parity != settings_.max_parity;
+    settings_ = settings;
+    return changed;
+}
+
+QualitySettings RateController::settings_for(uint8_t level) const {
+    QualitySettings settings;
+    settings.encoding = level >= 2 ? encoding_ : fallback_;
+
+    unsigned multiplier = level == TOP_LEVEL ? 1 : (level >= 1 ? 2 : 4);
+    unsigned frames = frames_per_packet_ * multiplier;
+    frames = std::min<unsigned>(frames, common::max_frames_per_packet(settings.encoding, frame_samples_, format_));
+    settings.frames_per_packet = static_cast<uint8_t>(std::max(frames, 1u));
+
+    if (!parity_allowed_) {
+        settings.max_parity = 0;
+    } else {
+        settings.max_parity = level == 0 ? 1 : protocol::FEC_MAX_PARITY_PACKETS;
+    }
+    return settings;
+}
+
+} // namespace accessory
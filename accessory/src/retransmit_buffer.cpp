@@ -0,0 +1,45 @@
+#include "accessory/retransmit_buffer.h"
+#include <cstring>
+
+namespace accessory {
+
+RetransmitBuffer::RetransmitBuffer(size_t capacity) {
+    reset(capacity);
+}
+
+void RetransmitBuffer::reset(size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    slots_.assign(capacity > 0 ? capacity : 1, Slot{false, 0, {}});
+}
+
+void RetransmitBuffer::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Slot& slot : slots_) {
+        slot.valid = false;
+    }
+}
+
+void RetransmitBuffer::store(const protocol::Packet& packet) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Slot& slot = slots_[packet.header.sequence % slots_.size()];
+    slot.valid = true;
+    slot.sequence = packet.header.sequence;
+    slot.bytes.resize(protocol::PACKET_HEADER_SIZE + packet.header.payload_length);
+    memcpy(slot.bytes.data(), &packet.header, protocol::PACKET_HEADER_SIZE);
+    memcpy(slot.bytes.data() + protocol::PACKET_HEADER_SIZE, packet.payload,
+           packet.header.payload_length);
+}
+
+bool RetransmitBuffer::fetch(uint32_t sequence, protocol::Packet* packet) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Slot& slot = slots_[sequence % slots_.size()];
+    if (!slot.valid || slot.sequence != sequence) {
+        return false;
+    }
+    memcpy(&packet->header, slot.bytes.data(), protocol::PACKET_HEADER_SIZE);
+    memcpy(packet->payload, slot.bytes.data() + protocol::PACKET_HEADER_SIZE,
+           slot.bytes.size() - protocol::PACKET_HEADER_SIZE);
+    return true;
+}
+
+} // namespace accessory
@@ -0,0 +1,672 @@
+#include "accessory/swarm.h"
+#include "accessory/crypto.h"
+#include "key_exchange.h"
+#include "secure_zero.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+
+namespace accessory {
+
+const char* traffic_profile_to_string(TrafficProfile profile) {
+    switch (profile) {
+        case TrafficProfile::AUDIO: return "audio";
+        case TrafficProfile::IDLE: return "idle";
+        case TrafficProfile::MIXED: return "mixed";
+        case TrafficProfile::BURSTY: return "bursty";
+        default: return "unknown";
+    }
+}
+
+bool traffic_profile_from_string(const char* name, TrafficProfile* profile) {
+    const TrafficProfile all[] = {
+        TrafficProfile::AUDIO, TrafficProfile::IDLE,
+        TrafficProfile::MIXED, TrafficProfile::BURSTY
+    };
+    for (TrafficProfile p : all) {
+        if (strcmp(name, traffic_profile_to_string(p)) == 0) {
+            *profile = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// SwarmChannel
+
+SwarmChannel::SwarmChannel(SwarmSocket* socket)
+    : socket_(socket)
+    , sent_(0)
+    , received_(0) {
+}
+
+bool SwarmChannel::send_packet(const protocol::Packet& packet) {
+    if (!socket_->enqueue(packet)) {
+        return false;
+    }
+    sent_++;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// SwarmDevice
+
+SwarmDevice::SwarmDevice(size_t index, SwarmSocket* socket, common::TimerWheel* scheduler,
+                         const SwarmConfig& config)
+    : index_(index)
+    , config_(config)
+    , scheduler_(scheduler)
+    , channel_(socket)
+    , fsm_(&channel_, scheduler)
+    , streamer_(&channel_, scheduler)
+    , telemetry_(&channel_, scheduler)
+    , active_(false)
+    , burst_timer_(common::TimerWheel::INVALID_TIMER) {
+
+    // Distinct tone and noise seed per device
+    double frequency_hz = 220.0 * std::pow(2.0, static_cast<double>(index % 24) / 12.0);
+    streamer_.set_test_signal(config.waveform, frequency_hz, static_cast<uint32_t>(index + 1));
+    
+    // Rate control runs on AUDIO_ACK feedback, which the shared sockets
+    // cannot route per device; pacing still applies
+    streamer_.set_rate_control(false);
+
+    fsm_.set_state_change_callback([this](protocol::ConnectionState old_state,
+                                          protocol::ConnectionState new_state) {
+        on_state_change(old_state, new_state);
+    });
+}
+
+SwarmDevice::~SwarmDevice() {
+    stop();
+}
+
+void SwarmDevice::start() {
+    std::lock_guard<std::mutex> lock(lifecycle_mutex_);
+    if (active_.load()) {
+        return;
+    }
+    active_.store(true);
+
+    if (config_.autonomous) {
+        // Load-only mode: no host handshake, no keepalive supervision
+        fsm_.enter_connected();
+    } else {
+        fsm_.start();
+    }
+}
+
+void SwarmDevice::stop() {
+    std::lock_guard<std::mutex> lock(lifecycle_mutex_);
+    if (!active_.load()) {
+        return;
+    }
+    active_.store(false);
+
+    // The FSM first: once it has stopped, no state change can start the
+    // streamer or the burst timer again
+    fsm_.stop();
+    scheduler_->cancel(burst_timer_);
+    burst_timer_ = common::TimerWheel::INVALID_TIMER;
+    streamer_.stop_streaming();
+    telemetry_.stop();
+}
+
+void SwarmDevice::on_packet(const protocol::Packet& packet) {
+    channel_.count_received();
+
+    switch (packet.header.type) {
+        case protocol::PacketType::DISCOVER_REQUEST:
+            fsm_.on_discover_request(packet);
+            break;
+
+        case protocol::PacketType::PAIR_REQUEST:
+            fsm_.on_pair_request(packet);
+            break;
+
+        case protocol::PacketType::CONNECT_REQUEST:
+            fsm_.on_connect_request(packet);
+            break;
+
+        case protocol::PacketType::RESUME_REQUEST:
+            fsm_.on_resume_request(packet);
+            break;
+
+        case protocol::PacketType::DISCONNECT:
+            fsm_.on_disconnect(packet);
+            streamer_.stop_streaming();
+            break;
+
+        case protocol::PacketType::KEEPALIVE:
+            fsm_.on_keepalive(packet);
+            break;
+
+        case protocol::PacketType::TIME_SYNC_REQUEST:
+            fsm_.on_time_sync_request(packet);
+            break;
+
+        default:
+            break;
+    }
+}
+
+bool SwarmDevice::matches(const uint8_t* device_id) const {
+    return memcmp(fsm_.get_device_id(), device_id, 8) == 0;
+}
+
+bool SwarmDevice::wants_audio() const {
+    switch (config_.profile) {
+        case TrafficProfile::AUDIO: return true;
+        case TrafficProfile::MIXED: return (index_ % 2) == 0;
+        case TrafficProfile::BURSTY: return true;
+        default: return false;
+    }
+}
+
+void SwarmDevice::on_state_change(protocol::ConnectionState old_state,
+                                  protocol::ConnectionState new_state) {
+    if (new_state == protocol::ConnectionState::CONNECTED) {
+        telemetry_.start();
+        if (wants_audio()) {
+            fsm_.enter_streaming();
+        }
+    } else if (new_state == protocol::ConnectionState::STREAMING) {
+        begin_streaming();
+    } else if (old_state == protocol::ConnectionState::CONNECTED ||
+               old_state == protocol::ConnectionState::STREAMING) {
+        streamer_.stop_streaming();
+        fsm_.set_resume_point(streamer_.get_next_sequence(), streamer_.get_sample_position());
+        telemetry_.stop();
+    }
+}
+
+void SwarmDevice::begin_streaming() {
+    if (!active_.load()) {
+        return;
+    }
+
+    if (config_.autonomous) {
+        streamer_.set_encoding(config_.encoding);
+    } else {
+        streamer_.set_stream_format(fsm_.get_stream_format());
+        streamer_.set_encoding(fsm_.get_audio_encoding());
+        streamer_.set_frame_format(fsm_.get_frame_samples(), fsm_.get_frames_per_packet());
+        uint8_t key[protocol::SESSION_KEY_SIZE];
+        streamer_.set_session_key(fsm_.get_session_key(key) ? key : nullptr);
+        uint32_t sequence;
+        uint64_t position;
+        if (fsm_.get_resume_point(&sequence, &position)) {
+            streamer_.set_resume_point(sequence, position);
+        }
+    }
+    streamer_.start_streaming();
+
+    if (config_.profile == TrafficProfile::BURSTY) {
+        scheduler_->cancel(burst_timer_);
+        burst_timer_ = scheduler_->schedule_periodic(
+            config_.burst_period_ms * 1000ull, [this] { toggle_burst(); });
+    }
+}
+
+void SwarmDevice::toggle_burst() {
+    if (!fsm_.is_streaming()) {
+        return;
+    }
+    if (streamer_.is_streaming()) {
+        streamer_.stop_streaming();
+    } else {
+        streamer_.start_streaming();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// SwarmSocket
+
+SwarmSocket::SwarmSocket()
+    : socket_fd_(-1)
+    , peer_known_(false)
+    , running_(false)
+    , datagrams_sent_(0)
+    , bytes_sent_(0)
+    , datagrams_received_(0)
+    , send_drops_(0) {
+    memset(&peer_addr_, 0, sizeof(peer_addr_));
+}
+
+SwarmSocket::~SwarmSocket() {
+    stop();
+}
+
+bool SwarmSocket::start(uint16_t port) {
+    if (running_.load()) {
+        return true;
+    }
+
+#ifdef _WIN32
+    socket_fd_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (socket_fd_ == INVALID_SOCKET) {
+        std::cerr << "[Swarm] Failed to create socket" << std::endl;
+        return false;
+    }
+    u_long mode = 1;
+    ioctlsocket(socket_fd_, FIONBIO, &mode);
+#else
+    socket_fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socket_fd_ < 0) {
+        std::cerr << "[Swarm] Failed to create socket" << std::endl;
+        return false;
+    }
+    int flags = fcntl(socket_fd_, F_GETFL, 0);
+    fcntl(socket_fd_, F_SETFL, flags | O_NONBLOCK);
+#endif
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+
+    if (bind(socket_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        std::cerr << "[Swarm] Failed to bind socket to port " << port << std::endl;
+#ifdef _WIN32
+        closesocket(socket_fd_);
+        socket_fd_ = INVALID_SOCKET;
+#else
+        close(socket_fd_);
+        socket_fd_ = -1;
+#endif
+        return false;
+    }
+
+    running_.store(true);
+    receive_thread_ = std::thread(&SwarmSocket::receive_loop, this);
+    send_thread_ = std::thread(&SwarmSocket::send_loop, this);
+    return true;
+}
+
+void SwarmSocket::stop() {
+    if (!running_.load()) {
+        return;
+    }
+
+    running_.store(false);
+    send_cv_.notify_all();
+
+    if (receive_thread_.joinable()) {
+        receive_thread_.join();
+    }
+    if (send_thread_.joinable()) {
+        send_thread_.join();
+    }
+
+#ifdef _WIN32
+    closesocket(socket_fd_);
+    socket_fd_ = INVALID_SOCKET;
+#else
+    close(socket_fd_);
+    socket_fd_ = -1;
+#endif
+}
+
+void SwarmSocket::add_device(SwarmDevice* device) {
+    devices_.push_back(device);
+}
+
+void SwarmSocket::set_peer(const sockaddr_in& peer) {
+    std::lock_guard<std::mutex> lock(peer_mutex_);
+    peer_addr_ = peer;
+    peer_known_.store(true);
+}
+
+bool SwarmSocket::enqueue(const protocol::Packet& packet) {
+    if (!running_.load()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    size_t datagrams = fragmenter_.split(packet, [this] {
+        send_queue_.emplace();
+        return &send_queue_.back();
+    });
+    if (datagrams == 0) {
+        return false;
+    }
+    send_cv_.notify_one();
+    return true;
+}
+
+void SwarmSocket::receive_loop() {
+    sockaddr_in from_addr;
+
+    while (running_.load()) {
+#ifdef _WIN32
+        int from_len = sizeof(from_addr);
+#else
+        socklen_t from_len = sizeof(from_addr);
+#endif
+        int received = recvfrom(socket_fd_, reinterpret_cast<char*>(reassembler_.receive_buffer()),
+                                static_cast<int>(common::Reassembler::receive_capacity()), 0,
+                                reinterpret_cast<sockaddr*>(&from_addr),
+                                &from_len);
+
+        if (received > 0) {
+            datagrams_received_++;
+
+            if (!peer_known_.load()) {
+                set_peer(from_addr);
+                if (peer_callback_) {
+                    peer_callback_(from_addr);
+                }
+            }
+
+            const protocol::Packet* packet =
+                reassembler_.on_datagram(static_cast<size_t>(received), protocol::get_timestamp_us());
+            if (packet) {
+                route_packet(*packet);
+            }
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+void SwarmSocket::route_packet(const protocol::Packet& packet) {
+    switch (packet.header.type) {
+        case protocol::PacketType::DISCOVER_REQUEST:
+            for (SwarmDevice* device : devices_) {
+                if (device->is_active()) {
+                    device->on_packet(packet);
+                }
+            }
+            break;
+
+        case protocol::PacketType::PAIR_REQUEST: {
+            if (packet.header.payload_length < sizeof(protocol::PairPayload)) {
+                break;
+            }
+            protocol::PairPayload payload;
+            memcpy(&payload, packet.payload, sizeof(payload));
+            for (SwarmDevice* device : devices_) {
+                if (device->is_active() && device->matches(payload.device_id)) {
+                    device->on_packet(packet);
+                    break;
+                }
+            }
+            break;
+        }
+
+        case protocol::PacketType::CONNECT_REQUEST:
+            for (SwarmDevice* device : devices_) {
+                if (device->is_active() &&
+                    device->get_state() == protocol::ConnectionState::PAIRING) {
+                    device->on_packet(packet);
+                }
+            }
+            break;
+
+        default:
+            for (SwarmDevice* device : devices_) {
+                auto state = device->get_state();
+                if (device->is_active() &&
+                    (state == protocol::ConnectionState::CONNECTED ||
+                     state == protocol::ConnectionState::STREAMING)) {
+                    device->on_packet(packet);
+                }
+            }
+            break;
+    }
+}
+
+void SwarmSocket::send_loop() {
+    uint8_t buffer[protocol::MAX_DATAGRAM_SIZE];
+
+    while (running_.load()) {
+        std::unique_lock<std::mutex> lock(send_mutex_);
+        send_cv_.wait(lock, [this] {
+            return !send_queue_.empty() || !running_.load();
+        });
+
+        if (!running_.load()) {
+            break;
+        }
+
+        while (!send_queue_.empty()) {
+            size_t length = send_queue_.front().length;
+            memcpy(buffer, send_queue_.front().bytes, length);
+            send_queue_.pop();
+            lock.unlock();
+
+            sockaddr_in peer;
+            bool have_peer = peer_known_.load();
+            if (have_peer) {
+                std::lock_guard<std::mutex> peer_lock(peer_mutex_);
+                peer = peer_addr_;
+            }
+
+            if (have_peer) {
+                int sent = sendto(socket_fd_, reinterpret_cast<const char*>(buffer),
+                                  static_cast<int>(length), 0,
+                                  reinterpret_cast<const sockaddr*>(&peer),
+                                  sizeof(peer));
+                if (sent > 0) {
+                    datagrams_sent_++;
+                    bytes_sent_ += static_cast<uint64_t>(sent);
+                } else {
+                    send_drops_++;
+                }
+            } else {
+                send_drops_++;
+            }
+
+            lock.lock();
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Swarm
+
+Swarm::Swarm(const SwarmConfig& config, common::TimerWheel* scheduler)
+    : config_(config)
+    , scheduler_(scheduler)
+    , churn_timer_(common::TimerWheel::INVALID_TIMER)
+    , churn_credit_(0.0)
+    , churn_rng_(std::random_device{}())
+    , churn_events_(0) {
+
+    if (config_.num_sockets == 0) {
+        config_.num_sockets = 1;
+    }
+    config_.num_sockets = std::min(config_.num_sockets, std::max<size_t>(config_.num_devices, 1));
+}
+
+Swarm::~Swarm() {
+    stop();
+}
+
+bool Swarm::start() {
+    // Build sockets and devices before any receive thread can route to them
+    for (size_t i = 0; i < config_.num_sockets; i++) {
+        sockets_.push_back(std::make_unique<SwarmSocket>());
+        sockets_.back()->set_datagram_size(config_.datagram_size);
+    }
+
+    // An explicit target wins; otherwise share the first learned host address
+    if (!config_.target_host.empty()) {
+        sockaddr_in peer;
+        memset(&peer, 0, sizeof(peer));
+        peer.sin_family = AF_INET;
+        peer.sin_port = htons(config_.target_port);
+#ifdef _WIN32
+        peer.sin_addr.s_addr = inet_addr(config_.target_host.c_str());
+#else
+        inet_pton(AF_INET, config_.target_host.c_str(), &peer.sin_addr);
+#endif
+        for (auto& socket : sockets_) {
+            socket->set_peer(peer);
+        }
+    } else {
+        for (auto& socket : sockets_) {
+            socket->set_peer_callback([this](const sockaddr_in& peer) {
+                for (auto& other : sockets_) {
+                    if (!other->has_peer()) {
+                        other->set_peer(peer);
+                    }
+                }
+            });
+        }
+    }
+
+    devices_.reserve(config_.num_devices);
+    for (size_t i = 0; i < config_.num_devices; i++) {
+        SwarmSocket* socket = sockets_[i % sockets_.size()].get();
+        devices_.push_back(std::make_unique<SwarmDevice>(i, socket, scheduler_, config_));
+        socket->add_device(devices_.back().get());
+    }
+
+    // The whole swarm pairs during ramp-up: generate every device's first
+    // key pair up front, in one batch
+    if (!config_.autonomous) {
+        const size_t key_size = common::X25519_KEY_SIZE;
+        std::vector<uint8_t> public_keys(devices_.size() * key_size);
+        std::vector<uint8_t> private_keys(devices_.size() * key_size);
+        auto keygen_start = std::chrono::steady_clock::now();
+        Crypto::generate_keypairs(public_keys.data(), private_keys.data(), devices_.size());
+        double keygen_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - keygen_start).count();
+        for (size_t i = 0; i < devices_.size(); i++) {
+            devices_[i]->set_pairing_keypair(&public_keys[i * key_size], &private_keys[i * key_size]);
+        }
+        common::secure_zero(private_keys.data(), private_keys.size());
+        std::cout << "[Swarm] Generated " << devices_.size() << " pairing key pairs in "
+                  << keygen_ms << "ms" << std::endl;
+    }
+
+    for (size_t i = 0; i < sockets_.size(); i++) {
+        if (!sockets_[i]->start(static_cast<uint16_t>(config_.base_port + i))) {
+            stop();
+            return false;
+        }
+    }
+
+    // Ramp-up: spread device starts evenly over the ramp window
+    ramp_timers_.resize(devices_.size(), common::TimerWheel::INVALID_TIMER);
+    restart_timers_.resize(devices_.size(), common::TimerWheel::INVALID_TIMER);
+    for (size_t i = 0; i < devices_.size(); i++) {
+        uint64_t delay_us = devices_.size() > 1
+            ? (static_cast<uint64_t>(config_.ramp_up_ms) * 1000ull * i) / (devices_.size() - 1)
+            : 0;
+        SwarmDevice* device = devices_[i].get();
+        ramp_timers_[i] = scheduler_->schedule_after(delay_us, [device] { device->start(); });
+    }
+
+    if (config_.churn_per_sec > 0.0) {
+        churn_timer_ = scheduler_->schedule_periodic(100000, [this] { churn_tick(); });
+    }
+
+    return true;
+}
+
+void Swarm::stop() {
+    scheduler_->cancel(churn_timer_);
+    churn_timer_ = common::TimerWheel::INVALID_TIMER;
+
+    for (auto id : ramp_timers_) {
+        scheduler_->cancel(id);
+    }
+    for (auto id : restart_timers_) {
+        scheduler_->cancel(id);
+    }
+    ramp_timers_.clear();
+    restart_timers_.clear();
+
+    for (auto& device : devices_) {
+        device->stop();
+    }
+    for (auto& socket : sockets_) {
+        socket->stop();
+    }
+    devices_.clear();
+    sockets_.clear();
+}
+
+void Swarm::churn_tick() {
+    churn_credit_ += config_.churn_per_sec * 0.1;
+
+    std::uniform_int_distribution<size_t> pick(0, devices_.size() - 1);
+    while (churn_credit_ >= 1.0) {
+        churn_credit_ -= 1.0;
+
+        // A few tries to find a device that is currently up
+        for (int attempt = 0; attempt < 8; attempt++) {
+            size_t index = pick(churn_rng_);
+            SwarmDevice* device = devices_[index].get();
+            if (!device->is_active()) {
+                continue;
+            }
+
+            device->stop();
+            churn_events_++;
+            scheduler_->cancel(restart_timers_[index]);
+            restart_timers_[index] = scheduler_->schedule_after(
+                config_.churn_downtime_ms * 1000ull, [device] { device->start(); });
+            break;
+        }
+    }
+}
+
+Swarm::Report Swarm::collect() const {
+    Report report;
+    memset(&report, 0, sizeof(report));
+
+    uint64_t timing_error_sum = 0;
+    uint64_t tick_work_sum = 0;
+    size_t timing_samples = 0;
+
+    for (const auto& device : devices_) {
+        if (device->is_active()) {
+            report.devices_active++;
+        }
+        auto state = device->get_state();
+        if (state == protocol::ConnectionState::CONNECTED ||
+            state == protocol::ConnectionState::STREAMING) {
+            report.devices_connected++;
+        }
+        if (state == protocol::ConnectionState::STREAMING) {
+            report.devices_streaming++;
+        }
+
+        auto audio = device->get_audio_stats();
+        report.audio_packets_sent += audio.packets_sent;
+        report.ticks_skipped += audio.ticks_skipped;
+        report.max_timing_error_us = std::max(report.max_timing_error_us, audio.max_timing_error_us);
+        report.max_tick_work_ns = std::max(report.max_tick_work_ns, audio.max_tick_work_ns);
+        report.render_underruns += audio.render_underruns;
+        if (audio.packets_sent > 0) {
+            timing_error_sum += audio.avg_timing_error_us;
+            tick_work_sum += audio.avg_tick_work_ns;
+            timing_samples++;
+        }
+        report.packets_sent += device->get_packets_sent();
+    }
+
+    if (timing_samples > 0) {
+        report.avg_timing_error_us = static_cast<uint32_t>(timing_error_sum / timing_samples);
+        report.avg_tick_work_ns = static_cast<uint32_t>(tick_work_sum / timing_samples);
+    }
+
+    for (const auto& socket : sockets_) {
+        report.datagrams_sent += socket->get_datagrams_sent();
+        report.bytes_sent += socket->get_bytes_sent();
+        report.datagrams_received += socket->get_datagrams_received();
+        report.send_drops += socket->get_send_drops();
+    }
+
+    report.churn_events = churn_events_.load();
+    return report;
+}
+
+} // namespace accessory
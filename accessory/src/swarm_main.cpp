@@ -0,0 +1,235 @@
+#include "accessory/swarm.h"
+#include "timer_wheel.h"
+#include "pacer.h"
+#include "audio_codec.h"
+#include <iostream>
+#include <iomanip>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+std::atomic<bool> g_running(true);
+
+void signal_handler(int signal) {
+    (void)signal;
+    g_running.store(false);
+}
+
+// Swallows the per-device component logging unless --verbose is given
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --devices N          Simulated accessories (default 100)\n"
+              << "  --sockets N          Shared UDP sockets (default 4)\n"
+              << "  --port P             First socket port; socket i binds P+i (default 8888)\n"
+              << "  --ramp-ms MS         Spread device starts over MS (default 5000)\n"
+              << "  --churn R            Random disconnects per second (default 0)\n"
+              << "  --churn-downtime MS  Downtime per churn event (default 2000)\n"
+              << "  --profile NAME       audio | idle | mixed | bursty (default audio)\n"
+              << "  --waveform NAME      sine | square | triangle | sawtooth | multitone | noise | silence\n"
+              << "  --burst-ms MS        Bursty on/off half-period (default 2000)\n"
+              << "  --autonomous         Stream without waiting for a host handshake\n"
+              << "  --codec NAME         pcm16 | adpcm | lossless with --autonomous (default pcm16;\n"
+              << "                       host-driven devices use the negotiated codec)\n"
+              << "  --target HOST:PORT   Send to this address instead of the learned host\n"
+              << "  --datagram BYTES     Largest datagram; bigger packets are fragmented (default 1472)\n"
+              << "  --workers N          Scheduler worker threads (default 2)\n"
+              << "  --pacer NAME         sleep | spin | nanosleep | timerfd (default sleep)\n"
+              << "  --spin-us US         Spin before each tick with --pacer spin (default 100)\n"
+              << "  --duration S         Stop after S seconds (default: until Ctrl+C)\n"
+              << "  --verbose            Keep per-device component logging\n";
+}
+
+static bool parse_args(int argc, char** argv, accessory::SwarmConfig* config,
+                       size_t* workers, common::PacerStrategy* pacer, uint32_t* spin_us,
+                       uint32_t* duration_s, bool* verbose) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = (i + 1 < argc);
+
+        if (arg == "--devices" && has_value) {
+            config->num_devices = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--sockets" && has_value) {
+            config->num_sockets = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--port" && has_value) {
+            config->base_port = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--ramp-ms" && has_value) {
+            config->ramp_up_ms = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--churn" && has_value) {
+            config->churn_per_sec = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--churn-downtime" && has_value) {
+            config->churn_downtime_ms = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--profile" && has_value) {
+            if (!accessory::traffic_profile_from_string(argv[++i], &config->profile)) {
+                std::cerr << "Unknown profile: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--waveform" && has_value) {
+            if (!accessory::waveform_from_string(argv[++i], &config->waveform)) {
+                std::cerr << "Unknown waveform: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--burst-ms" && has_value) {
+            config->burst_period_ms = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--autonomous") {
+            config->autonomous = true;
+        } else if (arg == "--codec" && has_value) {
+            if (!common::audio_encoding_from_string(argv[++i], &config->encoding)) {
+                std::cerr << "Unknown codec: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--target" && has_value) {
+            std::string target = argv[++i];
+            size_t colon = target.rfind(':');
+            if (colon == std::string::npos) {
+                std::cerr << "Target must be HOST:PORT" << std::endl;
+                return false;
+            }
+            config->target_host = target.substr(0, colon);
+            config->target_port = static_cast<uint16_t>(
+                std::strtoul(target.c_str() + colon + 1, nullptr, 10));
+        } else if (arg == "--datagram" && has_value) {
+            config->datagram_size = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--workers" && has_value) {
+            *workers = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--pacer" && has_value) {
+            if (!common::pacer_strategy_from_string(argv[++i], pacer)) {
+                std::cerr << "Unknown pacer: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--spin-us" && has_value) {
+            *spin_us = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--duration" && has_value) {
+            *duration_s = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--verbose") {
+            *verbose = true;
+        } else {
+            return false;
+        }
+    }
+    return config->num_devices > 0;
+}
+
+int main(int argc, char** argv) {
+    accessory::SwarmConfig config;
+    size_t workers = common::TimerWheel::DEFAULT_WORKERS;
+    common::PacerStrategy pacer = common::PacerStrategy::SLEEP;
+    uint32_t spin_us = common::Pacer::DEFAULT_SPIN_US;
+    uint32_t duration_s = 0;
+    bool verbose = false;
+
+    if (!parse_args(argc, argv, &config, &workers, &pacer, &spin_us, &duration_s, &verbose)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Reports go to the real stdout; component chatter is optionally muted
+    std::ostream report_out(std::cout.rdbuf());
+    NullBuffer null_buffer;
+    if (!verbose) {
+        std::cout.rdbuf(&null_buffer);
+    }
+
+    report_out << "=== Wireless Audio Accessory Swarm ===" << std::endl;
+    report_out << "Devices: " << config.num_devices
+               << ", Sockets: " << config.num_sockets
+               << " (ports " << config.base_port << "-"
+               << (config.base_port + config.num_sockets - 1) << ")"
+               << ", Profile: " << accessory::traffic_profile_to_string(config.profile)
+               << ", Waveform: " << accessory::waveform_to_string(config.waveform)
+               << ", Codec: " << (config.autonomous ? protocol::audio_encoding_to_string(config.encoding)
+                                                    : "negotiated")
+               << ", Ramp: " << config.ramp_up_ms << "ms"
+               << ", Churn: " << config.churn_per_sec << "/s"
+               << (config.autonomous ? ", Autonomous" : ", Host-driven")
+               << std::endl;
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    common::TimerWheel scheduler;
+    scheduler.set_pacer(pacer, spin_us);
+    scheduler.start(workers);
+
+    accessory::Swarm swarm(config, &scheduler);
+    if (!swarm.start()) {
+        std::cout.rdbuf(report_out.rdbuf());
+        std::cerr << "[Swarm] Failed to start sockets" << std::endl;
+        return 1;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    auto last_time = started;
+    accessory::Swarm::Report last = swarm.collect();
+
+    while (g_running.load()) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        auto now = std::chrono::steady_clock::now();
+        double dt = std::chrono::duration<double>(now - last_time).count();
+        auto report = swarm.collect();
+        auto sched = scheduler.get_stats();
+
+        report_out << std::fixed << std::setprecision(1)
+                   << "[Swarm] active=" << report.devices_active
+                   << " connected=" << report.devices_connected
+                   << " streaming=" << report.devices_streaming
+                   << " | audio " << (report.audio_packets_sent - last.audio_packets_sent) / dt << " pkt/s"
+                   << ", tx " << (report.datagrams_sent - last.datagrams_sent) / dt << " dgram/s"
+                   << ", " << (report.bytes_sent - last.bytes_sent) * 8.0 / dt / 1e6 << " Mbit/s"
+                   << ", rx " << (report.datagrams_received - last.datagrams_received) / dt << " dgram/s"
+                   << " | timing err avg=" << report.avg_timing_error_us
+                   << "us max=" << report.max_timing_error_us << "us"
+                   << ", skipped=" << report.ticks_skipped
+                   << ", drops=" << report.send_drops
+                   << ", churn=" << report.churn_events
+                   << ", sched delay max=" << sched.max_dispatch_delay_us << "us"
+                   << std::endl;
+
+        last = report;
+        last_time = now;
+
+        if (duration_s > 0 && now - started >= std::chrono::seconds(duration_s)) {
+            break;
+        }
+    }
+
+    auto total = swarm.collect();
+    common::Pacer::Stats pacer_stats = scheduler.get_pacer_stats();
+    common::TimingHistogram dispatch = scheduler.get_dispatch_histogram();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    swarm.stop();
+    scheduler.stop();
+    std::cout.rdbuf(report_out.rdbuf());
+
+    report_out << "\n=== Swarm Summary (" << std::setprecision(1) << elapsed << "s) ===" << std::endl;
+    report_out << "  Audio packets:   " << total.audio_packets_sent
+               << " (" << total.audio_packets_sent / elapsed << " pkt/s)" << std::endl;
+    report_out << "  Datagrams sent:  " << total.datagrams_sent
+               << " (" << total.bytes_sent * 8.0 / elapsed / 1e6 << " Mbit/s)" << std::endl;
+    report_out << "  Send drops:      " << total.send_drops << std::endl;
+    report_out << "  Timing error:    avg " << total.avg_timing_error_us
+               << "us, max " << total.max_timing_error_us << "us, "
+               << total.ticks_skipped << " ticks skipped" << std::endl;
+    report_out << "  Tick work:       avg " << total.avg_tick_work_ns / 1000.0
+               << "us, max " << total.max_tick_work_ns / 1000.0 << "us, "
+               << total.render_underruns << " render underruns" << std::endl;
+    report_out << "  Pacer:           " << common::pacer_strategy_to_string(pacer)
+               << ", wake error p50 " << pacer_stats.wake_error.percentile_us(0.5)
+               << "us, p99 " << pacer_stats.wake_error.percentile_us(0.99)
+               << "us, max " << pacer_stats.wake_error.max_us() << "us, "
+               << pacer_stats.ticks_skipped << " late ticks" << std::endl;
+    report_out << "  Dispatch error:  p50 " << dispatch.percentile_us(0.5)
+               << "us, p99 " << dispatch.percentile_us(0.99) << "us, max "
+               << dispatch.max_us() << "us over " << dispatch.count() << " firings" << std::endl;
+    report_out << "  Churn events:    " << total.churn_events << std::endl;
+    return 0;
+}
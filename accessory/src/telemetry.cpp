@@ -1,20 +1,25 @@
 #include "accessory/telemetry.h"
 #include "accessory/transport.h"
+#include "accessory/audio_streamer.h"
+#include <algorithm>
 #include <iostream>
-#include <thread>
-#include <chrono>
 #include <cstring>
 
 namespace accessory {
 
-Telemetry::Telemetry(Transport* transport)
+Telemetry::Telemetry(Transport* transport, common::TimerWheel* scheduler)
     : transport_(transport)
+    , scheduler_(scheduler)
     , running_(false)
+    , battery_timer_(common::TimerWheel::INVALID_TIMER)
+    , diagnostics_timer_(common::TimerWheel::INVALID_TIMER)
+    , drain_timer_(common::TimerWheel::INVALID_TIMER)
     , battery_level_(100)
     , charging_(false)
     , voltage_mv_(4200)  // Fully charged Li-ion
     , current_ma_(-150)  // Drawing 150mA
-    , temperature_c_(250) {  // 25.0°C
+    , temperature_c_(250)  // 25.0°C
+    , audio_streamer_(nullptr) {
     
     memset(&diagnostics_, 0, sizeof(diagnostics_));
 }
@@ -30,7 +35,13 @@ void Telemetry::start() {
     
     std::cout << "[Accessory] Starting telemetry" << std::endl;
     running_.store(true);
-    telemetry_thread_ = std::thread(&Telemetry::telemetry_loop, this);
+    
+    battery_timer_ = scheduler_->schedule_periodic(
+        1000000, [this] { send_battery_status(); });
+    diagnostics_timer_ = scheduler_->schedule_periodic(
+        5000000, [this] { send_diagnostics(); });
+    drain_timer_ = scheduler_->schedule_periodic(
+        10000000, [this] { simulate_battery_drain(); });
 }
 
 void Telemetry::stop() {
@@ -41,65 +52,38 @@ void Telemetry::stop() {
     std::cout << "[Accessory] Stopping telemetry" << std::endl;
     running_.store(false);
     
-    if (telemetry_thread_.joinable()) {
-        telemetry_thread_.join();
-    }
-}
-
-void Telemetry::telemetry_loop() {
-    auto last_battery_report = std::chrono::steady_clock::now();
-    auto last_diagnostics_report = std::chrono::steady_clock::now();
-    auto last_drain_update = std::chrono::steady_clock::now();
-    
-    const auto battery_report_interval = std::chrono::seconds(1);
-    const auto diagnostics_report_interval = std::chrono::seconds(5);
-    const auto drain_update_interval = std::chrono::seconds(10);
-    
-    while (running_.load()) {
-        auto now = std::chrono::steady_clock::now();
-        
-        // Send battery status at 1Hz
-        if (now - last_battery_report >= battery_report_interval) {
-            send_battery_status();
-            last_battery_report = now;
-        }
-        
-        // Send diagnostics at 0.2Hz
-        if (now - last_diagnostics_report >= diagnostics_report_interval) {
-            send_diagnostics();
-            last_diagnostics_report = now;
-        }
-        
-        // Update battery drain simulation
-        if (now - last_drain_update >= drain_update_interval) {
-            simulate_battery_drain();
-            last_drain_update = now;
-        }
-        
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    }
+    scheduler_->cancel(battery_timer_);
+    scheduler_->cancel(diagnostics_timer_);
+    scheduler_->cancel(drain_timer_);
+    battery_timer_ = common::TimerWheel::INVALID_TIMER;
+    diagnostics_timer_ = common::TimerWheel::INVALID_TIMER;
+    drain_timer_ = common::TimerWheel::INVALID_TIMER;
 }
 
 void Telemetry::send_battery_status() {
     protocol::Packet packet;
     packet.set_type(protocol::PacketType::BATTERY_STATUS);
-    packet.set_timestamp(static_cast<uint32_t>(protocol::get_timestamp_us()));
+    packet.set_timestamp(protocol::get_timestamp_us());
     
     protocol::BatteryPayload payload;
-    payload.level = battery_level_.load();
-    payload.charging = charging_.load() ? 1 : 0;
-    payload.voltage_mv = voltage_mv_;
-    payload.current_ma = current_ma_;
-    payload.temperature_c = temperature_c_;
-    
-    // Estimate time remaining (simplified)
-    if (!charging_.load() && current_ma_ < 0) {
-        // Assuming 500mAh battery capacity
-        const uint32_t battery_capacity_mah = 500;
-        uint32_t remaining_mah = (battery_capacity_mah * payload.level) / 100;
-        payload.time_remaining_s = (remaining_mah * 3600) / std::abs(current_ma_);
-    } else {
-        payload.time_remaining_s = 0;
+    {
+        // Drain updates run on another scheduler worker
+        std::lock_guard<std::mutex> lock(battery_mutex_);
+        payload.level = battery_level_.load();
+        payload.charging = charging_.load() ? 1 : 0;
+        payload.voltage_mv = voltage_mv_;
+        payload.current_ma = current_ma_;
+        payload.temperature_c = temperature_c_;
+        
+        // Estimate time remaining (simplified)
+        if (!charging_.load() && current_ma_ < 0) {
+            // Assuming 500mAh battery capacity
+            const uint32_t battery_capacity_mah = 500;
+            uint32_t remaining_mah = (battery_capacity_mah * payload.level) / 100;
+            payload.time_remaining_s = (remaining_mah * 3600) / std::abs(current_ma_);
+        } else {
+            payload.time_remaining_s = 0;
+        }
     }
     
     packet.set_payload(&payload, sizeof(payload));
@@ -116,12 +100,21 @@ void Telemetry::send_diagnostics() {
     
     protocol::Packet packet;
     packet.set_type(protocol::PacketType::DIAGNOSTICS);
-    packet.set_timestamp(static_cast<uint32_t>(protocol::get_timestamp_us()));
+    packet.set_timestamp(protocol::get_timestamp_us());
     
     // Update transport statistics
     diagnostics_.packets_sent = static_cast<uint32_t>(transport_->get_packets_sent());
     diagnostics_.packets_received = static_cast<uint32_t>(transport_->get_packets_received());
     
+    // Audio link estimates from the host's ACKs (RTT saturates at 65.5ms)
+    if (audio_streamer_) {
+        AudioStreamer::Stats audio = audio_streamer_->get_stats();
+        diagnostics_.packets_lost = static_cast<uint32_t>(audio.packets_lost);
+        diagnostics_.packets_retransmitted = static_cast<uint32_t>(audio.retransmissions);
+        diagnostics_.avg_latency_us = static_cast<uint16_t>(std::min<uint32_t>(audio.avg_latency_us, UINT16_MAX));
+        diagnostics_.max_latency_us = static_cast<uint16_t>(std::min<uint32_t>(audio.max_latency_us, UINT16_MAX));
+    }
+    
     // Simulate RSSI and link quality
     diagnostics_.rssi_dbm = -45;  // Good signal
     diagnostics_.link_quality = 95;  // Excellent
@@ -132,10 +125,13 @@ void Telemetry::send_diagnostics() {
     std::cout << "[Accessory] Diagnostics - Sent: " << diagnostics_.packets_sent
               << ", Received: " << diagnostics_.packets_received
               << ", Lost: " << diagnostics_.packets_lost
+              << ", RTT: " << diagnostics_.avg_latency_us << "us"
               << ", RSSI: " << static_cast<int>(diagnostics_.rssi_dbm) << "dBm" << std::endl;
 }
 
 void Telemetry::simulate_battery_drain() {
+    std::lock_guard<std::mutex> lock(battery_mutex_);
+    
     if (charging_.load()) {
         // Charging - increase level
         uint8_t level = battery_level_.load();
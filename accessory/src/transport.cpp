@@ -8,8 +8,10 @@ Transport::Transport()
     : socket_fd_(-1)
     , host_connected_(false)
     , running_(false)
+    , latency_trace_(nullptr)
     , packets_sent_(0)
-    , packets_received_(0) {
+    , packets_received_(0)
+    , datagrams_sent_(0) {
 #ifdef _WIN32
     WSAStartup(MAKEWORD(2, 2), &wsa_data_);
 #endif
@@ -115,7 +117,6 @@ void Transport::cleanup_socket() {
 }
 
 void Transport::receive_loop() {
-    uint8_t buffer[protocol::MAX_PACKET_SIZE];
     sockaddr_in from_addr;
     
 #ifdef _WIN32
@@ -127,26 +128,35 @@ void Transport::receive_loop() {
     while (running_.load()) {
         memset(&from_addr, 0, sizeof(from_addr));
         
-        int received = recvfrom(socket_fd_, reinterpret_cast<char*>(buffer),
-                               sizeof(buffer), 0,
+        // Straight into the reassembler's packet buffer
+        int received = recvfrom(socket_fd_, reinterpret_cast<char*>(reassembler_.receive_buffer()),
+                               static_cast<int>(common::Reassembler::receive_capacity()), 0,
                                reinterpret_cast<sockaddr*>(&from_addr),
                                &from_len);
         
         if (received > 0) {
-            // Save host address for sending responses
+            // Save host address for sending responses; follow a host that
+            // restarted on a new port
             if (!host_connected_) {
+                std::lock_guard<std::mutex> lock(send_mutex_);
                 host_addr_ = from_addr;
                 host_connected_ = true;
                 std::cout << "[Accessory] Host connected" << std::endl;
+            } else if (from_addr.sin_port != host_addr_.sin_port ||
+                       from_addr.sin_addr.s_addr != host_addr_.sin_addr.s_addr) {
+                std::lock_guard<std::mutex> lock(send_mutex_);
+                host_addr_ = from_addr;
+                std::cout << "[Accessory] Host address changed" << std::endl;
             }
             
-            // Deserialize packet
-            protocol::Packet packet;
-            if (protocol::deserialize_packet(buffer, received, &packet)) {
+            // Whole packets are checked in place; fragments wait for the rest
+            const protocol::Packet* packet =
+                reassembler_.on_datagram(static_cast<size_t>(received), protocol::get_timestamp_us());
+            if (packet) {
                 packets_received_++;
                 
                 if (packet_callback_) {
-                    packet_callback_(packet);
+                    packet_callback_(*packet);
                 }
             }
         } else {
@@ -157,6 +167,8 @@ void Transport::receive_loop() {
 }
 
 void Transport::send_loop() {
+    uint8_t buffer[protocol::MAX_DATAGRAM_SIZE];
+    
     while (running_.load()) {
         std::unique_lock<std::mutex> lock(send_mutex_);
         
@@ -176,22 +188,30 @@ void Transport::send_loop() {
                 continue;
             }
             
-            protocol::Packet packet = send_queue_.front();
+            // Copy out only the datagram's bytes
+            const common::Datagram& datagram = send_queue_.front();
+            size_t length = datagram.length;
+            protocol::PacketType type = datagram.type;
+            uint32_t sequence = datagram.sequence;
+            bool last = datagram.last;
+            memcpy(buffer, datagram.bytes, length);
+            sockaddr_in to_addr = host_addr_;
             send_queue_.pop();
             lock.unlock();
             
-            // Serialize packet
-            uint8_t buffer[protocol::MAX_PACKET_SIZE];
-            size_t bytes_written;
+            int sent = sendto(socket_fd_, reinterpret_cast<const char*>(buffer),
+                              static_cast<int>(length), 0,
+                              reinterpret_cast<const sockaddr*>(&to_addr),
+                              sizeof(to_addr));
             
-            if (protocol::serialize_packet(packet, buffer, sizeof(buffer), &bytes_written)) {
-                int sent = sendto(socket_fd_, reinterpret_cast<const char*>(buffer),
-                                static_cast<int>(bytes_written), 0,
-                                reinterpret_cast<const sockaddr*>(&host_addr_),
-                                sizeof(host_addr_));
-                
-                if (sent > 0) {
+            if (sent > 0) {
+                datagrams_sent_++;
+                if (last) {
                     packets_sent_++;
+                    
+                    if (latency_trace_ && type == protocol::PacketType::AUDIO_DATA) {
+                        latency_trace_->stamp(common::LatencyTrace::Stage::SENDTO, sequence);
+                    }
                 }
             }
             
@@ -205,8 +225,19 @@ bool Transport::send_packet(const protocol::Packet& packet) {
         return false;
     }
     
+    if (latency_trace_ && packet.header.type == protocol::PacketType::AUDIO_DATA) {
+        latency_trace_->stamp(common::LatencyTrace::Stage::ENQUEUE, packet.header.sequence);
+    }
+    
+    // Split on the caller's thread, straight into the queue
     std::lock_guard<std::mutex> lock(send_mutex_);
-    send_queue_.push(packet);
+    size_t datagrams = fragmenter_.split(packet, [this] {
+        send_queue_.emplace();
+        return &send_queue_.back();
+    });
+    if (datagrams == 0) {
+        return false;
+    }
     send_cv_.notify_one();
     
     return true;
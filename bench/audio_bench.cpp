@@ -0,0 +1,500 @@
+// Audio generation and codec micro-benchmark.
+//
+// Times how long one 10ms packet of test signal takes to generate, per
+// waveform, against the original per-sample std::sin loop. It renders many
+// independent streams round-robin, as accessory_swarm does, so per-stream
+// state does not sit in registers between packets.
+//
+// Then times encode and decode of one packet per codec and signal, with the
+// encoded size and, for lossy codecs, the signal-to-noise ratio.
+//
+// Then times GF(256) multiply-accumulate (SIMD vs scalar) and FEC parity
+// generation and recovery per group of packets.
+//
+// Then times reading one packet from memory-mapped files in several
+// formats, converted and resampled to the stream format.
+//
+// Finally times one 10ms frame per stream format through the templated
+// sample paths: render, raw PCM encode and decode, and the sink meter.
+
+#include "accessory/oscillator.h"
+#include "accessory/file_source.h"
+#include "audio_codec.h"
+#include "sample_format.h"
+#include "fec.h"
+#include "protocol.h"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <fstream>
+#include <cstdio>
+
+using accessory::Oscillator;
+using accessory::Waveform;
+
+struct BenchConfig {
+    size_t streams = 1000;
+    size_t packets = 200;           // Per stream
+};
+
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --streams N          Independent streams (default 1000)\n"
+              << "  --packets N          Packets rendered per stream (default 200)\n";
+}
+
+static bool parse_args(int argc, char** argv, BenchConfig* config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = (i + 1 < argc);
+
+        if (arg == "--streams" && has_value) {
+            config->streams = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--packets" && has_value) {
+            config->packets = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            return false;
+        }
+    }
+    return config->streams > 0 && config->packets > 0;
+}
+
+// The generator this benchmark replaced: double-precision std::sin per sample
+static void reference_sine(double* phase, int16_t* samples, size_t num_samples) {
+    const double phase_increment = 2.0 * M_PI * 440.0 / protocol::AUDIO_SAMPLE_RATE;
+    for (size_t i = 0; i < num_samples; i++) {
+        samples[i] = static_cast<int16_t>(16000.0 * std::sin(*phase));
+        *phase += phase_increment;
+        if (*phase >= 2.0 * M_PI) {
+            *phase -= 2.0 * M_PI;
+        }
+    }
+}
+
+static void print_result(const char* name, double elapsed_ns, size_t packets, double baseline_ns) {
+    double per_packet = elapsed_ns / packets;
+    std::cout << std::left << std::setw(12) << name << std::right
+              << std::setw(10) << std::fixed << std::setprecision(0) << per_packet << " ns"
+              << std::setw(10) << std::setprecision(2) << per_packet / protocol::AUDIO_SAMPLES_PER_PACKET << " ns"
+              << std::setw(11) << std::setprecision(1) << baseline_ns / per_packet << "x"
+              << std::endl;
+}
+
+// Encode and decode `packets` consecutive packets of one signal
+static void bench_codec(protocol::AudioEncoding encoding, Waveform waveform, size_t packets,
+                        uint64_t* checksum) {
+    const size_t samples_per_packet = protocol::AUDIO_SAMPLES_PER_PACKET;
+    std::unique_ptr<common::AudioCodec> encoder = common::create_audio_codec(encoding);
+    std::unique_ptr<common::AudioCodec> decoder = common::create_audio_codec(encoding);
+    if (!encoder || !decoder) {
+        return;
+    }
+
+    // Pre-render so only the codec is timed
+    Oscillator oscillator;
+    oscillator.set_waveform(waveform, 440.0, protocol::AUDIO_SAMPLE_RATE);
+    std::vector<int16_t> input(packets * samples_per_packet);
+    oscillator.render(input.data(), input.size());
+
+    const size_t capacity = encoder->max_encoded_size(samples_per_packet);
+    std::vector<uint8_t> encoded(packets * capacity);
+    std::vector<size_t> sizes(packets);
+    std::vector<int16_t> output(input.size());
+
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    size_t total_bytes = 0;
+    for (size_t p = 0; p < packets; p++) {
+        sizes[p] = encoder->encode(&input[p * samples_per_packet], samples_per_packet,
+                                   &encoded[p * capacity], capacity);
+        total_bytes += sizes[p];
+    }
+    double encode_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+
+    start = clock::now();
+    size_t failures = 0;
+    for (size_t p = 0; p < packets; p++) {
+        if (!decoder->decode(&encoded[p * capacity], sizes[p],
+                             &output[p * samples_per_packet], samples_per_packet)) {
+            failures++;
+        }
+    }
+    double decode_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+
+    double signal = 0.0;
+    double noise = 0.0;
+    for (size_t i = 0; i < input.size(); i++) {
+        double error = static_cast<double>(input[i]) - output[i];
+        signal += static_cast<double>(input[i]) * input[i];
+        noise += error * error;
+    }
+    *checksum += static_cast<uint16_t>(output[packets % output.size()]);
+
+    double bytes_per_packet = static_cast<double>(total_bytes) / packets;
+    double pcm_bytes = samples_per_packet * sizeof(int16_t);
+    std::cout << std::left << std::setw(11) << protocol::audio_encoding_to_string(encoding)
+              << std::setw(11) << accessory::waveform_to_string(waveform) << std::right
+              << std::setw(8) << std::fixed << std::setprecision(0) << encode_ns / packets << " ns"
+              << std::setw(8) << decode_ns / packets << " ns"
+              << std::setw(9) << std::setprecision(0) << pcm_bytes * packets / (encode_ns / 1e3) << " MB/s"
+              << std::setw(8) << std::setprecision(1) << bytes_per_packet
+              << std::setw(7) << std::setprecision(2) << pcm_bytes / bytes_per_packet << "x";
+    if (failures > 0) {
+        std::cout << "  " << failures << " decode failures";
+    } else if (noise == 0.0) {
+        std::cout << "  exact";
+    } else {
+        std::cout << "  " << std::setprecision(1) << 10.0 * std::log10(signal / noise) << " dB SNR";
+    }
+    std::cout << std::endl;
+}
+
+// GF(256) multiply-accumulate throughput over one packet-sized block
+static double bench_gf256(size_t length, size_t iterations, uint64_t* checksum) {
+    std::vector<uint8_t> src(length);
+    std::vector<uint8_t> dst(length, 0);
+    for (size_t i = 0; i < length; i++) {
+        src[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    for (size_t n = 0; n < iterations; n++) {
+        common::gf256_mul_add(dst.data(), src.data(), static_cast<uint8_t>(2 + n % 250), length);
+    }
+    double elapsed_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+    *checksum += dst[iterations % length];
+    return length * iterations / (elapsed_ns / 1e3);     // MB/s
+}
+
+// Parity for `groups` groups, then rebuild parity_count lost packets per group
+static void bench_fec(protocol::FecScheme scheme, size_t data_count, size_t parity_count,
+                      size_t block_size, size_t groups, uint64_t* checksum) {
+    std::vector<uint8_t> blocks(data_count * block_size);
+    for (size_t i = 0; i < blocks.size(); i++) {
+        blocks[i] = static_cast<uint8_t>(i * 131 + (i >> 8));
+    }
+    std::vector<uint8_t> parity_bytes(parity_count * block_size);
+    const uint8_t* data[protocol::FEC_MAX_DATA_PACKETS];
+    uint8_t* rebuilt[protocol::FEC_MAX_DATA_PACKETS];
+    uint8_t* parity[protocol::FEC_MAX_PARITY_PACKETS];
+    const uint8_t* parity_in[protocol::FEC_MAX_PARITY_PACKETS];
+    bool data_present[protocol::FEC_MAX_DATA_PACKETS];
+    bool parity_present[protocol::FEC_MAX_PARITY_PACKETS];
+    std::vector<uint8_t> work(blocks);
+    for (size_t i = 0; i < data_count; i++) {
+        data[i] = &blocks[i * block_size];
+        rebuilt[i] = &work[i * block_size];
+        data_present[i] = i >= parity_count;     // Lose the first parity_count
+    }
+    for (size_t j = 0; j < parity_count; j++) {
+        parity[j] = &parity_bytes[j * block_size];
+        parity_in[j] = parity[j];
+        parity_present[j] = true;
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    for (size_t g = 0; g < groups; g++) {
+        common::fec_encode(scheme, data, data_count, parity, parity_count, block_size);
+    }
+    double encode_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+
+    bool exact = true;
+    start = clock::now();
+    for (size_t g = 0; g < groups; g++) {
+        exact = common::fec_decode(scheme, rebuilt, data_present, data_count,
+                                   parity_in, parity_present, parity_count, block_size) && exact;
+    }
+    double decode_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+    exact = exact && work == blocks;
+    *checksum += parity_bytes[groups % parity_bytes.size()];
+
+    std::cout << std::left << std::setw(14) << protocol::fec_scheme_to_string(scheme) << std::right
+              << std::setw(3) << data_count << "+" << std::left << std::setw(4) << parity_count
+              << std::right << std::setw(10) << std::fixed << std::setprecision(0)
+              << encode_ns / groups << " ns" << std::setw(9)
+              << data_count * block_size / (encode_ns / groups / 1e3) << " MB/s"
+              << std::setw(10) << decode_ns / groups << " ns"
+              << "  " << (exact ? "exact" : "MISMATCH") << std::endl;
+}
+
+// WAV file of a 440Hz tone, seconds long, in the given format
+static bool write_wav(const std::string& path, const accessory::PcmFormat& format, size_t seconds) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        return false;
+    }
+    size_t frames = format.sample_rate * seconds;
+    size_t bytes = format.bits_per_sample / 8;
+    uint32_t data_size = static_cast<uint32_t>(frames * bytes * format.channels);
+    auto put = [&out](uint32_t value, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            out.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+    };
+    out.write("RIFF", 4);
+    put(36 + data_size, 4);
+    out.write("WAVEfmt ", 8);
+    put(16, 4);
+    put(1, 2);
+    put(format.channels, 2);
+    put(format.sample_rate, 4);
+    put(static_cast<uint32_t>(format.sample_rate * bytes * format.channels), 4);
+    put(static_cast<uint32_t>(bytes * format.channels), 2);
+    put(format.bits_per_sample, 2);
+    out.write("data", 4);
+    put(data_size, 4);
+    for (size_t i = 0; i < frames; i++) {
+        double value = 0.5 * std::sin(2.0 * M_PI * 440.0 * i / format.sample_rate);
+        int32_t sample = static_cast<int32_t>(value * (bytes == 2 ? 32767.0 : 8388607.0));
+        for (size_t c = 0; c < format.channels; c++) {
+            put(static_cast<uint32_t>(sample), bytes);
+        }
+    }
+    return out.good();
+}
+
+// One 10ms packet at a time from a looping file source
+static void bench_file_source(const accessory::PcmFormat& format, size_t packets,
+                              uint64_t* checksum) {
+    const std::string path = "/tmp/audio_bench_source.wav";
+    if (!write_wav(path, format, 10)) {
+        std::cout << "Cannot write " << path << std::endl;
+        return;
+    }
+
+    accessory::FileSource source;
+    std::streambuf* saved = std::cout.rdbuf(nullptr);     // Quiet "Playing ..."
+    bool opened = source.open({path}, protocol::AUDIO_SAMPLE_RATE);
+    std::cout.rdbuf(saved);
+    if (!opened) {
+        std::cout << "Cannot open " << path << std::endl;
+        return;
+    }
+
+    const size_t samples = protocol::AUDIO_SAMPLES_PER_PACKET;
+    std::vector<int16_t> scratch(samples);
+    size_t in_place = 0;
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    for (size_t p = 0; p < packets; p++) {
+        const int16_t* pcm = source.read(scratch.data(), samples);
+        in_place += pcm != scratch.data();
+        *checksum += static_cast<uint16_t>(pcm[p % samples]);
+    }
+    double elapsed_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+    std::remove(path.c_str());
+
+    std::string name = std::to_string(format.sample_rate) + "Hz " + std::to_string(format.channels) +
+                       "ch " + std::to_string(format.bits_per_sample) + "-bit";
+    double source_bytes = static_cast<double>(packets) * samples * format.sample_rate /
+                          protocol::AUDIO_SAMPLE_RATE * format.channels * format.bits_per_sample / 8;
+    std::cout << std::left << std::setw(22) << name << std::right << std::setw(10)
+              << std::fixed << std::setprecision(0) << elapsed_ns / packets << " ns"
+              << std::setw(9) << source_bytes / (elapsed_ns / 1e3) << " MB/s"
+              << std::setw(8) << std::setprecision(0) << 100.0 * in_place / packets << "%"
+              << std::endl;
+}
+
+// One 10ms frame at a time in the given format, from a single stream
+static void bench_stream_format(const protocol::StreamFormat& format, size_t frames,
+                                uint64_t* checksum) {
+    std::unique_ptr<common::AudioCodec> codec =
+        common::create_audio_codec(protocol::AudioEncoding::PCM16, format);
+    if (!codec) {
+        return;
+    }
+    const size_t channel_samples = protocol::stream_frame_samples(format, protocol::AUDIO_SAMPLES_PER_PACKET);
+    const size_t samples = channel_samples * format.channels;
+    std::vector<int32_t> pcm(samples);
+    std::vector<int32_t> decoded(samples);
+    std::vector<uint8_t> encoded(codec->max_encoded_size(samples));
+    float peaks[protocol::MAX_AUDIO_CHANNELS] = {};
+
+    Oscillator oscillator;
+    oscillator.set_waveform(Waveform::SINE, 440.0, format.sample_rate);
+    double render_ns = 0.0;
+    double codec_ns = 0.0;
+    double meter_ns = 0.0;
+    using clock = std::chrono::steady_clock;
+    common::with_sample_format(format.sample_format, [&](auto traits) {
+        using Traits = decltype(traits);
+        auto* in = reinterpret_cast<typename Traits::Type*>(pcm.data());
+        auto* out = reinterpret_cast<typename Traits::Type*>(decoded.data());
+        for (size_t f = 0; f < frames; f++) {
+            auto start = clock::now();
+            oscillator.render<Traits::FORMAT>(in, channel_samples, format.channels);
+            auto rendered = clock::now();
+            size_t size = codec->encode(in, samples, encoded.data(), encoded.size());
+            codec->decode(encoded.data(), size, out, samples);
+            auto coded = clock::now();
+            common::channel_peaks<Traits::FORMAT>(out, channel_samples, format.channels, peaks);
+            auto metered = clock::now();
+            render_ns += std::chrono::duration<double, std::nano>(rendered - start).count();
+            codec_ns += std::chrono::duration<double, std::nano>(coded - rendered).count();
+            meter_ns += std::chrono::duration<double, std::nano>(metered - coded).count();
+        }
+    });
+    *checksum += static_cast<uint64_t>(peaks[0] * 1000.0f);
+
+    std::string name = std::to_string(format.channels) + "ch " + std::to_string(format.sample_rate) +
+                       "Hz " + protocol::sample_format_to_string(format.sample_format);
+    double wire_kbps = codec->max_encoded_size(samples) * 8.0 / 10.0;
+    std::cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(0)
+              << std::setw(9) << render_ns / frames << " ns"
+              << std::setw(9) << codec_ns / frames << " ns"
+              << std::setw(9) << meter_ns / frames << " ns"
+              << std::setw(11) << wire_kbps << " kbit/s" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if (!parse_args(argc, argv, &config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    using clock = std::chrono::steady_clock;
+    const size_t samples_per_packet = protocol::AUDIO_SAMPLES_PER_PACKET;
+    const size_t total_packets = config.streams * config.packets;
+    std::vector<int16_t> packet(samples_per_packet);
+    uint64_t checksum = 0;  // Keeps the optimizer from dropping the work
+
+    std::cout << "=== Audio Generation Benchmark ===" << std::endl;
+    std::cout << config.streams << " streams x " << config.packets << " packets of "
+              << samples_per_packet << " samples" << std::endl << std::endl;
+    std::cout << std::left << std::setw(12) << "waveform" << std::right
+              << std::setw(13) << "per packet" << std::setw(13) << "per sample"
+              << std::setw(12) << "speedup" << std::endl;
+
+    // Baseline
+    std::vector<double> phases(config.streams, 0.0);
+    auto start = clock::now();
+    for (size_t p = 0; p < config.packets; p++) {
+        for (size_t s = 0; s < config.streams; s++) {
+            reference_sine(&phases[s], packet.data(), samples_per_packet);
+            checksum += static_cast<uint16_t>(packet[s % samples_per_packet]);
+        }
+    }
+    double baseline_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+    double baseline_per_packet = baseline_ns / total_packets;
+    print_result("std::sin", baseline_ns, total_packets, baseline_per_packet);
+
+    const Waveform waveforms[] = {
+        Waveform::SINE, Waveform::SQUARE, Waveform::TRIANGLE, Waveform::SAWTOOTH,
+        Waveform::MULTI_TONE, Waveform::NOISE
+    };
+    for (Waveform waveform : waveforms) {
+        std::vector<Oscillator> oscillators(config.streams);
+        for (size_t s = 0; s < config.streams; s++) {
+            oscillators[s].set_waveform(waveform, 440.0, protocol::AUDIO_SAMPLE_RATE);
+            oscillators[s].set_seed(static_cast<uint32_t>(s + 1));
+        }
+
+        start = clock::now();
+        for (size_t p = 0; p < config.packets; p++) {
+            for (size_t s = 0; s < config.streams; s++) {
+                oscillators[s].render(packet.data(), samples_per_packet);
+                checksum += static_cast<uint16_t>(packet[s % samples_per_packet]);
+            }
+        }
+        double elapsed_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        print_result(accessory::waveform_to_string(waveform), elapsed_ns, total_packets,
+                     baseline_per_packet);
+    }
+
+    // Accuracy of the recursive sine against the reference after a long run
+    // (one hour of audio), in 16-bit LSBs
+    Oscillator oscillator;
+    double phase = 0.0;
+    std::vector<int16_t> reference(samples_per_packet);
+    int max_error = 0;
+    const size_t hour_packets = 3600 * 1000 / protocol::AUDIO_PACKET_DURATION_MS;
+    for (size_t p = 0; p < hour_packets; p++) {
+        oscillator.render(packet.data(), samples_per_packet);
+        reference_sine(&phase, reference.data(), samples_per_packet);
+        if (p + 100 < hour_packets) {
+            continue;  // Compare the final second only
+        }
+        for (size_t i = 0; i < samples_per_packet; i++) {
+            max_error = std::max(max_error, std::abs(packet[i] - reference[i]));
+        }
+    }
+
+    std::cout << std::endl << "Sine error vs std::sin after 1h: " << max_error << " LSB" << std::endl;
+
+    std::cout << std::endl << "=== Codec Benchmark ===" << std::endl;
+    std::cout << std::left << std::setw(11) << "codec" << std::setw(11) << "signal" << std::right
+              << std::setw(11) << "encode" << std::setw(11) << "decode"
+              << std::setw(14) << "enc rate" << std::setw(8) << "bytes"
+              << std::setw(8) << "ratio" << std::endl;
+    const protocol::AudioEncoding encodings[] = {
+        protocol::AudioEncoding::PCM16, protocol::AudioEncoding::IMA_ADPCM,
+        protocol::AudioEncoding::LOSSLESS
+    };
+    const Waveform signals[] = {Waveform::SINE, Waveform::MULTI_TONE, Waveform::NOISE};
+    const size_t codec_packets = std::max<size_t>(config.packets * 10, 100);
+    for (protocol::AudioEncoding encoding : encodings) {
+        for (Waveform signal : signals) {
+            bench_codec(encoding, signal, codec_packets, &checksum);
+        }
+    }
+
+    // Parity over ADPCM-sized packets (10ms frames plus FEC block header)
+    const size_t block_size = 256 + sizeof(protocol::AudioPayload) + protocol::FEC_BLOCK_HEADER_SIZE;
+    const size_t gf_iterations = std::max<size_t>(config.packets * 1000, 10000);
+    std::cout << std::endl << "=== FEC Benchmark ===" << std::endl;
+    std::string simd = common::gf256_implementation();
+    double simd_rate = bench_gf256(block_size, gf_iterations, &checksum);
+    common::gf256_set_simd(false);
+    double scalar_rate = bench_gf256(block_size, gf_iterations, &checksum);
+    common::gf256_set_simd(true);
+    std::cout << "GF(256) mul-add, " << block_size << "-byte blocks: " << simd << " "
+              << std::setprecision(0) << simd_rate << " MB/s, scalar " << scalar_rate
+              << " MB/s (" << std::setprecision(1) << simd_rate / scalar_rate << "x)" << std::endl;
+    std::cout << std::left << std::setw(21) << "scheme" << std::right
+              << std::setw(13) << "encode" << std::setw(14) << "enc rate"
+              << std::setw(13) << "rebuild" << std::endl;
+    const size_t fec_groups = std::max<size_t>(config.packets * 50, 1000);
+    bench_fec(protocol::FecScheme::XOR, 4, 1, block_size, fec_groups, &checksum);
+    bench_fec(protocol::FecScheme::REED_SOLOMON, 8, 2, block_size, fec_groups, &checksum);
+    bench_fec(protocol::FecScheme::REED_SOLOMON, 8, 4, block_size, fec_groups, &checksum);
+    bench_fec(protocol::FecScheme::REED_SOLOMON, 16, 4, block_size, fec_groups, &checksum);
+
+    std::cout << std::endl << "=== File Source Benchmark ===" << std::endl;
+    std::cout << std::left << std::setw(22) << "file format" << std::right
+              << std::setw(13) << "per packet" << std::setw(14) << "source rate"
+              << std::setw(9) << "in place" << std::endl;
+    const accessory::PcmFormat file_formats[] = {
+        {48000, 1, 16}, {48000, 2, 16}, {48000, 1, 24}, {48000, 2, 24},
+        {44100, 2, 16}, {44100, 2, 24}, {96000, 2, 24}
+    };
+    const size_t file_packets = std::max<size_t>(config.packets * 100, 2000);
+    for (const accessory::PcmFormat& format : file_formats) {
+        bench_file_source(format, file_packets, &checksum);
+    }
+
+    std::cout << std::endl << "=== Stream Format Benchmark ===" << std::endl;
+    std::cout << std::left << std::setw(22) << "format" << std::right
+              << std::setw(12) << "render" << std::setw(12) << "enc+dec"
+              << std::setw(12) << "meter" << std::setw(18) << "wire" << std::endl;
+    const protocol::StreamFormat stream_formats[] = {
+        {48000, 1, protocol::SampleFormat::INT16}, {48000, 2, protocol::SampleFormat::INT16},
+        {44100, 2, protocol::SampleFormat::INT16}, {48000, 2, protocol::SampleFormat::INT24},
+        {96000, 2, protocol::SampleFormat::INT24}, {96000, 2, protocol::SampleFormat::FLOAT32},
+        {48000, 8, protocol::SampleFormat::FLOAT32}
+    };
+    const size_t format_frames = std::max<size_t>(config.packets * 50, 1000);
+    for (const protocol::StreamFormat& format : stream_formats) {
+        bench_stream_format(format, format_frames, &checksum);
+    }
+
+    std::cout << std::endl << "(checksum " << (checksum & 0xFFFF) << ")" << std::endl;
+    return 0;
+}
@@ -0,0 +1,183 @@
+// Bond store micro-benchmark.
+//
+// Fills a bond store with N bonds, then reopens it and times the open
+// (a header check, whatever N), lookups of bonded and unknown devices,
+// record updates left to writeback and updates flushed to disk, as
+// pairing results are. Device ids are random, as accessories make them.
+
+#include "host/bond_store.h"
+#include "csprng.h"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Swallows the store's own logging so only the table is printed
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+struct BenchConfig {
+    std::string path = "/tmp/bond_bench.db";
+    std::vector<uint32_t> sizes = {100, 1000, 10000, 100000};
+    size_t lookups = 200000;        // Per size, half of them misses
+    size_t durable_writes = 200;    // Flushed updates per size
+};
+
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --path PATH          Store file, replaced (default /tmp/bond_bench.db)\n"
+              << "  --bonds N            Store size to time (repeatable; default 100, 1000,\n"
+              << "                       10000 and 100000)\n"
+              << "  --lookups N          Lookups per size (default 200000)\n"
+              << "  --durable-writes N   Flushed updates per size (default 200)\n";
+}
+
+static bool parse_args(int argc, char** argv, BenchConfig* config) {
+    bool sizes_given = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = (i + 1 < argc);
+
+        if (arg == "--path" && has_value) {
+            config->path = argv[++i];
+        } else if (arg == "--bonds" && has_value) {
+            if (!sizes_given) {
+                config->sizes.clear();
+                sizes_given = true;
+            }
+            config->sizes.push_back(static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+        } else if (arg == "--lookups" && has_value) {
+            config->lookups = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--durable-writes" && has_value) {
+            config->durable_writes = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            return false;
+        }
+    }
+    return config->lookups > 0 && !config->sizes.empty();
+}
+
+static double elapsed_us(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+static host::Bond make_bond(const uint8_t* device_id, uint32_t index) {
+    host::Bond bond;
+    memset(&bond, 0, sizeof(bond));
+    memcpy(bond.device_id, device_id, sizeof(bond.device_id));
+    snprintf(bond.name, sizeof(bond.name), "AudioSim-%u", index);
+    common::random_bytes(bond.session_key, sizeof(bond.session_key));
+    bond.capabilities = 0x0007;
+    bond.params.encoding = static_cast<uint8_t>(protocol::AudioEncoding::IMA_ADPCM);
+    bond.params.frames_per_packet = 1;
+    bond.params.frame_samples = protocol::AUDIO_SAMPLES_PER_PACKET;
+    bond.paired_s = 1700000000ull + index;
+    return bond;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if (!parse_args(argc, argv, &config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::ostream report_out(std::cout.rdbuf());
+    NullBuffer null_buffer;
+    std::cout.rdbuf(&null_buffer);
+
+    report_out << "=== Bond Store Benchmark ===" << std::endl;
+    report_out << config.path << ", " << config.lookups << " lookups (half misses) and "
+               << config.durable_writes << " flushed updates per size" << std::endl << std::endl;
+    report_out << std::setw(8) << "bonds" << std::setw(9) << "slots" << std::setw(10) << "file KiB"
+               << std::setw(9) << "fill us" << std::setw(9) << "open us" << std::setw(11) << "lookup ns"
+               << std::setw(8) << "probes" << std::setw(10) << "update us" << std::setw(11)
+               << "durable us" << std::setw(10) << "rebuilds" << std::endl;
+
+    size_t failures = 0;
+    for (uint32_t count : config.sizes) {
+        unlink(config.path.c_str());
+        std::vector<uint8_t> ids(static_cast<size_t>(count) * 8);
+        common::random_bytes(ids.data(), ids.size());
+
+        // Fill from empty: inserts, growing as it goes, left to writeback
+        host::BondStore store;
+        if (!store.open(config.path)) {
+            std::cout.rdbuf(report_out.rdbuf());
+            std::cerr << "[Bench] Cannot open " << config.path << std::endl;
+            return 1;
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < count; i++) {
+            failures += store.put(make_bond(&ids[i * 8], i), false) ? 0 : 1;
+        }
+        double fill_us = elapsed_us(start) / std::max<uint32_t>(count, 1);
+        uint32_t rebuilds = store.get_stats().rebuilds;
+        store.close();
+
+        // Reopen as a restarted host would
+        if (!store.open(config.path)) {
+            std::cout.rdbuf(report_out.rdbuf());
+            std::cerr << "[Bench] Cannot reopen " << config.path << std::endl;
+            return 1;
+        }
+        host::BondStore::Stats opened = store.get_stats();
+        failures += opened.bonds == count ? 0 : 1;
+
+        host::Bond bond;
+        uint8_t unknown[8];
+        start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < config.lookups; n++) {
+            if (n & 1) {
+                common::random_bytes(unknown, sizeof(unknown));
+                failures += store.find(unknown, &bond) ? 1 : 0;
+            } else {
+                size_t index = (n / 2) % std::max<uint32_t>(count, 1);
+                failures += count == 0 || store.find(&ids[index * 8], &bond) ? 0 : 1;
+            }
+        }
+        double lookup_ns = elapsed_us(start) * 1000.0 / config.lookups;
+        host::BondStore::Stats looked = store.get_stats();
+        double probes = static_cast<double>(looked.probes - opened.probes) / config.lookups;
+
+        // Updates of existing bonds: a resume (writeback), then a pairing
+        // (flushed)
+        size_t updates = std::min<size_t>(count, 10000);
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < updates; i++) {
+            failures += store.put(make_bond(&ids[i * 8], static_cast<uint32_t>(i)), false) ? 0 : 1;
+        }
+        double update_us = updates > 0 ? elapsed_us(start) / updates : 0.0;
+        size_t durable = std::min<size_t>(count, config.durable_writes);
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < durable; i++) {
+            failures += store.put(make_bond(&ids[i * 8], static_cast<uint32_t>(i)), true) ? 0 : 1;
+        }
+        double durable_us = durable > 0 ? elapsed_us(start) / durable : 0.0;
+        store.close();
+
+        struct stat st;
+        uint64_t file_kib = stat(config.path.c_str(), &st) == 0 ? st.st_size / 1024 : 0;
+        report_out << std::setw(8) << count << std::setw(9) << opened.slots << std::setw(10) << file_kib
+                   << std::fixed << std::setprecision(2) << std::setw(9) << fill_us
+                   << std::setw(9) << opened.open_us << std::setw(11) << std::setprecision(1)
+                   << lookup_ns << std::setw(8) << std::setprecision(2) << probes
+                   << std::setw(10) << update_us << std::setw(11) << durable_us
+                   << std::setw(10) << rebuilds << std::endl;
+    }
+    unlink(config.path.c_str());
+    std::cout.rdbuf(report_out.rdbuf());
+
+    if (failures > 0) {
+        std::cerr << "[Bench] " << failures << " lookups or writes gave the wrong result" << std::endl;
+        return 1;
+    }
+    return 0;
+}
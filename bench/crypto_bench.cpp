@@ -0,0 +1,424 @@
+// Packet cryptography micro-benchmark.
+//
+// Times AES-128 in CTR mode and CCM seal and open over audio-sized
+// payloads, on AES-NI and on the bitsliced software path, in cycles per
+// byte (TSC cycles where the CPU has a TSC, else nanoseconds per byte).
+//
+// Then SHA-256 and HMAC-SHA256 on the SHA extensions and the portable
+// path: HMAC one-shot (key schedule on every call) against a precomputed
+// HmacSha256 with the 8-byte packet tag, and a session packet sealed and
+// opened in each protection mode.
+//
+// Then random bytes: the per-thread ChaCha20 generator against a
+// byte-per-call mt19937 distribution, for nonce-sized and bulk fills.
+//
+// Then times the pairing handshake: X25519 key generation one at a time
+// and in batches, the shared secret, and a whole exchange (both key
+// pairs, both shared secrets, both HKDF session keys) per second.
+
+#include "aes.h"
+#include "key_exchange.h"
+#include "sha256.h"
+#include "session_cipher.h"
+#include "csprng.h"
+#include "protocol.h"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define CRYPTO_BENCH_TSC
+#endif
+
+struct BenchConfig {
+    size_t iterations = 20000;      // Per payload size and operation
+    size_t handshakes = 2000;       // Key pairs and exchanges per handshake test
+};
+
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --iterations N       Operations timed per payload size (default 20000)\n"
+              << "  --handshakes N       Key pairs and exchanges per handshake test (default 2000)\n";
+}
+
+static bool parse_args(int argc, char** argv, BenchConfig* config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = (i + 1 < argc);
+
+        if (arg == "--iterations" && has_value) {
+            config->iterations = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--handshakes" && has_value) {
+            config->handshakes = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            return false;
+        }
+    }
+    return config->iterations > 0 && config->handshakes > 0;
+}
+
+// Cycle counter where there is one; nanoseconds otherwise
+static uint64_t ticks() {
+#ifdef CRYPTO_BENCH_TSC
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+static const char* tick_unit() {
+#ifdef CRYPTO_BENCH_TSC
+    return "cycles/byte";
+#else
+    return "ns/byte";
+#endif
+}
+
+enum class Operation { CTR, SEAL, OPEN };
+
+static const char* operation_name(Operation operation) {
+    switch (operation) {
+        case Operation::CTR:  return "ctr";
+        case Operation::SEAL: return "ccm seal";
+        case Operation::OPEN: return "ccm open";
+    }
+    return "?";
+}
+
+// Ticks per byte for one operation over `length`-byte payloads
+static double bench_aes(Operation operation, size_t length, size_t iterations, uint64_t* checksum) {
+    uint8_t key[common::Aes128::KEY_SIZE];
+    uint8_t nonce[common::Aes128::BLOCK_SIZE] = {};
+    uint8_t aad[protocol::PACKET_HEADER_SIZE];
+    uint8_t tag[protocol::AUTH_TAG_SIZE];
+    for (size_t i = 0; i < sizeof(key); i++) {
+        key[i] = static_cast<uint8_t>(i * 7 + 1);
+    }
+    memset(aad, 0x5A, sizeof(aad));
+    std::vector<uint8_t> data(length);
+    for (size_t i = 0; i < length; i++) {
+        data[i] = static_cast<uint8_t>(i);
+    }
+    common::Aes128 aes(key);
+
+    // Open needs a valid tag, so seal once and reuse the ciphertext
+    std::vector<uint8_t> sealed(data);
+    aes.ccm_seal(nonce, aad, sizeof(aad), sealed.data(), length, tag, sizeof(tag));
+
+    size_t failures = 0;
+    uint64_t start = ticks();
+    for (size_t n = 0; n < iterations; n++) {
+        switch (operation) {
+            case Operation::CTR:
+                nonce[15] = static_cast<uint8_t>(n);
+                aes.ctr_xor(nonce, data.data(), length);
+                break;
+            case Operation::SEAL:
+                nonce[0] = static_cast<uint8_t>(n);
+                aes.ccm_seal(nonce, aad, sizeof(aad), data.data(), length, tag, sizeof(tag));
+                break;
+            case Operation::OPEN:
+                memcpy(data.data(), sealed.data(), length);
+                failures += aes.ccm_open(nonce, aad, sizeof(aad), data.data(), length,
+                                         tag, sizeof(tag)) ? 0 : 1;
+                break;
+        }
+    }
+    uint64_t elapsed = ticks() - start;
+    *checksum += data[length / 2] + failures;
+    if (failures > 0) {
+        std::cerr << "[Bench] " << failures << " CCM open failures" << std::endl;
+    }
+    return static_cast<double>(elapsed) / (static_cast<double>(iterations) * length);
+}
+
+enum class HashOperation { SHA256, HMAC_ONESHOT, HMAC_KEYED };
+
+static const char* hash_operation_name(HashOperation operation) {
+    switch (operation) {
+        case HashOperation::SHA256:       return "sha256";
+        case HashOperation::HMAC_ONESHOT: return "hmac one-shot";
+        case HashOperation::HMAC_KEYED:   return "hmac keyed";
+    }
+    return "?";
+}
+
+// Ticks per byte for one hash operation over `length`-byte messages
+static double bench_hash(HashOperation operation, size_t length, size_t iterations,
+                         uint64_t* checksum) {
+    uint8_t key[protocol::SESSION_KEY_SIZE];
+    for (size_t i = 0; i < sizeof(key); i++) {
+        key[i] = static_cast<uint8_t>(i * 11 + 3);
+    }
+    std::vector<uint8_t> data(length);
+    for (size_t i = 0; i < length; i++) {
+        data[i] = static_cast<uint8_t>(i);
+    }
+    common::HmacSha256 hmac(key, sizeof(key));
+    uint8_t digest[common::Sha256::DIGEST_SIZE];
+
+    uint64_t start = ticks();
+    for (size_t n = 0; n < iterations; n++) {
+        data[0] = static_cast<uint8_t>(n);
+        switch (operation) {
+            case HashOperation::SHA256:
+                common::Sha256::hash(data.data(), length, digest);
+                break;
+            case HashOperation::HMAC_ONESHOT:
+                common::hmac_sha256(key, sizeof(key), data.data(), length, digest);
+                break;
+            case HashOperation::HMAC_KEYED:
+                hmac.sign(data.data(), length, digest, protocol::AUTH_TAG_SIZE);
+                break;
+        }
+        *checksum += digest[0];
+    }
+    uint64_t elapsed = ticks() - start;
+    return static_cast<double>(elapsed) / (static_cast<double>(iterations) * length);
+}
+
+// Ticks per byte to seal and then open one audio packet of `length` bytes
+static double bench_session(common::SessionCipher::Mode mode, size_t length, size_t iterations,
+                            uint64_t* checksum) {
+    uint8_t key[protocol::SESSION_KEY_SIZE];
+    for (size_t i = 0; i < sizeof(key); i++) {
+        key[i] = static_cast<uint8_t>(i * 5 + 9);
+    }
+    common::SessionCipher cipher;
+    cipher.set_key(key);
+    cipher.set_mode(mode);
+    protocol::Packet packet;
+    packet.set_type(protocol::PacketType::AUDIO_DATA);
+
+    size_t failures = 0;
+    uint64_t start = ticks();
+    for (size_t n = 0; n < iterations; n++) {
+        packet.set_sequence(static_cast<uint32_t>(n));
+        packet.set_flags(0);
+        packet.set_payload(nullptr, static_cast<uint16_t>(length));
+        cipher.seal(&packet);
+        failures += cipher.open(&packet) ? 0 : 1;
+    }
+    uint64_t elapsed = ticks() - start;
+    *checksum += packet.payload[0] + failures;
+    if (failures > 0) {
+        std::cerr << "[Bench] " << failures << " session open failures" << std::endl;
+    }
+    return static_cast<double>(elapsed) / (static_cast<double>(iterations) * length);
+}
+
+// Ticks per byte filling `length`-byte buffers: common::random_bytes, or
+// one mt19937 distribution call per byte
+static double bench_random(bool chacha, size_t length, size_t iterations, uint64_t* checksum) {
+    std::vector<uint8_t> buffer(length);
+    std::mt19937 generator(12345);
+    std::uniform_int_distribution<> distribution(0, 255);
+
+    uint64_t start = ticks();
+    for (size_t n = 0; n < iterations; n++) {
+        if (chacha) {
+            common::random_bytes(buffer.data(), length);
+        } else {
+            for (size_t i = 0; i < length; i++) {
+                buffer[i] = static_cast<uint8_t>(distribution(generator));
+            }
+        }
+        *checksum += buffer[0];
+    }
+    uint64_t elapsed = ticks() - start;
+    return static_cast<double>(elapsed) / (static_cast<double>(iterations) * length);
+}
+
+// Deterministic stand-in for random private keys
+static void fill_keys(uint8_t* keys, size_t count, uint32_t seed) {
+    uint32_t state = seed;
+    for (size_t i = 0; i < count * common::X25519_KEY_SIZE; i++) {
+        state = state * 1664525u + 1013904223u;
+        keys[i] = static_cast<uint8_t>(state >> 24);
+    }
+}
+
+static void print_rate(const char* name, double elapsed_ns, size_t operations) {
+    std::cout << std::left << std::setw(24) << name << std::right << std::fixed
+              << std::setprecision(1) << std::setw(10) << elapsed_ns / operations / 1000.0 << " us"
+              << std::setprecision(0) << std::setw(12) << operations / (elapsed_ns / 1e9) << "/s"
+              << std::endl;
+}
+
+// Key generation singly and in batches, shared secrets, and whole exchanges
+static void bench_handshake(size_t count, uint64_t* checksum) {
+    using clock = std::chrono::steady_clock;
+    const size_t key_size = common::X25519_KEY_SIZE;
+    std::vector<uint8_t> host_private(count * key_size);
+    std::vector<uint8_t> host_public(count * key_size);
+    std::vector<uint8_t> accessory_private(count * key_size);
+    std::vector<uint8_t> accessory_public(count * key_size);
+    fill_keys(host_private.data(), count, 1);
+    fill_keys(accessory_private.data(), count, 2);
+
+    auto start = clock::now();
+    for (size_t i = 0; i < count; i++) {
+        common::x25519_public_key(&host_private[i * key_size], &host_public[i * key_size]);
+    }
+    print_rate("keygen", std::chrono::duration<double, std::nano>(clock::now() - start).count(),
+               count);
+
+    const size_t batch_sizes[] = {8, 64, 1024};
+    for (size_t batch : batch_sizes) {
+        start = clock::now();
+        for (size_t i = 0; i < count; i += batch) {
+            size_t n = std::min(batch, count - i);
+            common::x25519_public_keys(&accessory_private[i * key_size],
+                                       &accessory_public[i * key_size], n);
+        }
+        std::string name = "keygen batch " + std::to_string(batch);
+        print_rate(name.c_str(), std::chrono::duration<double, std::nano>(clock::now() - start).count(),
+                   count);
+    }
+
+    uint8_t secret[common::X25519_KEY_SIZE];
+    size_t failures = 0;
+    start = clock::now();
+    for (size_t i = 0; i < count; i++) {
+        failures += common::x25519(&host_private[i * key_size], &accessory_public[i * key_size],
+                                   secret) ? 0 : 1;
+        *checksum += secret[0];
+    }
+    print_rate("shared secret", std::chrono::duration<double, std::nano>(clock::now() - start).count(),
+               count);
+
+    // Both sides of one pairing, as the host and an accessory run it
+    uint8_t host_nonce[16] = {1};
+    uint8_t accessory_nonce[16] = {2};
+    uint8_t host_key[protocol::SESSION_KEY_SIZE];
+    uint8_t accessory_key[protocol::SESSION_KEY_SIZE];
+    size_t mismatches = 0;
+    start = clock::now();
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* hp = &host_private[i * key_size];
+        const uint8_t* ap = &accessory_private[i * key_size];
+        uint8_t host_key_public[common::X25519_KEY_SIZE];
+        uint8_t accessory_key_public[common::X25519_KEY_SIZE];
+        common::x25519_public_key(hp, host_key_public);
+        common::x25519_public_key(ap, accessory_key_public);
+        common::x25519(ap, host_key_public, secret);
+        common::derive_session_key(secret, host_nonce, accessory_nonce, accessory_key);
+        common::x25519(hp, accessory_key_public, secret);
+        common::derive_session_key(secret, host_nonce, accessory_nonce, host_key);
+        mismatches += memcmp(host_key, accessory_key, sizeof(host_key)) != 0 ? 1 : 0;
+        *checksum += host_key[0];
+    }
+    print_rate("full handshake", std::chrono::duration<double, std::nano>(clock::now() - start).count(),
+               count);
+
+    if (failures > 0 || mismatches > 0) {
+        std::cerr << "[Bench] " << failures << " rejected keys, " << mismatches
+                  << " session key mismatches" << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if (!parse_args(argc, argv, &config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    uint64_t checksum = 0;  // Keeps the optimizer from dropping the work
+    const size_t lengths[] = {960, 2048};
+    const Operation operations[] = {Operation::CTR, Operation::SEAL, Operation::OPEN};
+
+    std::cout << "=== AES-128 Benchmark ===" << std::endl;
+    std::cout << config.iterations << " operations per size, " << tick_unit()
+              << " (lower is better)" << std::endl << std::endl;
+    std::cout << std::left << std::setw(11) << "operation" << std::right
+              << std::setw(8) << "bytes" << std::setw(12) << common::aes_implementation()
+              << std::setw(12) << "bitsliced" << std::setw(10) << "speedup" << std::endl;
+
+    for (Operation operation : operations) {
+        for (size_t length : lengths) {
+            double hardware = bench_aes(operation, length, config.iterations, &checksum);
+            common::aes_set_hardware(false);
+            double software = bench_aes(operation, length, config.iterations, &checksum);
+            common::aes_set_hardware(true);
+            std::cout << std::left << std::setw(11) << operation_name(operation) << std::right
+                      << std::setw(8) << length << std::fixed << std::setprecision(2)
+                      << std::setw(12) << hardware << std::setw(12) << software
+                      << std::setw(9) << std::setprecision(1) << software / hardware << "x"
+                      << std::endl;
+        }
+    }
+
+    std::cout << std::endl << "=== SHA-256 / HMAC Benchmark ===" << std::endl;
+    std::cout << config.iterations << " operations per size, " << tick_unit()
+              << " (lower is better)" << std::endl << std::endl;
+    std::cout << std::left << std::setw(15) << "operation" << std::right
+              << std::setw(8) << "bytes" << std::setw(12) << common::sha256_implementation()
+              << std::setw(12) << "portable" << std::setw(10) << "speedup" << std::endl;
+
+    const size_t hash_lengths[] = {64, 960, 2048};
+    const HashOperation hash_operations[] = {
+        HashOperation::SHA256, HashOperation::HMAC_ONESHOT, HashOperation::HMAC_KEYED
+    };
+    for (HashOperation operation : hash_operations) {
+        for (size_t length : hash_lengths) {
+            double hardware = bench_hash(operation, length, config.iterations, &checksum);
+            common::sha256_set_hardware(false);
+            double software = bench_hash(operation, length, config.iterations, &checksum);
+            common::sha256_set_hardware(true);
+            std::cout << std::left << std::setw(15) << hash_operation_name(operation) << std::right
+                      << std::setw(8) << length << std::fixed << std::setprecision(2)
+                      << std::setw(12) << hardware << std::setw(12) << software
+                      << std::setw(9) << std::setprecision(1) << software / hardware << "x"
+                      << std::endl;
+        }
+    }
+
+    // Both modes as the streamer and the host run them: seal then open
+    std::cout << std::endl << "Session packet seal + open, " << tick_unit() << std::endl;
+    std::cout << std::left << std::setw(15) << "mode" << std::right << std::setw(8) << "bytes"
+              << std::setw(12) << "cost" << std::endl;
+    const common::SessionCipher::Mode modes[] = {
+        common::SessionCipher::Mode::ENCRYPT, common::SessionCipher::Mode::AUTHENTICATE
+    };
+    for (common::SessionCipher::Mode mode : modes) {
+        for (size_t length : hash_lengths) {
+            double cost = bench_session(mode, length, config.iterations, &checksum);
+            std::cout << std::left << std::setw(15) << common::session_cipher_mode_to_string(mode)
+                      << std::right << std::setw(8) << length << std::fixed << std::setprecision(2)
+                      << std::setw(12) << cost << std::endl;
+        }
+    }
+
+    std::cout << std::endl << "=== Random Bytes Benchmark ===" << std::endl;
+    std::cout << config.iterations << " fills per size, " << tick_unit()
+              << " (lower is better)" << std::endl << std::endl;
+    std::cout << std::left << std::setw(15) << "fill" << std::right << std::setw(8) << "bytes"
+              << std::setw(12) << "chacha20" << std::setw(12) << "mt19937" << std::setw(10)
+              << "speedup" << std::endl;
+    const size_t random_lengths[] = {16, 32, 4096};
+    for (size_t length : random_lengths) {
+        double chacha = bench_random(true, length, config.iterations, &checksum);
+        double mt = bench_random(false, length, config.iterations, &checksum);
+        std::cout << std::left << std::setw(15) << (length > 32 ? "bulk" : "nonce") << std::right
+                  << std::setw(8) << length << std::fixed << std::setprecision(2)
+                  << std::setw(12) << chacha << std::setw(12) << mt
+                  << std::setw(9) << std::setprecision(1) << mt / chacha << "x" << std::endl;
+    }
+
+    std::cout << std::endl << "=== Pairing Handshake Benchmark ===" << std::endl;
+    std::cout << config.handshakes << " key pairs / exchanges per test" << std::endl << std::endl;
+    std::cout << std::left << std::setw(24) << "operation" << std::right
+              << std::setw(13) << "each" << std::setw(14) << "rate" << std::endl;
+    bench_handshake(config.handshakes, &checksum);
+
+    std::cout << std::endl << "(checksum " << (checksum & 0xFFFF) << ")" << std::endl;
+    return 0;
+}
@@ -0,0 +1,954 @@
+// End-to-end audio latency benchmark.
+//
+// Runs the accessory and host stacks in one process over loopback UDP and
+// stamps every audio frame at generation, enqueue, sendto, recv, jitter
+// buffer insert and playout. Because both sides share one clock the per-hop
+// deltas are absolute, so tail latency can be attributed to a stage.
+
+#include "accessory/connection_fsm.h"
+#include "accessory/audio_streamer.h"
+#include "accessory/telemetry.h"
+#include "accessory/transport.h"
+#include "accessory/file_source.h"
+#include "host/device_manager.h"
+#include "host/audio_sync.h"
+#include "host/clock_sync.h"
+#include "host/transport.h"
+#include "audio_codec.h"
+#include "sample_format.h"
+#include "fec.h"
+#include "aes.h"
+#include "sha256.h"
+#include "session_cipher.h"
+#include "latency_trace.h"
+#include "timer_wheel.h"
+#include "pacer.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <csignal>
+#include <cstdlib>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <deque>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <mutex>
+
+using common::LatencyTrace;
+
+std::atomic<bool> g_running(true);
+
+void signal_handler(int signal) {
+    (void)signal;
+    g_running.store(false);
+}
+
+// Swallows component logging unless --verbose is given
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+// Drops first transmissions of audio and parity packets at random to
+// exercise retransmission and FEC; resends always go through. With a
+// bottleneck, every packet also queues for a simulated radio that sends one
+// packet per airtime; packets that would wait more than RADIO_QUEUE_US are
+// dropped at the tail. During an outage nothing gets through either way (the
+// accessory's packet handler ignores what arrives).
+class LossyTransport : public accessory::Transport {
+public:
+    static constexpr uint64_t RADIO_QUEUE_US = 100000;
+
+    LossyTransport(double loss, uint32_t bottleneck_kbps)
+        : loss_(loss), bottleneck_kbps_(bottleneck_kbps), rng_(12345), dropped_(0)
+        , outage_(false), radio_running_(bottleneck_kbps > 0), radio_free_us_(0) {
+        if (radio_running_) {
+            radio_thread_ = std::thread([this] { radio_loop(); });
+        }
+    }
+
+    ~LossyTransport() override {
+        {
+            std::lock_guard<std::mutex> lock(radio_mutex_);
+            radio_running_ = false;
+        }
+        radio_cv_.notify_all();
+        if (radio_thread_.joinable()) {
+            radio_thread_.join();
+        }
+    }
+
+    bool send_packet(const protocol::Packet& packet) override {
+        if (outage_.load()) {
+            return true;
+        }
+        bool audio = packet.header.type == protocol::PacketType::AUDIO_DATA ||
+                     packet.header.type == protocol::PacketType::AUDIO_FEC;
+        if (loss_ > 0.0 && audio && !(packet.header.flags & protocol::FLAG_RETRANSMIT)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (std::uniform_real_distribution<double>(0.0, 1.0)(rng_) < loss_) {
+                dropped_++;
+                return true;    // Lost on the air, not a local failure
+            }
+        }
+        if (bottleneck_kbps_ > 0) {
+            return queue_on_radio(packet);
+        }
+        return accessory::Transport::send_packet(packet);
+    }
+
+    uint64_t get_dropped() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return dropped_;
+    }
+
+    void set_outage(bool outage) { outage_.store(outage); }
+    bool in_outage() const { return outage_.load(); }
+
+private:
+    bool queue_on_radio(const protocol::Packet& packet) {
+        uint64_t now = protocol::get_timestamp_us();
+        uint64_t airtime_us = packet.total_size() * 8000ull / bottleneck_kbps_;
+        {
+            std::lock_guard<std::mutex> lock(radio_mutex_);
+            uint64_t start = std::max(now, radio_free_us_);
+            if (start - now > RADIO_QUEUE_US) {
+                std::lock_guard<std::mutex> drop_lock(mutex_);
+                dropped_++;
+                return true;
+            }
+            radio_free_us_ = start + airtime_us;
+            radio_queue_.emplace_back(radio_free_us_, packet);
+        }
+        radio_cv_.notify_one();
+        return true;
+    }
+
+    void radio_loop() {
+        std::unique_lock<std::mutex> lock(radio_mutex_);
+        while (radio_running_) {
+            if (radio_queue_.empty()) {
+                radio_cv_.wait(lock);
+                continue;
+            }
+            uint64_t now = protocol::get_timestamp_us();
+            uint64_t due = radio_queue_.front().first;
+            if (due > now) {
+                radio_cv_.wait_for(lock, std::chrono::microseconds(due - now));
+                continue;
+            }
+            protocol::Packet packet = radio_queue_.front().second;
+            radio_queue_.pop_front();
+            lock.unlock();
+            accessory::Transport::send_packet(packet);
+            lock.lock();
+        }
+    }
+
+    double loss_;
+    uint32_t bottleneck_kbps_;
+    mutable std::mutex mutex_;
+    std::mt19937 rng_;
+    uint64_t dropped_;
+    std::atomic<bool> outage_;
+
+    // Simulated radio: packets with the time their airtime ends
+    std::mutex radio_mutex_;
+    std::condition_variable radio_cv_;
+    bool radio_running_;
+    uint64_t radio_free_us_;
+    std::deque<std::pair<uint64_t, protocol::Packet>> radio_queue_;
+    std::thread radio_thread_;
+};
+
+struct BenchConfig {
+    uint32_t duration_s = 10;
+    uint32_t warmup_s = 1;
+    uint16_t port = 8898;
+    uint32_t jitter_samples = protocol::DEFAULT_JITTER_BUFFER_SAMPLES;
+    uint16_t frame_samples = protocol::AUDIO_SAMPLES_PER_PACKET;
+    uint8_t frames_per_packet = 1;
+    size_t workers = common::TimerWheel::DEFAULT_WORKERS;
+    common::PacerStrategy pacer = common::PacerStrategy::SLEEP;
+    uint32_t spin_us = common::Pacer::DEFAULT_SPIN_US;
+    protocol::AudioEncoding encoding = protocol::AudioEncoding::IMA_ADPCM;
+    protocol::StreamFormat stream_format = protocol::DEFAULT_STREAM_FORMAT;
+    double loss = 0.0;              // Fraction of audio packets dropped
+    bool retransmit = true;
+    protocol::FecScheme fec = protocol::FecScheme::NONE;
+    common::SessionCipher::Mode protection = common::SessionCipher::Mode::ENCRYPT;
+    uint32_t bottleneck_kbps = 0;   // Simulated radio rate, 0 = unlimited
+    size_t datagram_size = protocol::DEFAULT_DATAGRAM_SIZE;
+    uint8_t battery_level = 100;
+    bool rate_control = true;
+    bool pacing = true;
+    bool prerender = true;
+    std::vector<std::string> audio_files;   // Files or playlists; empty = test tone
+    bool loop_audio = true;
+    uint32_t reconnects = 0;        // Simulated link losses while measuring
+    uint32_t outage_ms = 0;         // Silence per loss; 0 = both sides are told at once
+    bool full_reconnect = false;    // Pair and connect again instead of resuming
+    std::string csv_path;
+    std::string json_path;
+    bool verbose = false;
+};
+
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --duration S         Measured streaming time (default 10)\n"
+              << "  --warmup S           Frames in the first S seconds are ignored (default 1)\n"
+              << "  --port P             Loopback accessory port (default 8898)\n"
+              << "  --jitter-ms MS       Host jitter buffer target (default 30)\n"
+              << "  --frame-ms MS        Frame duration: 2.5 | 5 | 10 | 20 (default 10)\n"
+              << "  --aggregate N        Frames per packet (default 1, max 8)\n"
+              << "  --workers N          Scheduler worker threads (default 2)\n"
+              << "  --pacer NAME         sleep | spin | nanosleep | timerfd (default sleep)\n"
+              << "  --spin-us US         Spin before each tick with --pacer spin (default 100)\n"
+              << "  --codec NAME         pcm16 | adpcm | lossless (default adpcm)\n"
+              << "  --channels N         Audio channels, 1-8 (default 1)\n"
+              << "  --rate HZ            Sample rate: 44100 | 48000 | 96000 (default 48000)\n"
+              << "  --sample-format NAME int16 | int24 | float32 (default int16; formats other\n"
+              << "                       than mono 48kHz int16 stream raw PCM)\n"
+              << "  --loss PCT           Drop PCT% of audio packets (default 0)\n"
+              << "  --no-retransmit      Do not NACK lost packets\n"
+              << "  --fec NAME           off | xor | rs (default off)\n"
+              << "  --auth NAME          ccm | hmac: encrypt audio, or only tag it (default ccm)\n"
+              << "  --bottleneck KBPS    Accessory radio rate (default unlimited)\n"
+              << "  --datagram BYTES     Largest datagram; bigger packets are fragmented (default 1472)\n"
+              << "  --battery PCT        Accessory battery level (default 100)\n"
+              << "  --no-rate-control    Keep the negotiated format\n"
+              << "  --no-pacing          Send packets as soon as they are built\n"
+              << "  --no-prerender       Render and encode frames on the send tick\n"
+              << "  --audio-file PATH    Stream a WAV/raw PCM file or .m3u playlist (repeatable)\n"
+              << "  --no-loop            Play the files once, then silence\n"
+              << "  --reconnects N       Drop the link N times while measuring and reconnect\n"
+              << "  --outage-ms MS       Each drop silences the link both ways for MS, left to\n"
+              << "                       the host to detect (default 0: both sides are told)\n"
+              << "  --full-reconnect     Reconnect by pairing and connecting, not resuming\n"
+              << "  --csv PATH           Write per-frame stage timestamps\n"
+              << "  --json PATH          Write the latency summary\n"
+              << "  --verbose            Keep component logging\n";
+}
+
+static bool parse_args(int argc, char** argv, BenchConfig* config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = (i + 1 < argc);
+
+        if (arg == "--duration" && has_value) {
+            config->duration_s = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--warmup" && has_value) {
+            config->warmup_s = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--port" && has_value) {
+            config->port = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--jitter-ms" && has_value) {
+            double ms = std::strtod(argv[++i], nullptr);
+            config->jitter_samples = static_cast<uint32_t>(ms * protocol::AUDIO_SAMPLE_RATE / 1000.0);
+        } else if (arg == "--frame-ms" && has_value) {
+            double ms = std::strtod(argv[++i], nullptr);
+            config->frame_samples = static_cast<uint16_t>(ms * protocol::AUDIO_SAMPLE_RATE / 1000.0);
+            if (!protocol::is_valid_frame_samples(config->frame_samples)) {
+                std::cerr << "Frame duration must be 2.5, 5, 10 or 20ms" << std::endl;
+                return false;
+            }
+        } else if (arg == "--aggregate" && has_value) {
+            config->frames_per_packet = static_cast<uint8_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--workers" && has_value) {
+            config->workers = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--pacer" && has_value) {
+            if (!common::pacer_strategy_from_string(argv[++i], &config->pacer)) {
+                std::cerr << "Unknown pacer: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--spin-us" && has_value) {
+            config->spin_us = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--codec" && has_value) {
+            if (!common::audio_encoding_from_string(argv[++i], &config->encoding)) {
+                std::cerr << "Unknown codec: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--channels" && has_value) {
+            config->stream_format.channels = static_cast<uint8_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--rate" && has_value) {
+            config->stream_format.sample_rate = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--sample-format" && has_value) {
+            if (!common::sample_format_from_string(argv[++i], &config->stream_format.sample_format)) {
+                std::cerr << "Unknown sample format: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--loss" && has_value) {
+            config->loss = std::strtod(argv[++i], nullptr) / 100.0;
+        } else if (arg == "--no-retransmit") {
+            config->retransmit = false;
+        } else if (arg == "--fec" && has_value) {
+            if (!common::fec_scheme_from_string(argv[++i], &config->fec)) {
+                std::cerr << "Unknown FEC scheme: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--auth" && has_value) {
+            if (!common::session_cipher_mode_from_string(argv[++i], &config->protection)) {
+                std::cerr << "Unknown protection mode: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--bottleneck" && has_value) {
+            config->bottleneck_kbps = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--datagram" && has_value) {
+            config->datagram_size = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--battery" && has_value) {
+            config->battery_level = static_cast<uint8_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--no-rate-control") {
+            config->rate_control = false;
+        } else if (arg == "--no-pacing") {
+            config->pacing = false;
+        } else if (arg == "--no-prerender") {
+            config->prerender = false;
+        } else if (arg == "--audio-file" && has_value) {
+            config->audio_files.push_back(argv[++i]);
+        } else if (arg == "--no-loop") {
+            config->loop_audio = false;
+        } else if (arg == "--reconnects" && has_value) {
+            config->reconnects = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--outage-ms" && has_value) {
+            config->outage_ms = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--full-reconnect") {
+            config->full_reconnect = true;
+        } else if (arg == "--csv" && has_value) {
+            config->csv_path = argv[++i];
+        } else if (arg == "--json" && has_value) {
+            config->json_path = argv[++i];
+        } else if (arg == "--verbose") {
+            config->verbose = true;
+        } else {
+            return false;
+        }
+    }
+    if (!protocol::is_valid_stream_format(config->stream_format)) {
+        std::cerr << "Stream format must be 1-" << static_cast<int>(protocol::MAX_AUDIO_CHANNELS)
+                  << " channels at 44100, 48000 or 96000Hz" << std::endl;
+        return false;
+    }
+    return config->duration_s > 0 && config->loss >= 0.0 && config->loss < 1.0 &&
+           config->frames_per_packet >= 1 &&
+           config->frames_per_packet <= protocol::MAX_FRAMES_PER_PACKET;
+}
+
+static bool wait_for(const std::function<bool()>& condition, uint32_t timeout_ms) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!condition()) {
+        if (!g_running.load() || std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+static std::string hop_name(size_t hop) {
+    return std::string(LatencyTrace::stage_to_string(static_cast<LatencyTrace::Stage>(hop))) +
+           "->" + LatencyTrace::stage_to_string(static_cast<LatencyTrace::Stage>(hop + 1));
+}
+
+static void print_summary(std::ostream& out, const LatencyTrace::Summary& summary) {
+    out << "\n=== End-to-End Latency (us) ===" << std::endl;
+    out << "Frames: " << summary.frames_traced << " traced, "
+        << summary.frames_completed << " played out" << std::endl;
+
+    for (size_t s = 0; s + 1 < LatencyTrace::STAGE_COUNT; s++) {
+        if (summary.frames_stalled[s] > 0) {
+            out << "  stalled after "
+                << LatencyTrace::stage_to_string(static_cast<LatencyTrace::Stage>(s))
+                << ": " << summary.frames_stalled[s] << std::endl;
+        }
+    }
+
+    out << std::left << std::setw(26) << "hop" << std::right
+        << std::setw(9) << "min" << std::setw(9) << "p50" << std::setw(9) << "p90"
+        << std::setw(9) << "p99" << std::setw(9) << "p99.9" << std::setw(9) << "max"
+        << std::setw(10) << "mean" << std::setw(12) << "p99+ mean" << std::endl;
+
+    auto row = [&out](const std::string& name, const LatencyTrace::Distribution& d, double tail) {
+        out << std::left << std::setw(26) << name << std::right
+            << std::setw(9) << d.min_us << std::setw(9) << d.p50_us << std::setw(9) << d.p90_us
+            << std::setw(9) << d.p99_us << std::setw(9) << d.p999_us << std::setw(9) << d.max_us
+            << std::setw(10) << std::fixed << std::setprecision(1) << d.mean_us
+            << std::setw(12) << tail << std::endl;
+    };
+
+    double tail_total = 0.0;
+    for (size_t hop = 0; hop < LatencyTrace::HOP_COUNT; hop++) {
+        row(hop_name(hop), summary.hop[hop], summary.tail_hop_us[hop]);
+        tail_total += summary.tail_hop_us[hop];
+    }
+    row("total", summary.total, tail_total);
+}
+
+static bool write_csv(const std::string& path, const std::vector<LatencyTrace::Frame>& frames,
+                      uint32_t first_sequence) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        return false;
+    }
+
+    // Stamps are relative to the first traced frame; empty = never reached
+    out << "sequence";
+    for (size_t s = 0; s < LatencyTrace::STAGE_COUNT; s++) {
+        out << "," << LatencyTrace::stage_to_string(static_cast<LatencyTrace::Stage>(s)) << "_us";
+    }
+    out << ",total_us\n";
+
+    uint64_t origin = 0;
+    for (const auto& frame : frames) {
+        if (frame.sequence < first_sequence) {
+            continue;
+        }
+        if (origin == 0) {
+            origin = frame.stamp_us[0];
+        }
+
+        out << frame.sequence;
+        for (size_t s = 0; s < LatencyTrace::STAGE_COUNT; s++) {
+            out << ",";
+            if (frame.stamp_us[s] != 0) {
+                out << frame.stamp_us[s] - origin;
+            }
+        }
+        out << ",";
+        uint64_t played = frame.stamp_us[LatencyTrace::STAGE_COUNT - 1];
+        if (played != 0) {
+            out << played - frame.stamp_us[0];
+        }
+        out << "\n";
+    }
+    return true;
+}
+
+static void write_distribution(std::ostream& out, const LatencyTrace::Distribution& d) {
+    out << "{\"count\": " << d.count
+        << ", \"min_us\": " << d.min_us
+        << ", \"p50_us\": " << d.p50_us
+        << ", \"p90_us\": " << d.p90_us
+        << ", \"p99_us\": " << d.p99_us
+        << ", \"p999_us\": " << d.p999_us
+        << ", \"max_us\": " << d.max_us
+        << ", \"mean_us\": " << std::fixed << std::setprecision(1) << d.mean_us << "}";
+}
+
+// Both stacks share one clock here, so the true offset is 0 and the
+// estimated offset is the synchronization error
+static void print_clock_sync(std::ostream& out, const host::ClockSync::Stats& sync,
+                             const host::AudioSync::Stats& audio) {
+    out << "\n=== Clock Sync ===" << std::endl;
+    if (!sync.synchronized) {
+        out << "Not synchronized (" << sync.responses_received << " responses)" << std::endl;
+        return;
+    }
+    out << "Offset error: " << sync.offset_us << "us, drift " << std::setprecision(2)
+        << sync.drift_ppm << "ppm, RTT min " << sync.min_rtt_us << "us / last "
+        << sync.last_rtt_us << "us, " << sync.responses_received << " exchanges ("
+        << sync.samples_rejected << " slow)" << std::endl;
+    out << "Host one-way latency (capture->receive): avg " << audio.avg_one_way_latency_us
+        << "us, max " << audio.max_one_way_latency_us << "us"
+        << (audio.playout_aligned ? ", playout aligned to capture time" : "") << std::endl;
+}
+
+// Tick thread wake-ups, timer dispatch (all components) and the audio
+// frame tick against its ideal schedule
+static void print_scheduler(std::ostream& out, const common::TimerWheel& scheduler,
+                            const accessory::AudioStreamer::Stats& streamer) {
+    common::Pacer::Stats pacer = scheduler.get_pacer_stats();
+    common::TimingHistogram dispatch = scheduler.get_dispatch_histogram();
+    out << "\n=== Scheduler ===" << std::endl;
+    out << "Pacer " << common::pacer_strategy_to_string(scheduler.pacer_strategy())
+        << ": wake error p50 " << pacer.wake_error.percentile_us(0.5) << "us, p99 "
+        << pacer.wake_error.percentile_us(0.99) << "us, max " << pacer.wake_error.max_us()
+        << "us over " << pacer.waits << " ticks, " << pacer.ticks_skipped << " late" << std::endl;
+    out << "Timer dispatch error: p50 " << dispatch.percentile_us(0.5) << "us, p99 "
+        << dispatch.percentile_us(0.99) << "us, max " << dispatch.max_us() << "us over "
+        << dispatch.count() << " firings" << std::endl;
+    out << "Audio tick error: avg " << streamer.avg_timing_error_us << "us, max "
+        << streamer.max_timing_error_us << "us, " << streamer.ticks_skipped << " ticks skipped"
+        << std::endl;
+}
+
+static void print_stream(std::ostream& out, const host::AudioSync::Stats& audio,
+                         const accessory::AudioStreamer::Stats& streamer, uint64_t dropped,
+                         common::SessionCipher::Mode protection) {
+    out << "\n=== Stream ===" << std::endl;
+    out << protocol::audio_encoding_to_string(audio.encoding) << ", "
+        << static_cast<int>(audio.stream_format.channels) << "ch "
+        << audio.stream_format.sample_rate << "Hz "
+        << protocol::sample_format_to_string(audio.stream_format.sample_format) << ", "
+        << protocol::samples_to_us(audio.frame_samples) / 1000.0 << "ms frames x "
+        << static_cast<int>(audio.frames_per_packet) << " per packet: ";
+    if (audio.frames_received > 0) {
+        double bytes_per_frame = static_cast<double>(audio.audio_bytes_received) / audio.frames_received;
+        double frame_ms = protocol::samples_to_us(audio.frame_samples) / 1000.0;
+        out << std::fixed << std::setprecision(1) << bytes_per_frame << " bytes/frame ("
+            << bytes_per_frame * 8.0 / frame_ms << " kbit/s), "
+            << audio.packets_received * 1000.0 / (audio.frames_received * frame_ms) << " packets/s, ";
+    }
+    out << audio.decode_errors << " decode errors" << std::endl;
+    out << "Sink peak:";
+    for (uint8_t c = 0; c < audio.stream_format.channels; c++) {
+        out << (c ? ", " : " ") << std::setprecision(3) << audio.channel_peaks[c];
+    }
+    out << std::setprecision(1) << " of full scale" << std::endl;
+    out << "Frames played " << audio.frames_played << ", lost " << audio.frames_lost
+        << " (" << audio.samples_lost << " samples), late " << audio.frames_late << std::endl;
+    out << "Retransmission: " << dropped << " packets dropped, " << audio.retransmits_requested
+        << " NACKed in " << audio.nack_packets_sent << " requests, "
+        << audio.retransmits_recovered << " recovered, " << audio.retransmits_unrecoverable
+        << " unrecoverable; accessory resent " << streamer.retransmissions << " of "
+        << streamer.retransmit_requests << " (" << streamer.retransmit_misses
+        << " no longer held)" << std::endl;
+    out << "ACKs: " << audio.acks_sent << " sent, " << streamer.acks_received << " received, "
+        << streamer.packets_acked << " packets acked; accessory estimates RTT "
+        << std::setprecision(2) << streamer.avg_latency_us / 1000.0 << "ms (min "
+        << streamer.min_rtt_us / 1000.0 << ", max " << streamer.max_latency_us / 1000.0 << "), loss "
+        << streamer.packets_lost << " packets (" << std::setprecision(1)
+        << streamer.loss_rate * 100.0 << "% recent)" << std::endl;
+    out << "Rate control: level " << static_cast<int>(streamer.quality_level) << " after "
+        << streamer.quality_changes << " changes; pacing held " << streamer.packets_paced
+        << " packets (max " << streamer.max_pacing_delay_us << "us), " << streamer.pacing_overflows
+        << " overflows" << std::endl;
+    out << "Send tick work: avg " << std::setprecision(2) << streamer.avg_tick_work_ns / 1000.0
+        << "us, max " << streamer.max_tick_work_ns / 1000.0 << "us; render per frame avg "
+        << streamer.avg_render_work_ns / 1000.0 << "us, max " << streamer.max_render_work_ns / 1000.0
+        << "us; " << streamer.render_underruns << " underruns" << std::endl;
+    if (protection == common::SessionCipher::Mode::AUTHENTICATE) {
+        out << "Encryption: none, HMAC-SHA256 tags (" << common::sha256_implementation() << "), ";
+    } else {
+        out << "Encryption: AES-128-CCM (" << common::aes_implementation() << "), ";
+    }
+    out << streamer.packets_encrypted << " packets sealed, " << audio.packets_decrypted
+        << " opened, " << audio.decrypt_failures << " failed authentication" << std::endl;
+    if (audio.fec_scheme != protocol::FecScheme::NONE || audio.fec_packets_received > 0) {
+        out << "FEC: " << protocol::fec_scheme_to_string(audio.fec_scheme) << " "
+            << static_cast<int>(audio.fec_data_count) << "+" << static_cast<int>(audio.fec_parity_count)
+            << " at " << std::setprecision(1) << audio.loss_rate * 100.0 << "% loss, "
+            << streamer.fec_packets_sent << " parity sent, " << audio.fec_packets_received
+            << " received, " << audio.fec_packets_recovered << " rebuilt in time, "
+            << audio.fec_packets_late << " late, " << audio.fec_groups_failed
+            << " groups with too many losses" << std::endl;
+    }
+}
+
+static void print_fragmentation(std::ostream& out, const accessory::Transport& accessory_transport,
+                                const host::Transport& host_transport) {
+    common::Reassembler::Stats reassembly = host_transport.get_reassembly_stats();
+    out << "Fragmentation: " << accessory_transport.get_datagram_size() << "-byte datagrams, "
+        << accessory_transport.get_datagrams_sent() << " sent for "
+        << accessory_transport.get_packets_sent() << " packets; host reassembled "
+        << reassembly.packets_reassembled << " from " << reassembly.fragments_received
+        << " fragments (" << reassembly.timeouts << " timed out, " << reassembly.evictions
+        << " evicted, " << reassembly.fragments_invalid << " invalid, "
+        << reassembly.fragments_duplicate << " duplicate, max " << reassembly.max_in_flight
+        << " in flight)" << std::endl;
+}
+
+static void print_reconnects(std::ostream& out, const host::DeviceManager::Stats& stats,
+                             const host::ConnectionFSM::Stats& link,
+                             uint32_t accessory_resumes, uint32_t failed) {
+    out << "Reconnect: " << stats.reconnects << " to first audio ("
+        << stats.resumes_succeeded << "/" << stats.resumes_attempted << " resumed, "
+        << stats.resumes_rejected << " rejected, " << accessory_resumes
+        << " on the accessory, " << failed << " failed): avg "
+        << stats.avg_reconnect_us / 1000.0 << "ms, max " << stats.max_reconnect_us / 1000.0
+        << "ms" << std::endl;
+    out << "Downtime: " << link.drops << " drops detected within "
+        << link.max_detect_us / 1000.0 << "ms, " << link.attempts << " attempts ("
+        << link.attempts_failed << " unanswered, " << link.probes << " probes), audio down avg "
+        << link.avg_downtime_us / 1000.0 << "ms, max " << link.max_downtime_us / 1000.0
+        << "ms (" << link.recovered << " recovered, " << link.abandoned << " abandoned)"
+        << std::endl;
+}
+
+static bool write_json(const std::string& path, const BenchConfig& config,
+                       const LatencyTrace::Summary& summary,
+                       const host::ClockSync::Stats& sync) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        return false;
+    }
+
+    out << "{\n";
+    out << "  \"duration_s\": " << config.duration_s << ",\n";
+    out << "  \"warmup_s\": " << config.warmup_s << ",\n";
+    out << "  \"jitter_buffer_samples\": " << config.jitter_samples << ",\n";
+    out << "  \"frame_duration_us\": " << protocol::samples_to_us(config.frame_samples) << ",\n";
+    out << "  \"frames_per_packet\": " << static_cast<int>(config.frames_per_packet) << ",\n";
+    out << "  \"encoding\": \"" << protocol::audio_encoding_to_string(config.encoding) << "\",\n";
+    out << "  \"channels\": " << static_cast<int>(config.stream_format.channels) << ",\n";
+    out << "  \"sample_rate\": " << config.stream_format.sample_rate << ",\n";
+    out << "  \"sample_format\": \""
+        << protocol::sample_format_to_string(config.stream_format.sample_format) << "\",\n";
+    out << "  \"datagram_size\": " << config.datagram_size << ",\n";
+    out << "  \"packet_loss_pct\": " << config.loss * 100.0 << ",\n";
+    out << "  \"fec\": \"" << protocol::fec_scheme_to_string(config.fec) << "\",\n";
+    out << "  \"auth\": \"" << common::session_cipher_mode_to_string(config.protection) << "\",\n";
+    out << "  \"frames_traced\": " << summary.frames_traced << ",\n";
+    out << "  \"frames_completed\": " << summary.frames_completed << ",\n";
+
+    out << "  \"frames_stalled\": {";
+    for (size_t s = 0; s + 1 < LatencyTrace::STAGE_COUNT; s++) {
+        out << (s ? ", " : "") << "\""
+            << LatencyTrace::stage_to_string(static_cast<LatencyTrace::Stage>(s))
+            << "\": " << summary.frames_stalled[s];
+    }
+    out << "},\n";
+
+    out << "  \"hops\": [\n";
+    for (size_t hop = 0; hop < LatencyTrace::HOP_COUNT; hop++) {
+        out << "    {\"hop\": \"" << hop_name(hop) << "\", \"latency\": ";
+        write_distribution(out, summary.hop[hop]);
+        out << ", \"p99_tail_mean_us\": " << summary.tail_hop_us[hop] << "}"
+            << (hop + 1 < LatencyTrace::HOP_COUNT ? "," : "") << "\n";
+    }
+    out << "  ],\n";
+
+    out << "  \"total\": ";
+    write_distribution(out, summary.total);
+    out << ",\n";
+
+    out << "  \"clock_sync\": {\"synchronized\": " << (sync.synchronized ? "true" : "false")
+        << ", \"offset_error_us\": " << sync.offset_us
+        << ", \"drift_ppm\": " << std::setprecision(3) << sync.drift_ppm
+        << ", \"min_rtt_us\": " << sync.min_rtt_us
+        << ", \"exchanges\": " << sync.responses_received << "}\n";
+    out << "}\n";
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if (!parse_args(argc, argv, &config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::ostream report_out(std::cout.rdbuf());
+    NullBuffer null_buffer;
+    if (!config.verbose) {
+        std::cout.rdbuf(&null_buffer);
+    }
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    common::TimerWheel scheduler;
+    scheduler.set_pacer(config.pacer, config.spin_us);
+    scheduler.start(config.workers);
+
+    LatencyTrace trace;
+
+    // Accessory side
+    LossyTransport accessory_transport(config.loss, config.bottleneck_kbps);
+    if (!accessory_transport.start(config.port)) {
+        std::cout.rdbuf(report_out.rdbuf());
+        std::cerr << "[Bench] Failed to bind accessory port " << config.port << std::endl;
+        return 1;
+    }
+    accessory_transport.set_datagram_size(config.datagram_size);
+    accessory::ConnectionFSM connection_fsm(&accessory_transport, &scheduler);
+    accessory::FileSource file_source;     // Outlives the streamer
+    accessory::AudioStreamer audio_streamer(&accessory_transport, &scheduler);
+    accessory::Telemetry accessory_telemetry(&accessory_transport, &scheduler);
+    accessory_telemetry.set_audio_streamer(&audio_streamer);
+    accessory_telemetry.set_battery_level(config.battery_level);
+    audio_streamer.set_telemetry(&accessory_telemetry);
+    audio_streamer.set_pacing(config.pacing);
+    audio_streamer.set_prerender(config.prerender);
+    
+    if (!config.audio_files.empty()) {
+        file_source.set_loop(config.loop_audio);
+        if (!file_source.open(config.audio_files, protocol::AUDIO_SAMPLE_RATE)) {
+            std::cout.rdbuf(report_out.rdbuf());
+            std::cerr << "[Bench] No playable audio file" << std::endl;
+            return 1;
+        }
+        audio_streamer.set_file_source(&file_source);
+    }
+
+    accessory_transport.set_latency_trace(&trace);
+    audio_streamer.set_latency_trace(&trace);
+
+    // A fresh session streams once the host's clock sync burst has been
+    // answered, so host playout can align to capture time
+    constexpr uint32_t SYNC_EXCHANGES_BEFORE_AUDIO = 4;     // Host SYNC_MIN_SAMPLES
+    std::atomic<uint32_t> sync_exchanges(0);
+
+    accessory_transport.set_packet_callback([&](const protocol::Packet& packet) {
+        if (accessory_transport.in_outage()) {
+            return;
+        }
+        switch (packet.header.type) {
+            case protocol::PacketType::DISCOVER_REQUEST:
+                connection_fsm.on_discover_request(packet);
+                break;
+            case protocol::PacketType::PAIR_REQUEST:
+                connection_fsm.on_pair_request(packet);
+                break;
+            case protocol::PacketType::CONNECT_REQUEST:
+                connection_fsm.on_connect_request(packet);
+                break;
+            case protocol::PacketType::RESUME_REQUEST:
+                connection_fsm.on_resume_request(packet);
+                break;
+            case protocol::PacketType::DISCONNECT:
+                connection_fsm.on_disconnect(packet);
+                audio_streamer.stop_streaming();
+                break;
+            case protocol::PacketType::KEEPALIVE:
+                connection_fsm.on_keepalive(packet);
+                break;
+            case protocol::PacketType::TIME_SYNC_REQUEST:
+                connection_fsm.on_time_sync_request(packet);
+                if (++sync_exchanges == SYNC_EXCHANGES_BEFORE_AUDIO &&
+                    connection_fsm.get_state() == protocol::ConnectionState::CONNECTED) {
+                    connection_fsm.enter_streaming();
+                }
+                break;
+            case protocol::PacketType::AUDIO_RETRANSMIT:
+                audio_streamer.on_retransmit_request(packet);
+                break;
+            case protocol::PacketType::AUDIO_ACK:
+                audio_streamer.on_ack(packet);
+                break;
+            case protocol::PacketType::AUDIO_FEC_CONFIG:
+                audio_streamer.on_fec_config(packet);
+                break;
+            default:
+                break;
+        }
+    });
+
+    connection_fsm.set_state_change_callback([&](protocol::ConnectionState old_state,
+                                                  protocol::ConnectionState new_state) {
+        if (new_state == protocol::ConnectionState::CONNECTED) {
+            // A resumed session streams at once; if the burst was answered
+            // before this ran, the receive thread saw CONNECTED too early
+            accessory_telemetry.start();
+            if (connection_fsm.is_resumed() || sync_exchanges.load() >= SYNC_EXCHANGES_BEFORE_AUDIO) {
+                connection_fsm.enter_streaming();
+            }
+        } else if (new_state == protocol::ConnectionState::STREAMING) {
+            audio_streamer.set_stream_format(connection_fsm.get_stream_format());
+            audio_streamer.set_encoding(connection_fsm.get_audio_encoding());
+            audio_streamer.set_frame_format(connection_fsm.get_frame_samples(),
+                                            connection_fsm.get_frames_per_packet());
+            uint8_t key[protocol::SESSION_KEY_SIZE];
+            audio_streamer.set_session_key(connection_fsm.get_session_key(key) ? key : nullptr);
+            audio_streamer.set_protection_mode(config.protection);
+            audio_streamer.set_rate_control(config.rate_control,
+                connection_fsm.host_decodes_codecs() ? protocol::AudioEncoding::IMA_ADPCM
+                                                     : protocol::AudioEncoding::PCM16);
+            uint32_t sequence;
+            uint64_t position;
+            if (connection_fsm.get_resume_point(&sequence, &position)) {
+                audio_streamer.set_resume_point(sequence, position);
+            }
+            audio_streamer.start_streaming();
+        } else if (old_state == protocol::ConnectionState::CONNECTED ||
+                   old_state == protocol::ConnectionState::STREAMING) {
+            sync_exchanges.store(0);
+            audio_streamer.stop_streaming();
+            connection_fsm.set_resume_point(audio_streamer.get_next_sequence(),
+                                            audio_streamer.get_sample_position());
+            accessory_telemetry.stop();
+        }
+    });
+
+    // Host side
+    host::Transport host_transport;
+    if (!host_transport.start("127.0.0.1", config.port)) {
+        std::cout.rdbuf(report_out.rdbuf());
+        std::cerr << "[Bench] Failed to start host transport" << std::endl;
+        return 1;
+    }
+    host_transport.set_datagram_size(config.datagram_size);
+    host::DeviceManager device_manager(&host_transport, &scheduler);
+    device_manager.set_preferred_encoding(config.encoding);
+    device_manager.set_frame_format(config.frame_samples, config.frames_per_packet);
+    device_manager.set_stream_format(config.stream_format);
+    device_manager.set_resumption_enabled(!config.full_reconnect);
+    host::AudioSync audio_sync(&host_transport, &scheduler);
+    audio_sync.set_jitter_buffer_samples(config.jitter_samples);
+    audio_sync.set_retransmission_enabled(config.retransmit);
+    audio_sync.set_fec_scheme(config.fec);
+    host::ClockSync clock_sync(&host_transport, &scheduler);
+    audio_sync.set_clock_sync(&clock_sync);
+
+    host_transport.set_latency_trace(&trace);
+    audio_sync.set_latency_trace(&trace);
+
+    host_transport.set_packet_callback([&](protocol::Packet& packet) {
+        switch (packet.header.type) {
+            case protocol::PacketType::DISCOVER_RESPONSE:
+                device_manager.on_discover_response(packet);
+                break;
+            case protocol::PacketType::PAIR_RESPONSE:
+                device_manager.on_pair_response(packet);
+                break;
+            case protocol::PacketType::CONNECT_RESPONSE: {
+                device_manager.on_connect_response(packet);
+                uint8_t key[protocol::SESSION_KEY_SIZE];
+                audio_sync.set_session_key(device_manager.get_session_key(key) ? key : nullptr);
+                clock_sync.start();
+                audio_sync.start();
+                break;
+            }
+            case protocol::PacketType::SESSION_TICKET:
+                device_manager.on_session_ticket(packet);
+                break;
+            case protocol::PacketType::RESUME_RESPONSE:
+                if (device_manager.on_resume_response(packet)) {
+                    uint8_t key[protocol::SESSION_KEY_SIZE];
+                    audio_sync.set_session_key(device_manager.get_session_key(key) ? key : nullptr);
+                    clock_sync.start();
+                    audio_sync.start();
+                }
+                break;
+            case protocol::PacketType::KEEPALIVE:
+                device_manager.on_keepalive(packet);
+                break;
+            case protocol::PacketType::TIME_SYNC_RESPONSE:
+                clock_sync.on_time_sync_response(packet);
+                break;
+            case protocol::PacketType::AUDIO_DATA:
+                device_manager.on_audio_received();
+                audio_sync.on_audio_packet(packet);
+                break;
+            case protocol::PacketType::AUDIO_FEC:
+                audio_sync.on_fec_packet(packet);
+                break;
+            default:
+                break;
+        }
+    });
+
+    device_manager.set_connection_state_callback([&](bool connected) {
+        if (!connected) {
+            audio_sync.stop();
+            clock_sync.stop();
+        }
+    });
+
+    // Both sides streaming. The host's connection FSM pairs and connects,
+    // and resumes after a drop, by itself.
+    auto streaming = [&](uint32_t timeout_ms) {
+        return wait_for([&] {
+            return device_manager.get_link_state() == protocol::ConnectionState::STREAMING &&
+                   audio_streamer.is_streaming();
+        }, timeout_ms);
+    };
+
+    // Discover, pair and connect
+    connection_fsm.start();
+    device_manager.start_discovery();
+
+    bool connected =
+        wait_for([&] { return !device_manager.get_discovered_devices().empty(); }, 5000);
+    if (connected) {
+        host::DeviceInfo device = device_manager.get_discovered_devices().front();
+        device_manager.stop_discovery();
+        connected = device_manager.start_session(device) && streaming(2000);
+    }
+
+    if (!connected) {
+        std::cout.rdbuf(report_out.rdbuf());
+        std::cerr << "[Bench] Accessory did not reach STREAMING" << std::endl;
+        return 1;
+    }
+
+    // The accessory may have lowered the aggregation to fit its codec
+    const uint64_t packet_us = protocol::samples_to_us(
+        static_cast<uint64_t>(audio_streamer.get_frame_samples()) * audio_streamer.get_frames_per_packet());
+    report_out << "[Bench] Streaming on 127.0.0.1:" << config.port
+               << ", warm-up " << config.warmup_s << "s, measuring " << config.duration_s
+               << "s (jitter buffer " << protocol::samples_to_us(config.jitter_samples) / 1000.0
+               << "ms, " << packet_us / 1000.0 << "ms per packet)" << std::endl;
+
+    // Link losses spread evenly over the measured time
+    auto started = std::chrono::steady_clock::now();
+    auto end = started + std::chrono::seconds(config.warmup_s + config.duration_s);
+    auto loss_interval = std::chrono::seconds(config.duration_s) / (config.reconnects + 1);
+    auto next_loss = started + std::chrono::seconds(config.warmup_s) + loss_interval;
+    uint32_t reconnects_failed = 0;
+    for (uint32_t losses = 0; g_running.load() && std::chrono::steady_clock::now() < end;) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (losses < config.reconnects && std::chrono::steady_clock::now() >= next_loss) {
+            losses++;
+            next_loss += loss_interval;
+            if (config.outage_ms > 0) {
+                // Only the host's keepalive and audio supervision can tell
+                accessory_transport.set_outage(true);
+                std::this_thread::sleep_for(std::chrono::milliseconds(config.outage_ms));
+                accessory_transport.set_outage(false);
+            } else {
+                connection_fsm.handle_connection_loss();
+                device_manager.handle_connection_loss();
+            }
+            // Longer than the largest backoff step
+            if (!streaming(2 * protocol::RECONNECT_MAX_DELAY_MS)) {
+                reconnects_failed++;
+            }
+        }
+    }
+
+    // Stop the source, then let the jitter buffer drain before collecting
+    audio_streamer.stop_streaming();
+    std::this_thread::sleep_for(std::chrono::microseconds(
+        protocol::samples_to_us(protocol::MAX_JITTER_BUFFER_SAMPLES) + 2 * packet_us + 150000));
+
+    // Trace frames are packets (sequence numbers)
+    uint32_t first_sequence = static_cast<uint32_t>(config.warmup_s * 1000000ull / packet_us);
+    LatencyTrace::Summary summary = trace.summarize(first_sequence);
+    std::vector<LatencyTrace::Frame> frames = trace.frames();
+    host::ClockSync::Stats sync_stats = clock_sync.get_stats();
+    host::AudioSync::Stats audio_stats = audio_sync.get_stats();
+    accessory::AudioStreamer::Stats streamer_stats = audio_streamer.get_stats();
+    host::DeviceManager::Stats device_stats = device_manager.get_stats();
+    host::ConnectionFSM::Stats link_stats = device_manager.get_link_stats();
+
+    audio_sync.stop();
+    clock_sync.stop();
+    device_manager.disconnect_device();
+    accessory_telemetry.stop();
+    connection_fsm.stop();
+    host_transport.stop();
+    accessory_transport.stop();
+    scheduler.stop();
+    std::cout.rdbuf(report_out.rdbuf());
+
+    print_summary(report_out, summary);
+    print_clock_sync(report_out, sync_stats, audio_stats);
+    print_scheduler(report_out, scheduler, streamer_stats);
+    print_stream(report_out, audio_stats, streamer_stats, accessory_transport.get_dropped(),
+                 config.protection);
+    print_fragmentation(report_out, accessory_transport, host_transport);
+    if (config.reconnects > 0) {
+        print_reconnects(report_out, device_stats, link_stats, connection_fsm.get_resume_count(),
+                         reconnects_failed);
+    }
+
+    if (!config.csv_path.empty()) {
+        if (write_csv(config.csv_path, frames, first_sequence)) {
+            report_out << "[Bench] Per-frame CSV written to " << config.csv_path << std::endl;
+        } else {
+            std::cerr << "[Bench] Failed to write " << config.csv_path << std::endl;
+        }
+    }
+    if (!config.json_path.empty()) {
+        if (write_json(config.json_path, config, summary, sync_stats)) {
+            report_out << "[Bench] JSON summary written to " << config.json_path << std::endl;
+        } else {
+            std::cerr << "[Bench] Failed to write " << config.json_path << std::endl;
+        }
+    }
+
+    return summary.frames_completed > 0 ? 0 : 1;
+}
@@ -0,0 +1,228 @@
+// Device registry micro-benchmark.
+//
+// Fills a registry with N advertisers and times what discovery does with
+// it: new devices, known devices answering again (the common case), the
+// same against the linear list DeviceManager used to scan, lookups, a
+// stale sweep, and following the list through the change feed against
+// copying it. Device ids are random, as accessories make them.
+
+#include "host/device_registry.h"
+#include "csprng.h"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+struct BenchConfig {
+    std::vector<uint32_t> sizes = {100, 1000, 10000, 100000};
+    size_t responses = 1000000;     // Refreshes timed per size
+    size_t threads = 1;             // Threads sharing the refreshes
+};
+
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --devices N     Advertisers in range (repeatable; default 100, 1000,\n"
+              << "                  10000 and 100000)\n"
+              << "  --responses N   Discover responses timed per size (default 1000000)\n"
+              << "  --threads N     Threads handling them (default 1)\n";
+}
+
+static bool parse_args(int argc, char** argv, BenchConfig* config) {
+    bool sizes_given = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = (i + 1 < argc);
+
+        if (arg == "--devices" && has_value) {
+            if (!sizes_given) {
+                config->sizes.clear();
+                sizes_given = true;
+            }
+            config->sizes.push_back(static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+        } else if (arg == "--responses" && has_value) {
+            config->responses = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--threads" && has_value) {
+            config->threads = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            return false;
+        }
+    }
+    return config->responses > 0 && config->threads > 0 && !config->sizes.empty();
+}
+
+static double elapsed_us(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+static host::DeviceRecord make_record(const uint8_t* device_id, uint32_t index, uint64_t seen_us) {
+    host::DeviceRecord record;
+    memset(&record, 0, sizeof(record));
+    memcpy(record.device_id, device_id, sizeof(record.device_id));
+    snprintf(record.name, sizeof(record.name), "AudioSim-%u", index);
+    record.capabilities = 0x0007;
+    record.battery_level = 80;
+    record.last_seen_us = seen_us;
+    return record;
+}
+
+// The list DeviceManager kept before: a scan per response under a mutex
+struct LinearDevice {
+    std::string name;
+    uint8_t device_id[8];
+    uint64_t last_seen_us;
+};
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if (!parse_args(argc, argv, &config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::cout << "=== Device Registry Benchmark ===" << std::endl;
+    std::cout << config.responses << " responses from known devices per size on "
+              << config.threads << " thread(s); feed and copy for a round where 1% change"
+              << std::endl << std::endl;
+    std::cout << std::setw(8) << "devices" << std::setw(8) << "slots" << std::setw(10) << "insert ns"
+              << std::setw(11) << "refresh ns" << std::setw(11) << "linear ns" << std::setw(9)
+              << "find ns" << std::setw(8) << "probes" << std::setw(10) << "sweep us"
+              << std::setw(9) << "feed us" << std::setw(9) << "copy us" << std::endl;
+
+    size_t failures = 0;
+    for (uint32_t count : config.sizes) {
+        std::vector<uint8_t> ids(static_cast<size_t>(count) * 8);
+        common::random_bytes(ids.data(), ids.size());
+
+        // First round: every device is new
+        host::DeviceRegistry registry;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < count; i++) {
+            failures += registry.observe(make_record(&ids[i * 8], i, 1000)) ==
+                        host::DeviceRegistry::Result::ADDED ? 0 : 1;
+        }
+        double insert_ns = elapsed_us(start) * 1000.0 / std::max<uint32_t>(count, 1);
+
+        // Later rounds: the same devices answer again, split over the threads
+        std::vector<host::DeviceRecord> records;
+        records.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            records.push_back(make_record(&ids[i * 8], i, 2000));
+        }
+        std::vector<size_t> refreshed(config.threads, 0);
+        start = std::chrono::steady_clock::now();
+        {
+            std::vector<std::thread> workers;
+            for (size_t t = 0; t < config.threads; t++) {
+                workers.emplace_back([&, t] {
+                    size_t share = config.responses / config.threads;
+                    for (size_t n = 0; n < share && count > 0; n++) {
+                        const host::DeviceRecord& record = records[(n * config.threads + t) % count];
+                        refreshed[t] += registry.observe(record) ==
+                                        host::DeviceRegistry::Result::REFRESHED ? 1 : 0;
+                    }
+                });
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+        double refresh_ns = elapsed_us(start) * 1000.0 / config.responses;
+        for (size_t n : refreshed) {
+            failures += count > 0 && n != config.responses / config.threads ? 1 : 0;
+        }
+
+        // The old list: far fewer responses, it is slow enough
+        std::vector<LinearDevice> linear;
+        std::mutex linear_mutex;
+        for (uint32_t i = 0; i < count; i++) {
+            LinearDevice device;
+            device.name = records[i].name;
+            memcpy(device.device_id, records[i].device_id, sizeof(device.device_id));
+            device.last_seen_us = 1000;
+            linear.push_back(device);
+        }
+        size_t linear_responses = std::max<size_t>(std::min<size_t>(config.responses,
+                                                                    20000000 / (count + 1)), 1);
+        start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < linear_responses && count > 0; n++) {
+            const host::DeviceRecord& record = records[(n * 7919) % count];
+            std::lock_guard<std::mutex> lock(linear_mutex);
+            for (auto& existing : linear) {
+                if (memcmp(existing.device_id, record.device_id, sizeof(record.device_id)) == 0) {
+                    existing.last_seen_us = record.last_seen_us;
+                    break;
+                }
+            }
+        }
+        double linear_ns = elapsed_us(start) * 1000.0 / linear_responses;
+
+        // Lookups, half of them for devices out of range
+        host::DeviceRegistry::Stats before = registry.get_stats();
+        host::DeviceRecord found;
+        uint8_t unknown[8];
+        start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < config.responses; n++) {
+            if (n & 1) {
+                common::random_bytes(unknown, sizeof(unknown));
+                failures += registry.find(unknown, &found) ? 1 : 0;
+            } else {
+                failures += count == 0 || registry.find(&ids[((n / 2) % count) * 8], &found) ? 0 : 1;
+            }
+        }
+        double find_ns = elapsed_us(start) * 1000.0 / config.responses;
+        host::DeviceRegistry::Stats after = registry.get_stats();
+        double probes = static_cast<double>(after.probes - before.probes) /
+                        static_cast<double>(after.lookups - before.lookups);
+
+        // A round in which 1% of the devices change: follow the feed, or
+        // copy the whole list as get_discovered_devices() does
+        uint64_t version = after.version;
+        uint32_t changing = std::max<uint32_t>(count / 100, 1);
+        for (uint32_t i = 0; i < changing && i < count; i++) {
+            records[i].battery_level = 79;
+            registry.observe(records[i]);
+        }
+        std::vector<host::DeviceChange> changes;
+        start = std::chrono::steady_clock::now();
+        failures += registry.changes_since(&version, &changes) ? 0 : 1;
+        double feed_us = elapsed_us(start);
+        failures += changes.size() == std::min<uint32_t>(changing, count) ? 0 : 1;
+        start = std::chrono::steady_clock::now();
+        std::vector<host::DeviceRecord> copy = registry.snapshot();
+        double copy_us = elapsed_us(start);
+        failures += copy.size() == count ? 0 : 1;
+
+        // A tenth of the devices stopped answering
+        for (uint32_t i = 0; i < count; i++) {
+            if (i % 10 != 0) {
+                records[i].last_seen_us = 3000;
+                registry.observe(records[i]);
+            }
+        }
+        start = std::chrono::steady_clock::now();
+        size_t evicted = registry.evict_stale(2500);
+        double sweep_us = elapsed_us(start);
+        failures += evicted == (count + 9) / 10 ? 0 : 1;
+        for (uint32_t i = 0; i < count; i++) {
+            failures += registry.contains(&ids[i * 8]) == (i % 10 != 0) ? 0 : 1;
+        }
+
+        std::cout << std::setw(8) << count << std::setw(8) << registry.get_stats().slots
+                  << std::fixed << std::setprecision(1) << std::setw(10) << insert_ns
+                  << std::setw(11) << refresh_ns << std::setw(11) << linear_ns
+                  << std::setw(9) << find_ns << std::setw(8) << std::setprecision(2) << probes
+                  << std::setw(10) << std::setprecision(1) << sweep_us << std::setw(9) << feed_us
+                  << std::setw(9) << copy_us << std::endl;
+    }
+
+    if (failures > 0) {
+        std::cerr << "[Bench] " << failures << " operations gave the wrong result" << std::endl;
+        return 1;
+    }
+    return 0;
+}
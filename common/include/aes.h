@@ -0,0 +1,61 @@
+#ifndef COMMON_AES_H
+#define COMMON_AES_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace common {
+
+// AES-128 (FIPS-197), encryption direction only: CTR and CCM never run the
+// inverse cipher. Rounds use AES-NI when the CPU has it (picked at run
+// time), else a bitsliced software version that is constant time: no table
+// lookups or branches depend on the key or the data.
+class Aes128 {
+public:
+    static constexpr size_t KEY_SIZE = 16;
+    static constexpr size_t BLOCK_SIZE = 16;
+    static constexpr size_t CCM_NONCE_SIZE = 13;    // Leaves 2 length bytes: 64KB messages
+
+    Aes128();
+    explicit Aes128(const uint8_t* key);
+    ~Aes128();                                      // Wipes the round keys
+
+    void set_key(const uint8_t* key);
+
+    // `blocks` independent blocks (ECB); in may equal out
+    void encrypt_blocks(const uint8_t* in, uint8_t* out, size_t blocks) const;
+
+    // CTR mode (SP 800-38A) in place: data is XORed with E(counter),
+    // E(counter + 1), ..., counting in the last 32 bits, big-endian
+    void ctr_xor(const uint8_t* counter, uint8_t* data, size_t length) const;
+
+    // CCM (SP 800-38C, RFC 3610) with a CCM_NONCE_SIZE nonce and a tag of
+    // tag_size bytes (4 to 16, even). Encrypts data in place and writes the
+    // tag; aad is authenticated but not encrypted (may be null). False if
+    // the sizes are out of range.
+    bool ccm_seal(const uint8_t* nonce, const uint8_t* aad, size_t aad_length,
+                  uint8_t* data, size_t length, uint8_t* tag, size_t tag_size) const;
+
+    // Decrypts data in place and checks the tag in constant time. On a
+    // mismatch the data is zeroed and false is returned.
+    bool ccm_open(const uint8_t* nonce, const uint8_t* aad, size_t aad_length,
+                  uint8_t* data, size_t length, const uint8_t* tag, size_t tag_size) const;
+
+private:
+    void cbc_mac_header(const uint8_t* nonce, const uint8_t* aad, size_t aad_length,
+                        size_t length, size_t tag_size, uint8_t* mac) const;
+    void ccm_crypt(const uint8_t* nonce, uint8_t* data, size_t length, bool encrypt,
+                   uint8_t* mac) const;
+
+    alignas(16) uint8_t round_keys_[11 * BLOCK_SIZE];
+    uint64_t sliced_keys_[11][8];                   // Bitsliced, four blocks wide
+};
+
+// Implementation in use: "aes-ni" or "bitsliced". Disabling the hardware
+// path is for benchmarks only.
+const char* aes_implementation();
+void aes_set_hardware(bool enabled);
+
+} // namespace common
+
+#endif // COMMON_AES_H
@@ -0,0 +1,135 @@
+#ifndef COMMON_AUDIO_CODEC_H
+#define COMMON_AUDIO_CODEC_H
+
+#include "protocol.h"
+#include "sample_format.h"
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+namespace common {
+
+// Audio codec for one stream format. Samples are interleaved and held as
+// SampleTraits<format().sample_format>::Type; num_samples counts samples
+// across all channels. Every encoded packet is self-contained, so a lost
+// packet never corrupts the ones after it. Encoders may carry adaptation
+// state between packets; decoders only need the sample count from the
+// AudioPayload header.
+class AudioCodec {
+public:
+    virtual ~AudioCodec() = default;
+
+    virtual protocol::AudioEncoding encoding() const = 0;
+    virtual protocol::StreamFormat format() const { return protocol::DEFAULT_STREAM_FORMAT; }
+
+    // Upper bound of encode() output for num_samples
+    virtual size_t max_encoded_size(size_t num_samples) const = 0;
+
+    // Returns bytes written, 0 if capacity is too small
+    virtual size_t encode(const void* samples, size_t num_samples,
+                          uint8_t* out, size_t capacity) = 0;
+
+    // Returns false on malformed input
+    virtual bool decode(const uint8_t* data, size_t size,
+                        void* samples, size_t num_samples) = 0;
+
+    // Drop encoder adaptation state (new stream)
+    virtual void reset() {}
+};
+
+// nullptr for encodings this build cannot handle in the given format.
+// IMA ADPCM and lossless are mono INT16 only.
+std::unique_ptr<AudioCodec> create_audio_codec(
+    protocol::AudioEncoding encoding,
+    const protocol::StreamFormat& format = protocol::DEFAULT_STREAM_FORMAT);
+
+// Codec capability bits this build implements
+uint16_t supported_codec_capabilities();
+bool codec_supported(protocol::AudioEncoding encoding, uint16_t capabilities);
+
+// Best encoding the peer's capabilities allow, preferring `preferred`
+protocol::AudioEncoding negotiate_encoding(uint16_t peer_capabilities,
+                                           protocol::AudioEncoding preferred);
+
+// Worst-case encoded size of one frame of frame_samples media clock
+// samples (raw PCM if the encoding is unavailable in the format)
+size_t max_encoded_frame_size(protocol::AudioEncoding encoding, uint16_t frame_samples,
+                              const protocol::StreamFormat& format = protocol::DEFAULT_STREAM_FORMAT);
+
+// Most frames of frame_samples that fit one AUDIO_DATA packet in a
+// DEFAULT_DATAGRAM_SIZE datagram in the worst case (at least 1, at most
+// MAX_FRAMES_PER_PACKET)
+uint8_t max_frames_per_packet(protocol::AudioEncoding encoding, uint16_t frame_samples,
+                              const protocol::StreamFormat& format = protocol::DEFAULT_STREAM_FORMAT);
+
+// Command-line names: pcm16, adpcm, lossless
+bool audio_encoding_from_string(const char* name, protocol::AudioEncoding* encoding);
+
+// Raw little-endian PCM in the stream's sample format (no compression).
+// Goes on the wire as AudioEncoding::PCM16 whatever the sample type; INT24
+// is packed into three bytes. Instantiated for each SampleFormat.
+template <protocol::SampleFormat F>
+class PcmCodec : public AudioCodec {
+public:
+    explicit PcmCodec(const protocol::StreamFormat& format = protocol::DEFAULT_STREAM_FORMAT)
+        : format_(format) {
+        format_.sample_format = F;
+    }
+
+    protocol::AudioEncoding encoding() const override { return protocol::AudioEncoding::PCM16; }
+    protocol::StreamFormat format() const override { return format_; }
+    size_t max_encoded_size(size_t num_samples) const override {
+        return num_samples * SampleTraits<F>::WIRE_BYTES;
+    }
+    size_t encode(const void* samples, size_t num_samples,
+                  uint8_t* out, size_t capacity) override;
+    bool decode(const uint8_t* data, size_t size,
+                void* samples, size_t num_samples) override;
+
+private:
+    protocol::StreamFormat format_;
+};
+
+using Pcm16Codec = PcmCodec<protocol::SampleFormat::INT16>;
+
+// 4-bit IMA ADPCM. A packet is split into four equal sub-blocks that are
+// encoded independently, one per SSE2 lane (the ADPCM recursion itself is
+// serial). Each sub-block has a 4-byte header (first sample, step index)
+// followed by its packed nibbles, giving ~3.9x compression at 10ms frames.
+class ImaAdpcmCodec : public AudioCodec {
+public:
+    static constexpr size_t SUB_BLOCKS = 4;
+
+    ImaAdpcmCodec();
+
+    protocol::AudioEncoding encoding() const override { return protocol::AudioEncoding::IMA_ADPCM; }
+    size_t max_encoded_size(size_t num_samples) const override;
+    size_t encode(const void* samples, size_t num_samples,
+                  uint8_t* out, size_t capacity) override;
+    bool decode(const uint8_t* data, size_t size,
+                void* samples, size_t num_samples) override;
+    void reset() override;
+
+private:
+    int32_t step_index_[SUB_BLOCKS];    // Carried so each packet starts adapted
+};
+
+// Lossless predictive codec (FLAC-style fixed polynomial predictors of
+// order 0-3 with Rice-coded residuals). The order is chosen per packet from
+// SSE2 sums of absolute residuals, and the Rice parameter per partition.
+// Packets that would not shrink are sent verbatim.
+class LosslessCodec : public AudioCodec {
+public:
+    static constexpr size_t PARTITIONS = 4;
+
+    protocol::AudioEncoding encoding() const override { return protocol::AudioEncoding::LOSSLESS; }
+    size_t max_encoded_size(size_t num_samples) const override;
+    size_t encode(const void* samples, size_t num_samples,
+                  uint8_t* out, size_t capacity) override;
+    bool decode(const uint8_t* data, size_t size,
+                void* samples, size_t num_samples) override;
+};
+
+} // namespace common
+
+#endif // COMMON_AUDIO_CODEC_H
@@ -0,0 +1,51 @@
+#ifndef COMMON_CSPRNG_H
+#define COMMON_CSPRNG_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace common {
+
+// ChaCha20 keystream generator with fast key erasure: each refill makes
+// four blocks, keeps the first 32 bytes as the next key and hands out the
+// rest, wiping bytes as they go, so a captured state cannot reproduce
+// earlier output. Not thread-safe; random_bytes() keeps one per thread.
+class ChaCha20Rng {
+public:
+    static constexpr size_t SEED_SIZE = 32;
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    ChaCha20Rng();                              // Seeded from getrandom()
+    explicit ChaCha20Rng(const uint8_t* seed);  // Deterministic, for simulations
+    ~ChaCha20Rng();                             // Wipes the key and buffer
+
+    ChaCha20Rng(const ChaCha20Rng&) = delete;
+    ChaCha20Rng& operator=(const ChaCha20Rng&) = delete;
+
+    void reseed(const uint8_t* seed);
+    // Requests of whole blocks beyond the buffer are written straight out
+    void fill(uint8_t* buffer, size_t length);
+
+private:
+    static constexpr size_t BUFFER_BLOCKS = 4;
+    static constexpr size_t BUFFER_SIZE = BUFFER_BLOCKS * BLOCK_SIZE;
+
+    void refill();
+
+    uint32_t key_[8];
+    uint64_t counter_;                          // Blocks made under key_
+    uint8_t buffer_[BUFFER_SIZE];
+    size_t available_;                          // Unread bytes at the end of buffer_
+};
+
+// Cryptographically secure random bytes for keys, nonces, IVs and device
+// ids. Each thread draws from its own ChaCha20Rng, seeded from the kernel
+// on first use and again in a child after fork(): no locks, no sharing.
+void random_bytes(uint8_t* buffer, size_t length);
+
+// Seed material straight from the kernel (getrandom), for seeding
+void os_random_bytes(uint8_t* buffer, size_t length);
+
+} // namespace common
+
+#endif // COMMON_CSPRNG_H
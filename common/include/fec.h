@@ -0,0 +1,47 @@
+#ifndef COMMON_FEC_H
+#define COMMON_FEC_H
+
+#include "protocol.h"
+#include <cstdint>
+#include <cstddef>
+
+namespace common {
+
+// GF(2^8) arithmetic, polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11D)
+uint8_t gf256_mul(uint8_t a, uint8_t b);
+uint8_t gf256_inv(uint8_t a);       // a != 0
+
+// dst ^= coefficient * src over length bytes. Multiplication uses split
+// nibble tables looked up with PSHUFB (AVX2 or SSSE3, picked at run time),
+// with a scalar version of the same tables elsewhere.
+void gf256_mul_add(uint8_t* dst, const uint8_t* src, uint8_t coefficient, size_t length);
+void xor_region(uint8_t* dst, const uint8_t* src, size_t length);
+
+// Implementation in use: "avx2", "ssse3" or "scalar". Disabling SIMD is
+// for benchmarks only.
+const char* gf256_implementation();
+void gf256_set_simd(bool enabled);
+
+// Systematic erasure codes over data_count equal-length blocks:
+// - XOR: one parity block, the sum of all data blocks
+// - REED_SOLOMON: parity block j is sum(data_i / (x_j + y_i)) (a Cauchy
+//   matrix), so any data_count of the data_count + parity_count blocks
+//   rebuild the rest
+// Limits are FEC_MAX_DATA_PACKETS and FEC_MAX_PARITY_PACKETS.
+uint8_t fec_coefficient(protocol::FecScheme scheme, size_t parity_index, size_t data_index);
+
+bool fec_encode(protocol::FecScheme scheme, const uint8_t* const* data, size_t data_count,
+                uint8_t* const* parity, size_t parity_count, size_t length);
+
+// Rebuilds the data blocks not marked present, in place. False if fewer
+// parity blocks are present than data blocks are missing.
+bool fec_decode(protocol::FecScheme scheme, uint8_t* const* data, const bool* data_present,
+                size_t data_count, const uint8_t* const* parity, const bool* parity_present,
+                size_t parity_count, size_t length);
+
+// Command-line names: off, xor, rs
+bool fec_scheme_from_string(const char* name, protocol::FecScheme* scheme);
+
+} // namespace common
+
+#endif // COMMON_FEC_H
@@ -0,0 +1,136 @@
+#ifndef COMMON_FRAGMENT_H
+#define COMMON_FRAGMENT_H
+
+#include "protocol.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace common {
+
+// One datagram queued for sendto(), with the packet it carries for
+// tracing. `last` is set on a packet's final (or only) datagram. Left
+// uninitialized on construction; Fragmenter fills it.
+struct Datagram {
+    Datagram() {}
+
+    protocol::PacketType type;
+    uint32_t sequence;
+    bool last;
+    uint16_t length;
+    uint8_t bytes[protocol::MAX_DATAGRAM_SIZE];
+};
+
+// Splits packets larger than the datagram size into FRAGMENT datagrams.
+// Packets that fit are written whole, so the transports send every packet
+// through here. Thread-safe.
+class Fragmenter {
+public:
+    explicit Fragmenter(size_t datagram_size = protocol::DEFAULT_DATAGRAM_SIZE);
+
+    // Clamped to MIN_DATAGRAM_SIZE..MAX_DATAGRAM_SIZE
+    void set_datagram_size(size_t bytes);
+    size_t datagram_size() const { return datagram_size_.load(); }
+
+    // Writes the packet's datagrams, each into the Datagram* returned by
+    // next(), copying straight from the packet. Returns how many were
+    // written: 1 if it fits whole, 0 if its payload length is invalid.
+    template <typename Next>
+    size_t split(const protocol::Packet& packet, Next&& next) {
+        Plan plan;
+        if (!plan_split(packet, &plan)) {
+            return 0;
+        }
+        for (size_t i = 0; i < plan.count; i++) {
+            write_datagram(packet, plan, i, next());
+        }
+        return plan.count;
+    }
+
+private:
+    struct Plan {
+        size_t chunk;               // Packet bytes per datagram
+        size_t count;
+        uint32_t message_id;
+    };
+
+    bool plan_split(const protocol::Packet& packet, Plan* plan);
+    void write_datagram(const protocol::Packet& packet, const Plan& plan, size_t index,
+                        Datagram* out) const;
+
+    std::atomic<size_t> datagram_size_;
+    std::atomic<uint32_t> next_message_id_;
+};
+
+// Reassembles FRAGMENT datagrams from one peer. Datagrams are received
+// straight into receive_buffer(); a complete packet comes back from
+// on_datagram() without a further copy: whole packets in place, fragments
+// copied once into a pooled packet at their offset. The table holds
+// `slots` packets in flight; a packet is dropped if its fragments do not
+// all arrive within the timeout or if the table fills with newer ones. One
+// receiving thread; statistics may be read from any thread.
+class Reassembler {
+public:
+    static constexpr size_t DEFAULT_SLOTS = 8;
+    static constexpr uint64_t DEFAULT_TIMEOUT_US = 100000;
+
+    explicit Reassembler(size_t slots = DEFAULT_SLOTS, uint64_t timeout_us = DEFAULT_TIMEOUT_US);
+
+    Reassembler(const Reassembler&) = delete;
+    Reassembler& operator=(const Reassembler&) = delete;
+
+    // Where the next datagram goes, receive_capacity() bytes
+    uint8_t* receive_buffer() { return reinterpret_cast<uint8_t*>(&inbound_); }
+    static constexpr size_t receive_capacity() { return sizeof(protocol::Packet); }
+
+    // Takes the datagram of `length` bytes in receive_buffer(). Returns the
+    // packet it completes (the datagram itself unless it is a fragment), or
+    // nullptr if it is invalid or its packet is still incomplete. The
+    // packet stays valid until the next call and may be modified in place
+    // until then (decrypted, say).
+    protocol::Packet* on_datagram(size_t length, uint64_t now_us);
+
+    // Drops packets still incomplete
+    void clear();
+
+    struct Stats {
+        uint64_t fragments_received;
+        uint64_t packets_reassembled;
+        uint64_t fragments_invalid;     // Bad checksum, bounds or header
+        uint64_t fragments_duplicate;
+        uint64_t timeouts;              // Incomplete packets expired
+        uint64_t evictions;             // Incomplete packets pushed out by newer ones
+        uint64_t max_in_flight;
+    };
+
+    Stats get_stats() const;
+
+private:
+    struct Slot {
+        bool active;
+        uint32_t message_id;
+        uint8_t count;
+        uint16_t total_length;
+        uint64_t received_mask;
+        uint64_t started_us;
+    };
+
+    protocol::Packet* on_fragment(size_t length, uint64_t now_us);
+    // Expires timed-out slots on the way
+    size_t find_slot(uint32_t message_id, uint64_t now_us, uint64_t* expired);
+
+    protocol::Packet inbound_;
+    std::vector<Slot> slots_;
+    std::vector<protocol::Packet> pool_;    // One packet per slot
+    uint64_t timeout_us_;
+    size_t delivered_;                      // Slot returned last, freed on the next call
+
+    mutable std::mutex stats_mutex_;
+    Stats stats_;
+};
+
+} // namespace common
+
+#endif // COMMON_FRAGMENT_H
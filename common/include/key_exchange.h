@@ -0,0 +1,34 @@
+#ifndef COMMON_KEY_EXCHANGE_H
+#define COMMON_KEY_EXCHANGE_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace common {
+
+// X25519 (RFC 7748) over 51-bit limbs. Constant time: the Montgomery
+// ladder swaps with masks and no branch or index depends on a secret.
+// Keys are X25519_KEY_SIZE bytes, little-endian; private keys are clamped
+// on use, so any 32 random bytes make one.
+constexpr size_t X25519_KEY_SIZE = 32;
+
+void x25519_public_key(const uint8_t* private_key, uint8_t* public_key);
+
+// Public keys for `count` private keys (consecutive X25519_KEY_SIZE-byte
+// entries). The ladders share one field inversion, so a batch costs less
+// per key than single calls; for pairing storms at startup.
+void x25519_public_keys(const uint8_t* private_keys, uint8_t* public_keys, size_t count);
+
+// Shared secret from our private key and the peer's public key. False if
+// the peer's key is a low-order point (the secret would be all zeros).
+bool x25519(const uint8_t* private_key, const uint8_t* peer_public_key, uint8_t* shared_secret);
+
+// Session key (SESSION_KEY_SIZE bytes) from the pairing exchange:
+// HKDF-SHA256 over the X25519 shared secret, salted with the host's and
+// then the accessory's 16-byte nonce. Both sides derive the same key.
+void derive_session_key(const uint8_t* shared_secret, const uint8_t* host_nonce,
+                        const uint8_t* accessory_nonce, uint8_t* key);
+
+} // namespace common
+
+#endif // COMMON_KEY_EXCHANGE_H
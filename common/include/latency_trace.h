@@ -0,0 +1,94 @@
+#ifndef COMMON_LATENCY_TRACE_H
+#define COMMON_LATENCY_TRACE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace common {
+
+// Per-frame timestamps along the audio path, keyed by sequence number.
+// Components stamp a frame as it passes each stage; all stamps come from
+// protocol::get_timestamp_us(), so deltas are only meaningful when every
+// stage runs in the same process (see e2e_bench).
+//
+// Storage is a fixed ring of slots indexed by sequence; stamping is
+// lock-free and the trace holds the most recent `capacity` frames.
+class LatencyTrace {
+public:
+    enum class Stage : uint8_t {
+        GENERATE = 0,       // Accessory builds the frame
+        ENQUEUE,            // Handed to the accessory send queue
+        SENDTO,             // sendto() returned on the accessory
+        RECV,               // recvfrom() returned on the host
+        JITTER_INSERT,      // Inserted into the host jitter buffer
+        PLAYOUT             // Played out by the host
+    };
+
+    static constexpr size_t STAGE_COUNT = 6;
+    static constexpr size_t HOP_COUNT = STAGE_COUNT - 1;
+    static constexpr size_t DEFAULT_CAPACITY = 1u << 16;
+
+    static const char* stage_to_string(Stage stage);
+
+    explicit LatencyTrace(size_t capacity = DEFAULT_CAPACITY);
+
+    LatencyTrace(const LatencyTrace&) = delete;
+    LatencyTrace& operator=(const LatencyTrace&) = delete;
+
+    // GENERATE claims the slot for a sequence; later stages are recorded only
+    // while the slot still belongs to that sequence.
+    void stamp(Stage stage, uint32_t sequence);
+    void stamp(Stage stage, uint32_t sequence, uint64_t timestamp_us);
+
+    // Traced frames in sequence order; unreached stages are 0
+    struct Frame {
+        uint32_t sequence;
+        uint64_t stamp_us[STAGE_COUNT];
+    };
+
+    std::vector<Frame> frames() const;
+
+    struct Distribution {
+        uint64_t count;
+        uint64_t min_us;
+        uint64_t p50_us;
+        uint64_t p90_us;
+        uint64_t p99_us;
+        uint64_t p999_us;
+        uint64_t max_us;
+        double mean_us;
+    };
+
+    // hop[i] is the delay from stage i to stage i+1 over completed frames.
+    // tail_hop_us[i] is the mean of hop i over frames whose total is at or
+    // above the total p99, i.e. where the tail latency is spent. Frames
+    // below first_sequence (e.g. warm-up) are ignored.
+    struct Summary {
+        uint64_t frames_traced;
+        uint64_t frames_completed;
+        uint64_t frames_stalled[STAGE_COUNT];  // Incomplete, by last stage reached
+        Distribution hop[HOP_COUNT];
+        Distribution total;
+        double tail_hop_us[HOP_COUNT];
+    };
+
+    Summary summarize(uint32_t first_sequence = 0) const;
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        std::atomic<uint64_t> stamp_us[STAGE_COUNT];
+    };
+
+    static Distribution distribution(std::vector<uint64_t>& samples);
+
+    size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+};
+
+} // namespace common
+
+#endif // COMMON_LATENCY_TRACE_H
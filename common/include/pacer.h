@@ -0,0 +1,104 @@
+#ifndef COMMON_PACER_H
+#define COMMON_PACER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+
+namespace common {
+
+// Log2 histogram of timing errors in microseconds: bucket 0 holds 0us,
+// bucket i holds [2^(i-1), 2^i) us and the last bucket everything above.
+// Not thread-safe; owners lock around it.
+class TimingHistogram {
+public:
+    static constexpr size_t BUCKETS = 24;
+
+    TimingHistogram();
+
+    void record(uint64_t error_us);
+    void merge(const TimingHistogram& other);
+    void clear();
+
+    uint64_t count() const { return count_; }
+    uint64_t max_us() const { return max_us_; }
+    double mean_us() const;
+
+    // Upper bound of the bucket holding the given fraction (0-1) of
+    // samples, capped at the largest sample
+    uint64_t percentile_us(double fraction) const;
+
+    uint64_t bucket(size_t index) const { return buckets_[index]; }
+    static uint64_t bucket_upper_us(size_t index);
+
+private:
+    uint64_t buckets_[BUCKETS];
+    uint64_t count_;
+    uint64_t sum_us_;
+    uint64_t max_us_;
+};
+
+// How a Pacer waits for a deadline
+enum class PacerStrategy : uint8_t {
+    SLEEP = 0,      // std::this_thread::sleep_until
+    SLEEP_SPIN,     // Sleep until spin_us before the deadline, then spin
+    NANOSLEEP,      // clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME)
+    TIMERFD         // Absolute CLOCK_MONOTONIC timerfd, blocking read
+};
+
+const char* pacer_strategy_to_string(PacerStrategy strategy);
+
+// Command-line names: sleep, spin, nanosleep, timerfd
+bool pacer_strategy_from_string(const char* name, PacerStrategy* strategy);
+
+// Waits for absolute deadlines on the protocol::get_timestamp_us() clock
+// (steady_clock, i.e. CLOCK_MONOTONIC) and keeps a histogram of how late
+// each wake-up was. Plain sleeps overshoot by tens to hundreds of us on a
+// loaded box; spinning the last stretch trades CPU for precision. One
+// thread waits; statistics may be read from any thread.
+class Pacer {
+public:
+    static constexpr uint32_t DEFAULT_SPIN_US = 100;
+
+    explicit Pacer(PacerStrategy strategy = PacerStrategy::SLEEP,
+                   uint32_t spin_us = DEFAULT_SPIN_US);
+    ~Pacer();
+
+    Pacer(const Pacer&) = delete;
+    Pacer& operator=(const Pacer&) = delete;
+
+    // Not while another thread is waiting. TIMERFD falls back to NANOSLEEP
+    // if no timerfd can be created.
+    void configure(PacerStrategy strategy, uint32_t spin_us = DEFAULT_SPIN_US);
+    PacerStrategy strategy() const { return strategy_; }
+    uint32_t spin_us() const { return spin_us_; }
+
+    // Blocks until deadline_us; returns how late the wake-up was
+    uint64_t wait_until(uint64_t deadline_us);
+
+    // Deadlines the caller gave up on because it woke too late
+    void record_skipped(uint64_t count);
+
+    struct Stats {
+        uint64_t waits;
+        uint64_t ticks_skipped;
+        TimingHistogram wake_error;     // Wake-up minus deadline
+    };
+
+    Stats get_stats() const;
+    void reset_stats();
+
+private:
+    void wait_timerfd(uint64_t deadline_us);
+
+    PacerStrategy strategy_;
+    uint32_t spin_us_;
+    int timer_fd_;
+
+    mutable std::mutex stats_mutex_;
+    Stats stats_;
+};
+
+} // namespace common
+
+#endif // COMMON_PACER_H
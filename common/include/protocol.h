@@ -8,7 +8,7 @@
 namespace protocol {
 
 // Protocol version
-constexpr uint16_t PROTOCOL_VERSION = 0x0100;  // 1.0
+constexpr uint16_t PROTOCOL_VERSION = 0x0203;  // 2.3 (session resumption)
 
 // Packet types
 enum class PacketType : uint8_t {
@@ -21,11 +21,18 @@ enum class PacketType : uint8_t {
     CONNECT_RESPONSE = 0x13,
     DISCONNECT = 0x14,
     KEEPALIVE = 0x15,
+    TIME_SYNC_REQUEST = 0x16,
+    TIME_SYNC_RESPONSE = 0x17,
+    SESSION_TICKET = 0x18,
+    RESUME_REQUEST = 0x19,
+    RESUME_RESPONSE = 0x1A,
     
     // Audio streaming
     AUDIO_DATA = 0x20,
     AUDIO_ACK = 0x21,
     AUDIO_RETRANSMIT = 0x22,
+    AUDIO_FEC = 0x23,
+    AUDIO_FEC_CONFIG = 0x24,
     
     // Telemetry
     BATTERY_STATUS = 0x30,
@@ -33,7 +40,10 @@ enum class PacketType : uint8_t {
     
     // Security
     KEY_EXCHANGE = 0x40,
-    ENCRYPTED_PACKET = 0x41
+    ENCRYPTED_PACKET = 0x41,
+    
+    // Transport (never seen by components)
+    FRAGMENT = 0x50
 };
 
 // Connection states
@@ -49,19 +59,26 @@ enum class ConnectionState : uint8_t {
 
 // Audio configuration
 constexpr uint32_t AUDIO_SAMPLE_RATE = 48000;  // Hz
-constexpr uint16_t AUDIO_PACKET_DURATION_MS = 10;  // 10ms packets
+constexpr uint16_t AUDIO_PACKET_DURATION_MS = 10;  // Default frame duration
 constexpr uint16_t AUDIO_SAMPLES_PER_PACKET = (AUDIO_SAMPLE_RATE * AUDIO_PACKET_DURATION_MS) / 1000;  // 480 samples
 constexpr uint16_t AUDIO_BYTES_PER_SAMPLE = 2;  // 16-bit PCM
 constexpr uint16_t AUDIO_PACKET_SIZE = AUDIO_SAMPLES_PER_PACKET * AUDIO_BYTES_PER_SAMPLE;  // 960 bytes
 
+// Frame durations a stream may negotiate at connect: 2.5, 5, 10 or 20ms
+constexpr uint16_t AUDIO_FRAME_SAMPLES_2_5MS = 120;
+constexpr uint16_t AUDIO_FRAME_SAMPLES_5MS = 240;
+constexpr uint16_t AUDIO_FRAME_SAMPLES_10MS = 480;
+constexpr uint16_t AUDIO_FRAME_SAMPLES_20MS = 960;
+constexpr uint8_t MAX_FRAMES_PER_PACKET = 8;    // Aggregation limit per AUDIO_DATA
+
 // Latency constraints
 constexpr uint16_t TARGET_LATENCY_MS = 30;
 constexpr uint16_t MAX_LATENCY_MS = 50;
 
-// Buffer configuration
-constexpr uint8_t MIN_JITTER_BUFFER_PACKETS = 2;
-constexpr uint8_t MAX_JITTER_BUFFER_PACKETS = 4;
-constexpr uint8_t DEFAULT_JITTER_BUFFER_PACKETS = 3;
+// Jitter buffer depth in samples, independent of frame duration
+constexpr uint32_t MIN_JITTER_BUFFER_SAMPLES = 240;       // 5ms
+constexpr uint32_t MAX_JITTER_BUFFER_SAMPLES = 4800;      // 100ms
+constexpr uint32_t DEFAULT_JITTER_BUFFER_SAMPLES = 1440;  // 30ms
 
 // Timing
 constexpr uint16_t KEEPALIVE_INTERVAL_MS = 1000;
@@ -76,21 +93,98 @@ struct PacketHeader {
     PacketType type;            // Packet type
     uint8_t flags;              // Flags (encrypted, priority, etc.)
     uint32_t sequence;          // Sequence number
-    uint32_t timestamp_us;      // Microsecond timestamp
+    uint64_t timestamp_us;      // Sender clock, microseconds
     uint16_t payload_length;    // Payload length in bytes
     uint16_t checksum;          // Simple checksum
 };
 #pragma pack(pop)
 
 constexpr size_t PACKET_HEADER_SIZE = sizeof(PacketHeader);
-constexpr size_t MAX_PACKET_SIZE = 2048;
+constexpr size_t MAX_PACKET_SIZE = 16384;
 constexpr size_t MAX_PAYLOAD_SIZE = MAX_PACKET_SIZE - PACKET_HEADER_SIZE;
 
+// Datagram sizes (path MTU less IPv4 and UDP headers). Components build
+// packets of up to MAX_PACKET_SIZE; the transports send any packet larger
+// than their datagram size as FRAGMENT datagrams and reassemble it on
+// receipt.
+constexpr size_t DEFAULT_DATAGRAM_SIZE = 1472;     // 1500-byte Ethernet MTU
+constexpr size_t MIN_DATAGRAM_SIZE = 548;          // 576-byte IPv4 minimum
+constexpr size_t MAX_DATAGRAM_SIZE = 8972;         // 9000-byte jumbo frames
+
+// FRAGMENT payload: this header, then bytes [offset, offset + length) of
+// the serialized original packet (its header, then its payload). The
+// fragment's own header repeats the original's flags, sequence and
+// timestamp; the original's checksum is verified once reassembled.
+#pragma pack(push, 1)
+struct FragmentHeader {
+    uint32_t message_id;        // Per sender, one per fragmented packet
+    uint16_t total_length;      // Serialized original packet
+    uint16_t offset;            // Of this fragment's bytes
+    uint8_t index;              // 0..count-1
+    uint8_t count;
+};
+#pragma pack(pop)
+
+constexpr size_t MAX_FRAGMENTS = 64;
+
 // Flag bits
 constexpr uint8_t FLAG_ENCRYPTED = 0x01;
 constexpr uint8_t FLAG_PRIORITY = 0x02;
 constexpr uint8_t FLAG_ACK_REQUIRED = 0x04;
 constexpr uint8_t FLAG_RETRANSMIT = 0x08;
+constexpr uint8_t FLAG_AUTHENTICATED = 0x10;
+
+// Packets sent with FLAG_ENCRYPTED carry an AES-128-CCM payload followed by
+// its tag, under the session key agreed at pairing; with FLAG_AUTHENTICATED
+// the payload is in the clear, followed by a truncated HMAC-SHA256 tag
+constexpr size_t SESSION_KEY_SIZE = 16;
+constexpr size_t AUTH_TAG_SIZE = 8;
+
+// Capability bits (DiscoverPayload::capabilities)
+constexpr uint16_t CAP_AUDIO_STREAMING = 0x0001;
+constexpr uint16_t CAP_CODEC_IMA_ADPCM = 0x0002;
+constexpr uint16_t CAP_CODEC_LOSSLESS = 0x0004;
+
+// Audio payload encodings (AudioPayload::encoding)
+enum class AudioEncoding : uint8_t {
+    PCM16 = 0,
+    AAC = 1,                    // Reserved, not implemented
+    IMA_ADPCM = 2,              // 4 bits/sample, lossy
+    LOSSLESS = 3                // Fixed-predictor + Rice, bit-exact
+};
+
+// Sample types a stream may negotiate. Samples are interleaved by channel
+// and little-endian; INT24 is packed into three bytes on the wire.
+enum class SampleFormat : uint8_t {
+    INT16 = 0,
+    INT24 = 1,
+    FLOAT32 = 2
+};
+
+constexpr uint8_t MAX_AUDIO_CHANNELS = 8;
+constexpr uint32_t AUDIO_SAMPLE_RATE_44K = 44100;
+constexpr uint32_t AUDIO_SAMPLE_RATE_96K = 96000;
+
+// Stream format negotiated at connect. Frame durations, sample positions
+// and jitter depths stay on the AUDIO_SAMPLE_RATE media clock whatever the
+// stream's rate: a 10ms frame is 480 clock samples carrying 441 (44.1kHz)
+// or 960 (96kHz) samples per channel.
+struct StreamFormat {
+    uint32_t sample_rate;           // 44100, 48000 or 96000 Hz
+    uint8_t channels;               // 1..MAX_AUDIO_CHANNELS
+    SampleFormat sample_format;
+};
+
+constexpr StreamFormat DEFAULT_STREAM_FORMAT = { AUDIO_SAMPLE_RATE, 1, SampleFormat::INT16 };
+
+inline bool operator==(const StreamFormat& a, const StreamFormat& b) {
+    return a.sample_rate == b.sample_rate && a.channels == b.channels &&
+           a.sample_format == b.sample_format;
+}
+
+inline bool operator!=(const StreamFormat& a, const StreamFormat& b) {
+    return !(a == b);
+}
 
 // Discover response payload
 #pragma pack(push, 1)
@@ -106,22 +200,163 @@ struct DiscoverPayload {
 #pragma pack(push, 1)
 struct PairPayload {
     uint8_t device_id[8];
-    uint8_t public_key[32];     // Simulated ECDH public key
+    uint8_t public_key[32];     // X25519 ephemeral public key
     uint8_t nonce[16];          // Random nonce
 };
 #pragma pack(pop)
 
-// Audio data packet
+// Audio data packet. Carries frame_count consecutive frames of
+// sample_count media clock samples each, starting at sample_position. A
+// single frame is sent as is; with several, each encoded frame is prefixed
+// by its uint16 size. channels and format describe the stream format (see
+// pack_stream_format); zero means mono 48kHz INT16.
 #pragma pack(push, 1)
 struct AudioPayload {
-    uint32_t stream_timestamp;   // Stream time in microseconds
-    uint16_t sample_count;       // Number of samples in this packet
-    uint8_t encoding;            // 0=PCM16, 1=AAC, etc.
-    uint8_t reserved;
+    uint64_t stream_timestamp;   // Stream time of the first frame, microseconds
+    uint64_t sample_position;    // Stream index of the first sample
+    uint16_t sample_count;       // Media clock samples per frame
+    uint8_t encoding;            // AudioEncoding
+    uint8_t frame_count;         // Frames in this packet (0 is read as 1)
+    uint8_t channels;            // 0 is read as 1
+    uint8_t format;              // SampleFormat | sample rate code << 4
     // Followed by audio data
 };
 #pragma pack(pop)
 
+// Connect request/response. The host asks for an encoding from the
+// accessory's advertised capabilities, a frame format and a stream format;
+// the accessory echoes what it will stream. Zero fields (or a short
+// payload) mean PCM16, 10ms frames, one frame per packet, mono 48kHz INT16.
+#pragma pack(push, 1)
+struct ConnectPayload {
+    uint8_t encoding;           // AudioEncoding
+    uint8_t frames_per_packet;  // Frames aggregated per AUDIO_DATA
+    uint16_t frame_samples;     // Samples per frame (AUDIO_FRAME_SAMPLES_*)
+    uint8_t channels;           // As in AudioPayload
+    uint8_t format;
+};
+#pragma pack(pop)
+
+// Session resumption. After CONNECT_RESPONSE an accessory with a session
+// key issues a ticket (SESSION_TICKET): an id under which both sides keep
+// the key and the agreed stream parameters. A returning host sends
+// RESUME_REQUEST with the id, a fresh nonce and a MAC under the key; the
+// accessory answers RESUME_RESPONSE with its nonce, the stream parameters
+// and the sequence the audio resumes at, and goes straight to streaming.
+// Both sides move the ticket to a key derived from the old one and both
+// nonces, so a request cannot be replayed. One round trip instead of
+// discovery, pairing and connect.
+constexpr size_t TICKET_ID_SIZE = 16;
+constexpr size_t RESUME_NONCE_SIZE = 16;
+constexpr size_t RESUME_MAC_SIZE = 16;          // Truncated HMAC-SHA256
+constexpr uint32_t TICKET_LIFETIME_S = 600;
+
+#pragma pack(push, 1)
+struct TicketPayload {
+    uint8_t ticket_id[TICKET_ID_SIZE];
+    uint32_t lifetime_s;        // From issue; both sides drop it after
+};
+#pragma pack(pop)
+
+#pragma pack(push, 1)
+struct ResumeRequestPayload {
+    uint8_t device_id[8];
+    uint8_t ticket_id[TICKET_ID_SIZE];
+    uint8_t nonce[RESUME_NONCE_SIZE];
+    uint8_t mac[RESUME_MAC_SIZE];   // Over the fields above
+};
+#pragma pack(pop)
+
+enum class ResumeStatus : uint8_t {
+    OK = 0,
+    UNKNOWN_TICKET = 1,         // Never issued, expired or forgotten: pair again
+    BAD_MAC = 2
+};
+
+#pragma pack(push, 1)
+struct ResumeResponsePayload {
+    uint8_t status;             // ResumeStatus; the rest is only valid with OK
+    uint8_t nonce[RESUME_NONCE_SIZE];
+    ConnectPayload accepted;    // As in CONNECT_RESPONSE
+    uint32_t next_sequence;     // First AUDIO_DATA sequence of the resumed stream
+    uint8_t mac[RESUME_MAC_SIZE];   // Over the request nonce and the fields above
+};
+#pragma pack(pop)
+
+// Batched acknowledgement of AUDIO_DATA sent with FLAG_ACK_REQUIRED
+// (AUDIO_ACK). Selective over the 33 newest sequences: highest_sequence
+// plus bitmap (bit i: highest_sequence - 1 - i). The accessory times the
+// round trip from when it sent highest_sequence, less ack_delay_us.
+#pragma pack(push, 1)
+struct AckPayload {
+    uint32_t highest_sequence;      // Newest audio sequence received
+    uint32_t received_bitmap;       // The 32 sequences before it
+    uint32_t ack_delay_us;          // Host hold time since highest_sequence arrived
+    uint32_t packets_received;      // First transmissions this stream (cumulative)
+};
+#pragma pack(pop)
+
+// Selective retransmission request (AUDIO_RETRANSMIT), a list of entries
+// naming base_sequence plus the set bits of bitmap (bit i: base_sequence +
+// 1 + i), as in RTCP generic NACKs
+#pragma pack(push, 1)
+struct NackEntry {
+    uint32_t base_sequence;
+    uint32_t bitmap;
+};
+#pragma pack(pop)
+
+constexpr size_t MAX_NACK_ENTRIES = 16;     // Per AUDIO_RETRANSMIT
+
+// Forward error correction over groups of data_count consecutive AUDIO_DATA
+// packets. Each packet is protected as a block of its header timestamp,
+// payload length and payload (FEC_BLOCK_HEADER_SIZE + payload bytes),
+// zero-padded to the longest block of the group. After the last packet of a
+// group the accessory sends parity_count AUDIO_FEC packets, each a
+// FecPayload followed by block_size parity bytes.
+enum class FecScheme : uint8_t {
+    NONE = 0,
+    XOR = 1,                    // One parity block, recovers one loss
+    REED_SOLOMON = 2            // GF(256) Cauchy code, recovers parity_count losses
+};
+
+constexpr size_t FEC_BLOCK_HEADER_SIZE = sizeof(uint64_t) + sizeof(uint16_t);
+constexpr uint8_t FEC_MAX_DATA_PACKETS = 16;
+constexpr uint8_t FEC_MAX_PARITY_PACKETS = 4;
+
+#pragma pack(push, 1)
+struct FecPayload {
+    uint32_t base_sequence;     // First AUDIO_DATA sequence of the group
+    uint8_t scheme;             // FecScheme
+    uint8_t data_count;         // Packets in the group
+    uint8_t parity_count;       // Parity packets for the group
+    uint8_t parity_index;       // This parity packet, 0..parity_count-1
+    uint16_t block_size;        // Parity bytes that follow
+};
+#pragma pack(pop)
+
+// Host -> accessory (AUDIO_FEC_CONFIG). Applies from the next group;
+// NONE turns parity off.
+#pragma pack(push, 1)
+struct FecConfigPayload {
+    uint8_t scheme;             // FecScheme
+    uint8_t data_count;
+    uint8_t parity_count;
+    uint8_t reserved;
+};
+#pragma pack(pop)
+
+// Clock synchronization (NTP-style four timestamps; the host fills
+// origin_us, the accessory fills receive_us and transmit_us, and the host
+// takes the fourth on arrival of the response)
+#pragma pack(push, 1)
+struct TimeSyncPayload {
+    uint64_t origin_us;         // Host clock when the request was sent
+    uint64_t receive_us;        // Accessory clock when the request arrived
+    uint64_t transmit_us;       // Accessory clock when the response was sent
+};
+#pragma pack(pop)
+
 // Battery status
 #pragma pack(push, 1)
 struct BatteryPayload {
@@ -154,8 +389,10 @@ struct Packet {
     PacketHeader header;
     uint8_t payload[MAX_PAYLOAD_SIZE];
     
+    // Only the header is cleared: packets are large and the payload is
+    // only read up to payload_length
     Packet() {
-        memset(this, 0, sizeof(Packet));
+        memset(&header, 0, sizeof(header));
         header.version = PROTOCOL_VERSION;
     }
     
@@ -171,7 +408,7 @@ struct Packet {
         header.sequence = seq;
     }
     
-    void set_timestamp(uint32_t ts_us) {
+    void set_timestamp(uint64_t ts_us) {
         header.timestamp_us = ts_us;
     }
     
@@ -179,7 +416,9 @@ struct Packet {
         header.flags = flags;
     }
     
-    void set_payload(const void* data, uint16_t length);
+    // False (and an empty payload) if length exceeds MAX_PAYLOAD_SIZE.
+    // A null data keeps the payload bytes already in place.
+    bool set_payload(const void* data, uint16_t length);
     uint16_t calculate_checksum() const;
     bool verify_checksum() const;
 };
@@ -187,12 +426,42 @@ struct Packet {
 // Utility functions
 const char* packet_type_to_string(PacketType type);
 const char* connection_state_to_string(ConnectionState state);
+const char* audio_encoding_to_string(AudioEncoding encoding);
+const char* fec_scheme_to_string(FecScheme scheme);
+const char* sample_format_to_string(SampleFormat format);
+bool is_valid_frame_samples(uint16_t frame_samples);
+uint64_t samples_to_us(uint64_t samples);
+
+// Stream formats
+bool is_valid_stream_format(const StreamFormat& format);
+size_t sample_wire_bytes(SampleFormat format);     // 2, 3 or 4
+
+// Samples per channel in a frame of frame_samples media clock samples; 0 if
+// that is not a whole number (44.1kHz streams need 10 or 20ms frames)
+uint32_t stream_frame_samples(const StreamFormat& format, uint16_t frame_samples);
+
+// Wire form used by AudioPayload and ConnectPayload. unpack_stream_format
+// returns false for unknown rates, sample types or channel counts.
+void pack_stream_format(const StreamFormat& format, uint8_t* channels, uint8_t* packed);
+bool unpack_stream_format(uint8_t channels, uint8_t packed, StreamFormat* format);
 uint64_t get_timestamp_us();
 uint32_t get_timestamp_ms();
 
-// Packet serialization helpers
+// Pack ascending sequence numbers into NACK entries; returns entries used.
+// Sequences that do not fit max_entries are left out.
+size_t pack_nack_entries(const uint32_t* sequences, size_t count,
+                         NackEntry* entries, size_t max_entries);
+
+// Checksum of a header (up to its checksum field) and the payload_length
+// bytes that follow it
+uint16_t packet_checksum(const PacketHeader& header, const uint8_t* payload);
+
+// Packet serialization helpers. A Packet is laid out as its serialized
+// form, so a datagram may also be received straight into one and checked
+// with validate_packet().
 bool serialize_packet(const Packet& packet, uint8_t* buffer, size_t buffer_size, size_t* bytes_written);
 bool deserialize_packet(const uint8_t* buffer, size_t buffer_size, Packet* packet);
+bool validate_packet(const Packet& packet, size_t received);
 
 } // namespace protocol
 
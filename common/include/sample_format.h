@@ -0,0 +1,104 @@
+#ifndef COMMON_SAMPLE_FORMAT_H
+#define COMMON_SAMPLE_FORMAT_H
+
+#include "protocol.h"
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+namespace common {
+
+// In-memory sample type per protocol::SampleFormat. INT24 samples are held
+// sign-extended in an int32 and FLOAT32 samples in [-1, 1). Generators and
+// the int16 sources work in int16 scale (full scale 32768), so from_float()
+// takes int16-scaled values.
+template <protocol::SampleFormat F>
+struct SampleTraits;
+
+template <>
+struct SampleTraits<protocol::SampleFormat::INT16> {
+    using Type = int16_t;
+    static constexpr protocol::SampleFormat FORMAT = protocol::SampleFormat::INT16;
+    static constexpr size_t WIRE_BYTES = 2;
+
+    static Type from_float(float value) {
+        return static_cast<Type>(std::max(-32768.0f, std::min(32767.0f, std::nearbyint(value))));
+    }
+    static Type from_int16(int16_t value) { return value; }
+    static float to_unit(Type value) { return value * (1.0f / 32768.0f); }
+};
+
+template <>
+struct SampleTraits<protocol::SampleFormat::INT24> {
+    using Type = int32_t;
+    static constexpr protocol::SampleFormat FORMAT = protocol::SampleFormat::INT24;
+    static constexpr size_t WIRE_BYTES = 3;
+
+    static Type from_float(float value) {
+        return static_cast<Type>(std::max(-8388608.0f, std::min(8388607.0f, std::nearbyint(value * 256.0f))));
+    }
+    static Type from_int16(int16_t value) { return static_cast<Type>(value) * 256; }
+    static float to_unit(Type value) { return value * (1.0f / 8388608.0f); }
+};
+
+template <>
+struct SampleTraits<protocol::SampleFormat::FLOAT32> {
+    using Type = float;
+    static constexpr protocol::SampleFormat FORMAT = protocol::SampleFormat::FLOAT32;
+    static constexpr size_t WIRE_BYTES = 4;
+
+    static Type from_float(float value) { return value * (1.0f / 32768.0f); }
+    static Type from_int16(int16_t value) { return value * (1.0f / 32768.0f); }
+    static float to_unit(Type value) { return value; }
+};
+
+// In-memory bytes per sample (2 or 4)
+size_t sample_size(protocol::SampleFormat format);
+
+// Command-line names: int16, int24, float32
+bool sample_format_from_string(const char* name, protocol::SampleFormat* format);
+
+// Calls fn(SampleTraits<F>()) for the runtime format, so a stream branches
+// on its format once per frame and the loops behind fn are compiled per type
+template <typename Fn>
+void with_sample_format(protocol::SampleFormat format, Fn&& fn) {
+    switch (format) {
+        case protocol::SampleFormat::INT24:
+            fn(SampleTraits<protocol::SampleFormat::INT24>());
+            break;
+        case protocol::SampleFormat::FLOAT32:
+            fn(SampleTraits<protocol::SampleFormat::FLOAT32>());
+            break;
+        default:
+            fn(SampleTraits<protocol::SampleFormat::INT16>());
+            break;
+    }
+}
+
+// Mono int16-scaled floats to `channels` interleaved copies of each sample
+template <protocol::SampleFormat F>
+void samples_from_float(const float* in, size_t frames, size_t channels,
+                        typename SampleTraits<F>::Type* out);
+
+// Mono int16 to `channels` interleaved copies of each sample
+template <protocol::SampleFormat F>
+void samples_from_int16(const int16_t* in, size_t frames, size_t channels,
+                        typename SampleTraits<F>::Type* out);
+
+// Wire form: little-endian, WIRE_BYTES per sample. Returns bytes written.
+template <protocol::SampleFormat F>
+size_t pack_samples(const typename SampleTraits<F>::Type* in, size_t count, uint8_t* out);
+
+template <protocol::SampleFormat F>
+void unpack_samples(const uint8_t* in, size_t count, typename SampleTraits<F>::Type* out);
+
+// Raise peaks[c] to the largest magnitude of channel c, as a fraction of
+// full scale
+template <protocol::SampleFormat F>
+void channel_peaks(const typename SampleTraits<F>::Type* in, size_t frames, size_t channels,
+                   float* peaks);
+
+} // namespace common
+
+#endif // COMMON_SAMPLE_FORMAT_H
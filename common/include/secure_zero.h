@@ -0,0 +1,19 @@
+#ifndef COMMON_SECURE_ZERO_H
+#define COMMON_SECURE_ZERO_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace common {
+
+// Wipes key material; volatile stores, so the optimizer may not drop them
+inline void secure_zero(void* p, size_t length) {
+    volatile uint8_t* bytes = static_cast<volatile uint8_t*>(p);
+    for (size_t i = 0; i < length; i++) {
+        bytes[i] = 0;
+    }
+}
+
+} // namespace common
+
+#endif // COMMON_SECURE_ZERO_H
@@ -0,0 +1,64 @@
+#ifndef COMMON_SESSION_CIPHER_H
+#define COMMON_SESSION_CIPHER_H
+
+#include "protocol.h"
+#include "aes.h"
+#include "sha256.h"
+#include <cstdint>
+#include <cstddef>
+
+namespace common {
+
+// Protection of packet payloads under the session key agreed at pairing,
+// in one of two modes the sender picks:
+// - ENCRYPT: AES-128-CCM. The payload is encrypted in place and followed
+//   by an AUTH_TAG_SIZE tag; FLAG_ENCRYPTED.
+// - AUTHENTICATE: the payload stays in the clear, followed by HMAC-SHA256
+//   truncated to AUTH_TAG_SIZE; FLAG_AUTHENTICATED. For links that need
+//   integrity but not confidentiality.
+// Either way the packet type, sequence and timestamp are covered too (the
+// CCM nonce, or the start of the MAC input); senders never repeat a
+// sequence at one timestamp. open() takes either mode, whatever the local
+// one. Configure while no packets are being sealed or opened.
+class SessionCipher {
+public:
+    enum class Mode : uint8_t {
+        ENCRYPT,
+        AUTHENTICATE
+    };
+
+    SessionCipher();
+
+    // nullptr clears the key; seal() and open() then fail
+    void set_key(const uint8_t* key);
+    bool has_key() const { return keyed_; }
+
+    void set_mode(Mode mode) { mode_ = mode; }
+    Mode get_mode() const { return mode_; }
+
+    // False without a key or room for the tag
+    bool seal(protocol::Packet* packet) const;
+
+    // False without a key, if the packet is not sealed, or if the tag does
+    // not match (an encrypted payload is then zeroed)
+    bool open(protocol::Packet* packet) const;
+
+private:
+    static constexpr size_t NONCE_SIZE = Aes128::CCM_NONCE_SIZE;
+
+    static void packet_nonce(const protocol::PacketHeader& header, uint8_t* nonce);
+    void packet_mac(const protocol::Packet& packet, size_t length, uint8_t* tag) const;
+
+    Aes128 aes_;
+    HmacSha256 hmac_;               // Keyed with a MAC key derived from the session key
+    Mode mode_;
+    bool keyed_;
+};
+
+// Names for logs and command lines: ccm, hmac
+const char* session_cipher_mode_to_string(SessionCipher::Mode mode);
+bool session_cipher_mode_from_string(const char* name, SessionCipher::Mode* mode);
+
+} // namespace common
+
+#endif // COMMON_SESSION_CIPHER_H
@@ -0,0 +1,64 @@
+#ifndef COMMON_SESSION_TICKET_H
+#define COMMON_SESSION_TICKET_H
+
+#include "protocol.h"
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace common {
+
+// What one side remembers of a session so it can be resumed (see
+// protocol.h). The accessory also keeps the stream parameters and where
+// the audio stopped; the host only needs the key.
+struct SessionTicket {
+    uint8_t id[protocol::TICKET_ID_SIZE];
+    uint8_t device_id[8];
+    uint8_t session_key[protocol::SESSION_KEY_SIZE];
+    protocol::ConnectPayload params;    // Stream parameters agreed at connect
+    bool negotiated;                    // Host sent a CONNECT payload
+    uint32_t next_sequence;             // Where the audio resumes
+    uint64_t sample_position;
+    uint64_t expires_us;
+};
+
+// Bounded ticket cache. Storing a ticket replaces one with the same id,
+// else the one that expires first when full. Expired tickets are never
+// found. Keys are wiped when tickets are dropped. Thread-safe.
+class TicketStore {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 8;
+
+    explicit TicketStore(size_t capacity = DEFAULT_CAPACITY);
+    ~TicketStore();
+
+    void store(const SessionTicket& ticket);
+    bool find(const uint8_t* id, SessionTicket* ticket) const;
+    bool find_device(const uint8_t* device_id, SessionTicket* ticket) const;
+    void erase(const uint8_t* id);
+    void clear();
+    size_t size() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<SessionTicket> tickets_;
+    size_t capacity_;
+};
+
+// RESUME_REQUEST and RESUME_RESPONSE MACs under the ticket's key. The
+// response's covers the request nonce, tying it to one request.
+void resume_request_mac(const uint8_t* key, const protocol::ResumeRequestPayload& request,
+                        uint8_t* mac);
+void resume_response_mac(const uint8_t* key, const uint8_t* request_nonce,
+                         const protocol::ResumeResponsePayload& response, uint8_t* mac);
+bool resume_mac_equal(const uint8_t* a, const uint8_t* b);     // Constant time
+
+// Session key after a resume: HKDF-SHA256 over the ticket's key, salted
+// with the host's then the accessory's nonce
+void derive_resumed_key(const uint8_t* session_key, const uint8_t* host_nonce,
+                        const uint8_t* accessory_nonce, uint8_t* key);
+
+} // namespace common
+
+#endif // COMMON_SESSION_TICKET_H
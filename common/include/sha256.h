@@ -0,0 +1,79 @@
+#ifndef COMMON_SHA256_H
+#define COMMON_SHA256_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace common {
+
+// SHA-256 (FIPS 180-4), incremental. Blocks are compressed with the SHA
+// extensions when the CPU has them (picked at run time), else portably.
+// Copyable: a copy continues from the same point.
+class Sha256 {
+public:
+    static constexpr size_t DIGEST_SIZE = 32;
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    Sha256();
+
+    void reset();
+    void update(const uint8_t* data, size_t length);
+    // Writes DIGEST_SIZE bytes; reset() before reusing
+    void finish(uint8_t* digest);
+
+    static void hash(const uint8_t* data, size_t length, uint8_t* digest);
+
+private:
+    void compress(const uint8_t* blocks, size_t count);
+
+    uint32_t state_[8];
+    uint8_t buffer_[BLOCK_SIZE];
+    size_t buffered_;
+    uint64_t length_;               // Bytes hashed so far
+};
+
+// Implementation in use: "sha-ni" or "portable". Disabling the hardware
+// path is for benchmarks only.
+const char* sha256_implementation();
+void sha256_set_hardware(bool enabled);
+
+// HMAC-SHA256 (RFC 2104) under one key. The inner and outer hashes are
+// primed with the padded key once, at set_key(), so each MAC costs the
+// message blocks plus two: no per-message key schedule. Tags may be
+// truncated to tag_size bytes (RFC 2104 section 5). Const methods are
+// safe to call from several threads.
+class HmacSha256 {
+public:
+    HmacSha256();
+    HmacSha256(const uint8_t* key, size_t key_length);
+    ~HmacSha256();                  // Wipes the key states
+
+    void set_key(const uint8_t* key, size_t key_length);
+
+    // Tag of tag_size bytes (at most Sha256::DIGEST_SIZE) over data
+    void sign(const uint8_t* data, size_t length, uint8_t* tag, size_t tag_size) const;
+    // Compares in constant time
+    bool verify(const uint8_t* data, size_t length, const uint8_t* tag, size_t tag_size) const;
+
+    // For messages in pieces: update() the returned hash with the message,
+    // then finish() it into the tag
+    Sha256 start() const { return inner_; }
+    void finish(Sha256* inner, uint8_t* tag, size_t tag_size) const;
+
+private:
+    Sha256 inner_;                  // After the key ^ ipad block
+    Sha256 outer_;                  // After the key ^ opad block
+};
+
+// One-shot HMAC-SHA256; writes Sha256::DIGEST_SIZE bytes
+void hmac_sha256(const uint8_t* key, size_t key_length, const uint8_t* data, size_t length,
+                 uint8_t* mac);
+
+// HKDF-SHA256 (RFC 5869): extract with salt (may be null), then expand
+// with info to `length` bytes. False if length exceeds 255 digests.
+bool hkdf_sha256(const uint8_t* salt, size_t salt_length, const uint8_t* ikm, size_t ikm_length,
+                 const uint8_t* info, size_t info_length, uint8_t* out, size_t length);
+
+} // namespace common
+
+#endif // COMMON_SHA256_H
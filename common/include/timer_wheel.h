@@ -0,0 +1,160 @@
+#ifndef COMMON_TIMER_WHEEL_H
+#define COMMON_TIMER_WHEEL_H
+
+#include "pacer.h"
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace common {
+
+// Hierarchical timer wheel driving periodic and one-shot work on a small
+// worker pool. One tick thread advances the wheel; expired timers are handed
+// to the workers, so thousands of simulated components share a handful of
+// threads instead of each sleeping on its own.
+//
+// Wheel layout: WHEEL_LEVELS levels of WHEEL_SLOTS slots each. Level 0 holds
+// timers due within WHEEL_SLOTS ticks; higher levels are cascaded down as the
+// wheel turns (Varghese & Lauck scheme 6, as used by the Linux kernel).
+//
+// The tick thread waits for each tick through a Pacer, so every component
+// on the wheel (audio frames, keepalives, telemetry) shares its timing
+// strategy, and dispatch error is kept as a histogram.
+class TimerWheel {
+public:
+    using TimerId = uint64_t;
+    using Callback = std::function<void()>;
+
+    static constexpr TimerId INVALID_TIMER = 0;
+    static constexpr uint32_t DEFAULT_TICK_US = 1000;
+    static constexpr size_t DEFAULT_WORKERS = 2;
+
+    explicit TimerWheel(uint32_t tick_us = DEFAULT_TICK_US);
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // How the tick thread waits (default: plain sleep). Configure before
+    // start().
+    void set_pacer(PacerStrategy strategy, uint32_t spin_us = Pacer::DEFAULT_SPIN_US);
+    PacerStrategy pacer_strategy() const { return pacer_.strategy(); }
+
+    // Scheduler control
+    void start(size_t num_workers = DEFAULT_WORKERS);
+    void stop();
+    bool is_running() const { return running_.load(); }
+
+    // Timer management. Periodic timers are fixed-rate: each deadline is the
+    // previous deadline plus the interval, and missed deadlines are skipped
+    // (counted in Stats::ticks_skipped) rather than run back-to-back.
+    TimerId schedule_after(uint64_t delay_us, Callback callback);
+    TimerId schedule_periodic(uint64_t interval_us, Callback callback,
+                              uint64_t first_delay_us = UINT64_MAX);
+
+    // Runs `callback` on a worker as soon as one is free, without waiting
+    // for a tick. It cannot be cancelled and is left out of the dispatch
+    // timing. False, queueing nothing, when the wheel is stopped.
+    bool post(Callback callback);
+
+    // Cancel a timer. When the callback is running on another worker this
+    // blocks until it returns, so the caller may safely destroy whatever the
+    // callback captures. Returns false if the timer had already finished.
+    bool cancel(TimerId id);
+
+    uint32_t tick_us() const { return tick_us_; }
+
+    // Statistics
+    struct Stats {
+        uint64_t timers_scheduled;
+        uint64_t timers_fired;
+        uint64_t timers_cancelled;
+        uint64_t ticks_skipped;
+        uint64_t cascades;
+        uint64_t max_dispatch_delay_us;  // Deadline to callback start
+        size_t active_timers;
+    };
+
+    Stats get_stats() const;
+
+    // Callback start minus the tick the timer was due on, every firing
+    TimingHistogram get_dispatch_histogram() const;
+
+    // Tick thread wake-up error and late ticks (processed in a batch)
+    Pacer::Stats get_pacer_stats() const { return pacer_.get_stats(); }
+
+private:
+    static constexpr unsigned WHEEL_BITS = 6;
+    static constexpr unsigned WHEEL_SLOTS = 1u << WHEEL_BITS;
+    static constexpr unsigned WHEEL_MASK = WHEEL_SLOTS - 1;
+    static constexpr unsigned WHEEL_LEVELS = 4;
+    static constexpr uint32_t NIL = UINT32_MAX;
+
+    enum class NodeState : uint8_t {
+        FREE,
+        PENDING,    // Linked into a wheel slot
+        QUEUED,     // Waiting in the run queue
+        RUNNING,    // Callback executing on a worker
+        CANCELLED   // Cancelled while queued or running
+    };
+
+    struct Node {
+        Callback callback;
+        uint64_t expires_tick;
+        uint64_t deadline_us;
+        uint64_t interval_us;   // 0 for one-shot timers
+        uint32_t generation;
+        uint32_t prev;
+        uint32_t next;
+        uint16_t slot;          // (level << WHEEL_BITS) | index while PENDING
+        NodeState state;
+        bool posted;            // By post(): no deadline
+        std::thread::id runner;
+    };
+
+    TimerId schedule(uint64_t delay_us, uint64_t interval_us, Callback callback);
+    uint32_t allocate_node();
+    void release_node(uint32_t index);
+    void insert_node(uint32_t index);
+    void unlink_node(uint32_t index);
+    void cascade(unsigned level, unsigned slot);
+    void expire_tick(uint64_t tick);
+    uint64_t now_us() const;
+    uint64_t us_to_tick(uint64_t us) const;
+    uint64_t elapsed_ticks(uint64_t us) const;
+
+    void tick_loop();
+    void worker_loop();
+
+    const uint32_t tick_us_;
+    uint64_t origin_us_;
+    uint64_t current_tick_;
+
+    // Node pool; slots hold intrusive doubly-linked lists of node indices
+    std::vector<Node> nodes_;
+    uint32_t free_head_;
+    uint32_t slots_[WHEEL_LEVELS][WHEEL_SLOTS];
+    std::deque<uint32_t> run_queue_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable run_cv_;
+    std::condition_variable done_cv_;
+
+    std::atomic<bool> running_;
+    std::thread tick_thread_;
+    std::vector<std::thread> workers_;
+    Pacer pacer_;
+
+    Stats stats_;
+    TimingHistogram dispatch_error_;
+};
+
+} // namespace common
+
+#endif // COMMON_TIMER_WHEEL_H
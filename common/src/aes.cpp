@@ -0,0 +1,722 @@
+#include "aes.h"
+#include "secure_zero.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define AES_X86_DISPATCH 1
+#endif
+
+namespace common {
+
+namespace {
+
+constexpr size_t BLOCK = Aes128::BLOCK_SIZE;
+constexpr size_t ROUNDS = 10;
+constexpr size_t SLICED_BLOCKS = 4;                 // Blocks per bitsliced pass
+constexpr size_t CCM_LENGTH_BYTES = 15 - Aes128::CCM_NONCE_SIZE;
+constexpr size_t CCM_MAX_LENGTH = 0xFFFF;
+constexpr size_t CCM_MAX_AAD_LENGTH = 0xFEFF;      // Two-byte AAD length encoding
+
+struct KeySchedule {
+    const uint8_t* bytes;                           // (ROUNDS + 1) round keys
+    const uint64_t (*sliced)[8];
+};
+
+inline uint64_t load_le64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < 8; i++) {
+        v |= static_cast<uint64_t>(p[i]) << (8 * i);
+    }
+    return v;
+}
+
+inline void store_le64(uint8_t* p, uint64_t v) {
+    for (size_t i = 0; i < 8; i++) {
+        p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+}
+
+inline uint32_t load_be32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+inline void store_be32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+inline void xor_block(uint8_t* dst, const uint8_t* src, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Bitsliced software AES
+//
+// Four blocks are held as eight 64-bit planes: plane k has bit k of every
+// byte, byte j of block b at bit 16 * b + j. Bytes keep state order
+// (column-major), so a column is a nibble and a row every fourth bit, and
+// ShiftRows and MixColumns become shifts and masks.
+
+constexpr uint64_t lanes(uint64_t mask16) {
+    return mask16 * 0x0001000100010001ull;
+}
+
+// 8x8 bit matrix transpose: bit k of byte t to bit t of byte k
+inline uint64_t transpose8(uint64_t x) {
+    uint64_t t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAull;
+    x ^= t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCull;
+    x ^= t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ull;
+    x ^= t ^ (t << 28);
+    return x;
+}
+
+// 64 bytes (four blocks) to planes and back
+void load_planes(const uint8_t* in, uint64_t* q) {
+    uint64_t t[8];
+    for (size_t m = 0; m < 8; m++) {
+        t[m] = transpose8(load_le64(in + 8 * m));
+    }
+    for (size_t k = 0; k < 8; k++) {
+        uint64_t plane = 0;
+        for (size_t m = 0; m < 8; m++) {
+            plane |= ((t[m] >> (8 * k)) & 0xFF) << (8 * m);
+        }
+        q[k] = plane;
+    }
+}
+
+void store_planes(const uint64_t* q, uint8_t* out) {
+    for (size_t m = 0; m < 8; m++) {
+        uint64_t t = 0;
+        for (size_t k = 0; k < 8; k++) {
+            t |= ((q[k] >> (8 * m)) & 0xFF) << (8 * k);
+        }
+        store_le64(out + 8 * m, transpose8(t));
+    }
+}
+
+// SubBytes on every byte at once: the Boyar-Peralta circuit (GF(2^8)
+// inversion in a tower field, 113 gates), q[0] holding the low bits
+void sub_bytes(uint64_t* q) {
+    const uint64_t x0 = q[7], x1 = q[6], x2 = q[5], x3 = q[4];
+    const uint64_t x4 = q[3], x5 = q[2], x6 = q[1], x7 = q[0];
+
+    // Top linear transformation
+    const uint64_t y14 = x3 ^ x5;
+    const uint64_t y13 = x0 ^ x6;
+    const uint64_t y9 = x0 ^ x3;
+    const uint64_t y8 = x0 ^ x5;
+    const uint64_t t0 = x1 ^ x2;
+    const uint64_t y1 = t0 ^ x7;
+    const uint64_t y4 = y1 ^ x3;
+    const uint64_t y12 = y13 ^ y14;
+    const uint64_t y2 = y1 ^ x0;
+    const uint64_t y5 = y1 ^ x6;
+    const uint64_t y3 = y5 ^ y8;
+    const uint64_t t1 = x4 ^ y12;
+    const uint64_t y15 = t1 ^ x5;
+    const uint64_t y20 = t1 ^ x1;
+    const uint64_t y6 = y15 ^ x7;
+    const uint64_t y10 = y15 ^ t0;
+    const uint64_t y11 = y20 ^ y9;
+    const uint64_t y7 = x7 ^ y11;
+    const uint64_t y17 = y10 ^ y11;
+    const uint64_t y19 = y10 ^ y8;
+    const uint64_t y16 = t0 ^ y11;
+    const uint64_t y21 = y13 ^ y16;
+    const uint64_t y18 = x0 ^ y16;
+
+    // Non-linear section
+    const uint64_t t2 = y12 & y15;
+    const uint64_t t3 = y3 & y6;
+    const uint64_t t4 = t3 ^ t2;
+    const uint64_t t5 = y4 & x7;
+    const uint64_t t6 = t5 ^ t2;
+    const uint64_t t7 = y13 & y16;
+    const uint64_t t8 = y5 & y1;
+    const uint64_t t9 = t8 ^ t7;
+    const uint64_t t10 = y2 & y7;
+    const uint64_t t11 = t10 ^ t7;
+    const uint64_t t12 = y9 & y11;
+    const uint64_t t13 = y14 & y17;
+    const uint64_t t14 = t13 ^ t12;
+    const uint64_t t15 = y8 & y10;
+    const uint64_t t16 = t15 ^ t12;
+    const uint64_t t17 = t4 ^ t14;
+    const uint64_t t18 = t6 ^ t16;
+    const uint64_t t19 = t9 ^ t14;
+    const uint64_t t20 = t11 ^ t16;
+    const uint64_t t21 = t17 ^ y20;
+    const uint64_t t22 = t18 ^ y19;
+    const uint64_t t23 = t19 ^ y21;
+    const uint64_t t24 = t20 ^ y18;
+
+    const uint64_t t25 = t21 ^ t22;
+    const uint64_t t26 = t21 & t23;
+    const uint64_t t27 = t24 ^ t26;
+    const uint64_t t28 = t25 & t27;
+    const uint64_t t29 = t28 ^ t22;
+    const uint64_t t30 = t23 ^ t24;
+    const uint64_t t31 = t22 ^ t26;
+    const uint64_t t32 = t31 & t30;
+    const uint64_t t33 = t32 ^ t24;
+    const uint64_t t34 = t23 ^ t33;
+    const uint64_t t35 = t27 ^ t33;
+    const uint64_t t36 = t24 & t35;
+    const uint64_t t37 = t36 ^ t34;
+    const uint64_t t38 = t27 ^ t36;
+    const uint64_t t39 = t29 & t38;
+    const uint64_t t40 = t25 ^ t39;
+
+    const uint64_t t41 = t40 ^ t37;
+    const uint64_t t42 = t29 ^ t33;
+    const uint64_t t43 = t29 ^ t40;
+    const uint64_t t44 = t33 ^ t37;
+    const uint64_t t45 = t42 ^ t41;
+    const uint64_t z0 = t44 & y15;
+    const uint64_t z1 = t37 & y6;
+    const uint64_t z2 = t33 & x7;
+    const uint64_t z3 = t43 & y16;
+    const uint64_t z4 = t40 & y1;
+    const uint64_t z5 = t29 & y7;
+    const uint64_t z6 = t42 & y11;
+    const uint64_t z7 = t45 & y17;
+    const uint64_t z8 = t41 & y10;
+    const uint64_t z9 = t44 & y12;
+    const uint64_t z10 = t37 & y3;
+    const uint64_t z11 = t33 & y4;
+    const uint64_t z12 = t43 & y13;
+    const uint64_t z13 = t40 & y5;
+    const uint64_t z14 = t29 & y2;
+    const uint64_t z15 = t42 & y9;
+    const uint64_t z16 = t45 & y14;
+    const uint64_t z17 = t41 & y8;
+
+    // Bottom linear transformation
+    const uint64_t t46 = z15 ^ z16;
+    const uint64_t t47 = z10 ^ z11;
+    const uint64_t t48 = z5 ^ z13;
+    const uint64_t t49 = z9 ^ z10;
+    const uint64_t t50 = z2 ^ z12;
+    const uint64_t t51 = z2 ^ z5;
+    const uint64_t t52 = z7 ^ z8;
+    const uint64_t t53 = z0 ^ z3;
+    const uint64_t t54 = z6 ^ z7;
+    const uint64_t t55 = z16 ^ z17;
+    const uint64_t t56 = z12 ^ t48;
+    const uint64_t t57 = t50 ^ t53;
+    const uint64_t t58 = z4 ^ t46;
+    const uint64_t t59 = z3 ^ t54;
+    const uint64_t t60 = t46 ^ t57;
+    const uint64_t t61 = z14 ^ t57;
+    const uint64_t t62 = t52 ^ t58;
+    const uint64_t t63 = t49 ^ t58;
+    const uint64_t t64 = z4 ^ t59;
+    const uint64_t t65 = t61 ^ t62;
+    const uint64_t t66 = z1 ^ t63;
+    const uint64_t s0 = t59 ^ t63;
+    const uint64_t s6 = t56 ^ ~t62;
+    const uint64_t s7 = t48 ^ ~t60;
+    const uint64_t t67 = t64 ^ t65;
+    const uint64_t s3 = t53 ^ t66;
+    const uint64_t s4 = t51 ^ t66;
+    const uint64_t s5 = t47 ^ t65;
+    const uint64_t s1 = t64 ^ ~s3;
+    const uint64_t s2 = t55 ^ ~t67;
+
+    q[7] = s0;
+    q[6] = s1;
+    q[5] = s2;
+    q[4] = s3;
+    q[3] = s4;
+    q[2] = s5;
+    q[1] = s6;
+    q[0] = s7;
+}
+
+// Row r moves left by r columns: bit 4c + r takes bit 4((c + r) % 4) + r
+void shift_rows(uint64_t* q) {
+    for (size_t k = 0; k < 8; k++) {
+        const uint64_t x = q[k];
+        q[k] = (x & lanes(0x1111)) |
+               ((x >> 4) & lanes(0x0222)) | ((x << 12) & lanes(0x2000)) |
+               ((x >> 8) & lanes(0x0044)) | ((x << 8) & lanes(0x4400)) |
+               ((x >> 12) & lanes(0x0008)) | ((x << 4) & lanes(0x8880));
+    }
+}
+
+// Row r of each column takes row r + n
+inline uint64_t rotate_rows1(uint64_t x) {
+    return ((x >> 1) & lanes(0x7777)) | ((x << 3) & lanes(0x8888));
+}
+inline uint64_t rotate_rows2(uint64_t x) {
+    return ((x >> 2) & lanes(0x3333)) | ((x << 2) & lanes(0xCCCC));
+}
+inline uint64_t rotate_rows3(uint64_t x) {
+    return ((x >> 3) & lanes(0x1111)) | ((x << 1) & lanes(0xEEEE));
+}
+
+// out_r = 2 a_r + 3 a_r+1 + a_r+2 + a_r+3 = 2 (a_r + a_r+1) + a_r+1 + a_r+2 + a_r+3
+void mix_columns(uint64_t* q) {
+    uint64_t t[8];
+    for (size_t k = 0; k < 8; k++) {
+        const uint64_t r1 = rotate_rows1(q[k]);
+        t[k] = q[k] ^ r1;
+        q[k] = r1 ^ rotate_rows2(q[k]) ^ rotate_rows3(q[k]);
+    }
+    // Multiply t by x modulo x^8 + x^4 + x^3 + x + 1
+    q[0] ^= t[7];
+    q[1] ^= t[0] ^ t[7];
+    q[2] ^= t[1];
+    q[3] ^= t[2] ^ t[7];
+    q[4] ^= t[3] ^ t[7];
+    q[5] ^= t[4];
+    q[6] ^= t[5];
+    q[7] ^= t[6];
+}
+
+inline void add_round_key(uint64_t* q, const uint64_t* key) {
+    for (size_t k = 0; k < 8; k++) {
+        q[k] ^= key[k];
+    }
+}
+
+void sliced_encrypt(const uint64_t (*keys)[8], uint64_t* q) {
+    add_round_key(q, keys[0]);
+    for (size_t round = 1; round < ROUNDS; round++) {
+        sub_bytes(q);
+        shift_rows(q);
+        mix_columns(q);
+        add_round_key(q, keys[round]);
+    }
+    sub_bytes(q);
+    shift_rows(q);
+    add_round_key(q, keys[ROUNDS]);
+}
+
+// SubWord of the key schedule through the same circuit
+void sub_word(uint8_t* word) {
+    uint64_t q[8] = {};
+    for (size_t j = 0; j < 4; j++) {
+        for (size_t k = 0; k < 8; k++) {
+            q[k] |= static_cast<uint64_t>((word[j] >> k) & 1) << j;
+        }
+    }
+    sub_bytes(q);
+    for (size_t j = 0; j < 4; j++) {
+        uint8_t byte = 0;
+        for (size_t k = 0; k < 8; k++) {
+            byte |= static_cast<uint8_t>(((q[k] >> j) & 1) << k);
+        }
+        word[j] = byte;
+    }
+}
+
+void expand_key(const uint8_t* key, uint8_t* round_keys) {
+    memcpy(round_keys, key, Aes128::KEY_SIZE);
+    uint8_t rcon = 0x01;
+    for (size_t i = 4; i < 4 * (ROUNDS + 1); i++) {
+        uint8_t word[4];
+        memcpy(word, round_keys + 4 * (i - 1), 4);
+        if (i % 4 == 0) {
+            uint8_t first = word[0];
+            word[0] = word[1];
+            word[1] = word[2];
+            word[2] = word[3];
+            word[3] = first;
+            sub_word(word);
+            word[0] ^= rcon;
+            rcon = static_cast<uint8_t>((rcon << 1) ^ ((rcon >> 7) * 0x1B));
+        }
+        for (size_t j = 0; j < 4; j++) {
+            round_keys[4 * i + j] = round_keys[4 * (i - 4) + j] ^ word[j];
+        }
+    }
+}
+
+void soft_encrypt_blocks(const KeySchedule& keys, const uint8_t* in, uint8_t* out, size_t blocks) {
+    uint8_t batch[SLICED_BLOCKS * BLOCK];
+    uint64_t q[8];
+    while (blocks > 0) {
+        size_t count = std::min(blocks, SLICED_BLOCKS);
+        memcpy(batch, in, count * BLOCK);
+        load_planes(batch, q);
+        sliced_encrypt(keys.sliced, q);
+        store_planes(q, batch);
+        memcpy(out, batch, count * BLOCK);
+        in += count * BLOCK;
+        out += count * BLOCK;
+        blocks -= count;
+    }
+}
+
+void soft_ctr_xor(const KeySchedule& keys, const uint8_t* counter, uint8_t* data, size_t length) {
+    uint8_t batch[SLICED_BLOCKS * BLOCK];
+    uint64_t q[8];
+    uint32_t count = load_be32(counter + 12);
+    while (length > 0) {
+        for (size_t b = 0; b < SLICED_BLOCKS; b++) {
+            memcpy(batch + b * BLOCK, counter, 12);
+            store_be32(batch + b * BLOCK + 12, count++);
+        }
+        load_planes(batch, q);
+        sliced_encrypt(keys.sliced, q);
+        store_planes(q, batch);
+        size_t chunk = std::min(length, sizeof(batch));
+        xor_block(data, batch, chunk);
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+// CCM payload pass: CTR from `counter` (A1) and CBC-MAC into `mac`, each
+// block's keystream in one pass with the MAC of the block before it
+void soft_ccm_crypt(const KeySchedule& keys, const uint8_t* counter, uint8_t* data, size_t length,
+                    bool encrypt, uint8_t* mac) {
+    uint8_t in[2 * BLOCK];
+    uint8_t out[2 * BLOCK];
+    uint8_t plain[BLOCK];
+    bool have_plain = false;
+    memcpy(in, counter, BLOCK);
+    uint32_t count = load_be32(counter + 12);
+
+    for (size_t offset = 0; offset < length; offset += BLOCK) {
+        size_t n = std::min(BLOCK, length - offset);
+        store_be32(in + 12, count++);
+        if (have_plain) {
+            memcpy(in + BLOCK, mac, BLOCK);
+            xor_block(in + BLOCK, plain, BLOCK);
+        }
+        soft_encrypt_blocks(keys, in, out, have_plain ? 2 : 1);
+        if (have_plain) {
+            memcpy(mac, out + BLOCK, BLOCK);
+        }
+
+        memset(plain, 0, BLOCK);
+        if (encrypt) {
+            memcpy(plain, data + offset, n);
+        }
+        xor_block(data + offset, out, n);
+        if (!encrypt) {
+            memcpy(plain, data + offset, n);
+        }
+        have_plain = true;
+    }
+    if (have_plain) {
+        xor_block(mac, plain, BLOCK);
+        soft_encrypt_blocks(keys, mac, mac, 1);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// AES-NI
+
+#if defined(AES_X86_DISPATCH)
+__attribute__((target("aes")))
+inline __m128i ni_encrypt(const __m128i* k, __m128i b) {
+    b = _mm_xor_si128(b, k[0]);
+    for (size_t round = 1; round < ROUNDS; round++) {
+        b = _mm_aesenc_si128(b, k[round]);
+    }
+    return _mm_aesenclast_si128(b, k[ROUNDS]);
+}
+
+// Two independent blocks interleaved, so each round overlaps the other's
+__attribute__((target("aes")))
+inline void ni_encrypt2(const __m128i* k, __m128i* a, __m128i* b) {
+    __m128i x = _mm_xor_si128(*a, k[0]);
+    __m128i y = _mm_xor_si128(*b, k[0]);
+    for (size_t round = 1; round < ROUNDS; round++) {
+        x = _mm_aesenc_si128(x, k[round]);
+        y = _mm_aesenc_si128(y, k[round]);
+    }
+    *a = _mm_aesenclast_si128(x, k[ROUNDS]);
+    *b = _mm_aesenclast_si128(y, k[ROUNDS]);
+}
+
+__attribute__((target("aes")))
+inline void ni_load_keys(const uint8_t* bytes, __m128i* k) {
+    for (size_t round = 0; round <= ROUNDS; round++) {
+        k[round] = _mm_load_si128(reinterpret_cast<const __m128i*>(bytes + round * BLOCK));
+    }
+}
+
+// Counter block `base` (last 32 bits zero) with `count` there, big-endian
+__attribute__((target("aes")))
+inline __m128i ni_counter(__m128i base, uint32_t count) {
+    return _mm_xor_si128(base, _mm_set_epi32(static_cast<int>(__builtin_bswap32(count)), 0, 0, 0));
+}
+
+__attribute__((target("aes")))
+void ni_encrypt_blocks(const KeySchedule& keys, const uint8_t* in, uint8_t* out, size_t blocks) {
+    __m128i k[ROUNDS + 1];
+    ni_load_keys(keys.bytes, k);
+    for (size_t i = 0; i < blocks; i++) {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * BLOCK));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * BLOCK), ni_encrypt(k, b));
+    }
+}
+
+// Eight counter blocks per pass keep the AES unit's pipeline full
+__attribute__((target("aes")))
+void ni_ctr_xor(const KeySchedule& keys, const uint8_t* counter, uint8_t* data, size_t length) {
+    constexpr size_t WIDTH = 8;
+    __m128i k[ROUNDS + 1];
+    ni_load_keys(keys.bytes, k);
+    uint8_t base_bytes[BLOCK];
+    memcpy(base_bytes, counter, 12);
+    memset(base_bytes + 12, 0, 4);
+    const __m128i base = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base_bytes));
+    uint32_t count = load_be32(counter + 12);
+
+    size_t offset = 0;
+    for (; offset + WIDTH * BLOCK <= length; offset += WIDTH * BLOCK) {
+        __m128i b[WIDTH];
+        for (size_t i = 0; i < WIDTH; i++) {
+            b[i] = _mm_xor_si128(ni_counter(base, count++), k[0]);
+        }
+        for (size_t round = 1; round < ROUNDS; round++) {
+            for (size_t i = 0; i < WIDTH; i++) {
+                b[i] = _mm_aesenc_si128(b[i], k[round]);
+            }
+        }
+        for (size_t i = 0; i < WIDTH; i++) {
+            __m128i* p = reinterpret_cast<__m128i*>(data + offset + i * BLOCK);
+            b[i] = _mm_aesenclast_si128(b[i], k[ROUNDS]);
+            _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), b[i]));
+        }
+    }
+    for (; offset < length; offset += BLOCK) {
+        __m128i keystream = ni_encrypt(k, ni_counter(base, count++));
+        size_t n = std::min(BLOCK, length - offset);
+        if (n == BLOCK) {
+            __m128i* p = reinterpret_cast<__m128i*>(data + offset);
+            _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), keystream));
+        } else {
+            uint8_t bytes[BLOCK];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes), keystream);
+            xor_block(data + offset, bytes, n);
+        }
+    }
+}
+
+// Same pass as soft_ccm_crypt with the MAC and counter chains interleaved
+__attribute__((target("aes")))
+void ni_ccm_crypt(const KeySchedule& keys, const uint8_t* counter, uint8_t* data, size_t length,
+                  bool encrypt, uint8_t* mac_bytes) {
+    __m128i k[ROUNDS + 1];
+    ni_load_keys(keys.bytes, k);
+    uint8_t base_bytes[BLOCK];
+    memcpy(base_bytes, counter, 12);
+    memset(base_bytes + 12, 0, 4);
+    const __m128i base = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base_bytes));
+    uint32_t count = load_be32(counter + 12);
+    __m128i mac = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mac_bytes));
+    __m128i plain = _mm_setzero_si128();
+    bool have_plain = false;
+
+    for (size_t offset = 0; offset < length; offset += BLOCK) {
+        __m128i keystream = ni_counter(base, count++);
+        if (have_plain) {
+            __m128i chained = _mm_xor_si128(mac, plain);
+            ni_encrypt2(k, &keystream, &chained);
+            mac = chained;
+        } else {
+            keystream = ni_encrypt(k, keystream);
+        }
+
+        size_t n = std::min(BLOCK, length - offset);
+        uint8_t bytes[BLOCK] = {};
+        memcpy(bytes, data + offset, n);
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+        __m128i out = _mm_xor_si128(in, keystream);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes), out);
+        memcpy(data + offset, bytes, n);
+        if (encrypt) {
+            plain = in;
+        } else {
+            // Keystream past the end is not plaintext: the MAC pads with zeros
+            memset(bytes + n, 0, BLOCK - n);
+            plain = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+        }
+        have_plain = true;
+    }
+    if (have_plain) {
+        mac = ni_encrypt(k, _mm_xor_si128(mac, plain));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(mac_bytes), mac);
+}
+#endif
+
+struct AesImplementation {
+    void (*encrypt_blocks)(const KeySchedule&, const uint8_t*, uint8_t*, size_t);
+    void (*ctr_xor)(const KeySchedule&, const uint8_t*, uint8_t*, size_t);
+    void (*ccm_crypt)(const KeySchedule&, const uint8_t*, uint8_t*, size_t, bool, uint8_t*);
+    const char* name;
+};
+
+constexpr AesImplementation SOFTWARE = {
+    soft_encrypt_blocks, soft_ctr_xor, soft_ccm_crypt, "bitsliced"
+};
+
+AesImplementation detect_hardware() {
+#if defined(AES_X86_DISPATCH)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("aes")) {
+        return {ni_encrypt_blocks, ni_ctr_xor, ni_ccm_crypt, "aes-ni"};
+    }
+#endif
+    return SOFTWARE;
+}
+
+const AesImplementation& hardware_implementation() {
+    static const AesImplementation implementation = detect_hardware();
+    return implementation;
+}
+
+std::atomic<bool> g_hardware_enabled(true);
+
+const AesImplementation& active_implementation() {
+    if (!g_hardware_enabled.load(std::memory_order_relaxed)) {
+        return SOFTWARE;
+    }
+    return hardware_implementation();
+}
+
+} // namespace
+
+const char* aes_implementation() {
+    return active_implementation().name;
+}
+
+void aes_set_hardware(bool enabled) {
+    g_hardware_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// Aes128
+
+Aes128::Aes128() {
+    const uint8_t zero[KEY_SIZE] = {};
+    set_key(zero);
+}
+
+Aes128::Aes128(const uint8_t* key) {
+    set_key(key);
+}
+
+Aes128::~Aes128() {
+    secure_zero(round_keys_, sizeof(round_keys_));
+    secure_zero(sliced_keys_, sizeof(sliced_keys_));
+}
+
+void Aes128::set_key(const uint8_t* key) {
+    expand_key(key, round_keys_);
+    // Each round key repeated across the four sliced blocks
+    uint8_t repeated[SLICED_BLOCKS * BLOCK];
+    for (size_t round = 0; round <= ROUNDS; round++) {
+        for (size_t b = 0; b < SLICED_BLOCKS; b++) {
+            memcpy(repeated + b * BLOCK, round_keys_ + round * BLOCK, BLOCK);
+        }
+        load_planes(repeated, sliced_keys_[round]);
+    }
+    secure_zero(repeated, sizeof(repeated));
+}
+
+void Aes128::encrypt_blocks(const uint8_t* in, uint8_t* out, size_t blocks) const {
+    active_implementation().encrypt_blocks({round_keys_, sliced_keys_}, in, out, blocks);
+}
+
+void Aes128::ctr_xor(const uint8_t* counter, uint8_t* data, size_t length) const {
+    active_implementation().ctr_xor({round_keys_, sliced_keys_}, counter, data, length);
+}
+
+void Aes128::cbc_mac_header(const uint8_t* nonce, const uint8_t* aad, size_t aad_length,
+                            size_t length, size_t tag_size, uint8_t* mac) const {
+    // B0: flags, nonce, message length
+    mac[0] = static_cast<uint8_t>((aad_length > 0 ? 0x40 : 0) | (((tag_size - 2) / 2) << 3) |
+                                  (CCM_LENGTH_BYTES - 1));
+    memcpy(mac + 1, nonce, CCM_NONCE_SIZE);
+    mac[14] = static_cast<uint8_t>(length >> 8);
+    mac[15] = static_cast<uint8_t>(length);
+    encrypt_blocks(mac, mac, 1);
+
+    // Associated data after its two-byte length, zero-padded
+    if (aad_length > 0) {
+        uint8_t block[BLOCK] = {};
+        block[0] = static_cast<uint8_t>(aad_length >> 8);
+        block[1] = static_cast<uint8_t>(aad_length);
+        size_t used = 2;
+        size_t offset = 0;
+        while (offset < aad_length) {
+            size_t n = std::min(BLOCK - used, aad_length - offset);
+            memcpy(block + used, aad + offset, n);
+            offset += n;
+            xor_block(mac, block, BLOCK);
+            encrypt_blocks(mac, mac, 1);
+            memset(block, 0, BLOCK);
+            used = 0;
+        }
+    }
+}
+
+void Aes128::ccm_crypt(const uint8_t* nonce, uint8_t* data, size_t length, bool encrypt,
+                       uint8_t* mac) const {
+    uint8_t counter[BLOCK] = {};
+    counter[0] = CCM_LENGTH_BYTES - 1;
+    memcpy(counter + 1, nonce, CCM_NONCE_SIZE);
+    counter[15] = 1;                                // A1; A0 encrypts the tag
+    active_implementation().ccm_crypt({round_keys_, sliced_keys_}, counter, data, length,
+                                      encrypt, mac);
+
+    // Tag = MAC ^ E(A0)
+    counter[15] = 0;
+    encrypt_blocks(counter, counter, 1);
+    xor_block(mac, counter, BLOCK);
+}
+
+bool Aes128::ccm_seal(const uint8_t* nonce, const uint8_t* aad, size_t aad_length,
+                      uint8_t* data, size_t length, uint8_t* tag, size_t tag_size) const {
+    if (tag_size < 4 || tag_size > BLOCK || tag_size % 2 != 0 ||
+        length > CCM_MAX_LENGTH || aad_length > CCM_MAX_AAD_LENGTH) {
+        return false;
+    }
+    uint8_t mac[BLOCK];
+    cbc_mac_header(nonce, aad, aad_length, length, tag_size, mac);
+    ccm_crypt(nonce, data, length, true, mac);
+    memcpy(tag, mac, tag_size);
+    return true;
+}
+
+bool Aes128::ccm_open(const uint8_t* nonce, const uint8_t* aad, size_t aad_length,
+                      uint8_t* data, size_t length, const uint8_t* tag, size_t tag_size) const {
+    if (tag_size < 4 || tag_size > BLOCK || tag_size % 2 != 0 ||
+        length > CCM_MAX_LENGTH || aad_length > CCM_MAX_AAD_LENGTH) {
+        return false;
+    }
+    uint8_t mac[BLOCK];
+    cbc_mac_header(nonce, aad, aad_length, length, tag_size, mac);
+    ccm_crypt(nonce, data, length, false, mac);
+
+    uint8_t difference = 0;
+    for (size_t i = 0; i < tag_size; i++) {
+        difference |= mac[i] ^ tag[i];
+    }
+    if (difference != 0) {
+        secure_zero(data, length);
+        return false;
+    }
+    return true;
+}
+
+} // namespace common
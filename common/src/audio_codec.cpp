@@ -0,0 +1,815 @@
+#include "audio_codec.h"
+#include "sample_format.h"
+#include <cstring>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace common {
+
+using protocol::AudioEncoding;
+
+// ---------------------------------------------------------------------------
+// Negotiation
+
+std::unique_ptr<AudioCodec> create_audio_codec(AudioEncoding encoding,
+                                               const protocol::StreamFormat& format) {
+    if (!protocol::is_valid_stream_format(format)) {
+        return nullptr;
+    }
+    if (encoding == AudioEncoding::PCM16) {
+        std::unique_ptr<AudioCodec> codec;
+        with_sample_format(format.sample_format, [&](auto traits) {
+            codec.reset(new PcmCodec<decltype(traits)::FORMAT>(format));
+        });
+        return codec;
+    }
+
+    // The compressing codecs model a single int16 channel
+    if (format != protocol::DEFAULT_STREAM_FORMAT) {
+        return nullptr;
+    }
+    switch (encoding) {
+        case AudioEncoding::IMA_ADPCM: return std::unique_ptr<AudioCodec>(new ImaAdpcmCodec());
+        case AudioEncoding::LOSSLESS: return std::unique_ptr<AudioCodec>(new LosslessCodec());
+        default: return nullptr;
+    }
+}
+
+uint16_t supported_codec_capabilities() {
+    return protocol::CAP_CODEC_IMA_ADPCM | protocol::CAP_CODEC_LOSSLESS;
+}
+
+bool codec_supported(AudioEncoding encoding, uint16_t capabilities) {
+    switch (encoding) {
+        case AudioEncoding::PCM16: return true;  // Always available
+        case AudioEncoding::IMA_ADPCM: return (capabilities & protocol::CAP_CODEC_IMA_ADPCM) != 0;
+        case AudioEncoding::LOSSLESS: return (capabilities & protocol::CAP_CODEC_LOSSLESS) != 0;
+        default: return false;
+    }
+}
+
+AudioEncoding negotiate_encoding(uint16_t peer_capabilities, AudioEncoding preferred) {
+    uint16_t common_caps = peer_capabilities & supported_codec_capabilities();
+    if (codec_supported(preferred, common_caps)) {
+        return preferred;
+    }
+
+    // Otherwise the smallest encoding both sides have
+    const AudioEncoding by_size[] = {
+        AudioEncoding::IMA_ADPCM, AudioEncoding::LOSSLESS, AudioEncoding::PCM16
+    };
+    for (AudioEncoding encoding : by_size) {
+        if (codec_supported(encoding, common_caps)) {
+            return encoding;
+        }
+    }
+    return AudioEncoding::PCM16;
+}
+
+size_t max_encoded_frame_size(AudioEncoding encoding, uint16_t frame_samples,
+                              const protocol::StreamFormat& format) {
+    std::unique_ptr<AudioCodec> codec = create_audio_codec(encoding, format);
+    if (!codec) {
+        codec = create_audio_codec(AudioEncoding::PCM16, format);
+    }
+    if (!codec) {
+        return SIZE_MAX;
+    }
+    return codec->max_encoded_size(protocol::stream_frame_samples(format, frame_samples) *
+                                   format.channels);
+}
+
+uint8_t max_frames_per_packet(AudioEncoding encoding, uint16_t frame_samples,
+                              const protocol::StreamFormat& format) {
+    // Worst case per aggregated frame: its size prefix plus max encoded size.
+    // Aggregation only saves per-datagram overhead, so it stops at one
+    // datagram; a larger frame is sent alone and fragmented. Room is kept
+    // for the tag of an encrypted stream.
+    const size_t available = protocol::DEFAULT_DATAGRAM_SIZE - protocol::PACKET_HEADER_SIZE -
+                             sizeof(protocol::AudioPayload) - protocol::AUTH_TAG_SIZE;
+    const size_t encoded_size = max_encoded_frame_size(encoding, frame_samples, format);
+    if (encoded_size >= available) {
+        return 1;
+    }
+    const size_t frame_size = sizeof(uint16_t) + encoded_size;
+    uint8_t frames = 1;
+    while (frames < protocol::MAX_FRAMES_PER_PACKET && (frames + 1) * frame_size <= available) {
+        frames++;
+    }
+    return frames;
+}
+
+bool audio_encoding_from_string(const char* name, AudioEncoding* encoding) {
+    if (strcmp(name, "pcm16") == 0) {
+        *encoding = AudioEncoding::PCM16;
+    } else if (strcmp(name, "adpcm") == 0) {
+        *encoding = AudioEncoding::IMA_ADPCM;
+    } else if (strcmp(name, "lossless") == 0) {
+        *encoding = AudioEncoding::LOSSLESS;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Raw PCM
+
+template <protocol::SampleFormat F>
+size_t PcmCodec<F>::encode(const void* samples, size_t num_samples,
+                           uint8_t* out, size_t capacity) {
+    if (num_samples == 0 || max_encoded_size(num_samples) > capacity) {
+        return 0;
+    }
+    return pack_samples<F>(static_cast<const typename SampleTraits<F>::Type*>(samples),
+                           num_samples, out);
+}
+
+template <protocol::SampleFormat F>
+bool PcmCodec<F>::decode(const uint8_t* data, size_t size,
+                         void* samples, size_t num_samples) {
+    if (size != max_encoded_size(num_samples)) {
+        return false;
+    }
+    unpack_samples<F>(data, num_samples, static_cast<typename SampleTraits<F>::Type*>(samples));
+    return true;
+}
+
+template class PcmCodec<protocol::SampleFormat::INT16>;
+template class PcmCodec<protocol::SampleFormat::INT24>;
+template class PcmCodec<protocol::SampleFormat::FLOAT32>;
+
+// ---------------------------------------------------------------------------
+// IMA ADPCM
+
+namespace {
+
+const int32_t IMA_STEP_TABLE[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767
+};
+
+const int32_t IMA_INDEX_TABLE[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+constexpr int32_t IMA_MAX_INDEX = 88;
+constexpr size_t IMA_HEADER_SIZE = 4;   // int16 first sample, uint8 index, pad
+
+// Sub-block geometry: every sub-block spans `length` samples; samples past
+// the end of the packet are padded with the last sample and not decoded
+struct AdpcmLayout {
+    size_t length;          // Samples per sub-block
+    size_t code_bytes;      // Packed nibbles per sub-block (length - 1 codes)
+
+    explicit AdpcmLayout(size_t num_samples)
+        : length((num_samples + ImaAdpcmCodec::SUB_BLOCKS - 1) / ImaAdpcmCodec::SUB_BLOCKS)
+        , code_bytes(length / 2) {
+    }
+
+    size_t encoded_size() const {
+        return ImaAdpcmCodec::SUB_BLOCKS * (IMA_HEADER_SIZE + code_bytes);
+    }
+};
+
+inline int16_t padded_sample(const int16_t* samples, size_t num_samples, size_t index) {
+    return samples[std::min(index, num_samples - 1)];
+}
+
+inline int32_t clamp_index(int32_t index) {
+    return std::max(0, std::min(IMA_MAX_INDEX, index));
+}
+
+// Starting step for a sub-block: the headers carry the index, so instead of
+// ramping up from the previous packet's state the encoder starts from the
+// opening slope of the sub-block itself
+int32_t initial_step_index(const int16_t* samples, size_t num_samples, size_t start,
+                           int32_t previous) {
+    int32_t slope = 0;
+    for (size_t k = start; k < start + 4 && k + 1 < num_samples; k++) {
+        slope = std::max(slope, std::abs(samples[k + 1] - samples[k]));
+    }
+    if (slope == 0) {
+        return std::min(previous, IMA_MAX_INDEX);
+    }
+    int32_t index = 0;
+    while (index < IMA_MAX_INDEX && IMA_STEP_TABLE[index] < slope / 2) {
+        index++;
+    }
+    return index;
+}
+
+inline int32_t clamp_sample(int32_t value) {
+    return std::max(-32768, std::min(32767, value));
+}
+
+// One IMA step; returns the 4-bit code and updates predictor and index
+inline uint8_t ima_encode_sample(int32_t sample, int32_t* predictor, int32_t* index) {
+    int32_t step = IMA_STEP_TABLE[*index];
+    int32_t diff = sample - *predictor;
+    uint8_t code = 0;
+    if (diff < 0) {
+        code = 8;
+        diff = -diff;
+    }
+
+    int32_t vpdiff = step >> 3;
+    if (diff >= step) {
+        code |= 4;
+        diff -= step;
+        vpdiff += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        code |= 2;
+        diff -= step;
+        vpdiff += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        code |= 1;
+        vpdiff += step;
+    }
+
+    *predictor = clamp_sample((code & 8) ? *predictor - vpdiff : *predictor + vpdiff);
+    *index = clamp_index(*index + IMA_INDEX_TABLE[code & 7]);
+    return code;
+}
+
+inline int32_t ima_decode_sample(uint8_t code, int32_t* predictor, int32_t* index) {
+    int32_t step = IMA_STEP_TABLE[*index];
+    int32_t vpdiff = step >> 3;
+    if (code & 4) vpdiff += step;
+    if (code & 2) vpdiff += step >> 1;
+    if (code & 1) vpdiff += step >> 2;
+
+    *predictor = clamp_sample((code & 8) ? *predictor - vpdiff : *predictor + vpdiff);
+    *index = clamp_index(*index + IMA_INDEX_TABLE[code & 7]);
+    return *predictor;
+}
+
+inline void put_nibble(uint8_t* codes, size_t position, uint8_t code) {
+    if (position & 1) {
+        codes[position >> 1] |= static_cast<uint8_t>(code << 4);
+    } else {
+        codes[position >> 1] = code;
+    }
+}
+
+inline uint8_t get_nibble(const uint8_t* codes, size_t position) {
+    return (codes[position >> 1] >> ((position & 1) * 4)) & 0x0F;
+}
+
+#if defined(__SSE2__)
+// Saturate int32 lanes to int16 range (SSE2 has no 32-bit min/max)
+inline __m128i clamp_epi32_to_int16(__m128i value) {
+    __m128i packed = _mm_packs_epi32(value, value);
+    return _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+}
+
+// Lane-wise v < 0 ? 0 : (v > 88 ? 88 : v)
+inline __m128i clamp_index_epi32(__m128i index) {
+    index = _mm_andnot_si128(_mm_srai_epi32(index, 31), index);
+    __m128i max_index = _mm_set1_epi32(IMA_MAX_INDEX);
+    __m128i over = _mm_cmpgt_epi32(index, max_index);
+    return _mm_or_si128(_mm_and_si128(over, max_index), _mm_andnot_si128(over, index));
+}
+
+// IMA_INDEX_TABLE[code & 7] without a table: -1 for 0-3, (c - 3) * 2 above
+inline __m128i index_adjust_epi32(__m128i code) {
+    __m128i magnitude = _mm_and_si128(code, _mm_set1_epi32(7));
+    __m128i grow = _mm_cmpgt_epi32(magnitude, _mm_set1_epi32(3));
+    __m128i up = _mm_slli_epi32(_mm_sub_epi32(magnitude, _mm_set1_epi32(3)), 1);
+    return _mm_or_si128(_mm_and_si128(grow, up), _mm_andnot_si128(grow, _mm_set1_epi32(-1)));
+}
+
+inline __m128i gather_steps(const int32_t* index) {
+    return _mm_set_epi32(IMA_STEP_TABLE[index[3]], IMA_STEP_TABLE[index[2]],
+                         IMA_STEP_TABLE[index[1]], IMA_STEP_TABLE[index[0]]);
+}
+#endif
+
+} // namespace
+
+ImaAdpcmCodec::ImaAdpcmCodec() {
+    reset();
+}
+
+void ImaAdpcmCodec::reset() {
+    for (size_t j = 0; j < SUB_BLOCKS; j++) {
+        step_index_[j] = 0;
+    }
+}
+
+size_t ImaAdpcmCodec::max_encoded_size(size_t num_samples) const {
+    return AdpcmLayout(num_samples).encoded_size();
+}
+
+size_t ImaAdpcmCodec::encode(const void* input, size_t num_samples,
+                             uint8_t* out, size_t capacity) {
+    const int16_t* samples = static_cast<const int16_t*>(input);
+    AdpcmLayout layout(num_samples);
+    if (num_samples == 0 || layout.encoded_size() > capacity) {
+        return 0;
+    }
+
+    uint8_t* codes[SUB_BLOCKS];
+    alignas(16) int32_t predictor[SUB_BLOCKS];
+    alignas(16) int32_t index[SUB_BLOCKS];
+    for (size_t j = 0; j < SUB_BLOCKS; j++) {
+        uint8_t* header = out + j * IMA_HEADER_SIZE;
+        int16_t first = padded_sample(samples, num_samples, j * layout.length);
+        step_index_[j] = initial_step_index(samples, num_samples, j * layout.length, step_index_[j]);
+        memcpy(header, &first, sizeof(first));
+        header[2] = static_cast<uint8_t>(step_index_[j]);
+        header[3] = 0;
+
+        codes[j] = out + SUB_BLOCKS * IMA_HEADER_SIZE + j * layout.code_bytes;
+        memset(codes[j], 0, layout.code_bytes);
+        predictor[j] = first;
+        index[j] = step_index_[j];
+    }
+
+    const size_t length = layout.length;
+    size_t i = 1;
+
+#if defined(__SSE2__)
+    // Sub-block j runs in lane j
+    if (num_samples >= SUB_BLOCKS * length) {
+        __m128i pred = _mm_load_si128(reinterpret_cast<const __m128i*>(predictor));
+        __m128i idx = _mm_load_si128(reinterpret_cast<const __m128i*>(index));
+        alignas(16) int32_t code_out[SUB_BLOCKS];
+
+        for (; i < length; i++) {
+            __m128i sample = _mm_set_epi32(samples[3 * length + i], samples[2 * length + i],
+                                           samples[length + i], samples[i]);
+            __m128i step = gather_steps(index);
+
+            __m128i diff = _mm_sub_epi32(sample, pred);
+            __m128i negative = _mm_srai_epi32(diff, 31);
+            diff = _mm_sub_epi32(_mm_xor_si128(diff, negative), negative);
+            __m128i code = _mm_and_si128(negative, _mm_set1_epi32(8));
+            __m128i vpdiff = _mm_srai_epi32(step, 3);
+
+            // Three quantizer bits: take the step where |diff| >= step
+            __m128i below = _mm_cmpgt_epi32(step, diff);
+            code = _mm_or_si128(code, _mm_andnot_si128(below, _mm_set1_epi32(4)));
+            diff = _mm_sub_epi32(diff, _mm_andnot_si128(below, step));
+            vpdiff = _mm_add_epi32(vpdiff, _mm_andnot_si128(below, step));
+
+            step = _mm_srai_epi32(step, 1);
+            below = _mm_cmpgt_epi32(step, diff);
+            code = _mm_or_si128(code, _mm_andnot_si128(below, _mm_set1_epi32(2)));
+            diff = _mm_sub_epi32(diff, _mm_andnot_si128(below, step));
+            vpdiff = _mm_add_epi32(vpdiff, _mm_andnot_si128(below, step));
+
+            step = _mm_srai_epi32(step, 1);
+            below = _mm_cmpgt_epi32(step, diff);
+            code = _mm_or_si128(code, _mm_andnot_si128(below, _mm_set1_epi32(1)));
+            vpdiff = _mm_add_epi32(vpdiff, _mm_andnot_si128(below, step));
+
+            vpdiff = _mm_sub_epi32(_mm_xor_si128(vpdiff, negative), negative);
+            pred = clamp_epi32_to_int16(_mm_add_epi32(pred, vpdiff));
+            idx = clamp_index_epi32(_mm_add_epi32(idx, index_adjust_epi32(code)));
+
+            _mm_store_si128(reinterpret_cast<__m128i*>(index), idx);
+            _mm_store_si128(reinterpret_cast<__m128i*>(code_out), code);
+            for (size_t j = 0; j < SUB_BLOCKS; j++) {
+                put_nibble(codes[j], i - 1, static_cast<uint8_t>(code_out[j]));
+            }
+        }
+    }
+#endif
+
+    // Scalar path (and packets short enough to need padding)
+    for (size_t j = 0; j < SUB_BLOCKS; j++) {
+        for (size_t k = i; k < length; k++) {
+            int16_t sample = padded_sample(samples, num_samples, j * length + k);
+            put_nibble(codes[j], k - 1, ima_encode_sample(sample, &predictor[j], &index[j]));
+        }
+        step_index_[j] = index[j];
+    }
+
+    return layout.encoded_size();
+}
+
+bool ImaAdpcmCodec::decode(const uint8_t* data, size_t size,
+                           void* output, size_t num_samples) {
+    int16_t* samples = static_cast<int16_t*>(output);
+    AdpcmLayout layout(num_samples);
+    if (num_samples == 0 || size != layout.encoded_size()) {
+        return false;
+    }
+
+    const uint8_t* codes[SUB_BLOCKS];
+    alignas(16) int32_t predictor[SUB_BLOCKS];
+    alignas(16) int32_t index[SUB_BLOCKS];
+    for (size_t j = 0; j < SUB_BLOCKS; j++) {
+        const uint8_t* header = data + j * IMA_HEADER_SIZE;
+        int16_t first;
+        memcpy(&first, header, sizeof(first));
+        if (header[2] > IMA_MAX_INDEX) {
+            return false;
+        }
+        predictor[j] = first;
+        index[j] = header[2];
+        codes[j] = data + SUB_BLOCKS * IMA_HEADER_SIZE + j * layout.code_bytes;
+
+        if (j * layout.length < num_samples) {
+            samples[j * layout.length] = first;
+        }
+    }
+
+    const size_t length = layout.length;
+    size_t i = 1;
+
+#if defined(__SSE2__)
+    if (num_samples >= SUB_BLOCKS * length) {
+        __m128i pred = _mm_load_si128(reinterpret_cast<const __m128i*>(predictor));
+        __m128i idx = _mm_load_si128(reinterpret_cast<const __m128i*>(index));
+        alignas(16) int32_t decoded[SUB_BLOCKS];
+
+        for (; i < length; i++) {
+            __m128i code = _mm_set_epi32(get_nibble(codes[3], i - 1), get_nibble(codes[2], i - 1),
+                                         get_nibble(codes[1], i - 1), get_nibble(codes[0], i - 1));
+            __m128i step = gather_steps(index);
+            __m128i zero = _mm_setzero_si128();
+
+            __m128i vpdiff = _mm_srai_epi32(step, 3);
+            __m128i bit = _mm_cmpeq_epi32(_mm_and_si128(code, _mm_set1_epi32(4)), zero);
+            vpdiff = _mm_add_epi32(vpdiff, _mm_andnot_si128(bit, step));
+            bit = _mm_cmpeq_epi32(_mm_and_si128(code, _mm_set1_epi32(2)), zero);
+            vpdiff = _mm_add_epi32(vpdiff, _mm_andnot_si128(bit, _mm_srai_epi32(step, 1)));
+            bit = _mm_cmpeq_epi32(_mm_and_si128(code, _mm_set1_epi32(1)), zero);
+            vpdiff = _mm_add_epi32(vpdiff, _mm_andnot_si128(bit, _mm_srai_epi32(step, 2)));
+
+            __m128i negative = _mm_cmpeq_epi32(_mm_and_si128(code, _mm_set1_epi32(8)),
+                                               _mm_set1_epi32(8));
+            vpdiff = _mm_sub_epi32(_mm_xor_si128(vpdiff, negative), negative);
+            pred = clamp_epi32_to_int16(_mm_add_epi32(pred, vpdiff));
+            idx = clamp_index_epi32(_mm_add_epi32(idx, index_adjust_epi32(code)));
+
+            _mm_store_si128(reinterpret_cast<__m128i*>(index), idx);
+            _mm_store_si128(reinterpret_cast<__m128i*>(decoded), pred);
+            for (size_t j = 0; j < SUB_BLOCKS; j++) {
+                samples[j * length + i] = static_cast<int16_t>(decoded[j]);
+            }
+        }
+    }
+#endif
+
+    for (size_t j = 0; j < SUB_BLOCKS; j++) {
+        for (size_t k = i; k < length; k++) {
+            int32_t value = ima_decode_sample(get_nibble(codes[j], k - 1), &predictor[j], &index[j]);
+            if (j * length + k < num_samples) {
+                samples[j * length + k] = static_cast<int16_t>(value);
+            }
+        }
+    }
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Lossless
+
+namespace {
+
+constexpr uint8_t LOSSLESS_VERBATIM = 0xFF;
+constexpr size_t LOSSLESS_MAX_ORDER = 3;
+constexpr uint32_t RICE_ESCAPE = 20;        // Unary prefix that flags a raw value
+constexpr uint32_t RICE_RAW_BITS = 20;      // Zigzagged order-3 residuals fit in 20 bits
+constexpr uint32_t RICE_MAX_PARAMETER = 18;
+
+inline uint32_t zigzag(int32_t value) {
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+inline int32_t unzigzag(uint32_t value) {
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+// Fixed polynomial prediction P_order(x[i-1..i-order])
+inline int32_t predict(const int16_t* x, size_t i, size_t order) {
+    switch (order) {
+        case 0: return 0;
+        case 1: return x[i - 1];
+        case 2: return 2 * x[i - 1] - x[i - 2];
+        default: return 3 * x[i - 1] - 3 * x[i - 2] + x[i - 3];
+    }
+}
+
+inline uint32_t zigzag_residual(const int16_t* x, size_t i, size_t order) {
+    return zigzag(x[i] - predict(x, i, order));
+}
+
+// Sum of |residual| for orders 0-3 over samples [3, n)
+void residual_magnitudes(const int16_t* samples, size_t num_samples, uint64_t* sums) {
+    for (size_t order = 0; order <= LOSSLESS_MAX_ORDER; order++) {
+        sums[order] = 0;
+    }
+    size_t i = LOSSLESS_MAX_ORDER;
+
+#if defined(__SSE2__)
+    // Four samples per iteration; int32 lane sums are flushed before they
+    // can overflow (|order-3 residual| < 2^18, 2^11 iterations per flush)
+    constexpr size_t FLUSH_ITERATIONS = 2048;
+    while (i + 4 <= num_samples) {
+        __m128i acc[4] = {
+            _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()
+        };
+        for (size_t n = 0; n < FLUSH_ITERATIONS && i + 4 <= num_samples; n++, i += 4) {
+            // Sign-extend x[i..i+3], x[i-1..], x[i-2..], x[i-3..] to int32
+            __m128i x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(samples + i));
+            __m128i x1 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(samples + i - 1));
+            __m128i x2 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(samples + i - 2));
+            __m128i x3 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(samples + i - 3));
+            x0 = _mm_srai_epi32(_mm_unpacklo_epi16(x0, x0), 16);
+            x1 = _mm_srai_epi32(_mm_unpacklo_epi16(x1, x1), 16);
+            x2 = _mm_srai_epi32(_mm_unpacklo_epi16(x2, x2), 16);
+            x3 = _mm_srai_epi32(_mm_unpacklo_epi16(x3, x3), 16);
+
+            __m128i d1 = _mm_sub_epi32(x0, x1);
+            __m128i d1_prev = _mm_sub_epi32(x1, x2);
+            __m128i d2 = _mm_sub_epi32(d1, d1_prev);
+            __m128i d2_prev = _mm_sub_epi32(d1_prev, _mm_sub_epi32(x2, x3));
+            __m128i d3 = _mm_sub_epi32(d2, d2_prev);
+
+            const __m128i residuals[4] = { x0, d1, d2, d3 };
+            for (size_t order = 0; order <= LOSSLESS_MAX_ORDER; order++) {
+                __m128i sign = _mm_srai_epi32(residuals[order], 31);
+                __m128i magnitude = _mm_sub_epi32(_mm_xor_si128(residuals[order], sign), sign);
+                acc[order] = _mm_add_epi32(acc[order], magnitude);
+            }
+        }
+        for (size_t order = 0; order <= LOSSLESS_MAX_ORDER; order++) {
+            alignas(16) uint32_t lanes[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc[order]);
+            sums[order] += static_cast<uint64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+        }
+    }
+#endif
+
+    for (; i < num_samples; i++) {
+        int32_t x0 = samples[i], x1 = samples[i - 1], x2 = samples[i - 2], x3 = samples[i - 3];
+        int32_t d[4] = { x0, x0 - x1, x0 - 2 * x1 + x2, x0 - 3 * x1 + 3 * x2 - x3 };
+        for (size_t order = 0; order <= LOSSLESS_MAX_ORDER; order++) {
+            sums[order] += static_cast<uint64_t>(d[order] < 0 ? -d[order] : d[order]);
+        }
+    }
+}
+
+// Rice parameter ~ log2 of the mean zigzagged residual
+uint8_t rice_parameter(uint64_t sum, size_t count) {
+    uint32_t k = 0;
+    while (k < RICE_MAX_PARAMETER && (static_cast<uint64_t>(count) << (k + 1)) < sum) {
+        k++;
+    }
+    return static_cast<uint8_t>(k);
+}
+
+// MSB-first bit writer bounded by a byte budget
+class BitWriter {
+public:
+    BitWriter(uint8_t* out, size_t capacity)
+        : out_(out), capacity_(capacity), position_(0), bits_(0), count_(0), overflow_(false) {}
+
+    void write(uint32_t value, uint32_t num_bits) {
+        bits_ = (bits_ << num_bits) | (value & ((1ull << num_bits) - 1));
+        count_ += num_bits;
+        while (count_ >= 8) {
+            count_ -= 8;
+            put(static_cast<uint8_t>(bits_ >> count_));
+        }
+    }
+
+    void write_ones(uint32_t count) {
+        while (count > 16) {
+            write(0xFFFF, 16);
+            count -= 16;
+        }
+        write((1u << count) - 1, count);
+    }
+
+    // Returns total bytes, or 0 if the budget was exceeded
+    size_t finish() {
+        if (count_ > 0) {
+            put(static_cast<uint8_t>(bits_ << (8 - count_)));
+            count_ = 0;
+        }
+        return overflow_ ? 0 : position_;
+    }
+
+    bool overflowed() const { return overflow_; }
+
+private:
+    void put(uint8_t byte) {
+        if (position_ < capacity_) {
+            out_[position_++] = byte;
+        } else {
+            overflow_ = true;
+        }
+    }
+
+    uint8_t* out_;
+    size_t capacity_;
+    size_t position_;
+    uint64_t bits_;
+    uint32_t count_;
+    bool overflow_;
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size)
+        : data_(data), size_(size), position_(0), bits_(0), count_(0) {}
+
+    // Leading one bits, at most `limit`; consumes them. False if truncated.
+    bool read_ones(uint32_t limit, uint32_t* ones) {
+        uint32_t n = 0;
+        while (n < limit) {
+            refill();
+            if (count_ == 0) {
+                return false;
+            }
+            if (!(bits_ >> 63)) {
+                break;
+            }
+            bits_ <<= 1;
+            count_--;
+            n++;
+        }
+        *ones = n;
+        return true;
+    }
+
+    bool read(uint32_t num_bits, uint32_t* value) {
+        refill();
+        if (count_ < num_bits) {
+            return false;
+        }
+        *value = num_bits == 0 ? 0 : static_cast<uint32_t>(bits_ >> (64 - num_bits));
+        bits_ <<= num_bits;
+        count_ -= num_bits;
+        return true;
+    }
+
+private:
+    void refill() {
+        while (count_ <= 56 && position_ < size_) {
+            bits_ |= static_cast<uint64_t>(data_[position_++]) << (56 - count_);
+            count_ += 8;
+        }
+    }
+
+    const uint8_t* data_;
+    size_t size_;
+    size_t position_;
+    uint64_t bits_;     // Left-aligned
+    uint32_t count_;
+};
+
+} // namespace
+
+size_t LosslessCodec::max_encoded_size(size_t num_samples) const {
+    return 1 + num_samples * sizeof(int16_t);  // Verbatim bound
+}
+
+size_t LosslessCodec::encode(const void* input, size_t num_samples,
+                             uint8_t* out, size_t capacity) {
+    const int16_t* samples = static_cast<const int16_t*>(input);
+    size_t verbatim_size = max_encoded_size(num_samples);
+    if (num_samples == 0 || capacity < verbatim_size) {
+        return 0;
+    }
+
+    // Pick the predictor order with the smallest residual energy
+    size_t order = 0;
+    if (num_samples > LOSSLESS_MAX_ORDER) {
+        uint64_t sums[LOSSLESS_MAX_ORDER + 1];
+        residual_magnitudes(samples, num_samples, sums);
+        for (size_t o = 1; o <= LOSSLESS_MAX_ORDER; o++) {
+            if (sums[o] < sums[order]) {
+                order = o;
+            }
+        }
+    }
+
+    // Header: order, warm-up samples, one Rice parameter per partition
+    size_t partition = (num_samples + PARTITIONS - 1) / PARTITIONS;
+    uint8_t parameters[PARTITIONS];
+    for (size_t p = 0; p < PARTITIONS; p++) {
+        size_t begin = std::max(order, p * partition);
+        size_t end = std::min(num_samples, (p + 1) * partition);
+        uint64_t sum = 0;
+        for (size_t i = begin; i < end; i++) {
+            sum += zigzag_residual(samples, i, order);
+        }
+        parameters[p] = end > begin ? rice_parameter(sum, end - begin) : 0;
+    }
+
+    size_t header_size = 1 + order * sizeof(int16_t) + PARTITIONS;
+    if (header_size + 1 >= verbatim_size) {
+        out[0] = LOSSLESS_VERBATIM;
+        memcpy(out + 1, samples, num_samples * sizeof(int16_t));
+        return verbatim_size;
+    }
+    out[0] = static_cast<uint8_t>(order);
+    memcpy(out + 1, samples, order * sizeof(int16_t));
+    memcpy(out + 1 + order * sizeof(int16_t), parameters, PARTITIONS);
+
+    // Anything not smaller than verbatim is sent verbatim
+    BitWriter writer(out + header_size, verbatim_size - 1 - header_size);
+    for (size_t i = order; i < num_samples && !writer.overflowed(); i++) {
+        uint32_t k = parameters[i / partition];
+        uint32_t value = zigzag_residual(samples, i, order);
+        uint32_t quotient = value >> k;
+        if (quotient >= RICE_ESCAPE) {
+            writer.write_ones(RICE_ESCAPE);
+            writer.write(value, RICE_RAW_BITS);
+        } else {
+            writer.write_ones(quotient);
+            writer.write(0, 1);
+            if (k > 0) {
+                writer.write(value, k);
+            }
+        }
+    }
+
+    size_t body_size = writer.finish();
+    if (body_size == 0) {
+        out[0] = LOSSLESS_VERBATIM;
+        memcpy(out + 1, samples, num_samples * sizeof(int16_t));
+        return verbatim_size;
+    }
+    return header_size + body_size;
+}
+
+bool LosslessCodec::decode(const uint8_t* data, size_t size,
+                           void* output, size_t num_samples) {
+    int16_t* samples = static_cast<int16_t*>(output);
+    if (num_samples == 0 || size < 1) {
+        return false;
+    }
+
+    if (data[0] == LOSSLESS_VERBATIM) {
+        if (size != 1 + num_samples * sizeof(int16_t)) {
+            return false;
+        }
+        memcpy(samples, data + 1, num_samples * sizeof(int16_t));
+        return true;
+    }
+
+    size_t order = data[0];
+    size_t header_size = 1 + order * sizeof(int16_t) + PARTITIONS;
+    if (order > LOSSLESS_MAX_ORDER || order > num_samples || size < header_size) {
+        return false;
+    }
+
+    memcpy(samples, data + 1, order * sizeof(int16_t));
+    const uint8_t* parameters = data + 1 + order * sizeof(int16_t);
+    size_t partition = (num_samples + PARTITIONS - 1) / PARTITIONS;
+
+    BitReader reader(data + header_size, size - header_size);
+    for (size_t i = order; i < num_samples; i++) {
+        uint32_t k = parameters[i / partition];
+        if (k > RICE_MAX_PARAMETER) {
+            return false;
+        }
+
+        uint32_t quotient;
+        uint32_t value;
+        if (!reader.read_ones(RICE_ESCAPE, &quotient)) {
+            return false;
+        }
+        if (quotient == RICE_ESCAPE) {
+            if (!reader.read(RICE_RAW_BITS, &value)) {
+                return false;
+            }
+        } else {
+            uint32_t stop;
+            uint32_t remainder;
+            if (!reader.read(1, &stop) || !reader.read(k, &remainder)) {
+                return false;
+            }
+            value = (quotient << k) | remainder;
+        }
+
+        int32_t sample = predict(samples, i, order) + unzigzag(value);
+        if (sample < -32768 || sample > 32767) {
+            return false;
+        }
+        samples[i] = static_cast<int16_t>(sample);
+    }
+    return true;
+}
+
+} // namespace common
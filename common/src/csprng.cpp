@@ -0,0 +1,266 @@
+#include "csprng.h"
+#include "secure_zero.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <pthread.h>
+#include <sys/random.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace common {
+
+namespace {
+
+constexpr uint32_t SIGMA[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};  // "expand 32-byte k"
+
+inline uint32_t rotl(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+inline void quarter_round(uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d) {
+    a += b; d ^= a; d = rotl(d, 16);
+    c += d; b ^= c; b = rotl(b, 12);
+    a += b; d ^= a; d = rotl(d, 8);
+    c += d; b ^= c; b = rotl(b, 7);
+}
+
+inline void store_le32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p[2] = static_cast<uint8_t>(v >> 16);
+    p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+inline uint32_t load_le32(const uint8_t* p) {
+    return p[0] | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) |
+           (static_cast<uint32_t>(p[3]) << 24);
+}
+
+#if defined(__SSE2__)
+template <int N>
+inline __m128i rotl_epi32(__m128i x) {
+    return _mm_or_si128(_mm_slli_epi32(x, N), _mm_srli_epi32(x, 32 - N));
+}
+
+inline void quarter_round(__m128i& a, __m128i& b, __m128i& c, __m128i& d) {
+    a = _mm_add_epi32(a, b); d = rotl_epi32<16>(_mm_xor_si128(d, a));
+    c = _mm_add_epi32(c, d); b = rotl_epi32<12>(_mm_xor_si128(b, c));
+    a = _mm_add_epi32(a, b); d = rotl_epi32<8>(_mm_xor_si128(d, a));
+    c = _mm_add_epi32(c, d); b = rotl_epi32<7>(_mm_xor_si128(b, c));
+}
+
+// Four blocks at once, one per 32-bit lane, transposed back on the way
+// out. The caller's 32-vector scratch holds the state, so it is wiped once
+// per call of chacha20_blocks rather than per four blocks.
+void chacha20_blocks4(const uint32_t* input, uint64_t counter, uint8_t* out, __m128i* scratch) {
+    __m128i* start = scratch;
+    __m128i* x = scratch + 16;
+    for (size_t i = 0; i < 16; i++) {
+        start[i] = _mm_set1_epi32(static_cast<int>(input[i]));
+    }
+    uint32_t low[4], high[4];
+    for (size_t lane = 0; lane < 4; lane++) {
+        low[lane] = static_cast<uint32_t>(counter + lane);
+        high[lane] = static_cast<uint32_t>((counter + lane) >> 32);
+    }
+    start[12] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(low));
+    start[13] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(high));
+    memcpy(x, start, 16 * sizeof(__m128i));
+
+    for (int round = 0; round < 10; round++) {
+        quarter_round(x[0], x[4], x[8], x[12]);
+        quarter_round(x[1], x[5], x[9], x[13]);
+        quarter_round(x[2], x[6], x[10], x[14]);
+        quarter_round(x[3], x[7], x[11], x[15]);
+        quarter_round(x[0], x[5], x[10], x[15]);
+        quarter_round(x[1], x[6], x[11], x[12]);
+        quarter_round(x[2], x[7], x[8], x[13]);
+        quarter_round(x[3], x[4], x[9], x[14]);
+    }
+
+    for (size_t w = 0; w < 16; w += 4) {
+        __m128i a = _mm_add_epi32(x[w], start[w]);
+        __m128i b = _mm_add_epi32(x[w + 1], start[w + 1]);
+        __m128i c = _mm_add_epi32(x[w + 2], start[w + 2]);
+        __m128i d = _mm_add_epi32(x[w + 3], start[w + 3]);
+        __m128i ab_low = _mm_unpacklo_epi32(a, b);
+        __m128i cd_low = _mm_unpacklo_epi32(c, d);
+        __m128i ab_high = _mm_unpackhi_epi32(a, b);
+        __m128i cd_high = _mm_unpackhi_epi32(c, d);
+        uint8_t* p = out + 4 * w;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_unpacklo_epi64(ab_low, cd_low));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 64), _mm_unpackhi_epi64(ab_low, cd_low));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 128), _mm_unpacklo_epi64(ab_high, cd_high));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 192), _mm_unpackhi_epi64(ab_high, cd_high));
+    }
+}
+#endif
+
+// `count` consecutive ChaCha20 blocks (RFC 8439 rounds, 64-bit counter,
+// zero nonce: every key is used for one refill only)
+void chacha20_blocks(const uint32_t* key, uint64_t counter, uint8_t* out, size_t count) {
+    uint32_t input[16] = {
+        SIGMA[0], SIGMA[1], SIGMA[2], SIGMA[3],
+        key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+        0, 0, 0, 0
+    };
+#if defined(__SSE2__)
+    if (count >= 4) {
+        __m128i scratch[32];
+        for (; count >= 4; count -= 4, counter += 4, out += 4 * ChaCha20Rng::BLOCK_SIZE) {
+            chacha20_blocks4(input, counter, out, scratch);
+        }
+        secure_zero(scratch, sizeof(scratch));
+    }
+#endif
+    uint32_t x[16];
+    for (size_t block = 0; block < count; block++, counter++, out += ChaCha20Rng::BLOCK_SIZE) {
+        input[12] = static_cast<uint32_t>(counter);
+        input[13] = static_cast<uint32_t>(counter >> 32);
+        memcpy(x, input, sizeof(x));
+        for (int round = 0; round < 10; round++) {
+            quarter_round(x[0], x[4], x[8], x[12]);
+            quarter_round(x[1], x[5], x[9], x[13]);
+            quarter_round(x[2], x[6], x[10], x[14]);
+            quarter_round(x[3], x[7], x[11], x[15]);
+            quarter_round(x[0], x[5], x[10], x[15]);
+            quarter_round(x[1], x[6], x[11], x[12]);
+            quarter_round(x[2], x[7], x[8], x[13]);
+            quarter_round(x[3], x[4], x[9], x[14]);
+        }
+        for (size_t i = 0; i < 16; i++) {
+            store_le32(out + 4 * i, x[i] + input[i]);
+        }
+    }
+    secure_zero(x, sizeof(x));
+    secure_zero(input, sizeof(input));
+}
+
+// Bumped in every child after fork(), so thread generators copied into the
+// child reseed instead of repeating the parent's output
+std::atomic<uint32_t> g_fork_generation{0};
+
+void on_fork_child() {
+    g_fork_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+struct ThreadGenerator {
+    ThreadGenerator()
+        : generation(g_fork_generation.load(std::memory_order_relaxed)) {
+    }
+
+    ChaCha20Rng rng;
+    uint32_t generation;
+};
+
+} // namespace
+
+ChaCha20Rng::ChaCha20Rng()
+    : counter_(0)
+    , available_(0) {
+    uint8_t seed[SEED_SIZE];
+    os_random_bytes(seed, sizeof(seed));
+    reseed(seed);
+    secure_zero(seed, sizeof(seed));
+}
+
+ChaCha20Rng::ChaCha20Rng(const uint8_t* seed)
+    : counter_(0)
+    , available_(0) {
+    reseed(seed);
+}
+
+ChaCha20Rng::~ChaCha20Rng() {
+    secure_zero(key_, sizeof(key_));
+    secure_zero(buffer_, sizeof(buffer_));
+}
+
+void ChaCha20Rng::reseed(const uint8_t* seed) {
+    for (size_t i = 0; i < 8; i++) {
+        key_[i] = load_le32(seed + 4 * i);
+    }
+    counter_ = 0;
+    secure_zero(buffer_, sizeof(buffer_));
+    available_ = 0;
+}
+
+void ChaCha20Rng::refill() {
+    chacha20_blocks(key_, counter_, buffer_, BUFFER_BLOCKS);
+    for (size_t i = 0; i < 8; i++) {
+        key_[i] = load_le32(buffer_ + 4 * i);
+    }
+    counter_ = 0;
+    secure_zero(buffer_, SEED_SIZE);
+    available_ = BUFFER_SIZE - SEED_SIZE;
+}
+
+void ChaCha20Rng::fill(uint8_t* buffer, size_t length) {
+    while (length > 0) {
+        if (available_ == 0) {
+            if (length >= BUFFER_SIZE) {
+                // Bulk: blocks go straight to the caller under the current
+                // key, then the refill below replaces that key
+                size_t blocks = length / BLOCK_SIZE;
+                chacha20_blocks(key_, counter_, buffer, blocks);
+                counter_ += blocks;
+                buffer += blocks * BLOCK_SIZE;
+                length -= blocks * BLOCK_SIZE;
+            }
+            refill();
+            continue;
+        }
+        size_t n = std::min(length, available_);
+        uint8_t* source = buffer_ + BUFFER_SIZE - available_;
+        memcpy(buffer, source, n);
+        secure_zero(source, n);
+        buffer += n;
+        length -= n;
+        available_ -= n;
+    }
+}
+
+void random_bytes(uint8_t* buffer, size_t length) {
+    static const int registered = pthread_atfork(nullptr, nullptr, on_fork_child);
+    (void)registered;
+
+    thread_local ThreadGenerator generator;
+    uint32_t generation = g_fork_generation.load(std::memory_order_relaxed);
+    if (generator.generation != generation) {
+        uint8_t seed[ChaCha20Rng::SEED_SIZE];
+        os_random_bytes(seed, sizeof(seed));
+        generator.rng.reseed(seed);
+        secure_zero(seed, sizeof(seed));
+        generator.generation = generation;
+    }
+    generator.rng.fill(buffer, length);
+}
+
+void os_random_bytes(uint8_t* buffer, size_t length) {
+    while (length > 0) {
+        ssize_t n = getrandom(buffer, length, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // No getrandom (old kernel or sandbox): the library's device
+            std::random_device device;
+            while (length > 0) {
+                uint32_t word = device();
+                size_t take = std::min(length, sizeof(word));
+                memcpy(buffer, &word, take);
+                buffer += take;
+                length -= take;
+            }
+            return;
+        }
+        buffer += n;
+        length -= static_cast<size_t>(n);
+    }
+}
+
+} // namespace common
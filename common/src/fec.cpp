@@ -0,0 +1,365 @@
+#include "fec.h"
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FEC_X86_DISPATCH 1
+#endif
+
+namespace common {
+
+using protocol::FecScheme;
+
+namespace {
+
+constexpr unsigned GF_POLYNOMIAL = 0x11D;
+
+struct GfTables {
+    uint8_t exp[512];       // Doubled so exp[log a + log b] needs no modulo
+    uint8_t log[256];
+    // Products of each coefficient with every low and every high nibble;
+    // a byte b multiplies as lo[c][b & 15] ^ hi[c][b >> 4]
+    alignas(16) uint8_t lo[256][16];
+    alignas(16) uint8_t hi[256][16];
+
+    GfTables() {
+        unsigned value = 1;
+        for (unsigned i = 0; i < 255; i++) {
+            exp[i] = static_cast<uint8_t>(value);
+            log[value] = static_cast<uint8_t>(i);
+            value <<= 1;
+            if (value & 0x100) {
+                value ^= GF_POLYNOMIAL;
+            }
+        }
+        for (unsigned i = 255; i < 512; i++) {
+            exp[i] = exp[i - 255];
+        }
+        log[0] = 0;     // Undefined; callers test for zero
+        
+        for (unsigned c = 0; c < 256; c++) {
+            for (unsigned n = 0; n < 16; n++) {
+                lo[c][n] = multiply(c, n);
+                hi[c][n] = multiply(c, n << 4);
+            }
+        }
+    }
+
+    uint8_t multiply(unsigned a, unsigned b) const {
+        return (a == 0 || b == 0) ? 0 : exp[log[a] + log[b]];
+    }
+};
+
+const GfTables& gf_tables() {
+    static const GfTables tables;
+    return tables;
+}
+
+void mul_add_scalar(uint8_t* dst, const uint8_t* src, const uint8_t* lo, const uint8_t* hi,
+                    size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        dst[i] ^= lo[src[i] & 0x0F] ^ hi[src[i] >> 4];
+    }
+}
+
+#if defined(FEC_X86_DISPATCH)
+__attribute__((target("ssse3")))
+void mul_add_ssse3(uint8_t* dst, const uint8_t* src, const uint8_t* lo, const uint8_t* hi,
+                   size_t length) {
+    const __m128i lo_table = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lo));
+    const __m128i hi_table = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hi));
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i l = _mm_shuffle_epi8(lo_table, _mm_and_si128(s, mask));
+        __m128i h = _mm_shuffle_epi8(hi_table, _mm_and_si128(_mm_srli_epi64(s, 4), mask));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(d, _mm_xor_si128(l, h)));
+    }
+    mul_add_scalar(dst + i, src + i, lo, hi, length - i);
+}
+
+__attribute__((target("avx2")))
+void mul_add_avx2(uint8_t* dst, const uint8_t* src, const uint8_t* lo, const uint8_t* hi,
+                  size_t length) {
+    const __m256i lo_table = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(lo)));
+    const __m256i hi_table = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(hi)));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i l = _mm256_shuffle_epi8(lo_table, _mm256_and_si256(s, mask));
+        __m256i h = _mm256_shuffle_epi8(hi_table, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                            _mm256_xor_si256(d, _mm256_xor_si256(l, h)));
+    }
+    // One 16-byte step inline (VEX-encoded here; calling the SSSE3 version
+    // would pay an AVX/SSE transition)
+    if (i + 16 <= length) {
+        const __m128i mask128 = _mm_set1_epi8(0x0F);
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i l = _mm_shuffle_epi8(_mm256_castsi256_si128(lo_table), _mm_and_si128(s, mask128));
+        __m128i h = _mm_shuffle_epi8(_mm256_castsi256_si128(hi_table),
+                                     _mm_and_si128(_mm_srli_epi64(s, 4), mask128));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(d, _mm_xor_si128(l, h)));
+        i += 16;
+    }
+    mul_add_scalar(dst + i, src + i, lo, hi, length - i);
+}
+#endif
+
+using MulAddFunction = void (*)(uint8_t*, const uint8_t*, const uint8_t*, const uint8_t*, size_t);
+
+struct MulAddImplementation {
+    MulAddFunction function;
+    const char* name;
+};
+
+MulAddImplementation detect_simd() {
+#if defined(FEC_X86_DISPATCH)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {mul_add_avx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return {mul_add_ssse3, "ssse3"};
+    }
+#endif
+    return {mul_add_scalar, "scalar"};
+}
+
+const MulAddImplementation& simd_implementation() {
+    static const MulAddImplementation implementation = detect_simd();
+    return implementation;
+}
+
+std::atomic<bool> g_simd_enabled(true);
+
+MulAddImplementation active_implementation() {
+    if (!g_simd_enabled.load(std::memory_order_relaxed)) {
+        return {mul_add_scalar, "scalar"};
+    }
+    return simd_implementation();
+}
+
+// Gauss-Jordan inversion of an n x n matrix (row-major) in place; false if
+// singular
+bool invert_matrix(uint8_t* matrix, size_t n) {
+    uint8_t inverse[protocol::FEC_MAX_PARITY_PACKETS * protocol::FEC_MAX_PARITY_PACKETS] = {};
+    for (size_t i = 0; i < n; i++) {
+        inverse[i * n + i] = 1;
+    }
+
+    for (size_t col = 0; col < n; col++) {
+        size_t pivot = col;
+        while (pivot < n && matrix[pivot * n + col] == 0) {
+            pivot++;
+        }
+        if (pivot == n) {
+            return false;
+        }
+        if (pivot != col) {
+            for (size_t k = 0; k < n; k++) {
+                std::swap(matrix[pivot * n + k], matrix[col * n + k]);
+                std::swap(inverse[pivot * n + k], inverse[col * n + k]);
+            }
+        }
+
+        uint8_t scale = gf256_inv(matrix[col * n + col]);
+        for (size_t k = 0; k < n; k++) {
+            matrix[col * n + k] = gf256_mul(matrix[col * n + k], scale);
+            inverse[col * n + k] = gf256_mul(inverse[col * n + k], scale);
+        }
+
+        for (size_t row = 0; row < n; row++) {
+            uint8_t factor = matrix[row * n + col];
+            if (row == col || factor == 0) {
+                continue;
+            }
+            for (size_t k = 0; k < n; k++) {
+                matrix[row * n + k] ^= gf256_mul(factor, matrix[col * n + k]);
+                inverse[row * n + k] ^= gf256_mul(factor, inverse[col * n + k]);
+            }
+        }
+    }
+
+    memcpy(matrix, inverse, n * n);
+    return true;
+}
+
+bool valid_geometry(FecScheme scheme, size_t data_count, size_t parity_count) {
+    if (data_count == 0 || data_count > protocol::FEC_MAX_DATA_PACKETS || parity_count == 0) {
+        return false;
+    }
+    switch (scheme) {
+        case FecScheme::XOR: return parity_count == 1;
+        case FecScheme::REED_SOLOMON: return parity_count <= protocol::FEC_MAX_PARITY_PACKETS;
+        default: return false;
+    }
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// GF(256)
+
+uint8_t gf256_mul(uint8_t a, uint8_t b) {
+    return gf_tables().multiply(a, b);
+}
+
+uint8_t gf256_inv(uint8_t a) {
+    const GfTables& tables = gf_tables();
+    return tables.exp[255 - tables.log[a]];
+}
+
+void gf256_mul_add(uint8_t* dst, const uint8_t* src, uint8_t coefficient, size_t length) {
+    if (coefficient == 0) {
+        return;
+    }
+    if (coefficient == 1) {
+        xor_region(dst, src, length);
+        return;
+    }
+    const GfTables& tables = gf_tables();
+    active_implementation().function(dst, src, tables.lo[coefficient], tables.hi[coefficient], length);
+}
+
+void xor_region(uint8_t* dst, const uint8_t* src, size_t length) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= length; i += 16) {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(d, s));
+    }
+#endif
+    for (; i < length; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+const char* gf256_implementation() {
+    return active_implementation().name;
+}
+
+void gf256_set_simd(bool enabled) {
+    g_simd_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// Erasure coding
+
+uint8_t fec_coefficient(FecScheme scheme, size_t parity_index, size_t data_index) {
+    if (scheme != FecScheme::REED_SOLOMON) {
+        return 1;
+    }
+    // x_j = FEC_MAX_DATA_PACKETS + j and y_i = i never coincide, so the
+    // sum (XOR) is never zero and every square submatrix is invertible
+    return gf256_inv(static_cast<uint8_t>((protocol::FEC_MAX_DATA_PACKETS + parity_index) ^ data_index));
+}
+
+bool fec_encode(FecScheme scheme, const uint8_t* const* data, size_t data_count,
+                uint8_t* const* parity, size_t parity_count, size_t length) {
+    if (!valid_geometry(scheme, data_count, parity_count)) {
+        return false;
+    }
+    for (size_t j = 0; j < parity_count; j++) {
+        memset(parity[j], 0, length);
+        for (size_t i = 0; i < data_count; i++) {
+            gf256_mul_add(parity[j], data[i], fec_coefficient(scheme, j, i), length);
+        }
+    }
+    return true;
+}
+
+bool fec_decode(FecScheme scheme, uint8_t* const* data, const bool* data_present,
+                size_t data_count, const uint8_t* const* parity, const bool* parity_present,
+                size_t parity_count, size_t length) {
+    if (!valid_geometry(scheme, data_count, parity_count)) {
+        return false;
+    }
+
+    size_t missing[protocol::FEC_MAX_PARITY_PACKETS];
+    size_t missing_count = 0;
+    for (size_t i = 0; i < data_count; i++) {
+        if (!data_present[i]) {
+            if (missing_count == parity_count) {
+                return false;
+            }
+            missing[missing_count++] = i;
+        }
+    }
+    if (missing_count == 0) {
+        return true;
+    }
+
+    size_t rows[protocol::FEC_MAX_PARITY_PACKETS];
+    size_t row_count = 0;
+    for (size_t j = 0; j < parity_count && row_count < missing_count; j++) {
+        if (parity_present[j]) {
+            rows[row_count++] = j;
+        }
+    }
+    if (row_count < missing_count) {
+        return false;
+    }
+
+    // Syndromes: each used parity block minus the present data's share,
+    // leaving only the missing blocks' contribution
+    std::vector<uint8_t> syndromes(missing_count * length);
+    for (size_t r = 0; r < missing_count; r++) {
+        uint8_t* syndrome = &syndromes[r * length];
+        memcpy(syndrome, parity[rows[r]], length);
+        for (size_t i = 0; i < data_count; i++) {
+            if (data_present[i]) {
+                gf256_mul_add(syndrome, data[i], fec_coefficient(scheme, rows[r], i), length);
+            }
+        }
+    }
+
+    uint8_t matrix[protocol::FEC_MAX_PARITY_PACKETS * protocol::FEC_MAX_PARITY_PACKETS];
+    for (size_t r = 0; r < missing_count; r++) {
+        for (size_t c = 0; c < missing_count; c++) {
+            matrix[r * missing_count + c] = fec_coefficient(scheme, rows[r], missing[c]);
+        }
+    }
+    if (!invert_matrix(matrix, missing_count)) {
+        return false;
+    }
+
+    for (size_t c = 0; c < missing_count; c++) {
+        uint8_t* block = data[missing[c]];
+        memset(block, 0, length);
+        for (size_t r = 0; r < missing_count; r++) {
+            gf256_mul_add(block, &syndromes[r * length], matrix[c * missing_count + r], length);
+        }
+    }
+    return true;
+}
+
+bool fec_scheme_from_string(const char* name, FecScheme* scheme) {
+    if (strcmp(name, "off") == 0) {
+        *scheme = FecScheme::NONE;
+    } else if (strcmp(name, "xor") == 0) {
+        *scheme = FecScheme::XOR;
+    } else if (strcmp(name, "rs") == 0) {
+        *scheme = FecScheme::REED_SOLOMON;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+} // namespace common
@@ -0,0 +1,237 @@
+#include "fragment.h"
+#include <algorithm>
+#include <cstring>
+
+namespace common {
+
+namespace {
+
+constexpr size_t NO_SLOT = SIZE_MAX;
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// Fragmenter
+
+Fragmenter::Fragmenter(size_t datagram_size)
+    : datagram_size_(protocol::DEFAULT_DATAGRAM_SIZE)
+    , next_message_id_(0) {
+    set_datagram_size(datagram_size);
+}
+
+void Fragmenter::set_datagram_size(size_t bytes) {
+    datagram_size_.store(std::max(protocol::MIN_DATAGRAM_SIZE,
+                                  std::min(bytes, protocol::MAX_DATAGRAM_SIZE)));
+}
+
+bool Fragmenter::plan_split(const protocol::Packet& packet, Plan* plan) {
+    if (packet.header.payload_length > protocol::MAX_PAYLOAD_SIZE) {
+        return false;
+    }
+    const size_t total = packet.total_size();
+    const size_t datagram_size = datagram_size_.load();
+    if (total <= datagram_size) {
+        plan->chunk = total;
+        plan->count = 1;
+        plan->message_id = 0;
+        return true;
+    }
+    plan->chunk = datagram_size - protocol::PACKET_HEADER_SIZE - sizeof(protocol::FragmentHeader);
+    plan->count = (total + plan->chunk - 1) / plan->chunk;
+    plan->message_id = next_message_id_.fetch_add(1);
+    return plan->count <= protocol::MAX_FRAGMENTS;
+}
+
+void Fragmenter::write_datagram(const protocol::Packet& packet, const Plan& plan, size_t index,
+                                Datagram* out) const {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&packet);
+    const size_t total = packet.total_size();
+    out->type = packet.header.type;
+    out->sequence = packet.header.sequence;
+    out->last = index + 1 == plan.count;
+
+    if (plan.count == 1) {
+        out->length = static_cast<uint16_t>(total);
+        memcpy(out->bytes, bytes, total);
+        return;
+    }
+
+    // Fragment: own header (original flags, sequence and timestamp), then
+    // the fragment header and the slice of the serialized packet
+    size_t offset = index * plan.chunk;
+    size_t length = std::min(plan.chunk, total - offset);
+
+    protocol::FragmentHeader fragment;
+    fragment.message_id = plan.message_id;
+    fragment.total_length = static_cast<uint16_t>(total);
+    fragment.offset = static_cast<uint16_t>(offset);
+    fragment.index = static_cast<uint8_t>(index);
+    fragment.count = static_cast<uint8_t>(plan.count);
+
+    protocol::PacketHeader header = packet.header;
+    header.type = protocol::PacketType::FRAGMENT;
+    header.payload_length = static_cast<uint16_t>(sizeof(fragment) + length);
+
+    uint8_t* payload = out->bytes + protocol::PACKET_HEADER_SIZE;
+    memcpy(payload, &fragment, sizeof(fragment));
+    memcpy(payload + sizeof(fragment), bytes + offset, length);
+    header.checksum = protocol::packet_checksum(header, payload);
+    memcpy(out->bytes, &header, protocol::PACKET_HEADER_SIZE);
+    out->length = static_cast<uint16_t>(protocol::PACKET_HEADER_SIZE + header.payload_length);
+}
+
+// ---------------------------------------------------------------------------
+// Reassembler
+
+Reassembler::Reassembler(size_t slots, uint64_t timeout_us)
+    : slots_(std::max<size_t>(slots, 1))
+    , pool_(std::max<size_t>(slots, 1))
+    , timeout_us_(timeout_us)
+    , delivered_(NO_SLOT) {
+
+    memset(&stats_, 0, sizeof(stats_));
+    clear();
+}
+
+void Reassembler::clear() {
+    for (Slot& slot : slots_) {
+        slot.active = false;
+    }
+    delivered_ = NO_SLOT;
+}
+
+protocol::Packet* Reassembler::on_datagram(size_t length, uint64_t now_us) {
+    // The packet handed out last call is no longer referenced
+    if (delivered_ != NO_SLOT) {
+        slots_[delivered_].active = false;
+        delivered_ = NO_SLOT;
+    }
+
+    if (length < protocol::PACKET_HEADER_SIZE) {
+        return nullptr;
+    }
+    if (inbound_.header.type != protocol::PacketType::FRAGMENT) {
+        return protocol::validate_packet(inbound_, length) ? &inbound_ : nullptr;
+    }
+    return on_fragment(length, now_us);
+}
+
+protocol::Packet* Reassembler::on_fragment(size_t length, uint64_t now_us) {
+    protocol::FragmentHeader fragment;
+    bool valid = protocol::validate_packet(inbound_, length) &&
+                 inbound_.header.payload_length > sizeof(fragment);
+    size_t bytes = 0;
+    if (valid) {
+        memcpy(&fragment, inbound_.payload, sizeof(fragment));
+        bytes = inbound_.header.payload_length - sizeof(fragment);
+        valid = fragment.count >= 1 && fragment.count <= protocol::MAX_FRAGMENTS &&
+                fragment.index < fragment.count &&
+                fragment.total_length >= protocol::PACKET_HEADER_SIZE &&
+                fragment.total_length <= protocol::MAX_PACKET_SIZE &&
+                static_cast<size_t>(fragment.offset) + bytes <= fragment.total_length;
+    }
+    if (!valid) {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.fragments_received++;
+        stats_.fragments_invalid++;
+        return nullptr;
+    }
+
+    Stats delta;
+    memset(&delta, 0, sizeof(delta));
+    delta.fragments_received = 1;
+    protocol::Packet* complete = nullptr;
+
+    size_t index = find_slot(fragment.message_id, now_us, &delta.timeouts);
+    Slot* slot = nullptr;
+    if (index == NO_SLOT) {
+        // Start a packet, in a free slot or over the oldest one
+        size_t oldest = 0;
+        for (size_t i = 0; i < slots_.size(); i++) {
+            if (!slots_[i].active) {
+                index = i;
+                break;
+            }
+            if (slots_[i].started_us < slots_[oldest].started_us) {
+                oldest = i;
+            }
+        }
+        if (index == NO_SLOT) {
+            index = oldest;
+            delta.evictions++;
+        }
+        slot = &slots_[index];
+        slot->active = true;
+        slot->message_id = fragment.message_id;
+        slot->count = fragment.count;
+        slot->total_length = fragment.total_length;
+        slot->received_mask = 0;
+        slot->started_us = now_us;
+    } else {
+        slot = &slots_[index];
+    }
+
+    uint64_t bit = 1ull << fragment.index;
+    if (slot->count != fragment.count || slot->total_length != fragment.total_length) {
+        delta.fragments_invalid++;
+    } else if (slot->received_mask & bit) {
+        delta.fragments_duplicate++;
+    } else {
+        uint8_t* target = reinterpret_cast<uint8_t*>(&pool_[index]);
+        memcpy(target + fragment.offset, inbound_.payload + sizeof(fragment), bytes);
+        slot->received_mask |= bit;
+
+        uint64_t all = slot->count == 64 ? ~0ull : (1ull << slot->count) - 1;
+        if (slot->received_mask == all) {
+            protocol::Packet& packet = pool_[index];
+            if (protocol::validate_packet(packet, slot->total_length) &&
+                packet.total_size() == slot->total_length) {
+                complete = &packet;
+                delivered_ = index;
+                delta.packets_reassembled++;
+            } else {
+                slot->active = false;
+                delta.fragments_invalid++;
+            }
+        }
+    }
+
+    uint64_t in_flight = 0;
+    for (const Slot& s : slots_) {
+        in_flight += s.active ? 1 : 0;
+    }
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.fragments_received += delta.fragments_received;
+    stats_.packets_reassembled += delta.packets_reassembled;
+    stats_.fragments_invalid += delta.fragments_invalid;
+    stats_.fragments_duplicate += delta.fragments_duplicate;
+    stats_.timeouts += delta.timeouts;
+    stats_.evictions += delta.evictions;
+    stats_.max_in_flight = std::max(stats_.max_in_flight, in_flight);
+    return complete;
+}
+
+size_t Reassembler::find_slot(uint32_t message_id, uint64_t now_us, uint64_t* expired) {
+    size_t found = NO_SLOT;
+    for (size_t i = 0; i < slots_.size(); i++) {
+        Slot& slot = slots_[i];
+        if (!slot.active) {
+            continue;
+        }
+        if (now_us - slot.started_us > timeout_us_) {
+            slot.active = false;
+            (*expired)++;
+        } else if (slot.message_id == message_id) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+Reassembler::Stats Reassembler::get_stats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+} // namespace common
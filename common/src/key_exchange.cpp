@@ -0,0 +1,320 @@
+#include "key_exchange.h"
+#include "protocol.h"
+#include "secure_zero.h"
+#include "sha256.h"
+#include <cstring>
+#include <vector>
+
+namespace common {
+
+namespace {
+
+// Field elements mod p = 2^255 - 19: five 51-bit limbs, least significant
+// first. Limbs may run a few bits over 51 between operations; products
+// are accumulated in 128 bits (GCC and Clang on 64-bit targets).
+__extension__ typedef unsigned __int128 uint128;
+
+struct Fe {
+    uint64_t v[5];
+};
+
+constexpr uint64_t MASK51 = (1ull << 51) - 1;
+constexpr uint64_t A24 = 121665;                    // (486662 - 2) / 4
+constexpr char SESSION_KEY_INFO[] = "wireless-audio session key";
+
+inline uint64_t load_le64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < 8; i++) {
+        v |= static_cast<uint64_t>(p[i]) << (8 * i);
+    }
+    return v;
+}
+
+inline void store_le64(uint8_t* p, uint64_t v) {
+    for (size_t i = 0; i < 8; i++) {
+        p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+}
+
+// Ignores the top bit, as RFC 7748 asks of u-coordinates
+void fe_from_bytes(Fe* h, const uint8_t* s) {
+    h->v[0] = load_le64(s) & MASK51;
+    h->v[1] = (load_le64(s + 6) >> 3) & MASK51;
+    h->v[2] = (load_le64(s + 12) >> 6) & MASK51;
+    h->v[3] = (load_le64(s + 19) >> 1) & MASK51;
+    h->v[4] = (load_le64(s + 24) >> 12) & MASK51;
+}
+
+inline void fe_carry(Fe* h) {
+    uint64_t c;
+    c = h->v[0] >> 51; h->v[0] &= MASK51; h->v[1] += c;
+    c = h->v[1] >> 51; h->v[1] &= MASK51; h->v[2] += c;
+    c = h->v[2] >> 51; h->v[2] &= MASK51; h->v[3] += c;
+    c = h->v[3] >> 51; h->v[3] &= MASK51; h->v[4] += c;
+    c = h->v[4] >> 51; h->v[4] &= MASK51; h->v[0] += c * 19;
+}
+
+// Fully reduced, 32 bytes little-endian
+void fe_to_bytes(uint8_t* s, const Fe& f) {
+    Fe h = f;
+    fe_carry(&h);
+    fe_carry(&h);
+
+    // Now below 2^255 + a little. Adding 19 carries out of bit 255 exactly
+    // when h >= p; then add 2^255 - 19 back and drop bit 255.
+    h.v[0] += 19;
+    fe_carry(&h);
+    h.v[0] += (1ull << 51) - 19;
+    h.v[1] += (1ull << 51) - 1;
+    h.v[2] += (1ull << 51) - 1;
+    h.v[3] += (1ull << 51) - 1;
+    h.v[4] += (1ull << 51) - 1;
+    h.v[1] += h.v[0] >> 51; h.v[0] &= MASK51;
+    h.v[2] += h.v[1] >> 51; h.v[1] &= MASK51;
+    h.v[3] += h.v[2] >> 51; h.v[2] &= MASK51;
+    h.v[4] += h.v[3] >> 51; h.v[3] &= MASK51;
+    h.v[4] &= MASK51;
+
+    store_le64(s, h.v[0] | (h.v[1] << 51));
+    store_le64(s + 8, (h.v[1] >> 13) | (h.v[2] << 38));
+    store_le64(s + 16, (h.v[2] >> 26) | (h.v[3] << 25));
+    store_le64(s + 24, (h.v[3] >> 39) | (h.v[4] << 12));
+}
+
+inline void fe_add(Fe* h, const Fe& f, const Fe& g) {
+    for (size_t i = 0; i < 5; i++) {
+        h->v[i] = f.v[i] + g.v[i];
+    }
+    fe_carry(h);
+}
+
+// f - g + 2p, so limbs stay positive
+inline void fe_sub(Fe* h, const Fe& f, const Fe& g) {
+    h->v[0] = f.v[0] + 0xFFFFFFFFFFFDAull - g.v[0];
+    for (size_t i = 1; i < 5; i++) {
+        h->v[i] = f.v[i] + 0xFFFFFFFFFFFFEull - g.v[i];
+    }
+    fe_carry(h);
+}
+
+// Carries 128-bit column sums into a loosely reduced element
+inline void fe_reduce_wide(Fe* h, uint128 r0, uint128 r1, uint128 r2, uint128 r3, uint128 r4) {
+    r1 += static_cast<uint64_t>(r0 >> 51);
+    r2 += static_cast<uint64_t>(r1 >> 51);
+    r3 += static_cast<uint64_t>(r2 >> 51);
+    r4 += static_cast<uint64_t>(r3 >> 51);
+    uint128 top = (r4 >> 51) * 19 + (static_cast<uint64_t>(r0) & MASK51);
+    h->v[0] = static_cast<uint64_t>(top) & MASK51;
+    h->v[1] = (static_cast<uint64_t>(r1) & MASK51) + static_cast<uint64_t>(top >> 51);
+    h->v[2] = static_cast<uint64_t>(r2) & MASK51;
+    h->v[3] = static_cast<uint64_t>(r3) & MASK51;
+    h->v[4] = static_cast<uint64_t>(r4) & MASK51;
+}
+
+void fe_mul(Fe* h, const Fe& f, const Fe& g) {
+    const uint64_t f0 = f.v[0], f1 = f.v[1], f2 = f.v[2], f3 = f.v[3], f4 = f.v[4];
+    const uint64_t g0 = g.v[0], g1 = g.v[1], g2 = g.v[2], g3 = g.v[3], g4 = g.v[4];
+    const uint64_t g1_19 = g1 * 19, g2_19 = g2 * 19, g3_19 = g3 * 19, g4_19 = g4 * 19;
+
+    uint128 r0 = (uint128)f0 * g0 + (uint128)f1 * g4_19 + (uint128)f2 * g3_19 +
+                 (uint128)f3 * g2_19 + (uint128)f4 * g1_19;
+    uint128 r1 = (uint128)f0 * g1 + (uint128)f1 * g0 + (uint128)f2 * g4_19 +
+                 (uint128)f3 * g3_19 + (uint128)f4 * g2_19;
+    uint128 r2 = (uint128)f0 * g2 + (uint128)f1 * g1 + (uint128)f2 * g0 +
+                 (uint128)f3 * g4_19 + (uint128)f4 * g3_19;
+    uint128 r3 = (uint128)f0 * g3 + (uint128)f1 * g2 + (uint128)f2 * g1 +
+                 (uint128)f3 * g0 + (uint128)f4 * g4_19;
+    uint128 r4 = (uint128)f0 * g4 + (uint128)f1 * g3 + (uint128)f2 * g2 +
+                 (uint128)f3 * g1 + (uint128)f4 * g0;
+    fe_reduce_wide(h, r0, r1, r2, r3, r4);
+}
+
+void fe_sq(Fe* h, const Fe& f) {
+    const uint64_t f0 = f.v[0], f1 = f.v[1], f2 = f.v[2], f3 = f.v[3], f4 = f.v[4];
+    const uint64_t f0_2 = f0 * 2, f1_2 = f1 * 2;
+    const uint64_t f3_19 = f3 * 19, f4_19 = f4 * 19;
+
+    uint128 r0 = (uint128)f0 * f0 + (uint128)f1_2 * f4_19 + (uint128)(f2 * 2) * f3_19;
+    uint128 r1 = (uint128)f0_2 * f1 + (uint128)(f2 * 2) * f4_19 + (uint128)f3 * f3_19;
+    uint128 r2 = (uint128)f0_2 * f2 + (uint128)f1 * f1 + (uint128)(f3 * 2) * f4_19;
+    uint128 r3 = (uint128)f0_2 * f3 + (uint128)f1_2 * f2 + (uint128)f4 * f4_19;
+    uint128 r4 = (uint128)f0_2 * f4 + (uint128)f1_2 * f3 + (uint128)f2 * f2;
+    fe_reduce_wide(h, r0, r1, r2, r3, r4);
+}
+
+inline void fe_sq_times(Fe* h, const Fe& f, int count) {
+    fe_sq(h, f);
+    for (int i = 1; i < count; i++) {
+        fe_sq(h, *h);
+    }
+}
+
+inline void fe_mul_small(Fe* h, const Fe& f, uint64_t n) {
+    fe_reduce_wide(h, (uint128)f.v[0] * n, (uint128)f.v[1] * n, (uint128)f.v[2] * n,
+                   (uint128)f.v[3] * n, (uint128)f.v[4] * n);
+}
+
+// z^(p - 2) = 1/z; z = 0 gives 0
+void fe_invert(Fe* out, const Fe& z) {
+    Fe z2, z9, z11, z2_5_0, z2_10_0, z2_20_0, z2_50_0, z2_100_0, t;
+    fe_sq(&z2, z);                          // 2
+    fe_sq_times(&t, z2, 2);                 // 8
+    fe_mul(&z9, t, z);                      // 9
+    fe_mul(&z11, z9, z2);                   // 11
+    fe_sq(&t, z11);                         // 22
+    fe_mul(&z2_5_0, t, z9);                 // 2^5 - 1
+    fe_sq_times(&t, z2_5_0, 5);
+    fe_mul(&z2_10_0, t, z2_5_0);            // 2^10 - 1
+    fe_sq_times(&t, z2_10_0, 10);
+    fe_mul(&z2_20_0, t, z2_10_0);           // 2^20 - 1
+    fe_sq_times(&t, z2_20_0, 20);
+    fe_mul(&t, t, z2_20_0);                 // 2^40 - 1
+    fe_sq_times(&t, t, 10);
+    fe_mul(&z2_50_0, t, z2_10_0);           // 2^50 - 1
+    fe_sq_times(&t, z2_50_0, 50);
+    fe_mul(&z2_100_0, t, z2_50_0);          // 2^100 - 1
+    fe_sq_times(&t, z2_100_0, 100);
+    fe_mul(&t, t, z2_100_0);                // 2^200 - 1
+    fe_sq_times(&t, t, 50);
+    fe_mul(&t, t, z2_50_0);                 // 2^250 - 1
+    fe_sq_times(&t, t, 5);                  // 2^255 - 32
+    fe_mul(out, t, z11);                    // 2^255 - 21
+}
+
+// Swaps f and g when swap is 1, without branching on it
+inline void fe_cswap(Fe* f, Fe* g, uint64_t swap) {
+    uint64_t mask = 0 - swap;
+    for (size_t i = 0; i < 5; i++) {
+        uint64_t x = (f->v[i] ^ g->v[i]) & mask;
+        f->v[i] ^= x;
+        g->v[i] ^= x;
+    }
+}
+
+void clamp(const uint8_t* private_key, uint8_t* scalar) {
+    memcpy(scalar, private_key, X25519_KEY_SIZE);
+    scalar[0] &= 248;
+    scalar[31] &= 127;
+    scalar[31] |= 64;
+}
+
+// Montgomery ladder (RFC 7748 section 5): scalar times the point with
+// u-coordinate u, as projective X / Z
+void ladder(const uint8_t* private_key, const Fe& u, Fe* x_out, Fe* z_out) {
+    uint8_t scalar[X25519_KEY_SIZE];
+    clamp(private_key, scalar);
+
+    Fe x2 = {{1, 0, 0, 0, 0}};
+    Fe z2 = {{0, 0, 0, 0, 0}};
+    Fe x3 = u;
+    Fe z3 = {{1, 0, 0, 0, 0}};
+    Fe a, aa, b, bb, e, c, d, da, cb;
+    uint64_t swap = 0;
+
+    for (int t = 254; t >= 0; t--) {
+        uint64_t bit = (scalar[t >> 3] >> (t & 7)) & 1;
+        swap ^= bit;
+        fe_cswap(&x2, &x3, swap);
+        fe_cswap(&z2, &z3, swap);
+        swap = bit;
+
+        fe_add(&a, x2, z2);
+        fe_sq(&aa, a);
+        fe_sub(&b, x2, z2);
+        fe_sq(&bb, b);
+        fe_sub(&e, aa, bb);
+        fe_add(&c, x3, z3);
+        fe_sub(&d, x3, z3);
+        fe_mul(&da, d, a);
+        fe_mul(&cb, c, b);
+
+        fe_add(&x3, da, cb);
+        fe_sq(&x3, x3);
+        fe_sub(&z3, da, cb);
+        fe_sq(&z3, z3);
+        fe_mul(&z3, z3, u);
+        fe_mul(&x2, aa, bb);
+        fe_mul_small(&z2, e, A24);
+        fe_add(&z2, z2, aa);
+        fe_mul(&z2, z2, e);
+    }
+    fe_cswap(&x2, &x3, swap);
+    fe_cswap(&z2, &z3, swap);
+
+    *x_out = x2;
+    *z_out = z2;
+    secure_zero(scalar, sizeof(scalar));
+    secure_zero(&x3, sizeof(x3));
+    secure_zero(&z3, sizeof(z3));
+}
+
+const Fe BASE_POINT = {{9, 0, 0, 0, 0}};
+
+} // namespace
+
+void x25519_public_key(const uint8_t* private_key, uint8_t* public_key) {
+    x25519_public_keys(private_key, public_key, 1);
+}
+
+void x25519_public_keys(const uint8_t* private_keys, uint8_t* public_keys, size_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    // Montgomery's trick: invert the product of all Z once, then peel each
+    // inverse off with two multiplications. Clamped scalars are nonzero
+    // modulo the base point's order, so no Z is zero.
+    std::vector<Fe> x(count);
+    std::vector<Fe> z(count);
+    std::vector<Fe> prefix(count);          // Z_0 * ... * Z_i
+    for (size_t i = 0; i < count; i++) {
+        ladder(private_keys + i * X25519_KEY_SIZE, BASE_POINT, &x[i], &z[i]);
+        if (i == 0) {
+            prefix[0] = z[0];
+        } else {
+            fe_mul(&prefix[i], prefix[i - 1], z[i]);
+        }
+    }
+
+    Fe inverse;                             // 1 / (Z_0 * ... * Z_i)
+    Fe z_inverse;
+    fe_invert(&inverse, prefix[count - 1]);
+    for (size_t i = count - 1; i > 0; i--) {
+        fe_mul(&z_inverse, inverse, prefix[i - 1]);
+        fe_mul(&inverse, inverse, z[i]);
+        fe_mul(&x[i], x[i], z_inverse);
+        fe_to_bytes(public_keys + i * X25519_KEY_SIZE, x[i]);
+    }
+    fe_mul(&x[0], x[0], inverse);
+    fe_to_bytes(public_keys, x[0]);
+}
+
+bool x25519(const uint8_t* private_key, const uint8_t* peer_public_key, uint8_t* shared_secret) {
+    Fe u, x, z, z_inverse;
+    fe_from_bytes(&u, peer_public_key);
+    ladder(private_key, u, &x, &z);
+    fe_invert(&z_inverse, z);
+    fe_mul(&x, x, z_inverse);
+    fe_to_bytes(shared_secret, x);
+    secure_zero(&x, sizeof(x));
+    secure_zero(&z, sizeof(z));
+
+    // All zeros (a low-order peer point) without branching on the bytes
+    uint8_t any = 0;
+    for (size_t i = 0; i < X25519_KEY_SIZE; i++) {
+        any |= shared_secret[i];
+    }
+    return any != 0;
+}
+
+void derive_session_key(const uint8_t* shared_secret, const uint8_t* host_nonce,
+                        const uint8_t* accessory_nonce, uint8_t* key) {
+    uint8_t salt[32];
+    memcpy(salt, host_nonce, 16);
+    memcpy(salt + 16, accessory_nonce, 16);
+    hkdf_sha256(salt, sizeof(salt), shared_secret, X25519_KEY_SIZE,
+                reinterpret_cast<const uint8_t*>(SESSION_KEY_INFO), sizeof(SESSION_KEY_INFO) - 1,
+                key, protocol::SESSION_KEY_SIZE);
+}
+
+} // namespace common
@@ -0,0 +1,176 @@
+#include "latency_trace.h"
+#include "protocol.h"
+#include <algorithm>
+
+namespace common {
+
+const char* LatencyTrace::stage_to_string(Stage stage) {
+    switch (stage) {
+        case Stage::GENERATE: return "generate";
+        case Stage::ENQUEUE: return "enqueue";
+        case Stage::SENDTO: return "sendto";
+        case Stage::RECV: return "recv";
+        case Stage::JITTER_INSERT: return "jitter_insert";
+        case Stage::PLAYOUT: return "playout";
+        default: return "unknown";
+    }
+}
+
+LatencyTrace::LatencyTrace(size_t capacity) {
+    // Round up to a power of two so the slot index is a mask
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    mask_ = size - 1;
+    slots_.reset(new Slot[size]());
+}
+
+void LatencyTrace::stamp(Stage stage, uint32_t sequence) {
+    stamp(stage, sequence, protocol::get_timestamp_us());
+}
+
+void LatencyTrace::stamp(Stage stage, uint32_t sequence, uint64_t timestamp_us) {
+    Slot& slot = slots_[sequence & mask_];
+    size_t index = static_cast<size_t>(stage);
+
+    if (stage == Stage::GENERATE) {
+        slot.stamp_us[0].store(0, std::memory_order_relaxed);
+        slot.sequence.store(sequence, std::memory_order_relaxed);
+        for (size_t i = 1; i < STAGE_COUNT; i++) {
+            slot.stamp_us[i].store(0, std::memory_order_relaxed);
+        }
+        slot.stamp_us[0].store(timestamp_us, std::memory_order_release);
+        return;
+    }
+
+    if (slot.stamp_us[0].load(std::memory_order_acquire) == 0 ||
+        slot.sequence.load(std::memory_order_relaxed) != sequence) {
+        return;  // Never generated, or slot reused by a newer frame
+    }
+
+    // First stamp wins (e.g. a retransmitted copy does not overwrite)
+    uint64_t expected = 0;
+    slot.stamp_us[index].compare_exchange_strong(expected, timestamp_us,
+                                                 std::memory_order_relaxed);
+}
+
+std::vector<LatencyTrace::Frame> LatencyTrace::frames() const {
+    std::vector<Frame> result;
+
+    for (size_t i = 0; i <= mask_; i++) {
+        const Slot& slot = slots_[i];
+        uint64_t generated = slot.stamp_us[0].load(std::memory_order_acquire);
+        if (generated == 0) {
+            continue;
+        }
+
+        Frame frame;
+        frame.sequence = slot.sequence.load(std::memory_order_relaxed);
+        frame.stamp_us[0] = generated;
+        for (size_t s = 1; s < STAGE_COUNT; s++) {
+            frame.stamp_us[s] = slot.stamp_us[s].load(std::memory_order_relaxed);
+        }
+        result.push_back(frame);
+    }
+
+    std::sort(result.begin(), result.end(), [](const Frame& a, const Frame& b) {
+        return a.sequence < b.sequence;
+    });
+    return result;
+}
+
+LatencyTrace::Distribution LatencyTrace::distribution(std::vector<uint64_t>& samples) {
+    Distribution dist = {};
+    if (samples.empty()) {
+        return dist;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+
+    // Nearest-rank percentile
+    auto percentile = [&samples, n](double p) {
+        size_t rank = static_cast<size_t>(p * n + 0.999999);
+        return samples[rank == 0 ? 0 : std::min(rank, n) - 1];
+    };
+
+    double sum = 0.0;
+    for (uint64_t sample : samples) {
+        sum += static_cast<double>(sample);
+    }
+
+    dist.count = n;
+    dist.min_us = samples.front();
+    dist.p50_us = percentile(0.50);
+    dist.p90_us = percentile(0.90);
+    dist.p99_us = percentile(0.99);
+    dist.p999_us = percentile(0.999);
+    dist.max_us = samples.back();
+    dist.mean_us = sum / n;
+    return dist;
+}
+
+LatencyTrace::Summary LatencyTrace::summarize(uint32_t first_sequence) const {
+    Summary summary = {};
+    std::vector<Frame> traced = frames();
+
+    std::vector<const Frame*> completed;
+    for (const Frame& frame : traced) {
+        if (frame.sequence < first_sequence) {
+            continue;
+        }
+        summary.frames_traced++;
+
+        size_t reached = 0;
+        while (reached + 1 < STAGE_COUNT && frame.stamp_us[reached + 1] != 0) {
+            reached++;
+        }
+        if (reached == STAGE_COUNT - 1) {
+            completed.push_back(&frame);
+        } else {
+            summary.frames_stalled[reached]++;
+        }
+    }
+    summary.frames_completed = completed.size();
+
+    // Stages run on different threads; clamp rare out-of-order stamps to 0
+    auto delta = [](uint64_t from, uint64_t to) -> uint64_t {
+        return to > from ? to - from : 0;
+    };
+
+    std::vector<uint64_t> samples;
+    samples.reserve(completed.size());
+    for (size_t hop = 0; hop < HOP_COUNT; hop++) {
+        samples.clear();
+        for (const Frame* frame : completed) {
+            samples.push_back(delta(frame->stamp_us[hop], frame->stamp_us[hop + 1]));
+        }
+        summary.hop[hop] = distribution(samples);
+    }
+
+    samples.clear();
+    for (const Frame* frame : completed) {
+        samples.push_back(delta(frame->stamp_us[0], frame->stamp_us[STAGE_COUNT - 1]));
+    }
+    summary.total = distribution(samples);
+
+    // Attribute the tail: mean per-hop delay over frames at or above p99
+    size_t tail_frames = 0;
+    for (const Frame* frame : completed) {
+        if (delta(frame->stamp_us[0], frame->stamp_us[STAGE_COUNT - 1]) < summary.total.p99_us) {
+            continue;
+        }
+        for (size_t hop = 0; hop < HOP_COUNT; hop++) {
+            summary.tail_hop_us[hop] += delta(frame->stamp_us[hop], frame->stamp_us[hop + 1]);
+        }
+        tail_frames++;
+    }
+    for (size_t hop = 0; hop < HOP_COUNT && tail_frames > 0; hop++) {
+        summary.tail_hop_us[hop] /= tail_frames;
+    }
+
+    return summary;
+}
+
+} // namespace common
@@ -0,0 +1,227 @@
+#include "pacer.h"
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace common {
+
+namespace {
+
+uint64_t now_us() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+timespec to_timespec(uint64_t us) {
+    timespec ts;
+    ts.tv_sec = static_cast<time_t>(us / 1000000);
+    ts.tv_nsec = static_cast<long>((us % 1000000) * 1000);
+    return ts;
+}
+
+void sleep_until_us(uint64_t deadline_us) {
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+        std::chrono::microseconds(deadline_us)));
+}
+
+void spin_until_us(uint64_t deadline_us) {
+    while (now_us() < deadline_us) {
+#if defined(__SSE2__)
+        _mm_pause();
+#endif
+    }
+}
+
+} // namespace
+
+TimingHistogram::TimingHistogram() {
+    clear();
+}
+
+void TimingHistogram::record(uint64_t error_us) {
+    size_t index = error_us == 0 ? 0 : static_cast<size_t>(64 - __builtin_clzll(error_us));
+    if (index >= BUCKETS) {
+        index = BUCKETS - 1;
+    }
+    buckets_[index]++;
+    count_++;
+    sum_us_ += error_us;
+    if (error_us > max_us_) {
+        max_us_ = error_us;
+    }
+}
+
+void TimingHistogram::merge(const TimingHistogram& other) {
+    for (size_t i = 0; i < BUCKETS; i++) {
+        buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    sum_us_ += other.sum_us_;
+    if (other.max_us_ > max_us_) {
+        max_us_ = other.max_us_;
+    }
+}
+
+void TimingHistogram::clear() {
+    memset(buckets_, 0, sizeof(buckets_));
+    count_ = 0;
+    sum_us_ = 0;
+    max_us_ = 0;
+}
+
+double TimingHistogram::mean_us() const {
+    return count_ > 0 ? static_cast<double>(sum_us_) / static_cast<double>(count_) : 0.0;
+}
+
+uint64_t TimingHistogram::percentile_us(double fraction) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(count_));
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += buckets_[i];
+        if (seen >= rank) {
+            uint64_t upper = bucket_upper_us(i);
+            return upper < max_us_ ? upper : max_us_;
+        }
+    }
+    return max_us_;
+}
+
+uint64_t TimingHistogram::bucket_upper_us(size_t index) {
+    if (index == 0) {
+        return 0;
+    }
+    if (index >= BUCKETS - 1) {
+        return UINT64_MAX;
+    }
+    return (1ull << index) - 1;
+}
+
+const char* pacer_strategy_to_string(PacerStrategy strategy) {
+    switch (strategy) {
+        case PacerStrategy::SLEEP: return "sleep";
+        case PacerStrategy::SLEEP_SPIN: return "spin";
+        case PacerStrategy::NANOSLEEP: return "nanosleep";
+        case PacerStrategy::TIMERFD: return "timerfd";
+        default: return "unknown";
+    }
+}
+
+bool pacer_strategy_from_string(const char* name, PacerStrategy* strategy) {
+    static const PacerStrategy strategies[] = {
+        PacerStrategy::SLEEP, PacerStrategy::SLEEP_SPIN,
+        PacerStrategy::NANOSLEEP, PacerStrategy::TIMERFD
+    };
+    for (PacerStrategy candidate : strategies) {
+        if (strcmp(name, pacer_strategy_to_string(candidate)) == 0) {
+            *strategy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+Pacer::Pacer(PacerStrategy strategy, uint32_t spin_us)
+    : strategy_(PacerStrategy::SLEEP)
+    , spin_us_(0)
+    , timer_fd_(-1) {
+
+    stats_.waits = 0;
+    stats_.ticks_skipped = 0;
+    configure(strategy, spin_us);
+}
+
+Pacer::~Pacer() {
+    if (timer_fd_ >= 0) {
+        close(timer_fd_);
+    }
+}
+
+void Pacer::configure(PacerStrategy strategy, uint32_t spin_us) {
+    strategy_ = strategy;
+    spin_us_ = spin_us;
+    if (strategy_ == PacerStrategy::TIMERFD && timer_fd_ < 0) {
+        timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (timer_fd_ < 0) {
+            strategy_ = PacerStrategy::NANOSLEEP;
+        }
+    }
+}
+
+uint64_t Pacer::wait_until(uint64_t deadline_us) {
+    if (now_us() < deadline_us) {
+        switch (strategy_) {
+            case PacerStrategy::SLEEP:
+                sleep_until_us(deadline_us);
+                break;
+            case PacerStrategy::SLEEP_SPIN:
+                if (deadline_us > spin_us_) {
+                    sleep_until_us(deadline_us - spin_us_);
+                }
+                spin_until_us(deadline_us);
+                break;
+            case PacerStrategy::NANOSLEEP: {
+                timespec ts = to_timespec(deadline_us);
+                while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+                }
+                break;
+            }
+            case PacerStrategy::TIMERFD:
+                wait_timerfd(deadline_us);
+                break;
+        }
+    }
+
+    uint64_t woke = now_us();
+    uint64_t error_us = woke > deadline_us ? woke - deadline_us : 0;
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.waits++;
+    stats_.wake_error.record(error_us);
+    return error_us;
+}
+
+void Pacer::wait_timerfd(uint64_t deadline_us) {
+    itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value = to_timespec(deadline_us);
+    if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+        sleep_until_us(deadline_us);
+        return;
+    }
+    uint64_t expirations;
+    while (read(timer_fd_, &expirations, sizeof(expirations)) < 0 && errno == EINTR) {
+    }
+}
+
+void Pacer::record_skipped(uint64_t count) {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.ticks_skipped += count;
+}
+
+Pacer::Stats Pacer::get_stats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+void Pacer::reset_stats() {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.waits = 0;
+    stats_.ticks_skipped = 0;
+    stats_.wake_error.clear();
+}
+
+} // namespace common
@@ -5,18 +5,27 @@
 
 namespace protocol {
 
-void Packet::set_payload(const void* data, uint16_t length) {
-    if (length > MAX_PAYLOAD_SIZE) {
-        length = MAX_PAYLOAD_SIZE;
+static_assert(offsetof(Packet, payload) == PACKET_HEADER_SIZE,
+              "Packet must be laid out as its serialized form");
+
+bool Packet::set_payload(const void* data, uint16_t length) {
+    bool fits = length <= MAX_PAYLOAD_SIZE;
+    if (!fits) {
+        length = 0;
     }
     header.payload_length = length;
     if (data && length > 0) {
         memcpy(payload, data, length);
     }
     header.checksum = calculate_checksum();
+    return fits;
 }
 
 uint16_t Packet::calculate_checksum() const {
+    return packet_checksum(header, payload);
+}
+
+uint16_t packet_checksum(const PacketHeader& header, const uint8_t* payload) {
     uint32_t sum = 0;
     
     // Checksum the header (excluding checksum field)
@@ -48,13 +57,21 @@ const char* packet_type_to_string(PacketType type) {
         case PacketType::CONNECT_RESPONSE: return "CONNECT_RESPONSE";
         case PacketType::DISCONNECT: return "DISCONNECT";
         case PacketType::KEEPALIVE: return "KEEPALIVE";
+        case PacketType::TIME_SYNC_REQUEST: return "TIME_SYNC_REQUEST";
+        case PacketType::TIME_SYNC_RESPONSE: return "TIME_SYNC_RESPONSE";
+        case PacketType::SESSION_TICKET: return "SESSION_TICKET";
+        case PacketType::RESUME_REQUEST: return "RESUME_REQUEST";
+        case PacketType::RESUME_RESPONSE: return "RESUME_RESPONSE";
         case PacketType::AUDIO_DATA: return "AUDIO_DATA";
         case PacketType::AUDIO_ACK: return "AUDIO_ACK";
         case PacketType::AUDIO_RETRANSMIT: return "AUDIO_RETRANSMIT";
+        case PacketType::AUDIO_FEC: return "AUDIO_FEC";
+        case PacketType::AUDIO_FEC_CONFIG: return "AUDIO_FEC_CONFIG";
         case PacketType::BATTERY_STATUS: return "BATTERY_STATUS";
         case PacketType::DIAGNOSTICS: return "DIAGNOSTICS";
         case PacketType::KEY_EXCHANGE: return "KEY_EXCHANGE";
         case PacketType::ENCRYPTED_PACKET: return "ENCRYPTED_PACKET";
+        case PacketType::FRAGMENT: return "FRAGMENT";
         default: return "UNKNOWN";
     }
 }
@@ -72,6 +89,131 @@ const char* connection_state_to_string(ConnectionState state) {
     }
 }
 
+const char* audio_encoding_to_string(AudioEncoding encoding) {
+    switch (encoding) {
+        case AudioEncoding::PCM16: return "PCM16";
+        case AudioEncoding::AAC: return "AAC";
+        case AudioEncoding::IMA_ADPCM: return "IMA_ADPCM";
+        case AudioEncoding::LOSSLESS: return "LOSSLESS";
+        default: return "UNKNOWN";
+    }
+}
+
+const char* fec_scheme_to_string(FecScheme scheme) {
+    switch (scheme) {
+        case FecScheme::NONE: return "NONE";
+        case FecScheme::XOR: return "XOR";
+        case FecScheme::REED_SOLOMON: return "REED_SOLOMON";
+        default: return "UNKNOWN";
+    }
+}
+
+const char* sample_format_to_string(SampleFormat format) {
+    switch (format) {
+        case SampleFormat::INT16: return "int16";
+        case SampleFormat::INT24: return "int24";
+        case SampleFormat::FLOAT32: return "float32";
+        default: return "unknown";
+    }
+}
+
+bool is_valid_frame_samples(uint16_t frame_samples) {
+    switch (frame_samples) {
+        case AUDIO_FRAME_SAMPLES_2_5MS:
+        case AUDIO_FRAME_SAMPLES_5MS:
+        case AUDIO_FRAME_SAMPLES_10MS:
+        case AUDIO_FRAME_SAMPLES_20MS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+uint64_t samples_to_us(uint64_t samples) {
+    return samples * 1000000ull / AUDIO_SAMPLE_RATE;
+}
+
+namespace {
+
+// Sample rate codes in the high nibble of the packed format byte
+const uint32_t STREAM_RATES[] = { AUDIO_SAMPLE_RATE, AUDIO_SAMPLE_RATE_44K, AUDIO_SAMPLE_RATE_96K };
+constexpr size_t STREAM_RATE_COUNT = sizeof(STREAM_RATES) / sizeof(STREAM_RATES[0]);
+
+} // namespace
+
+bool is_valid_stream_format(const StreamFormat& format) {
+    bool rate_known = false;
+    for (uint32_t rate : STREAM_RATES) {
+        rate_known = rate_known || format.sample_rate == rate;
+    }
+    return rate_known && format.channels >= 1 && format.channels <= MAX_AUDIO_CHANNELS &&
+           static_cast<uint8_t>(format.sample_format) <= static_cast<uint8_t>(SampleFormat::FLOAT32);
+}
+
+size_t sample_wire_bytes(SampleFormat format) {
+    switch (format) {
+        case SampleFormat::INT24: return 3;
+        case SampleFormat::FLOAT32: return 4;
+        default: return 2;
+    }
+}
+
+uint32_t stream_frame_samples(const StreamFormat& format, uint16_t frame_samples) {
+    uint64_t scaled = static_cast<uint64_t>(frame_samples) * format.sample_rate;
+    if (scaled % AUDIO_SAMPLE_RATE != 0) {
+        return 0;
+    }
+    return static_cast<uint32_t>(scaled / AUDIO_SAMPLE_RATE);
+}
+
+void pack_stream_format(const StreamFormat& format, uint8_t* channels, uint8_t* packed) {
+    uint8_t rate_code = 0;
+    for (size_t i = 0; i < STREAM_RATE_COUNT; i++) {
+        if (STREAM_RATES[i] == format.sample_rate) {
+            rate_code = static_cast<uint8_t>(i);
+        }
+    }
+    *channels = format.channels;
+    *packed = static_cast<uint8_t>(static_cast<uint8_t>(format.sample_format) | (rate_code << 4));
+}
+
+bool unpack_stream_format(uint8_t channels, uint8_t packed, StreamFormat* format) {
+    size_t rate_code = packed >> 4;
+    if (rate_code >= STREAM_RATE_COUNT) {
+        return false;
+    }
+    format->sample_rate = STREAM_RATES[rate_code];
+    format->channels = channels == 0 ? 1 : channels;
+    format->sample_format = static_cast<SampleFormat>(packed & 0x0F);
+    return is_valid_stream_format(*format);
+}
+
+size_t pack_nack_entries(const uint32_t* sequences, size_t count,
+                         NackEntry* entries, size_t max_entries) {
+    size_t used = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t sequence = sequences[i];
+        if (used > 0) {
+            NackEntry& last = entries[used - 1];
+            uint32_t offset = sequence - last.base_sequence;
+            if (offset == 0) {
+                continue;   // Duplicate
+            }
+            if (offset <= 32) {
+                last.bitmap |= 1u << (offset - 1);
+                continue;
+            }
+        }
+        if (used == max_entries) {
+            break;
+        }
+        entries[used].base_sequence = sequence;
+        entries[used].bitmap = 0;
+        used++;
+    }
+    return used;
+}
+
 uint64_t get_timestamp_us() {
     auto now = std::chrono::steady_clock::now();
     auto duration = now.time_since_epoch();
@@ -130,4 +272,11 @@ bool deserialize_packet(const uint8_t* buffer, size_t buffer_size, Packet* packe
     return packet->verify_checksum();
 }
 
+bool validate_packet(const Packet& packet, size_t received) {
+    return received >= PACKET_HEADER_SIZE &&
+           packet.header.payload_length <= MAX_PAYLOAD_SIZE &&
+           received >= packet.total_size() &&
+           packet.verify_checksum();
+}
+
 } // namespace protocol
@@ -0,0 +1,322 @@
+#include "sample_format.h"
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SAMPLE_FORMAT_X86_DISPATCH 1
+#endif
+
+namespace common {
+
+using protocol::SampleFormat;
+
+namespace {
+
+constexpr size_t CHUNK_FRAMES = 256;
+
+// Mono int16-scaled floats to F, one output per input
+template <SampleFormat F>
+void convert_block(const float* in, size_t count, typename SampleTraits<F>::Type* out);
+
+template <>
+void convert_block<SampleFormat::INT16>(const float* in, size_t count, int16_t* out) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 8 <= count; i += 8) {
+        __m128i low = _mm_cvtps_epi32(_mm_loadu_ps(in + i));
+        __m128i high = _mm_cvtps_epi32(_mm_loadu_ps(in + i + 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(low, high));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = SampleTraits<SampleFormat::INT16>::from_float(in[i]);
+    }
+}
+
+template <>
+void convert_block<SampleFormat::INT24>(const float* in, size_t count, int32_t* out) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(256.0f);
+    const __m128 low_limit = _mm_set1_ps(-8388608.0f);
+    const __m128 high_limit = _mm_set1_ps(8388607.0f);
+    for (; i + 4 <= count; i += 4) {
+        __m128 value = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+        value = _mm_min_ps(_mm_max_ps(value, low_limit), high_limit);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_cvtps_epi32(value));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = SampleTraits<SampleFormat::INT24>::from_float(in[i]);
+    }
+}
+
+template <>
+void convert_block<SampleFormat::FLOAT32>(const float* in, size_t count, float* out) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(in + i), scale));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = SampleTraits<SampleFormat::FLOAT32>::from_float(in[i]);
+    }
+}
+
+template <typename T>
+void duplicate_channels(const T* mono, size_t frames, size_t channels, T* out) {
+    if (channels == 2) {
+        for (size_t f = 0; f < frames; f++) {
+            out[2 * f] = mono[f];
+            out[2 * f + 1] = mono[f];
+        }
+        return;
+    }
+    for (size_t f = 0; f < frames; f++) {
+        for (size_t c = 0; c < channels; c++) {
+            out[f * channels + c] = mono[f];
+        }
+    }
+}
+
+#if defined(SAMPLE_FORMAT_X86_DISPATCH)
+// Four samples per PSHUFB between int32 containers and packed 24-bit
+// little-endian. Both stop short of the end so no load or store strays past
+// the buffers; the caller finishes the rest.
+__attribute__((target("ssse3")))
+size_t pack24_ssse3(const int32_t* in, size_t count, uint8_t* out) {
+    const __m128i mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i packed = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), mask);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 3 * i), packed);
+        uint32_t tail = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(packed, 8)));
+        memcpy(out + 3 * i + 8, &tail, sizeof(tail));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+size_t unpack24_ssse3(const uint8_t* in, size_t count, int32_t* out) {
+    // Each sample into the top three bytes of its lane, then sign-extend
+    const __m128i mask = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    size_t i = 0;
+    for (; i + 6 <= count; i += 4) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 3 * i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                         _mm_srai_epi32(_mm_shuffle_epi8(bytes, mask), 8));
+    }
+    return i;
+}
+
+bool has_ssse3() {
+    static const bool supported = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("ssse3") != 0;
+    }();
+    return supported;
+}
+#endif
+
+// Largest magnitude in each of 8 lanes over the first multiple of 8
+// samples; lane k holds channel k % channels when channels divides 8.
+// Returns samples covered.
+template <SampleFormat F>
+size_t lane_peaks(const typename SampleTraits<F>::Type* in, size_t count, float* lanes);
+
+#if defined(__SSE2__)
+template <>
+size_t lane_peaks<SampleFormat::INT16>(const int16_t* in, size_t count, float* lanes) {
+    // Track both extremes; negating in int16 would lose -32768
+    __m128i high = _mm_setzero_si128();
+    __m128i low = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        high = _mm_max_epi16(high, value);
+        low = _mm_min_epi16(low, value);
+    }
+    alignas(16) int16_t highs[8];
+    alignas(16) int16_t lows[8];
+    _mm_store_si128(reinterpret_cast<__m128i*>(highs), high);
+    _mm_store_si128(reinterpret_cast<__m128i*>(lows), low);
+    for (size_t k = 0; k < 8; k++) {
+        lanes[k] = std::max(static_cast<int>(highs[k]), -static_cast<int>(lows[k])) * (1.0f / 32768.0f);
+    }
+    return i;
+}
+
+template <>
+size_t lane_peaks<SampleFormat::INT24>(const int32_t* in, size_t count, float* lanes) {
+    // 24-bit magnitudes are exact in float, so compare there
+    const __m128 scale = _mm_set1_ps(1.0f / 8388608.0f);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 low = _mm_setzero_ps();
+    __m128 high = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+        __m128 b = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 4)));
+        low = _mm_max_ps(low, _mm_andnot_ps(sign, a));
+        high = _mm_max_ps(high, _mm_andnot_ps(sign, b));
+    }
+    _mm_storeu_ps(lanes, _mm_mul_ps(low, scale));
+    _mm_storeu_ps(lanes + 4, _mm_mul_ps(high, scale));
+    return i;
+}
+
+template <>
+size_t lane_peaks<SampleFormat::FLOAT32>(const float* in, size_t count, float* lanes) {
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 low = _mm_setzero_ps();
+    __m128 high = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        low = _mm_max_ps(low, _mm_andnot_ps(sign, _mm_loadu_ps(in + i)));
+        high = _mm_max_ps(high, _mm_andnot_ps(sign, _mm_loadu_ps(in + i + 4)));
+    }
+    _mm_storeu_ps(lanes, low);
+    _mm_storeu_ps(lanes + 4, high);
+    return i;
+}
+#else
+template <SampleFormat F>
+size_t lane_peaks(const typename SampleTraits<F>::Type* in, size_t count, float* lanes) {
+    (void)in;
+    (void)count;
+    std::fill(lanes, lanes + 8, 0.0f);
+    return 0;
+}
+#endif
+
+} // namespace
+
+size_t sample_size(SampleFormat format) {
+    return format == SampleFormat::INT16 ? sizeof(int16_t) : sizeof(int32_t);
+}
+
+bool sample_format_from_string(const char* name, SampleFormat* format) {
+    const SampleFormat formats[] = { SampleFormat::INT16, SampleFormat::INT24, SampleFormat::FLOAT32 };
+    for (SampleFormat candidate : formats) {
+        if (strcmp(name, protocol::sample_format_to_string(candidate)) == 0) {
+            *format = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+template <SampleFormat F>
+void samples_from_float(const float* in, size_t frames, size_t channels,
+                        typename SampleTraits<F>::Type* out) {
+    if (channels == 1) {
+        convert_block<F>(in, frames, out);
+        return;
+    }
+    typename SampleTraits<F>::Type mono[CHUNK_FRAMES];
+    for (size_t f = 0; f < frames; f += CHUNK_FRAMES) {
+        size_t count = std::min(CHUNK_FRAMES, frames - f);
+        convert_block<F>(in + f, count, mono);
+        duplicate_channels(mono, count, channels, out + f * channels);
+    }
+}
+
+template <SampleFormat F>
+void samples_from_int16(const int16_t* in, size_t frames, size_t channels,
+                        typename SampleTraits<F>::Type* out) {
+    typename SampleTraits<F>::Type mono[CHUNK_FRAMES];
+    for (size_t f = 0; f < frames; f += CHUNK_FRAMES) {
+        size_t count = std::min(CHUNK_FRAMES, frames - f);
+        typename SampleTraits<F>::Type* dest = channels == 1 ? out + f : mono;
+        for (size_t i = 0; i < count; i++) {
+            dest[i] = SampleTraits<F>::from_int16(in[f + i]);
+        }
+        if (channels > 1) {
+            duplicate_channels(mono, count, channels, out + f * channels);
+        }
+    }
+}
+
+// INT16 and FLOAT32 are stored as is on little-endian hosts; INT24 drops
+// the high byte of its int32 container
+template <SampleFormat F>
+size_t pack_samples(const typename SampleTraits<F>::Type* in, size_t count, uint8_t* out) {
+    if (F != SampleFormat::INT24) {
+        memcpy(out, in, count * sizeof(*in));
+        return count * sizeof(*in);
+    }
+    size_t i = 0;
+#if defined(SAMPLE_FORMAT_X86_DISPATCH)
+    if (has_ssse3()) {
+        i = pack24_ssse3(reinterpret_cast<const int32_t*>(in), count, out);
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t value = static_cast<uint32_t>(in[i]);
+        out[3 * i] = static_cast<uint8_t>(value);
+        out[3 * i + 1] = static_cast<uint8_t>(value >> 8);
+        out[3 * i + 2] = static_cast<uint8_t>(value >> 16);
+    }
+    return count * 3;
+}
+
+template <SampleFormat F>
+void unpack_samples(const uint8_t* in, size_t count, typename SampleTraits<F>::Type* out) {
+    if (F != SampleFormat::INT24) {
+        memcpy(out, in, count * sizeof(*out));
+        return;
+    }
+    size_t i = 0;
+#if defined(SAMPLE_FORMAT_X86_DISPATCH)
+    if (has_ssse3()) {
+        i = unpack24_ssse3(in, count, reinterpret_cast<int32_t*>(out));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t value = in[3 * i] | (in[3 * i + 1] << 8) | (static_cast<uint32_t>(in[3 * i + 2]) << 16);
+        out[i] = static_cast<int32_t>(value << 8) >> 8;
+    }
+}
+
+template <SampleFormat F>
+void channel_peaks(const typename SampleTraits<F>::Type* in, size_t frames, size_t channels,
+                   float* peaks) {
+    // Layouts whose channels tile the 8 lanes go through SIMD; the rest
+    // (and any tail) one sample at a time
+    const size_t count = frames * channels;
+    size_t i = 0;
+    if (8 % channels == 0) {
+        float lanes[8];
+        i = lane_peaks<F>(in, count, lanes);
+        for (size_t k = 0; k < 8; k++) {
+            peaks[k % channels] = std::max(peaks[k % channels], lanes[k]);
+        }
+    }
+    for (size_t c = 0; i < count; i++) {
+        peaks[c] = std::max(peaks[c], std::fabs(SampleTraits<F>::to_unit(in[i])));
+        c = c + 1 == channels ? 0 : c + 1;
+    }
+}
+
+#define INSTANTIATE_SAMPLE_FORMAT(F)                                                           \
+    template void samples_from_float<F>(const float*, size_t, size_t,                          \
+                                        SampleTraits<F>::Type*);                               \
+    template void samples_from_int16<F>(const int16_t*, size_t, size_t,                        \
+                                        SampleTraits<F>::Type*);                               \
+    template size_t pack_samples<F>(const SampleTraits<F>::Type*, size_t, uint8_t*);           \
+    template void unpack_samples<F>(const uint8_t*, size_t, SampleTraits<F>::Type*);           \
+    template void channel_peaks<F>(const SampleTraits<F>::Type*, size_t, size_t, float*);
+
+INSTANTIATE_SAMPLE_FORMAT(SampleFormat::INT16)
+INSTANTIATE_SAMPLE_FORMAT(SampleFormat::INT24)
+INSTANTIATE_SAMPLE_FORMAT(SampleFormat::FLOAT32)
+
+#undef INSTANTIATE_SAMPLE_FORMAT
+
+} // namespace common
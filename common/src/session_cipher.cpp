@@ -0,0 +1,133 @@
+#include "session_cipher.h"
+#include "secure_zero.h"
+#include <cstring>
+
+namespace common {
+
+namespace {
+
+constexpr char MAC_KEY_LABEL[] = "packet mac";
+
+} // namespace
+
+static_assert(protocol::SESSION_KEY_SIZE == Aes128::KEY_SIZE, "session keys are AES-128 keys");
+static_assert(protocol::AUTH_TAG_SIZE <= Sha256::DIGEST_SIZE, "tags are truncated digests");
+
+SessionCipher::SessionCipher()
+    : mode_(Mode::ENCRYPT)
+    , keyed_(false) {
+}
+
+void SessionCipher::set_key(const uint8_t* key) {
+    if (!key) {
+        const uint8_t zero[Aes128::KEY_SIZE] = {};
+        aes_.set_key(zero);
+        hmac_.set_key(nullptr, 0);
+        keyed_ = false;
+        return;
+    }
+    aes_.set_key(key);
+
+    // The MAC gets its own key, so no key serves both AES and HMAC
+    uint8_t mac_key[Sha256::DIGEST_SIZE];
+    hmac_sha256(key, protocol::SESSION_KEY_SIZE, reinterpret_cast<const uint8_t*>(MAC_KEY_LABEL),
+                sizeof(MAC_KEY_LABEL) - 1, mac_key);
+    hmac_.set_key(mac_key, sizeof(mac_key));
+    secure_zero(mac_key, sizeof(mac_key));
+    keyed_ = true;
+}
+
+void SessionCipher::packet_nonce(const protocol::PacketHeader& header, uint8_t* nonce) {
+    nonce[0] = static_cast<uint8_t>(header.type);
+    memcpy(nonce + 1, &header.sequence, sizeof(header.sequence));
+    memcpy(nonce + 5, &header.timestamp_us, sizeof(header.timestamp_us));
+}
+
+void SessionCipher::packet_mac(const protocol::Packet& packet, size_t length, uint8_t* tag) const {
+    uint8_t nonce[NONCE_SIZE];
+    packet_nonce(packet.header, nonce);
+    Sha256 inner = hmac_.start();
+    inner.update(nonce, sizeof(nonce));
+    inner.update(packet.payload, length);
+    hmac_.finish(&inner, tag, protocol::AUTH_TAG_SIZE);
+}
+
+bool SessionCipher::seal(protocol::Packet* packet) const {
+    const size_t length = packet->header.payload_length;
+    if (!keyed_ || length + protocol::AUTH_TAG_SIZE > protocol::MAX_PAYLOAD_SIZE) {
+        return false;
+    }
+    uint8_t* tag = packet->payload + length;
+    uint8_t flag = protocol::FLAG_ENCRYPTED;
+    if (mode_ == Mode::AUTHENTICATE) {
+        packet_mac(*packet, length, tag);
+        flag = protocol::FLAG_AUTHENTICATED;
+    } else {
+        uint8_t nonce[NONCE_SIZE];
+        packet_nonce(packet->header, nonce);
+        aes_.ccm_seal(nonce, nullptr, 0, packet->payload, length, tag, protocol::AUTH_TAG_SIZE);
+    }
+    packet->set_flags(packet->header.flags | flag);
+    packet->set_payload(nullptr, static_cast<uint16_t>(length + protocol::AUTH_TAG_SIZE));
+    return true;
+}
+
+bool SessionCipher::open(protocol::Packet* packet) const {
+    const uint8_t flags = packet->header.flags;
+    const bool encrypted = (flags & protocol::FLAG_ENCRYPTED) != 0;
+    const bool authenticated = (flags & protocol::FLAG_AUTHENTICATED) != 0;
+    if (!keyed_ || encrypted == authenticated ||
+        packet->header.payload_length < protocol::AUTH_TAG_SIZE) {
+        return false;
+    }
+    const size_t length = packet->header.payload_length - protocol::AUTH_TAG_SIZE;
+    const uint8_t* tag = packet->payload + length;
+
+    if (encrypted) {
+        uint8_t nonce[NONCE_SIZE];
+        packet_nonce(packet->header, nonce);
+        if (!aes_.ccm_open(nonce, nullptr, 0, packet->payload, length, tag,
+                           protocol::AUTH_TAG_SIZE)) {
+            return false;
+        }
+    } else {
+        uint8_t expected[protocol::AUTH_TAG_SIZE];
+        packet_mac(*packet, length, expected);
+        uint8_t difference = 0;
+        for (size_t i = 0; i < sizeof(expected); i++) {
+            difference |= expected[i] ^ tag[i];
+        }
+        if (difference != 0) {
+            return false;
+        }
+    }
+
+    // The checksum still covers the packet as received
+    packet->header.flags &= static_cast<uint8_t>(~(protocol::FLAG_ENCRYPTED |
+                                                   protocol::FLAG_AUTHENTICATED));
+    packet->header.payload_length = static_cast<uint16_t>(length);
+    return true;
+}
+
+const char* session_cipher_mode_to_string(SessionCipher::Mode mode) {
+    switch (mode) {
+        case SessionCipher::Mode::ENCRYPT: return "ccm";
+        case SessionCipher::Mode::AUTHENTICATE: return "hmac";
+        default: return "unknown";
+    }
+}
+
+bool session_cipher_mode_from_string(const char* name, SessionCipher::Mode* mode) {
+    static const SessionCipher::Mode modes[] = {
+        SessionCipher::Mode::ENCRYPT, SessionCipher::Mode::AUTHENTICATE
+    };
+    for (SessionCipher::Mode candidate : modes) {
+        if (strcmp(name, session_cipher_mode_to_string(candidate)) == 0) {
+            *mode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace common
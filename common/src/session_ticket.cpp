@@ -0,0 +1,148 @@
+#include "session_ticket.h"
+#include "sha256.h"
+#include "secure_zero.h"
+#include <algorithm>
+#include <cstring>
+
+namespace common {
+
+namespace {
+
+constexpr char RESUME_REQUEST_LABEL[] = "resume request";
+constexpr char RESUME_RESPONSE_LABEL[] = "resume response";
+constexpr char RESUME_KEY_INFO[] = "wireless-audio resume key";
+
+bool expired(const SessionTicket& ticket, uint64_t now) {
+    return ticket.expires_us <= now;
+}
+
+} // namespace
+
+TicketStore::TicketStore(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 1)) {
+    tickets_.reserve(capacity_);
+}
+
+TicketStore::~TicketStore() {
+    clear();
+}
+
+void TicketStore::store(const SessionTicket& ticket) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (SessionTicket& existing : tickets_) {
+        if (memcmp(existing.id, ticket.id, sizeof(ticket.id)) == 0) {
+            existing = ticket;
+            return;
+        }
+    }
+    if (tickets_.size() < capacity_) {
+        tickets_.push_back(ticket);
+        return;
+    }
+    auto oldest = std::min_element(tickets_.begin(), tickets_.end(),
+        [](const SessionTicket& a, const SessionTicket& b) { return a.expires_us < b.expires_us; });
+    *oldest = ticket;
+}
+
+bool TicketStore::find(const uint8_t* id, SessionTicket* ticket) const {
+    uint64_t now = protocol::get_timestamp_us();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const SessionTicket& existing : tickets_) {
+        if (memcmp(existing.id, id, sizeof(existing.id)) == 0) {
+            if (expired(existing, now)) {
+                return false;
+            }
+            *ticket = existing;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TicketStore::find_device(const uint8_t* device_id, SessionTicket* ticket) const {
+    uint64_t now = protocol::get_timestamp_us();
+    std::lock_guard<std::mutex> lock(mutex_);
+    const SessionTicket* newest = nullptr;
+    for (const SessionTicket& existing : tickets_) {
+        if (memcmp(existing.device_id, device_id, sizeof(existing.device_id)) == 0 &&
+            !expired(existing, now) && (!newest || existing.expires_us > newest->expires_us)) {
+            newest = &existing;
+        }
+    }
+    if (newest) {
+        *ticket = *newest;
+    }
+    return newest != nullptr;
+}
+
+void TicketStore::erase(const uint8_t* id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < tickets_.size(); i++) {
+        if (memcmp(tickets_[i].id, id, sizeof(tickets_[i].id)) == 0) {
+            secure_zero(tickets_[i].session_key, sizeof(tickets_[i].session_key));
+            tickets_[i] = tickets_.back();
+            tickets_.pop_back();
+            return;
+        }
+    }
+}
+
+void TicketStore::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (SessionTicket& ticket : tickets_) {
+        secure_zero(ticket.session_key, sizeof(ticket.session_key));
+    }
+    tickets_.clear();
+}
+
+size_t TicketStore::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tickets_.size();
+}
+
+void resume_request_mac(const uint8_t* key, const protocol::ResumeRequestPayload& request,
+                        uint8_t* mac) {
+    HmacSha256 hmac(key, protocol::SESSION_KEY_SIZE);
+    Sha256 inner = hmac.start();
+    inner.update(reinterpret_cast<const uint8_t*>(RESUME_REQUEST_LABEL),
+                 sizeof(RESUME_REQUEST_LABEL) - 1);
+    inner.update(reinterpret_cast<const uint8_t*>(&request),
+                 offsetof(protocol::ResumeRequestPayload, mac));
+    hmac.finish(&inner, mac, protocol::RESUME_MAC_SIZE);
+}
+
+void resume_response_mac(const uint8_t* key, const uint8_t* request_nonce,
+                         const protocol::ResumeResponsePayload& response, uint8_t* mac) {
+    HmacSha256 hmac(key, protocol::SESSION_KEY_SIZE);
+    Sha256 inner = hmac.start();
+    inner.update(reinterpret_cast<const uint8_t*>(RESUME_RESPONSE_LABEL),
+                 sizeof(RESUME_RESPONSE_LABEL) - 1);
+    inner.update(request_nonce, protocol::RESUME_NONCE_SIZE);
+    inner.update(reinterpret_cast<const uint8_t*>(&response),
+                 offsetof(protocol::ResumeResponsePayload, mac));
+    hmac.finish(&inner, mac, protocol::RESUME_MAC_SIZE);
+}
+
+bool resume_mac_equal(const uint8_t* a, const uint8_t* b) {
+    uint8_t difference = 0;
+    for (size_t i = 0; i < protocol::RESUME_MAC_SIZE; i++) {
+        difference |= a[i] ^ b[i];
+    }
+    return difference == 0;
+}
+
+void derive_resumed_key(const uint8_t* session_key, const uint8_t* host_nonce,
+                        const uint8_t* accessory_nonce, uint8_t* key) {
+    uint8_t salt[2 * protocol::RESUME_NONCE_SIZE];
+    memcpy(salt, host_nonce, protocol::RESUME_NONCE_SIZE);
+    memcpy(salt + protocol::RESUME_NONCE_SIZE, accessory_nonce, protocol::RESUME_NONCE_SIZE);
+    uint8_t derived[protocol::SESSION_KEY_SIZE];
+    hkdf_sha256(salt, sizeof(salt), session_key, protocol::SESSION_KEY_SIZE,
+                reinterpret_cast<const uint8_t*>(RESUME_KEY_INFO), sizeof(RESUME_KEY_INFO) - 1,
+                derived, sizeof(derived));
+    // key may alias session_key
+    memcpy(key, derived, sizeof(derived));
+    secure_zero(derived, sizeof(derived));
+}
+
+} // namespace common
@@ -0,0 +1,372 @@
+#include "sha256.h"
+#include "secure_zero.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#include <cpuid.h>
+#define SHA256_X86_DISPATCH 1
+#endif
+
+namespace common {
+
+namespace {
+
+constexpr uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+constexpr uint32_t INITIAL_STATE[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+inline uint32_t load_be32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+inline void store_be32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+// ---------------------------------------------------------------------------
+// Block compression
+
+void compress_portable(uint32_t* state, const uint8_t* blocks, size_t count) {
+    uint32_t w[64];
+    for (size_t block = 0; block < count; block++, blocks += Sha256::BLOCK_SIZE) {
+        for (size_t t = 0; t < 16; t++) {
+            w[t] = load_be32(blocks + 4 * t);
+        }
+        for (size_t t = 16; t < 64; t++) {
+            uint32_t s0 = rotr(w[t - 15], 7) ^ rotr(w[t - 15], 18) ^ (w[t - 15] >> 3);
+            uint32_t s1 = rotr(w[t - 2], 17) ^ rotr(w[t - 2], 19) ^ (w[t - 2] >> 10);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (size_t t = 0; t < 64; t++) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) +
+                          K[t] + w[t];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+    secure_zero(w, sizeof(w));
+}
+
+#if defined(SHA256_X86_DISPATCH)
+
+// SHA extensions: the state is held as ABEF and CDGH, and each
+// sha256rnds2 runs two rounds. Message words are scheduled four at a time
+// in a ring of four vectors.
+__attribute__((target("sha,sse4.1,ssse3")))
+void compress_sha_ni(uint32_t* state, const uint8_t* blocks, size_t count) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bll, 0x0405060700010203ll);
+
+    __m128i dcba = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state));
+    __m128i hgfe = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4));
+    __m128i cdab = _mm_shuffle_epi32(dcba, 0xB1);
+    __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1B);
+    __m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+    __m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xF0);
+
+    for (size_t block = 0; block < count; block++, blocks += Sha256::BLOCK_SIZE) {
+        const __m128i abef_saved = abef;
+        const __m128i cdgh_saved = cdgh;
+        __m128i w[4];
+
+        for (size_t i = 0; i < 16; i++) {
+            __m128i& current = w[i % 4];
+            if (i < 4) {
+                current = _mm_shuffle_epi8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16 * i)), byte_swap);
+            } else {
+                // W[t-16] + s0(W[t-15]) + W[t-7] + s1(W[t-2]); current holds W[i-4]
+                const __m128i& previous = w[(i + 3) % 4];
+                __m128i t = _mm_sha256msg1_epu32(current, w[(i + 1) % 4]);
+                t = _mm_add_epi32(t, _mm_alignr_epi8(previous, w[(i + 2) % 4], 4));
+                current = _mm_sha256msg2_epu32(t, previous);
+            }
+            __m128i message = _mm_add_epi32(
+                current, _mm_loadu_si128(reinterpret_cast<const __m128i*>(K + 4 * i)));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, message);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(message, 0x0E));
+        }
+
+        abef = _mm_add_epi32(abef, abef_saved);
+        cdgh = _mm_add_epi32(cdgh, cdgh_saved);
+    }
+
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_blend_epi16(feba, dchg, 0xF0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(dchg, feba, 8));
+}
+
+#endif
+
+using CompressFunction = void (*)(uint32_t* state, const uint8_t* blocks, size_t count);
+
+struct Sha256Implementation {
+    CompressFunction compress;
+    const char* name;
+};
+
+constexpr Sha256Implementation PORTABLE = {compress_portable, "portable"};
+
+Sha256Implementation detect_hardware() {
+#if defined(SHA256_X86_DISPATCH)
+    // __builtin_cpu_supports() has no "sha" in older compilers: CPUID leaf 7
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3") &&
+        __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 29))) {
+        return {compress_sha_ni, "sha-ni"};
+    }
+#endif
+    return PORTABLE;
+}
+
+const Sha256Implementation& hardware_implementation() {
+    static const Sha256Implementation implementation = detect_hardware();
+    return implementation;
+}
+
+std::atomic<bool> g_hardware_enabled(true);
+
+const Sha256Implementation& active_implementation() {
+    if (!g_hardware_enabled.load(std::memory_order_relaxed)) {
+        return PORTABLE;
+    }
+    return hardware_implementation();
+}
+
+} // namespace
+
+const char* sha256_implementation() {
+    return active_implementation().name;
+}
+
+void sha256_set_hardware(bool enabled) {
+    g_hardware_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// Sha256
+
+Sha256::Sha256() {
+    reset();
+}
+
+void Sha256::reset() {
+    memcpy(state_, INITIAL_STATE, sizeof(state_));
+    buffered_ = 0;
+    length_ = 0;
+}
+
+void Sha256::compress(const uint8_t* blocks, size_t count) {
+    if (count > 0) {
+        active_implementation().compress(state_, blocks, count);
+    }
+}
+
+void Sha256::update(const uint8_t* data, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    length_ += length;
+    if (buffered_ > 0) {
+        size_t take = std::min(length, BLOCK_SIZE - buffered_);
+        memcpy(buffer_ + buffered_, data, take);
+        buffered_ += take;
+        data += take;
+        length -= take;
+        if (buffered_ < BLOCK_SIZE) {
+            return;
+        }
+        compress(buffer_, 1);
+        buffered_ = 0;
+    }
+    size_t blocks = length / BLOCK_SIZE;
+    compress(data, blocks);
+    data += blocks * BLOCK_SIZE;
+    length -= blocks * BLOCK_SIZE;
+    memcpy(buffer_, data, length);
+    buffered_ = length;
+}
+
+void Sha256::finish(uint8_t* digest) {
+    // Padding: 0x80, zeros, then the bit length in the last 8 bytes
+    uint64_t bits = length_ * 8;
+    buffer_[buffered_++] = 0x80;
+    if (buffered_ > BLOCK_SIZE - 8) {
+        memset(buffer_ + buffered_, 0, BLOCK_SIZE - buffered_);
+        compress(buffer_, 1);
+        buffered_ = 0;
+    }
+    memset(buffer_ + buffered_, 0, BLOCK_SIZE - 8 - buffered_);
+    for (size_t i = 0; i < 8; i++) {
+        buffer_[BLOCK_SIZE - 1 - i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+    compress(buffer_, 1);
+
+    for (size_t i = 0; i < 8; i++) {
+        store_be32(digest + 4 * i, state_[i]);
+    }
+    secure_zero(buffer_, sizeof(buffer_));
+    buffered_ = 0;
+}
+
+void Sha256::hash(const uint8_t* data, size_t length, uint8_t* digest) {
+    Sha256 sha;
+    sha.update(data, length);
+    sha.finish(digest);
+}
+
+// ---------------------------------------------------------------------------
+// HMAC and HKDF
+
+HmacSha256::HmacSha256() {
+    set_key(nullptr, 0);
+}
+
+HmacSha256::HmacSha256(const uint8_t* key, size_t key_length) {
+    set_key(key, key_length);
+}
+
+HmacSha256::~HmacSha256() {
+    secure_zero(&inner_, sizeof(inner_));
+    secure_zero(&outer_, sizeof(outer_));
+}
+
+void HmacSha256::set_key(const uint8_t* key, size_t key_length) {
+    // Keys longer than a block are hashed first
+    uint8_t pad[Sha256::BLOCK_SIZE] = {};
+    if (key_length > Sha256::BLOCK_SIZE) {
+        Sha256::hash(key, key_length, pad);
+    } else if (key_length > 0) {
+        memcpy(pad, key, key_length);
+    }
+
+    for (uint8_t& byte : pad) {
+        byte ^= 0x36;
+    }
+    inner_.reset();
+    inner_.update(pad, sizeof(pad));
+    for (uint8_t& byte : pad) {
+        byte ^= 0x36 ^ 0x5c;
+    }
+    outer_.reset();
+    outer_.update(pad, sizeof(pad));
+    secure_zero(pad, sizeof(pad));
+}
+
+void HmacSha256::finish(Sha256* inner, uint8_t* tag, size_t tag_size) const {
+    uint8_t digest[Sha256::DIGEST_SIZE];
+    inner->finish(digest);
+    Sha256 outer = outer_;
+    outer.update(digest, sizeof(digest));
+    outer.finish(digest);
+    memcpy(tag, digest, std::min(tag_size, sizeof(digest)));
+    secure_zero(digest, sizeof(digest));
+}
+
+void HmacSha256::sign(const uint8_t* data, size_t length, uint8_t* tag, size_t tag_size) const {
+    Sha256 inner = inner_;
+    inner.update(data, length);
+    finish(&inner, tag, tag_size);
+}
+
+bool HmacSha256::verify(const uint8_t* data, size_t length, const uint8_t* tag,
+                        size_t tag_size) const {
+    if (tag_size == 0 || tag_size > Sha256::DIGEST_SIZE) {
+        return false;
+    }
+    uint8_t expected[Sha256::DIGEST_SIZE];
+    sign(data, length, expected, tag_size);
+    uint8_t difference = 0;
+    for (size_t i = 0; i < tag_size; i++) {
+        difference |= expected[i] ^ tag[i];
+    }
+    return difference == 0;
+}
+
+void hmac_sha256(const uint8_t* key, size_t key_length, const uint8_t* data, size_t length,
+                 uint8_t* mac) {
+    HmacSha256(key, key_length).sign(data, length, mac, Sha256::DIGEST_SIZE);
+}
+
+bool hkdf_sha256(const uint8_t* salt, size_t salt_length, const uint8_t* ikm, size_t ikm_length,
+                 const uint8_t* info, size_t info_length, uint8_t* out, size_t length) {
+    if (length > 255 * Sha256::DIGEST_SIZE) {
+        return false;
+    }
+
+    // Extract: PRK = HMAC(salt, IKM); a missing salt is a block of zeros
+    const uint8_t zero_salt[Sha256::DIGEST_SIZE] = {};
+    if (!salt) {
+        salt = zero_salt;
+        salt_length = sizeof(zero_salt);
+    }
+    uint8_t prk[Sha256::DIGEST_SIZE];
+    hmac_sha256(salt, salt_length, ikm, ikm_length, prk);
+
+    // Expand: T(i) = HMAC(PRK, T(i-1) | info | i)
+    HmacSha256 expand(prk, sizeof(prk));
+    uint8_t block[Sha256::DIGEST_SIZE];
+    size_t done = 0;
+    for (uint8_t counter = 1; done < length; counter++) {
+        Sha256 inner = expand.start();
+        if (counter > 1) {
+            inner.update(block, sizeof(block));
+        }
+        if (info) {
+            inner.update(info, info_length);
+        }
+        inner.update(&counter, 1);
+        expand.finish(&inner, block, sizeof(block));
+
+        size_t take = std::min(length - done, sizeof(block));
+        memcpy(out + done, block, take);
+        done += take;
+    }
+
+    secure_zero(prk, sizeof(prk));
+    secure_zero(block, sizeof(block));
+    return true;
+}
+
+} // namespace common
@@ -0,0 +1,434 @@
+#include "timer_wheel.h"
+#include <chrono>
+#include <cstring>
+
+namespace common {
+
+TimerWheel::TimerWheel(uint32_t tick_us)
+    : tick_us_(tick_us > 0 ? tick_us : DEFAULT_TICK_US)
+    , origin_us_(0)
+    , current_tick_(0)
+    , free_head_(NIL)
+    , running_(false) {
+
+    for (auto& level : slots_) {
+        for (auto& slot : level) {
+            slot = NIL;
+        }
+    }
+    memset(&stats_, 0, sizeof(stats_));
+    origin_us_ = now_us();
+}
+
+TimerWheel::~TimerWheel() {
+    stop();
+}
+
+void TimerWheel::start(size_t num_workers) {
+    if (running_.load()) {
+        return;
+    }
+
+    if (num_workers == 0) {
+        num_workers = 1;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Resume from wall time so a restart does not replay idle ticks
+        uint64_t tick = us_to_tick(now_us());
+        while (current_tick_ < tick) {
+            expire_tick(current_tick_);
+            current_tick_++;
+        }
+    }
+
+    running_.store(true);
+    tick_thread_ = std::thread(&TimerWheel::tick_loop, this);
+    for (size_t i = 0; i < num_workers; i++) {
+        workers_.emplace_back(&TimerWheel::worker_loop, this);
+    }
+}
+
+void TimerWheel::stop() {
+    if (!running_.load()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_.store(false);
+    }
+    run_cv_.notify_all();
+
+    if (tick_thread_.joinable()) {
+        tick_thread_.join();
+    }
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers_.clear();
+    done_cv_.notify_all();
+}
+
+void TimerWheel::set_pacer(PacerStrategy strategy, uint32_t spin_us) {
+    pacer_.configure(strategy, spin_us);
+}
+
+TimerWheel::TimerId TimerWheel::schedule_after(uint64_t delay_us, Callback callback) {
+    return schedule(delay_us, 0, std::move(callback));
+}
+
+TimerWheel::TimerId TimerWheel::schedule_periodic(uint64_t interval_us, Callback callback,
+                                                  uint64_t first_delay_us) {
+    if (interval_us == 0) {
+        interval_us = tick_us_;
+    }
+    if (first_delay_us == UINT64_MAX) {
+        first_delay_us = interval_us;
+    }
+    return schedule(first_delay_us, interval_us, std::move(callback));
+}
+
+TimerWheel::TimerId TimerWheel::schedule(uint64_t delay_us, uint64_t interval_us, Callback callback) {
+    uint64_t deadline = now_us() + delay_us;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint32_t index = allocate_node();
+    Node& node = nodes_[index];
+    node.callback = std::move(callback);
+    node.deadline_us = deadline;
+    node.interval_us = interval_us;
+    node.expires_tick = us_to_tick(deadline);
+    node.state = NodeState::PENDING;
+    node.posted = false;
+    insert_node(index);
+
+    stats_.timers_scheduled++;
+    return (static_cast<uint64_t>(node.generation) << 32) | index;
+}
+
+bool TimerWheel::post(Callback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_.load()) {
+        return false;
+    }
+
+    uint32_t index = allocate_node();
+    Node& node = nodes_[index];
+    node.callback = std::move(callback);
+    node.deadline_us = 0;
+    node.interval_us = 0;
+    node.expires_tick = 0;
+    node.state = NodeState::QUEUED;
+    node.posted = true;
+    run_queue_.push_back(index);
+    run_cv_.notify_one();
+    return true;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    if (id == INVALID_TIMER) {
+        return false;
+    }
+
+    uint32_t index = static_cast<uint32_t>(id & 0xFFFFFFFFu);
+    uint32_t generation = static_cast<uint32_t>(id >> 32);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (index >= nodes_.size() || nodes_[index].generation != generation) {
+        return false;
+    }
+
+    Node& node = nodes_[index];
+    bool cancelled = true;
+
+    switch (node.state) {
+        case NodeState::PENDING:
+            unlink_node(index);
+            release_node(index);
+            stats_.timers_cancelled++;
+            return true;
+
+        case NodeState::QUEUED:
+            // The worker that dequeues it will release the node
+            node.state = NodeState::CANCELLED;
+            stats_.timers_cancelled++;
+            return true;
+
+        case NodeState::RUNNING:
+            node.state = NodeState::CANCELLED;
+            stats_.timers_cancelled++;
+            break;
+
+        case NodeState::CANCELLED:
+            cancelled = false;
+            break;
+
+        default:
+            return false;
+    }
+
+    // Cancelling from inside the callback itself must not wait on itself
+    if (nodes_[index].runner != std::this_thread::get_id()) {
+        done_cv_.wait(lock, [this, index, generation] {
+            return nodes_[index].generation != generation || !running_.load();
+        });
+    }
+
+    return cancelled;
+}
+
+TimerWheel::Stats TimerWheel::get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+TimingHistogram TimerWheel::get_dispatch_histogram() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dispatch_error_;
+}
+
+uint32_t TimerWheel::allocate_node() {
+    uint32_t index;
+    if (free_head_ != NIL) {
+        index = free_head_;
+        free_head_ = nodes_[index].next;
+    } else {
+        index = static_cast<uint32_t>(nodes_.size());
+        nodes_.emplace_back();
+        nodes_[index].generation = 0;
+    }
+
+    Node& node = nodes_[index];
+    node.generation++;
+    if (node.generation == 0) {
+        node.generation = 1;  // Keep TimerId non-zero
+    }
+    node.prev = NIL;
+    node.next = NIL;
+    node.runner = std::thread::id();
+    stats_.active_timers++;
+    return index;
+}
+
+void TimerWheel::release_node(uint32_t index) {
+    Node& node = nodes_[index];
+    node.callback = nullptr;
+    node.state = NodeState::FREE;
+    node.generation++;
+    node.runner = std::thread::id();
+    node.prev = NIL;
+    node.next = free_head_;
+    free_head_ = index;
+    stats_.active_timers--;
+}
+
+void TimerWheel::insert_node(uint32_t index) {
+    Node& node = nodes_[index];
+
+    if (node.expires_tick < current_tick_) {
+        // Already due - hand straight to the workers
+        node.state = NodeState::QUEUED;
+        run_queue_.push_back(index);
+        run_cv_.notify_one();
+        return;
+    }
+
+    uint64_t delta = node.expires_tick - current_tick_;
+    uint64_t expires = node.expires_tick;
+
+    unsigned level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (1ull << (WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+
+    constexpr uint64_t max_delta = (1ull << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+    if (delta > max_delta) {
+        // Park beyond-range timers in the furthest slot; cascade re-files them
+        expires = current_tick_ + max_delta;
+    }
+
+    unsigned slot = static_cast<unsigned>((expires >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    uint32_t& head = slots_[level][slot];
+
+    node.state = NodeState::PENDING;
+    node.prev = NIL;
+    node.next = head;
+    if (head != NIL) {
+        nodes_[head].prev = index;
+    }
+    head = index;
+    node.slot = static_cast<uint16_t>((level << WHEEL_BITS) | slot);
+}
+
+void TimerWheel::unlink_node(uint32_t index) {
+    Node& node = nodes_[index];
+    unsigned level = node.slot >> WHEEL_BITS;
+    unsigned slot = node.slot & WHEEL_MASK;
+
+    if (node.prev != NIL) {
+        nodes_[node.prev].next = node.next;
+    } else {
+        slots_[level][slot] = node.next;
+    }
+    if (node.next != NIL) {
+        nodes_[node.next].prev = node.prev;
+    }
+    node.prev = NIL;
+    node.next = NIL;
+}
+
+void TimerWheel::cascade(unsigned level, unsigned slot) {
+    uint32_t index = slots_[level][slot];
+    slots_[level][slot] = NIL;
+    stats_.cascades++;
+
+    while (index != NIL) {
+        uint32_t next = nodes_[index].next;
+        insert_node(index);
+        index = next;
+    }
+}
+
+void TimerWheel::expire_tick(uint64_t tick) {
+    // Cascade higher levels down whenever the lower level wraps
+    for (unsigned level = 1; level < WHEEL_LEVELS; level++) {
+        if ((tick & ((1ull << (WHEEL_BITS * level)) - 1)) != 0) {
+            break;
+        }
+        cascade(level, static_cast<unsigned>((tick >> (WHEEL_BITS * level)) & WHEEL_MASK));
+    }
+
+    unsigned slot = static_cast<unsigned>(tick & WHEEL_MASK);
+    uint32_t index = slots_[0][slot];
+    slots_[0][slot] = NIL;
+
+    while (index != NIL) {
+        uint32_t next = nodes_[index].next;
+        Node& node = nodes_[index];
+        if (node.expires_tick <= tick) {
+            node.state = NodeState::QUEUED;
+            node.prev = NIL;
+            node.next = NIL;
+            run_queue_.push_back(index);
+        } else {
+            insert_node(index);
+        }
+        index = next;
+    }
+
+    if (!run_queue_.empty()) {
+        run_cv_.notify_all();
+    }
+}
+
+uint64_t TimerWheel::now_us() const {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+uint64_t TimerWheel::us_to_tick(uint64_t us) const {
+    if (us <= origin_us_) {
+        return 0;
+    }
+    // Round up so a timer never fires before its deadline
+    return (us - origin_us_ + tick_us_ - 1) / tick_us_;
+}
+
+uint64_t TimerWheel::elapsed_ticks(uint64_t us) const {
+    // Ticks whose time has fully arrived
+    return us <= origin_us_ ? 0 : (us - origin_us_) / tick_us_;
+}
+
+void TimerWheel::tick_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (running_.load()) {
+        // Ticks past the one we woke for were late and run in a batch
+        uint64_t target = elapsed_ticks(now_us());
+        if (target > current_tick_) {
+            pacer_.record_skipped(target - current_tick_);
+        }
+        while (current_tick_ <= target) {
+            expire_tick(current_tick_);
+            current_tick_++;
+        }
+
+        // Wait unlocked; stop() is noticed within a tick
+        uint64_t next_tick_us = origin_us_ + current_tick_ * tick_us_;
+        lock.unlock();
+        pacer_.wait_until(next_tick_us);
+        lock.lock();
+    }
+}
+
+void TimerWheel::worker_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        run_cv_.wait(lock, [this] {
+            return !run_queue_.empty() || !running_.load();
+        });
+
+        if (!running_.load()) {
+            break;
+        }
+
+        uint32_t index = run_queue_.front();
+        run_queue_.pop_front();
+
+        if (nodes_[index].state == NodeState::CANCELLED) {
+            release_node(index);
+            done_cv_.notify_all();
+            continue;
+        }
+
+        // Move the callback out: nodes_ may reallocate while we run unlocked
+        Callback callback = std::move(nodes_[index].callback);
+        nodes_[index].state = NodeState::RUNNING;
+        nodes_[index].runner = std::this_thread::get_id();
+
+        if (!nodes_[index].posted) {
+            uint64_t start = now_us();
+            uint64_t deadline = nodes_[index].deadline_us;
+            if (start > deadline && start - deadline > stats_.max_dispatch_delay_us) {
+                stats_.max_dispatch_delay_us = start - deadline;
+            }
+            // Against the tick it was due on: wake-up plus hand-off latency,
+            // without the wheel's rounding of deadlines to ticks
+            uint64_t due = origin_us_ + nodes_[index].expires_tick * tick_us_;
+            dispatch_error_.record(start > due ? start - due : 0);
+            stats_.timers_fired++;
+        }
+
+        lock.unlock();
+        callback();
+        lock.lock();
+
+        Node& node = nodes_[index];
+        node.runner = std::thread::id();
+
+        if (node.state == NodeState::CANCELLED || node.interval_us == 0) {
+            release_node(index);
+            done_cv_.notify_all();
+            continue;
+        }
+
+        // Fixed-rate reschedule; skip deadlines we have already missed
+        node.deadline_us += node.interval_us;
+        uint64_t now = now_us();
+        if (node.deadline_us <= now) {
+            uint64_t missed = (now - node.deadline_us) / node.interval_us + 1;
+            node.deadline_us += missed * node.interval_us;
+            stats_.ticks_skipped += missed;
+        }
+        node.callback = std::move(callback);
+        node.expires_tick = us_to_tick(node.deadline_us);
+        insert_node(index);
+    }
+}
+
+} // namespace common
@@ -2,28 +2,36 @@
 #define HOST_AUDIO_SYNC_H
 
 #include "protocol.h"
+#include "timer_wheel.h"
+#include "latency_trace.h"
+#include "audio_codec.h"
+#include "session_cipher.h"
 #include <atomic>
-#include <thread>
-#include <queue>
 #include <mutex>
-#include <condition_variable>
 #include <map>
+#include <memory>
+#include <vector>
 
 namespace host {
 
 class Transport;
+class ClockSync;
 
-struct AudioPacketInfo {
-    uint32_t sequence;
-    uint32_t stream_timestamp;
+// One decoded frame; a packet may carry several
+struct AudioFrameInfo {
+    uint32_t sequence;                  // Of the packet that carried it
+    bool first_in_packet;
+    uint64_t sample_position;
+    uint64_t stream_timestamp;
     uint64_t received_timestamp_us;
-    uint16_t sample_count;
-    std::vector<uint8_t> audio_data;
+    uint16_t sample_count;              // Media clock samples
+    protocol::StreamFormat format;
+    std::vector<uint8_t> audio_data;    // Decoded, interleaved SampleTraits<format>::Type
 };
 
 class AudioSync {
 public:
-    explicit AudioSync(Transport* transport);
+    AudioSync(Transport* transport, common::TimerWheel* scheduler);
     ~AudioSync();
     
     // Synchronization control
@@ -31,47 +39,220 @@ public:
     void stop();
     bool is_running() const { return running_.load(); }
     
-    // Packet handling
-    void on_audio_packet(const protocol::Packet& packet);
+    // Packet handling. Audio is decrypted in place in the receive buffer.
+    void on_audio_packet(protocol::Packet& packet);
+    void on_fec_packet(const protocol::Packet& packet);
     
-    // Buffer configuration
-    void set_jitter_buffer_size(uint8_t packets);
-    uint8_t get_jitter_buffer_size() const { return jitter_buffer_size_.load(); }
+    // Buffer configuration. The target depth is in samples, so it means the
+    // same latency at any frame duration. It never drops below one packet
+    // plus one frame, or aggregated packets would underrun between arrivals.
+    void set_jitter_buffer_samples(uint32_t samples);
+    uint32_t get_jitter_buffer_samples() const { return jitter_buffer_samples_.load(); }
+    
+    // Session key agreed at pairing (nullptr: none). With a key, audio must
+    // arrive sealed (FLAG_ENCRYPTED or FLAG_AUTHENTICATED) and is
+    // authenticated, and decrypted if need be, before decoding; packets that
+    // fail are dropped. Without one, sealed packets are dropped. Set before
+    // start().
+    void set_session_key(const uint8_t* key) { cipher_.set_key(key); }
+    
+    // Optional per-frame audio path tracing (nullptr disables)
+    void set_latency_trace(common::LatencyTrace* trace) { latency_trace_ = trace; }
+    
+    // Optional accessory clock mapping for one-way latency and playout
+    // aligned to capture time (nullptr: buffer-fill playout only)
+    void set_clock_sync(const ClockSync* clock_sync) { clock_sync_ = clock_sync; }
+    
+    // Selective retransmission: sequence gaps are NACKed (AUDIO_RETRANSMIT)
+    // while the missing audio can still arrive one round trip before its
+    // playout slot. Enabled by default.
+    void set_retransmission_enabled(bool enabled) { retransmission_enabled_.store(enabled); }
+    
+    // Forward error correction (NONE by default). Parity lets lost packets
+    // be rebuilt without a round trip; the host picks the group size and
+    // parity count from the loss rate it observes, keeping groups short
+    // enough that parity arrives within the jitter buffer target, and sends
+    // them to the accessory (AUDIO_FEC_CONFIG).
+    void set_fec_scheme(protocol::FecScheme scheme);
+    
+    // Acknowledgements for packets sent with FLAG_ACK_REQUIRED are batched:
+    // one AUDIO_ACK per `frames` audio frames, or after `interval_us` if
+    // fewer arrive. The accessory derives RTT and loss from them.
+    void set_ack_batch(uint32_t frames, uint32_t interval_us);
     
     // Statistics
     struct Stats {
         uint64_t packets_received;
-        uint64_t packets_played;
-        uint64_t packets_dropped;
-        uint64_t packets_late;
+        uint64_t frames_received;
+        uint64_t frames_played;
+        uint64_t frames_lost;               // Missing at their playout slot
+        uint64_t frames_late;               // Arrived after their playout slot
+        uint64_t samples_played;
+        uint64_t samples_lost;
         uint64_t buffer_underruns;
+        uint64_t stalls;                    // No audio for a while; rebuffered
+        uint16_t frame_samples;             // Of the last packet
+        uint8_t frames_per_packet;          // Of the last packet
+        protocol::StreamFormat stream_format;   // Of the last packet
+        // Sink level meter: peak of each channel over the last ~second of
+        // playout, as a fraction of full scale
+        float channel_peaks[protocol::MAX_AUDIO_CHANNELS];
+        // Transit delay above the fastest packet seen. Host and accessory
+        // clocks have unrelated origins, so this is queueing/jitter delay,
+        // not absolute one-way latency (e2e_bench measures that in-process).
         uint32_t current_latency_ms;
         uint32_t avg_latency_ms;
         uint32_t max_latency_ms;
+        // Accessory capture to host receive; only valid once the clock is
+        // synchronized
+        uint32_t one_way_latency_us;
+        uint32_t avg_one_way_latency_us;    // EWMA
+        uint32_t max_one_way_latency_us;
+        bool clock_synchronized;
+        bool playout_aligned;               // Playout tied to capture time
+        // Codec
+        uint64_t audio_bytes_received;      // Encoded audio, excluding headers
+        uint64_t decode_errors;             // Unknown encoding or malformed data
+        protocol::AudioEncoding encoding;   // Of the last packet
+        // Retransmission
+        uint64_t nack_packets_sent;
+        uint64_t retransmits_requested;     // Missing packets NACKed
+        uint64_t retransmits_recovered;     // Resent in time for playout
+        uint64_t retransmits_unrecoverable; // Played out (concealed) first
+        // Forward error correction
+        double loss_rate;                   // First transmissions, last window
+        protocol::FecScheme fec_scheme;     // Requested from the accessory
+        uint8_t fec_data_count;
+        uint8_t fec_parity_count;
+        uint64_t fec_packets_received;
+        uint64_t fec_packets_recovered;     // Rebuilt in time for playout
+        uint64_t fec_packets_late;          // Rebuilt after their playout slot
+        uint64_t fec_groups_failed;         // More losses than parity
+        uint64_t acks_sent;
+        uint64_t packets_decrypted;
+        uint64_t decrypt_failures;          // Bad tag, or sealed state not as keyed
     };
     
     Stats get_stats() const;
     
 private:
-    void sync_loop();
-    void play_audio_packet(const AudioPacketInfo& packet_info);
-    void handle_packet_loss(uint32_t lost_sequence);
+    void start_playout_clock(uint64_t capture_time_us, uint64_t now_us, uint16_t frame_samples);
+    bool open_packet(protocol::Packet* packet);
+    void process_audio_packet(const protocol::Packet& packet, bool fec_recovered);
+    bool decode_frames(const protocol::Packet& packet, const protocol::AudioPayload& audio_payload,
+                       uint64_t received_time, std::vector<AudioFrameInfo>* frames);
+    uint32_t target_depth_samples() const;
+    void playout_tick();
+    void advance_playout(uint64_t now);
+    bool play_next_frame(uint64_t now);
+    void play_audio_frame(const AudioFrameInfo& frame);
+    void meter_frame(const AudioFrameInfo& frame);
+    void handle_frame_loss(uint64_t lost_position, uint16_t samples);
     void adjust_buffer_size();
+    void request_retransmits(uint32_t sequence, uint64_t sample_position, uint64_t now,
+                             std::vector<uint32_t>* nacks);
+    void retry_retransmits(uint64_t now, std::vector<uint32_t>* nacks);
+    bool before_deadline(uint64_t sample_position, uint64_t now) const;
+    void send_nack(const std::vector<uint32_t>& sequences);
+    bool record_ack(const protocol::Packet& packet, size_t frames, uint64_t now,
+                    protocol::AckPayload* ack);
+    void build_ack(uint64_t now, protocol::AckPayload* ack);
+    void send_ack(const protocol::AckPayload& ack);
+    bool update_loss_window(uint64_t now, protocol::FecConfigPayload* config);
+    protocol::FecConfigPayload choose_fec_config() const;
+    void send_fec_config(const protocol::FecConfigPayload& config);
+    void store_fec_block(const protocol::Packet& packet);
+    bool recover_fec_group(uint32_t base_sequence, std::vector<protocol::Packet>* recovered);
     
     Transport* transport_;
+    common::TimerWheel* scheduler_;
     std::atomic<bool> running_;
-    std::thread sync_thread_;
+    common::TimerWheel::TimerId playout_timer_;
     
-    // Jitter buffer
-    std::map<uint32_t, AudioPacketInfo> jitter_buffer_;
+    // Jitter buffer of frames keyed by stream sample position. Playout runs
+    // under buffer_mutex_ (stats_mutex_ nests inside it).
+    std::map<uint64_t, AudioFrameInfo> jitter_buffer_;
     std::mutex buffer_mutex_;
-    std::condition_variable buffer_cv_;
-    std::atomic<uint8_t> jitter_buffer_size_;
-    uint32_t next_play_sequence_;
+    std::atomic<uint32_t> jitter_buffer_samples_;   // Target depth
+    uint32_t buffered_samples_;
+    uint64_t next_play_position_;
+    uint64_t playout_origin_us_;                    // Sample clock anchor
+    uint64_t playout_origin_position_;
+    uint16_t frame_samples_;                        // Playout tick length
+    uint32_t packet_samples_;                       // Audio per packet, last seen
+    bool playback_started_;
+    bool playout_aligned_;
+    
+    // Outstanding NACKs by sequence (under buffer_mutex_)
+    struct PendingRetransmit {
+        uint64_t sample_position;       // Estimated from the surrounding packets
+        uint64_t last_request_us;
+        uint32_t attempts;
+    };
+    std::map<uint32_t, PendingRetransmit> pending_retransmits_;
+    std::atomic<bool> retransmission_enabled_;
+    uint32_t highest_sequence_;
+    bool highest_sequence_valid_;
+    std::atomic<uint32_t> nack_sequence_;
+    
+    // Batched ACK state (under buffer_mutex_)
+    std::atomic<uint32_t> ack_batch_frames_;
+    std::atomic<uint32_t> ack_interval_us_;
+    bool ack_valid_;
+    uint32_t ack_highest_;
+    uint32_t ack_bitmap_;
+    uint64_t ack_highest_received_us_;
+    uint32_t ack_packets_received_;
+    uint32_t ack_pending_frames_;
+    uint64_t ack_pending_since_us_;
+    
+    // Loss measurement and FEC configuration (under buffer_mutex_)
+    std::atomic<protocol::FecScheme> fec_scheme_;
+    uint64_t loss_window_start_us_;
+    uint64_t loss_window_expected_;
+    uint64_t loss_window_received_;
+    double loss_rate_;
+    protocol::FecConfigPayload fec_config_;         // Last requested
+    uint64_t fec_config_sent_us_;
+    std::atomic<uint32_t> fec_seen_config_;         // Of the last parity packet
+    
+    // FEC decoding (receive thread, under fec_mutex_). Recent data packets
+    // are kept as protected blocks, slot = sequence % FEC_HISTORY_PACKETS.
+    struct FecGroup {
+        protocol::FecScheme scheme;
+        uint8_t data_count;
+        uint8_t parity_count;
+        uint16_t block_size;
+        uint8_t parity_present[protocol::FEC_MAX_PARITY_PACKETS];
+        std::vector<uint8_t> parity;                // parity_count x block_size
+    };
+    struct FecBlock {
+        bool valid;
+        uint32_t sequence;
+        std::vector<uint8_t> bytes;
+    };
+    std::mutex fec_mutex_;
+    std::map<uint32_t, FecGroup> fec_groups_;       // By base sequence
+    std::vector<FecBlock> fec_history_;
     
     // Timing
     uint64_t stream_start_time_;
     uint64_t last_packet_time_;
+    int64_t transit_base_us_;       // Minimum (receive - stream timestamp)
+    bool transit_base_valid_;
+    
+    // One decoder per encoding, created on first use and re-created when
+    // the stream format changes (receive thread only)
+    std::unique_ptr<common::AudioCodec> decoders_[4];
+    
+    // Level meter window (under buffer_mutex_)
+    float meter_peaks_[protocol::MAX_AUDIO_CHANNELS];
+    uint64_t meter_samples_;
+    
+    const ClockSync* clock_sync_;
+    common::LatencyTrace* latency_trace_;
+    common::SessionCipher cipher_;                  // Receive thread only
+    uint8_t protection_flag_;                       // Of the last packet opened; receive thread
     
     // Statistics
     mutable std::mutex stats_mutex_;
@@ -0,0 +1,107 @@
+#ifndef HOST_BOND_STORE_H
+#define HOST_BOND_STORE_H
+
+#include "protocol.h"
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+namespace host {
+
+// What the host keeps of a paired device across restarts: the key from
+// the last pairing or resume, what the device can do, the stream
+// parameters last agreed, and its session ticket, which lets a restarted
+// host resume the session instead of pairing again. Stored as is.
+#pragma pack(push, 1)
+struct Bond {
+    uint8_t device_id[8];
+    char name[32];
+    uint8_t session_key[protocol::SESSION_KEY_SIZE];
+    uint16_t capabilities;
+    protocol::ConnectPayload params;            // Zero before the first connect
+    uint8_t ticket_id[protocol::TICKET_ID_SIZE];
+    uint64_t ticket_expires_s;                  // Unix time; 0 = no ticket
+    uint64_t paired_s;                          // Unix time of the last pairing
+};
+#pragma pack(pop)
+
+// Bonds in a memory-mapped file laid out as an open-addressing hash table
+// keyed by device id. Opening maps the file and checks its header, with no
+// scan whatever the number of bonds; a lookup reads a slot or two.
+//
+// Each slot holds two copies of its record, each with a sequence number
+// and a checksum. An update overwrites the older copy and leaves the
+// current one alone, so a crash mid-write loses at most that update.
+// Removing a bond leaves a tombstone. When three quarters of the slots are
+// taken the table is rebuilt in a new file, renamed over the old one: at
+// twice the size, or the same size when most are tombstones. Thread-safe.
+class BondStore {
+public:
+    static constexpr uint32_t DEFAULT_SLOTS = 1024;
+
+    struct Stats {
+        uint32_t slots;
+        uint32_t bonds;
+        uint32_t tombstones;
+        uint64_t lookups;
+        uint64_t probes;                // Slots read by lookups and writes
+        uint64_t writes;
+        uint64_t syncs;                 // Writes flushed before returning
+        uint32_t rebuilds;
+        uint32_t damaged_copies;        // Failed their checksum when read (torn writes)
+        uint64_t open_us;               // Time taken by the last open()
+    };
+
+    BondStore();
+    ~BondStore();
+
+    BondStore(const BondStore&) = delete;
+    BondStore& operator=(const BondStore&) = delete;
+
+    // Creates the file (with `slots` rounded up to a power of two) if it
+    // does not exist. A file that is not a bond store is moved aside to
+    // path + ".bad" and a new one created.
+    bool open(const std::string& path, uint32_t slots = DEFAULT_SLOTS);
+    void close();
+    bool is_open() const;
+
+    bool find(const uint8_t* device_id, Bond* bond) const;
+    // Adds or replaces the device's bond. Durable writes are flushed to the
+    // disk before returning (pairing results); others are left to the
+    // kernel's writeback, which survives a crash of this process but not
+    // of the machine.
+    bool put(const Bond& bond, bool durable = true);
+    bool erase(const uint8_t* device_id);
+
+    size_t size() const;
+    Stats get_stats() const;
+
+private:
+    struct Table {
+        uint8_t* base;
+        size_t size;
+        uint32_t slots;
+    };
+
+    bool map_file(const std::string& path);
+    bool create_file(const std::string& path, uint32_t slots, const Table* source);
+    bool rebuild();
+    void unmap();
+    // Slot holding the device (and its bond), or the slot to insert it in
+    // (found false). False when every slot is taken.
+    bool probe(const Table& table, const uint8_t* device_id, uint32_t* slot, bool* found,
+               Bond* bond) const;
+    void write_record(Table& table, uint32_t slot, uint8_t state, const Bond& bond, bool durable);
+    void write_counters(bool durable);
+
+    mutable std::mutex mutex_;
+    std::string path_;
+    Table table_;
+    uint32_t counter_sequence_;
+    mutable Stats stats_;
+};
+
+} // namespace host
+
+#endif // HOST_BOND_STORE_H
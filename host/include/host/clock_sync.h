@@ -0,0 +1,80 @@
+#ifndef HOST_CLOCK_SYNC_H
+#define HOST_CLOCK_SYNC_H
+
+#include "protocol.h"
+#include "timer_wheel.h"
+#include <atomic>
+#include <mutex>
+#include <deque>
+
+namespace host {
+
+class Transport;
+
+// NTP-style clock synchronization with the connected accessory. Each
+// TIME_SYNC round trip yields an offset and a delay sample. Queueing only
+// ever adds delay, so the lowest-delay exchanges are the most symmetric;
+// offset and drift are fitted (least squares) over those samples only.
+class ClockSync {
+public:
+    ClockSync(Transport* transport, common::TimerWheel* scheduler);
+    ~ClockSync();
+
+    // Exchanges run at the keepalive interval after a short start-up burst
+    void start();
+    void stop();
+    bool is_running() const { return running_.load(); }
+
+    // Packet handling
+    void on_time_sync_response(const protocol::Packet& packet);
+
+    // Accessory clock -> host clock. Identity until synchronized.
+    bool is_synchronized() const { return synchronized_.load(); }
+    uint64_t to_host_time(uint64_t accessory_us) const;
+
+    // Statistics
+    struct Stats {
+        uint64_t requests_sent;
+        uint64_t responses_received;
+        uint64_t samples_rejected;      // Round trip too far above the minimum
+        int64_t offset_us;              // Accessory clock minus host clock
+        double drift_ppm;               // Offset change per host second
+        uint32_t min_rtt_us;
+        uint32_t last_rtt_us;
+        bool synchronized;
+    };
+
+    Stats get_stats() const;
+
+private:
+    struct Sample {
+        uint64_t host_us;               // Midpoint of the exchange
+        int64_t offset_us;
+        uint64_t rtt_us;
+    };
+
+    void sync_tick();
+    void send_request();
+    void update_estimate();
+
+    Transport* transport_;
+    common::TimerWheel* scheduler_;
+    std::atomic<bool> running_;
+    common::TimerWheel::TimerId sync_timer_;
+    uint32_t next_sequence_;
+    uint64_t last_request_us_;
+
+    // Estimate: offset(t) = base_offset_us_ + drift_ * (t - base_time_us_)
+    mutable std::mutex mutex_;
+    std::deque<Sample> samples_;
+    int64_t base_offset_us_;
+    uint64_t base_time_us_;
+    double drift_;
+    std::atomic<bool> synchronized_;
+
+    Stats stats_;
+};
+
+} // namespace host
+
+#endif // HOST_CLOCK_SYNC_H
@@ -0,0 +1,140 @@
+#ifndef HOST_CONNECTION_FSM_H
+#define HOST_CONNECTION_FSM_H
+
+#include "protocol.h"
+#include "timer_wheel.h"
+#include <functional>
+#include <mutex>
+#include <atomic>
+
+namespace host {
+
+// The host's side of one device's connection, in the accessory's states
+// (see protocol::ConnectionState):
+//
+//   IDLE/ERROR -> PAIRING   a handshake went out (RESUME_REQUEST, or
+//                           PAIR_REQUEST and then CONNECT_REQUEST)
+//   PAIRING -> CONNECTED    CONNECT_RESPONSE or RESUME_RESPONSE
+//   CONNECTED -> STREAMING  the first audio packet
+//   up -> ERROR             the link is lost
+//   ERROR -> PAIRING        a reconnect attempt
+//   any -> DISCONNECTING -> IDLE   the host hung up
+//
+// Every packet from the device keeps the link alive. When audio stops, one
+// KEEPALIVE goes out as a probe; if the probe goes unanswered, the link is
+// dropped. A link that is silent past the link timeout is dropped as
+// well. A drop asks for a reconnect at once, sent straight to the device
+// rather than through discovery. A handshake not answered in time is retried
+// with jittered exponential backoff. When the attempts run out, the FSM goes
+// back to IDLE.
+//
+// Audio downtime is measured per drop: from the last audio packet before
+// the drop to the first one after it. Callbacks run on the thread that
+// caused the change, with no lock held.
+class ConnectionFSM {
+public:
+    using StateChangeCallback = std::function<void(protocol::ConnectionState, protocol::ConnectionState)>;
+    using ActionCallback = std::function<void()>;
+
+    struct Config {
+        uint32_t link_timeout_ms = 3 * protocol::KEEPALIVE_INTERVAL_MS;    // Three keepalives
+        uint32_t probe_gap_ms = 150;            // Audio silence before probing
+        uint32_t probe_timeout_ms = 150;        // Probe unanswered: dropped
+        uint32_t handshake_timeout_ms = 300;    // Attempt unanswered: retried
+        uint32_t backoff_base_ms = protocol::RECONNECT_BASE_DELAY_MS;
+        uint32_t backoff_max_ms = protocol::RECONNECT_MAX_DELAY_MS;
+        uint32_t max_attempts = 10;             // Reconnects per drop before IDLE
+    };
+
+    struct Stats {
+        uint32_t drops;                 // Links lost while up
+        uint32_t probes;                // KEEPALIVEs sent on audio silence
+        uint32_t attempts;              // Reconnect attempts sent
+        uint32_t attempts_failed;       // Not answered in time
+        uint32_t recovered;             // Drops with audio back
+        uint32_t abandoned;             // Drops without: gave up or hung up
+        uint64_t last_detect_us;        // Last packet heard -> drop declared
+        uint64_t max_detect_us;
+        uint64_t last_downtime_us;      // Last audio before a drop -> first after
+        uint64_t avg_downtime_us;
+        uint64_t max_downtime_us;
+    };
+
+    ConnectionFSM(const uint8_t* device_id, common::TimerWheel* scheduler, const Config& config);
+    ~ConnectionFSM();
+
+    ConnectionFSM(const ConnectionFSM&) = delete;
+    ConnectionFSM& operator=(const ConnectionFSM&) = delete;
+
+    const uint8_t* get_device_id() const { return device_id_; }
+    protocol::ConnectionState get_state() const { return state_.load(); }
+
+    bool is_connected() const {
+        auto state = state_.load();
+        return state == protocol::ConnectionState::CONNECTED ||
+               state == protocol::ConnectionState::STREAMING;
+    }
+
+    // Events from the device manager
+    void on_handshake_sent();
+    void on_connected();
+    void on_packet();                   // Anything from the device
+    void on_audio();                    // An audio packet (implies on_packet)
+    void on_link_lost();                // DISCONNECT from the device, or known lost
+    void close();                       // The host hung up: no reconnects
+
+    // Callbacks: the probe sends a KEEPALIVE, a reconnect sends a handshake
+    // to the device
+    void set_state_change_callback(StateChangeCallback callback) {
+        state_change_callback_ = callback;
+    }
+    void set_probe_callback(ActionCallback callback) { probe_callback_ = callback; }
+    void set_reconnect_callback(ActionCallback callback) { reconnect_callback_ = callback; }
+
+    Stats get_stats() const;
+
+private:
+    // Under mutex_; the old state for notify(), which runs after unlocking
+    protocol::ConnectionState set_state_locked(protocol::ConnectionState state);
+    void notify(protocol::ConnectionState old_state, protocol::ConnectionState new_state);
+    void start_supervision_locked();
+    common::TimerWheel::TimerId take_timers_locked(common::TimerWheel::TimerId* backoff);
+
+    void check_link();                  // Supervision timer
+    void drop(uint64_t now_us, uint64_t heard_us);
+    void attempt(uint64_t epoch);       // Right after a drop, or when a backoff ends
+    uint32_t next_backoff_ms_locked();
+    void close_downtime_locked(uint64_t now_us, bool recovered);
+
+    uint8_t device_id_[8];
+    common::TimerWheel* scheduler_;
+    const Config config_;
+
+    mutable std::mutex mutex_;
+    std::atomic<protocol::ConnectionState> state_;
+    std::atomic<uint64_t> last_heard_us_;
+    std::atomic<uint64_t> last_audio_us_;
+    uint64_t probe_sent_us_;            // 0 when no probe is out
+    uint64_t attempt_sent_us_;          // Current handshake
+    uint32_t attempts_;                 // Since the drop
+    uint32_t backoff_ms_;
+    uint64_t epoch_;                    // Bumped on every change; stale backoffs compare it
+
+    // The open drop, closed by the first audio packet after it
+    bool downtime_open_;
+    uint64_t downtime_start_us_;
+
+    common::TimerWheel::TimerId supervision_timer_;
+    common::TimerWheel::TimerId backoff_timer_;
+
+    Stats stats_;
+    uint64_t total_downtime_us_;
+
+    StateChangeCallback state_change_callback_;
+    ActionCallback probe_callback_;
+    ActionCallback reconnect_callback_;
+};
+
+} // namespace host
+
+#endif // HOST_CONNECTION_FSM_H
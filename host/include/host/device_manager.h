@@ -2,11 +2,17 @@
 #define HOST_DEVICE_MANAGER_H
 
 #include "protocol.h"
+#include "timer_wheel.h"
+#include "session_ticket.h"
+#include "host/bond_store.h"
+#include "host/device_registry.h"
+#include "host/connection_fsm.h"
 #include <string>
 #include <vector>
 #include <mutex>
 #include <atomic>
-#include <thread>
+#include <memory>
+#include <unordered_map>
 #include <functional>
 
 namespace host {
@@ -18,8 +24,12 @@ struct DeviceInfo {
     uint8_t device_id[8];
     uint16_t capabilities;
     uint8_t battery_level;
-    bool paired;
+    bool paired;                                // Bonded: has a stored key
     bool connected;
+    protocol::AudioEncoding audio_encoding;    // Agreed at connect
+    uint16_t frame_samples;                     // Agreed at connect
+    uint8_t frames_per_packet;                  // Agreed at connect
+    protocol::StreamFormat stream_format;       // Agreed at connect
     uint64_t last_seen_us;
 };
 
@@ -28,29 +38,119 @@ public:
     using DeviceDiscoveredCallback = std::function<void(const DeviceInfo&)>;
     using ConnectionStateCallback = std::function<void(bool)>;
     
-    explicit DeviceManager(Transport* transport);
+    // Reconnects: resumptions tried and how long each reconnect took from
+    // the first request to the first audio packet
+    struct Stats {
+        uint32_t resumes_attempted;
+        uint32_t resumes_succeeded;
+        uint32_t resumes_rejected;
+        uint32_t reconnects;
+        bool last_resumed;              // Last reconnect used a ticket
+        uint64_t last_reconnect_us;
+        uint64_t avg_reconnect_us;
+        uint64_t max_reconnect_us;
+    };
+    
+    DeviceManager(Transport* transport, common::TimerWheel* scheduler);
     ~DeviceManager();
     
     // Discovery
     void start_discovery();
     void stop_discovery();
     bool is_discovering() const { return discovering_.load(); }
+    // Devices not heard from for this long are dropped from the list, checked
+    // each discovery round (every 2 seconds). 0 keeps them until the next
+    // start_discovery().
+    void set_stale_window_us(uint64_t window_us) { stale_window_us_ = window_us; }
     
     // Connection management
     bool pair_device(const DeviceInfo& device);
     bool connect_device(const DeviceInfo& device);
     bool disconnect_device();
-    bool is_connected() const { return connected_.load(); }
+    bool is_connected() const;
+    
+    // Connects the quickest way: RESUME_REQUEST with a live ticket, otherwise
+    // PAIR_REQUEST with a CONNECT_REQUEST as soon as pairing completes. From
+    // then on the device's ConnectionFSM keeps it connected (as it does for
+    // any connection): a drop is detected and reconnected without the caller.
+    bool start_session(const DeviceInfo& device);
+    
+    // The connection FSM of the device connected last (see connection_fsm.h):
+    // its state, and its drops and audio downtime. IDLE and zeros before
+    // the first connection.
+    protocol::ConnectionState get_link_state() const;
+    ConnectionFSM::Stats get_link_stats() const;
+    // Timeouts and backoff for FSMs created after the call
+    void set_link_config(const ConnectionFSM::Config& config) { link_config_ = config; }
+    // Sessions resume from tickets (default), or always pair and connect
+    void set_resumption_enabled(bool enabled) { resumption_enabled_ = enabled; }
+    
+    // Session resumption (see protocol.h): with a ticket from the device's
+    // last connect, one RESUME_REQUEST replaces pairing and connect. False
+    // when there is no live ticket for the device; on_resume_response()
+    // reports the outcome.
+    bool resume_device(const DeviceInfo& device);
+    
+    // Bonds (see bond_store.h) kept in `path` across restarts: pairing
+    // results are written as they happen, and a restarted host resumes a
+    // bonded device from its stored ticket instead of pairing again.
+    // Without a store bonds last as long as the process.
+    bool open_bond_store(const std::string& path) { return bonds_.open(path); }
+    bool is_bonded(const uint8_t* device_id) const;
+    BondStore::Stats get_bond_stats() const { return bonds_.get_stats(); }
+    
+    // The link is known to be gone without a DISCONNECT. Losses are
+    // detected anyway (keepalive and audio silence); this skips the wait.
+    // The reconnect goes out at once and is timed.
+    void handle_connection_loss();
+    
+    // Encoding requested at connect when the device supports it; otherwise
+    // the smallest one both sides have
+    void set_preferred_encoding(protocol::AudioEncoding encoding) { preferred_encoding_ = encoding; }
+    
+    // Frame duration (AUDIO_FRAME_SAMPLES_*) and frames aggregated per
+    // packet requested at connect. The accessory may lower the aggregation
+    // to fit its codec's packets.
+    void set_frame_format(uint16_t frame_samples, uint8_t frames_per_packet) {
+        frame_samples_ = frame_samples;
+        frames_per_packet_ = frames_per_packet;
+    }
     
-    // Device list
+    // Channels, sample rate and sample type requested at connect. Formats
+    // other than mono 48kHz INT16 stream raw PCM, and the accessory may
+    // shorten the frames of large formats to fit one packet.
+    void set_stream_format(const protocol::StreamFormat& format) { stream_format_ = format; }
+    
+    // Device list (see device_registry.h). get_discovered_devices() copies
+    // it; with many devices in range follow get_device_changes() instead,
+    // starting from version 0, and copy the list only when it returns false.
     std::vector<DeviceInfo> get_discovered_devices() const;
+    bool find_discovered_device(const uint8_t* device_id, DeviceInfo* device) const;
+    bool get_device_changes(uint64_t* version, std::vector<DeviceChange>* changes) const {
+        return devices_.changes_since(version, changes);
+    }
+    DeviceRegistry::Stats get_registry_stats() const { return devices_.get_stats(); }
     DeviceInfo get_connected_device() const;
     
+    // AES-128 key for the audio payloads, agreed when the last pairing
+    // completed. False before that.
+    bool get_session_key(uint8_t* key) const;
+    
     // Packet handlers
     void on_discover_response(const protocol::Packet& packet);
     void on_pair_response(const protocol::Packet& packet);
     void on_connect_response(const protocol::Packet& packet);
     void on_disconnect(const protocol::Packet& packet);
+    // Replies to our keepalives: the device is still in range
+    void on_keepalive(const protocol::Packet& packet);
+    void on_session_ticket(const protocol::Packet& packet);
+    // True when the session resumed: the key changed and audio may start.
+    // A rejected ticket falls back to pairing and connecting.
+    bool on_resume_response(const protocol::Packet& packet);
+    // Any audio packet; ends the reconnect timing
+    void on_audio_received();
+    
+    Stats get_stats() const;
     
     // Callbacks
     void set_device_discovered_callback(DeviceDiscoveredCallback callback) {
@@ -62,28 +162,73 @@ public:
     }
     
 private:
-    void discovery_loop();
     void send_discover_request();
     void send_pair_request(const DeviceInfo& device);
     void send_connect_request();
+    void establish_connection(const protocol::ConnectPayload& accepted, bool resumed);
+    void mark_reconnect_start();
+    // Read-modify-write of the device's bond, if there is one (or `create`)
+    void update_bond(const uint8_t* device_id, bool create, bool durable,
+                     const std::function<void(Bond*)>& update);
     void send_keepalive();
-    void keepalive_loop();
+    void stop_keepalive();
+    // The device's FSM, created on first use and made the active one
+    std::shared_ptr<ConnectionFSM> link_for(const DeviceInfo& device);
+    std::shared_ptr<ConnectionFSM> active_link() const;
+    void on_link_state(protocol::ConnectionState old_state, protocol::ConnectionState new_state);
     
     Transport* transport_;
+    common::TimerWheel* scheduler_;
     
     // Discovery state
     std::atomic<bool> discovering_;
-    std::thread discovery_thread_;
-    mutable std::mutex devices_mutex_;
-    std::vector<DeviceInfo> discovered_devices_;
+    common::TimerWheel::TimerId discovery_timer_;
+    DeviceRegistry devices_;
+    std::atomic<uint64_t> stale_window_us_;
     
-    // Connection state
-    std::atomic<bool> connected_;
+    // Connection state: an FSM per device connected so far, one of them
+    // active (one connection at a time)
+    mutable std::mutex links_mutex_;
+    std::unordered_map<uint64_t, std::shared_ptr<ConnectionFSM>> links_;
+    std::shared_ptr<ConnectionFSM> link_;
+    ConnectionFSM::Config link_config_;
+    std::atomic<bool> resumption_enabled_;
+    std::atomic<bool> connect_after_pair_;      // start_session() and reconnects
     DeviceInfo connected_device_;
+    protocol::AudioEncoding preferred_encoding_;
+    uint16_t frame_samples_;
+    uint8_t frames_per_packet_;
+    protocol::StreamFormat stream_format_;
+    
+    // Pairing: our half of the exchange until the response, then the key
+    mutable std::mutex pairing_mutex_;
+    uint8_t pair_private_key_[32];
+    uint8_t pair_nonce_[16];
+    bool pair_pending_;
+    uint8_t session_key_[protocol::SESSION_KEY_SIZE];
+    bool has_session_key_;
+    
+    // Resumption: tickets by device, and the request awaiting its response
+    // (under pairing_mutex_)
+    common::TicketStore tickets_;
+    uint8_t resume_ticket_id_[protocol::TICKET_ID_SIZE];
+    uint8_t resume_nonce_[protocol::RESUME_NONCE_SIZE];
+    bool resume_pending_;
+    
+    BondStore bonds_;
+    
+    // Reconnect timing: set on link loss, started by the next request and
+    // stopped by the first audio packet after the connection is back
+    std::atomic<bool> link_lost_;
+    std::atomic<uint64_t> reconnect_start_us_;
+    std::atomic<bool> awaiting_audio_;
+    std::atomic<bool> reconnect_resumed_;
+    mutable std::mutex stats_mutex_;
+    Stats stats_;
+    uint64_t total_reconnect_us_;
     
     // Keepalive
-    std::thread keepalive_thread_;
-    std::atomic<bool> keepalive_running_;
+    common::TimerWheel::TimerId keepalive_timer_;
     
     // Callbacks
     DeviceDiscoveredCallback device_discovered_callback_;
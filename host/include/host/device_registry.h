@@ -0,0 +1,144 @@
+#ifndef HOST_DEVICE_REGISTRY_H
+#define HOST_DEVICE_REGISTRY_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+
+namespace host {
+
+// A device as last heard in discovery. Fixed size: copying one allocates
+// nothing.
+struct DeviceRecord {
+    uint8_t device_id[8];
+    char name[32];                  // NUL-padded
+    uint16_t capabilities;
+    uint8_t battery_level;
+    bool paired;
+    uint64_t last_seen_us;
+};
+
+// One entry of the change feed. Versions count up from 1 with no gaps.
+struct DeviceChange {
+    enum class Kind : uint8_t {
+        ADDED,
+        UPDATED,                    // Advertised fields or pairing changed
+        REMOVED                     // Evicted; `device` as last seen
+    };
+
+    uint64_t version;
+    Kind kind;
+    DeviceRecord device;
+};
+
+// Discovered devices in an open-addressing (linear probing) hash table
+// keyed by device id, so an advertisement costs the same with ten devices
+// in range or ten thousand.
+//
+// Lookups and the common case of discovery, a known device answering
+// again with nothing new, share a reader lock: the last-seen time is an
+// atomic in the slot. Adding, changing and evicting devices take the
+// writer lock. Removal shifts later entries back (no tombstones) and the
+// table doubles at three quarters full.
+//
+// Changes that matter to a device list (added, updated, removed; not
+// last-seen refreshes) go to a bounded feed, so a consumer can follow the
+// list with changes_since() instead of copying it. Thread-safe.
+class DeviceRegistry {
+public:
+    static constexpr uint32_t DEFAULT_SLOTS = 64;
+    static constexpr size_t DEFAULT_FEED_CAPACITY = 4096;
+
+    enum class Result {
+        ADDED,
+        UPDATED,
+        REFRESHED                   // Only the last-seen time moved
+    };
+
+    struct Stats {
+        uint32_t devices;
+        uint32_t slots;
+        uint64_t lookups;           // observe(), find() and set_paired()
+        uint64_t probes;            // Slots compared by those lookups
+        uint64_t refreshes;         // Observations taking the reader lock only
+        uint64_t added;
+        uint64_t updated;
+        uint64_t evicted;
+        uint32_t rehashes;
+        uint64_t version;           // Of the latest change
+    };
+
+    explicit DeviceRegistry(uint32_t slots = DEFAULT_SLOTS,
+                            size_t feed_capacity = DEFAULT_FEED_CAPACITY);
+    ~DeviceRegistry();
+
+    DeviceRegistry(const DeviceRegistry&) = delete;
+    DeviceRegistry& operator=(const DeviceRegistry&) = delete;
+
+    // Records an advertisement. `device.paired` is taken for new devices
+    // only; a known device keeps its own (see set_paired()).
+    Result observe(const DeviceRecord& device);
+    bool find(const uint8_t* device_id, DeviceRecord* device) const;
+    bool contains(const uint8_t* device_id) const { return find(device_id, nullptr); }
+    // False when the device is not in the registry
+    bool set_paired(const uint8_t* device_id, bool paired, DeviceRecord* device = nullptr);
+
+    // Removes devices last seen before `cutoff_us`, each a REMOVED change.
+    // Returns how many.
+    size_t evict_stale(uint64_t cutoff_us);
+    // Removes everything without a change per device: consumers behind the
+    // new version resync from snapshot()
+    void clear();
+
+    size_t size() const;
+    // Every device, and the version they reflect
+    std::vector<DeviceRecord> snapshot(uint64_t* version = nullptr) const;
+    // Appends the changes after `*version` and moves it to the latest.
+    // False, appending nothing, when some of them have left the feed (or
+    // the registry was cleared): take a snapshot() instead.
+    bool changes_since(uint64_t* version, std::vector<DeviceChange>* changes) const;
+
+    Stats get_stats() const;
+
+private:
+    struct Slot {
+        bool used;
+        DeviceRecord device;                    // last_seen_us unused
+        std::atomic<uint64_t> last_seen_us;
+    };
+
+    // Index of the device's slot, or of the empty slot ending its probe
+    // sequence (found false). Caller holds either lock.
+    uint32_t probe(const uint8_t* device_id, bool* found) const;
+    void read_slot(const Slot& slot, DeviceRecord* device) const;
+    void grow();
+    void remove_slot(uint32_t index);
+    void publish(DeviceChange::Kind kind, const DeviceRecord& device);
+
+    mutable std::shared_mutex mutex_;
+    std::unique_ptr<Slot[]> slots_;
+    uint32_t slot_count_;           // Power of two
+    uint32_t device_count_;
+
+    // Feed: change `v` lives at feed_[v % capacity]; the last feed_count_
+    // versions up to version_ are held (under mutex_)
+    std::vector<DeviceChange> feed_;
+    uint64_t version_;
+    size_t feed_count_;
+
+    // Counted under the reader lock too
+    mutable std::atomic<uint64_t> lookups_;
+    mutable std::atomic<uint64_t> probes_;
+    std::atomic<uint64_t> refreshes_;
+    uint64_t added_;
+    uint64_t updated_;
+    uint64_t evicted_;
+    uint32_t rehashes_;
+};
+
+} // namespace host
+
+#endif // HOST_DEVICE_REGISTRY_H
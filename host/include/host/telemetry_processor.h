@@ -8,6 +8,8 @@
 
 namespace host {
 
+class ClockSync;
+
 class TelemetryProcessor {
 public:
     TelemetryProcessor();
@@ -17,6 +19,9 @@ public:
     bool open_log(const std::string& filename);
     void close_log();
     
+    // Optional accessory clock mapping; adds one-way delay to log entries
+    void set_clock_sync(const ClockSync* clock_sync) { clock_sync_ = clock_sync; }
+    
     // Process telemetry packets
     void process_battery_status(const protocol::Packet& packet);
     void process_diagnostics(const protocol::Packet& packet);
@@ -27,6 +32,7 @@ public:
     
 private:
     void log_message(const std::string& message);
+    std::string one_way_delay(const protocol::Packet& packet) const;
     
     std::ofstream log_file_;
     mutable std::mutex log_mutex_;
@@ -34,6 +40,8 @@ private:
     protocol::BatteryPayload latest_battery_;
     protocol::DiagnosticsPayload latest_diagnostics_;
     mutable std::mutex data_mutex_;
+    
+    const ClockSync* clock_sync_;
 };
 
 } // namespace host
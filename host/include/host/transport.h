@@ -2,6 +2,8 @@
 #define HOST_TRANSPORT_H
 
 #include "protocol.h"
+#include "latency_trace.h"
+#include "fragment.h"
 #include <functional>
 #include <thread>
 #include <atomic>
@@ -25,7 +27,9 @@ namespace host {
 
 class Transport {
 public:
-    using PacketCallback = std::function<void(const protocol::Packet&)>;
+    // The packet is the receive buffer: handlers may work on it in place
+    // (AudioSync decrypts audio there) until they return
+    using PacketCallback = std::function<void(protocol::Packet&)>;
     
     Transport();
     ~Transport();
@@ -43,9 +47,19 @@ public:
         packet_callback_ = callback;
     }
     
+    // Optional per-frame audio path tracing (nullptr disables)
+    void set_latency_trace(common::LatencyTrace* trace) { latency_trace_ = trace; }
+    
+    // Largest datagram sent (path MTU less IPv4 and UDP headers); larger
+    // packets go out as fragments and are reassembled by the peer
+    void set_datagram_size(size_t bytes) { fragmenter_.set_datagram_size(bytes); }
+    size_t get_datagram_size() const { return fragmenter_.datagram_size(); }
+    
     // Statistics
     uint64_t get_packets_sent() const { return packets_sent_.load(); }
     uint64_t get_packets_received() const { return packets_received_.load(); }
+    uint64_t get_datagrams_sent() const { return datagrams_sent_.load(); }
+    common::Reassembler::Stats get_reassembly_stats() const { return reassembler_.get_stats(); }
     
 private:
     void receive_loop();
@@ -67,17 +81,22 @@ private:
     std::thread send_thread_;
     std::atomic<bool> running_;
     
-    // Send queue
-    std::queue<protocol::Packet> send_queue_;
+    // Send queue, already split into datagrams
+    common::Fragmenter fragmenter_;
+    std::queue<common::Datagram> send_queue_;
     std::mutex send_mutex_;
     std::condition_variable send_cv_;
     
-    // Packet callback
+    // Packet callback, fed by the (single) receive thread's reassembler
     PacketCallback packet_callback_;
+    common::Reassembler reassembler_;
+    
+    common::LatencyTrace* latency_trace_;
     
     // Statistics
     std::atomic<uint64_t> packets_sent_;
     std::atomic<uint64_t> packets_received_;
+    std::atomic<uint64_t> datagrams_sent_;
 };
 
 } // namespace host
@@ -1,23 +1,101 @@
 #include "host/audio_sync.h"
 #include "host/transport.h"
+#include "host/clock_sync.h"
+#include "fec.h"
+#include "sample_format.h"
 #include <iostream>
 #include <cstring>
 #include <algorithm>
-#include <thread>
-#include <chrono>
 
 namespace host {
 
-AudioSync::AudioSync(Transport* transport)
+namespace {
+
+// Playout holds a missing frame while nothing newer is buffered for this
+// long (or two packets' worth, if longer), then rebuffers
+constexpr uint64_t STALL_TIMEOUT_US = 100000;
+
+// Retransmission. A NACK is only worth sending if the resend can arrive a
+// round trip (plus margin) before the missing audio is due; larger gaps
+// mean the link is down rather than dropping packets.
+constexpr uint64_t DEFAULT_RTT_US = 5000;      // Until the clock sync measures one
+constexpr uint64_t NACK_GUARD_US = 1000;
+constexpr uint32_t MAX_NACK_GAP = 32;
+constexpr uint32_t MAX_NACK_ATTEMPTS = 3;
+constexpr size_t MAX_PENDING_RETRANSMITS = 128;
+
+// Loss is measured over windows of first transmissions; FEC is resized at
+// each window end, and a configuration the accessory has not applied yet
+// (judged by its parity packets) is re-sent
+constexpr uint64_t LOSS_WINDOW_US = 1000000;
+constexpr uint64_t MIN_LOSS_WINDOW_PACKETS = 20;
+constexpr uint64_t FEC_CONFIG_RETRY_US = 500000;
+// Margin between parity arrival and the playout of the group's first packet
+constexpr uint32_t FEC_GUARD_SAMPLES = protocol::AUDIO_SAMPLE_RATE / 1000;
+constexpr size_t FEC_HISTORY_PACKETS = 64;
+constexpr uint32_t FEC_GROUP_HORIZON = 2 * protocol::FEC_MAX_DATA_PACKETS;
+
+// Default ACK batching: 4 frames (one per aggregated packet of up to 4
+// frames), at least every 50ms
+constexpr uint32_t DEFAULT_ACK_BATCH_FRAMES = 4;
+constexpr uint32_t DEFAULT_ACK_INTERVAL_US = 50000;
+
+uint32_t pack_fec_config(protocol::FecScheme scheme, uint8_t data_count, uint8_t parity_count) {
+    return static_cast<uint32_t>(scheme) | (static_cast<uint32_t>(data_count) << 8) |
+           (static_cast<uint32_t>(parity_count) << 16);
+}
+
+} // namespace
+
+AudioSync::AudioSync(Transport* transport, common::TimerWheel* scheduler)
     : transport_(transport)
+    , scheduler_(scheduler)
     , running_(false)
-    , jitter_buffer_size_(protocol::DEFAULT_JITTER_BUFFER_PACKETS)
-    , next_play_sequence_(0)
+    , playout_timer_(common::TimerWheel::INVALID_TIMER)
+    , jitter_buffer_samples_(protocol::DEFAULT_JITTER_BUFFER_SAMPLES)
+    , buffered_samples_(0)
+    , next_play_position_(0)
+    , playout_origin_us_(0)
+    , playout_origin_position_(0)
+    , frame_samples_(protocol::AUDIO_SAMPLES_PER_PACKET)
+    , packet_samples_(protocol::AUDIO_SAMPLES_PER_PACKET)
+    , playback_started_(false)
+    , playout_aligned_(false)
+    , retransmission_enabled_(true)
+    , highest_sequence_(0)
+    , highest_sequence_valid_(false)
+    , nack_sequence_(0)
+    , ack_batch_frames_(DEFAULT_ACK_BATCH_FRAMES)
+    , ack_interval_us_(DEFAULT_ACK_INTERVAL_US)
+    , ack_valid_(false)
+    , ack_highest_(0)
+    , ack_bitmap_(0)
+    , ack_highest_received_us_(0)
+    , ack_packets_received_(0)
+    , ack_pending_frames_(0)
+    , ack_pending_since_us_(0)
+    , fec_scheme_(protocol::FecScheme::NONE)
+    , loss_window_start_us_(0)
+    , loss_window_expected_(0)
+    , loss_window_received_(0)
+    , loss_rate_(0.0)
+    , fec_config_sent_us_(0)
+    , fec_seen_config_(0)
+    , fec_history_(FEC_HISTORY_PACKETS)
     , stream_start_time_(0)
     , last_packet_time_(0)
+    , transit_base_us_(0)
+    , transit_base_valid_(false)
+    , meter_samples_(0)
+    , clock_sync_(nullptr)
+    , latency_trace_(nullptr)
+    , protection_flag_(protocol::FLAG_ENCRYPTED)
     , consecutive_losses_(0) {
     
     memset(&stats_, 0, sizeof(stats_));
+    memset(&fec_config_, 0, sizeof(fec_config_));
+    memset(meter_peaks_, 0, sizeof(meter_peaks_));
+    stats_.stream_format = protocol::DEFAULT_STREAM_FORMAT;
 }
 
 AudioSync::~AudioSync() {
@@ -29,16 +107,41 @@ void AudioSync::start() {
         return;
     }
     
-    std::cout << "[Host] Starting audio synchronization (buffer size: "
-              << static_cast<int>(jitter_buffer_size_.load()) << " packets)" << std::endl;
+    std::cout << "[Host] Starting audio synchronization (buffer: "
+              << protocol::samples_to_us(jitter_buffer_samples_.load()) / 1000.0 << "ms)" << std::endl;
     
-    running_.store(true);
-    next_play_sequence_ = 0;
-    stream_start_time_ = protocol::get_timestamp_us();
-    last_packet_time_ = stream_start_time_;
-    consecutive_losses_ = 0;
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex_);
+        buffered_samples_ = 0;
+        next_play_position_ = 0;
+        playback_started_ = false;
+        playout_aligned_ = false;
+        stream_start_time_ = protocol::get_timestamp_us();
+        last_packet_time_ = stream_start_time_;
+        transit_base_valid_ = false;
+        consecutive_losses_ = 0;
+        pending_retransmits_.clear();
+        highest_sequence_valid_ = false;
+        loss_window_start_us_ = 0;
+        loss_window_expected_ = 0;
+        loss_window_received_ = 0;
+        loss_rate_ = 0.0;
+        memset(&fec_config_, 0, sizeof(fec_config_));
+        fec_config_sent_us_ = 0;
+        ack_valid_ = false;
+        ack_packets_received_ = 0;
+        ack_pending_frames_ = 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(fec_mutex_);
+        fec_groups_.clear();
+        for (FecBlock& block : fec_history_) {
+            block.valid = false;
+        }
+    }
     
-    sync_thread_ = std::thread(&AudioSync::sync_loop, this);
+    // The playout clock starts with the first packet (start_playout_clock)
+    running_.store(true);
 }
 
 void AudioSync::stop() {
@@ -48,54 +151,220 @@ void AudioSync::stop() {
     
     std::cout << "[Host] Stopping audio synchronization" << std::endl;
     running_.store(false);
-    buffer_cv_.notify_all();
     
-    if (sync_thread_.joinable()) {
-        sync_thread_.join();
+    // Packets arriving now see running_ false and cannot restart the clock.
+    // Cancel outside the buffer lock: a running playout_tick() needs it.
+    common::TimerWheel::TimerId playout_timer;
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex_);
+        playout_timer = playout_timer_;
+        playout_timer_ = common::TimerWheel::INVALID_TIMER;
     }
+    scheduler_->cancel(playout_timer);
     
     std::lock_guard<std::mutex> lock(buffer_mutex_);
     jitter_buffer_.clear();
+    buffered_samples_ = 0;
+    pending_retransmits_.clear();
+}
+
+uint32_t AudioSync::target_depth_samples() const {
+    // The first frame of an aggregated packet waits for the rest before it
+    // is sent, so aggregation adds to the jitter margin
+    uint32_t aggregation_delay = packet_samples_ > frame_samples_ ? packet_samples_ - frame_samples_ : 0;
+    return jitter_buffer_samples_.load() + aggregation_delay;
+}
+
+void AudioSync::start_playout_clock(uint64_t capture_time_us, uint64_t now_us, uint16_t frame_samples) {
+    // Playout ticks once per frame of the stream's negotiated duration
+    frame_samples_ = frame_samples;
+    const uint64_t frame_us = protocol::samples_to_us(frame_samples);
+    uint64_t first_delay_us = frame_us;
+    
+    // With the accessory clock mapped, tick at capture time + target delay so
+    // every frame sees the same capture-to-playout latency regardless of when
+    // the first packet happened to arrive
+    playout_aligned_ = clock_sync_ && clock_sync_->is_synchronized();
+    if (playout_aligned_) {
+        uint64_t deadline = clock_sync_->to_host_time(capture_time_us) +
+                            protocol::samples_to_us(target_depth_samples());
+        first_delay_us = deadline > now_us ? deadline - now_us : 0;
+    }
+    
+    playout_timer_ = scheduler_->schedule_periodic(
+        frame_us, [this] { playout_tick(); }, first_delay_us);
 }
 
-void AudioSync::on_audio_packet(const protocol::Packet& packet) {
+void AudioSync::on_audio_packet(protocol::Packet& packet) {
+    // Keep the packet for rebuilding its group's losses. Parity covers the
+    // packets as sent, so the block is taken before decryption.
+    bool fec = fec_scheme_.load() != protocol::FecScheme::NONE &&
+               packet.header.payload_length >= sizeof(protocol::AudioPayload);
+    if (fec) {
+        std::lock_guard<std::mutex> lock(fec_mutex_);
+        store_fec_block(packet);
+    }
+    if (open_packet(&packet)) {
+        process_audio_packet(packet, false);
+    }
+    if (!fec) {
+        return;
+    }
+    
+    // Parity that arrived first may now be enough
+    std::vector<protocol::Packet> recovered;
+    {
+        std::lock_guard<std::mutex> lock(fec_mutex_);
+        auto group = fec_groups_.upper_bound(packet.header.sequence);
+        if (group != fec_groups_.begin()) {
+            --group;
+            if (packet.header.sequence - group->first < group->second.data_count) {
+                recover_fec_group(group->first, &recovered);
+            }
+        }
+    }
+    for (protocol::Packet& rebuilt : recovered) {
+        if (open_packet(&rebuilt)) {
+            process_audio_packet(rebuilt, true);
+        }
+    }
+}
+
+bool AudioSync::open_packet(protocol::Packet* packet) {
+    const uint8_t protection = packet->header.flags &
+                               (protocol::FLAG_ENCRYPTED | protocol::FLAG_AUTHENTICATED);
+    if (protection == 0 && !cipher_.has_key()) {
+        return true;
+    }
+    bool opened = protection != 0 && cipher_.open(packet);
+    if (opened) {
+        protection_flag_ = protection;
+    }
+    
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    (opened ? stats_.packets_decrypted : stats_.decrypt_failures)++;
+    return opened;
+}
+
+void AudioSync::process_audio_packet(const protocol::Packet& packet, bool fec_recovered) {
     uint64_t received_time = protocol::get_timestamp_us();
     
     if (packet.header.payload_length < sizeof(protocol::AudioPayload)) {
         return;
     }
     
+    // One-way latency needs the capture time (header timestamp, accessory
+    // clock) mapped onto the host clock
+    bool clock_synchronized = clock_sync_ && clock_sync_->is_synchronized();
+    uint64_t one_way_us = 0;
+    if (clock_synchronized) {
+        uint64_t capture_time = clock_sync_->to_host_time(packet.header.timestamp_us);
+        one_way_us = received_time > capture_time ? received_time - capture_time : 0;
+    }
+    
     // Parse audio payload
     protocol::AudioPayload audio_payload;
     memcpy(&audio_payload, packet.payload, sizeof(audio_payload));
     
-    // Extract audio data
-    size_t audio_data_size = packet.header.payload_length - sizeof(protocol::AudioPayload);
-    AudioPacketInfo packet_info;
-    packet_info.sequence = packet.header.sequence;
-    packet_info.stream_timestamp = audio_payload.stream_timestamp;
-    packet_info.received_timestamp_us = received_time;
-    packet_info.sample_count = audio_payload.sample_count;
-    packet_info.audio_data.resize(audio_data_size);
-    
-    if (audio_data_size > 0) {
-        memcpy(packet_info.audio_data.data(),
-               packet.payload + sizeof(protocol::AudioPayload),
-               audio_data_size);
+    // Split into frames and decode them to PCM16
+    std::vector<AudioFrameInfo> frames;
+    if (!decode_frames(packet, audio_payload, received_time, &frames)) {
+        return;
     }
     
     // Add to jitter buffer
+    std::vector<uint32_t> nacks;
+    protocol::FecConfigPayload fec_config;
+    bool send_config = false;
+    protocol::AckPayload ack;
+    bool send_ack_now = false;
     {
         std::lock_guard<std::mutex> lock(buffer_mutex_);
-        jitter_buffer_[packet_info.sequence] = packet_info;
+        
+        uint64_t frames_late = 0;
+        for (AudioFrameInfo& frame : frames) {
+            uint64_t position = frame.sample_position;
+            if (playback_started_ && position < next_play_position_) {
+                // Playout already moved past this frame
+                frames_late++;
+                continue;
+            }
+            
+            auto inserted = jitter_buffer_.emplace(position, std::move(frame));
+            if (inserted.second) {
+                buffered_samples_ += inserted.first->second.sample_count;
+            }
+        }
+        packet_samples_ = static_cast<uint32_t>(frames.size()) * audio_payload.sample_count;
+        
+        // A packet we NACKed is recovered if any of it is still ahead of playout
+        bool in_time = frames_late < frames.size();
+        uint64_t recovered = 0;
+        uint64_t unrecoverable = 0;
+        auto pending = pending_retransmits_.find(packet.header.sequence);
+        if (pending != pending_retransmits_.end()) {
+            if (fec_recovered) {
+                // Rebuilt from parity first
+            } else if (in_time) {
+                recovered++;
+            } else {
+                unrecoverable++;
+            }
+            pending_retransmits_.erase(pending);
+        }
+        if (!fec_recovered && (packet.header.flags & protocol::FLAG_ACK_REQUIRED)) {
+            send_ack_now = record_ack(packet, frames.size(), received_time, &ack);
+        }
+        if (!fec_recovered && !(packet.header.flags & protocol::FLAG_RETRANSMIT)) {
+            loss_window_received_++;
+            request_retransmits(packet.header.sequence, audio_payload.sample_position,
+                                received_time, &nacks);
+            send_config = update_loss_window(received_time, &fec_config);
+        }
+        
+        if (latency_trace_ && frames_late < frames.size()) {
+            latency_trace_->stamp(common::LatencyTrace::Stage::JITTER_INSERT, packet.header.sequence);
+        }
+        
+        if (playout_timer_ == common::TimerWheel::INVALID_TIMER && running_.load()) {
+            start_playout_clock(packet.header.timestamp_us, received_time, audio_payload.sample_count);
+        }
+        last_packet_time_ = received_time;
+        
+        // Transit = receive time - stream time carries an unknown clock
+        // offset; relative to the fastest packet seen the offset cancels
+        int64_t transit_us = static_cast<int64_t>(received_time) -
+                             static_cast<int64_t>(audio_payload.stream_timestamp);
+        if (!transit_base_valid_ || transit_us < transit_base_us_) {
+            transit_base_us_ = transit_us;
+            transit_base_valid_ = true;
+        }
+        uint64_t excess_us = static_cast<uint64_t>(transit_us - transit_base_us_);
         
         std::lock_guard<std::mutex> stats_lock(stats_mutex_);
         stats_.packets_received++;
+        stats_.frames_received += frames.size();
+        stats_.frames_late += frames_late;
+        stats_.frame_samples = audio_payload.sample_count;
+        stats_.frames_per_packet = static_cast<uint8_t>(frames.size());
+        stats_.current_latency_ms = static_cast<uint32_t>(excess_us / 1000);
+        stats_.clock_synchronized = clock_synchronized;
+        stats_.playout_aligned = playout_aligned_;
+        stats_.retransmits_recovered += recovered;
+        stats_.retransmits_unrecoverable += unrecoverable;
+        if (fec_recovered) {
+            (in_time ? stats_.fec_packets_recovered : stats_.fec_packets_late)++;
+        }
         
-        // Calculate latency
-        uint32_t latency_us = static_cast<uint32_t>(received_time - stream_start_time_) -
-                              packet_info.stream_timestamp;
-        stats_.current_latency_ms = latency_us / 1000;
+        if (clock_synchronized) {
+            stats_.one_way_latency_us = static_cast<uint32_t>(one_way_us);
+            stats_.avg_one_way_latency_us = stats_.avg_one_way_latency_us == 0
+                ? stats_.one_way_latency_us
+                : static_cast<uint32_t>((stats_.avg_one_way_latency_us * 15ull + one_way_us) / 16);
+            if (stats_.one_way_latency_us > stats_.max_one_way_latency_us) {
+                stats_.max_one_way_latency_us = stats_.one_way_latency_us;
+            }
+        }
         
         if (stats_.current_latency_ms > stats_.max_latency_ms) {
             stats_.max_latency_ms = stats_.current_latency_ms;
@@ -108,120 +377,700 @@ void AudioSync::on_audio_packet(const protocol::Packet& packet) {
         }
     }
     
-    last_packet_time_ = received_time;
-    buffer_cv_.notify_one();
+    // Outside buffer_mutex_: the transport may block
+    if (send_ack_now) {
+        send_ack(ack);
+    }
+    send_nack(nacks);
+    if (send_config) {
+        send_fec_config(fec_config);
+    }
+}
+
+void AudioSync::request_retransmits(uint32_t sequence, uint64_t sample_position, uint64_t now,
+                                    std::vector<uint32_t>* nacks) {
+    // Sequence numbers wrap; compare by signed distance
+    int32_t ahead = static_cast<int32_t>(sequence - highest_sequence_);
+    if (highest_sequence_valid_ && ahead <= 0) {
+        return;     // Reordered or duplicate
+    }
+    // A jump past the NACK range is a stream restart, not loss
+    bool restart = highest_sequence_valid_ && static_cast<uint32_t>(ahead) > MAX_NACK_GAP + 1;
+    loss_window_expected_ += (highest_sequence_valid_ && !restart) ? static_cast<uint32_t>(ahead) : 1;
+    uint32_t previous = highest_sequence_;
+    bool gap_valid = highest_sequence_valid_;
+    highest_sequence_ = sequence;
+    highest_sequence_valid_ = true;
+    
+    if (!gap_valid || ahead == 1 || restart || !retransmission_enabled_.load()) {
+        return;
+    }
+    
+    // Packets carry a fixed amount of audio, so the missing ones sit just
+    // before this one
+    for (uint32_t missing = previous + 1; missing != sequence; missing++) {
+        uint64_t back = static_cast<uint64_t>(sequence - missing) * packet_samples_;
+        if (back > sample_position || pending_retransmits_.size() >= MAX_PENDING_RETRANSMITS) {
+            continue;
+        }
+        uint64_t position = sample_position - back;
+        if (!before_deadline(position, now)) {
+            continue;
+        }
+        pending_retransmits_[missing] = PendingRetransmit{position, now, 1};
+        nacks->push_back(missing);
+    }
+    
+    std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+    stats_.retransmits_requested += nacks->size();
+}
+
+void AudioSync::retry_retransmits(uint64_t now, std::vector<uint32_t>* nacks) {
+    if (pending_retransmits_.empty()) {
+        return;
+    }
+    uint32_t rtt_us = clock_sync_ ? clock_sync_->get_stats().last_rtt_us : 0;
+    uint64_t retry_us = 2 * (rtt_us > 0 ? rtt_us : DEFAULT_RTT_US);
+    uint64_t unrecoverable = 0;
+    
+    for (auto it = pending_retransmits_.begin(); it != pending_retransmits_.end();) {
+        PendingRetransmit& pending = it->second;
+        bool given_up = pending.attempts >= MAX_NACK_ATTEMPTS &&
+                        now - pending.last_request_us >= retry_us;
+        if (given_up || (playback_started_ && pending.sample_position < next_play_position_)) {
+            // Its playout slot has passed (concealed), or the accessory no
+            // longer has it
+            unrecoverable++;
+            it = pending_retransmits_.erase(it);
+            continue;
+        }
+        if (pending.attempts < MAX_NACK_ATTEMPTS && now - pending.last_request_us >= retry_us &&
+            before_deadline(pending.sample_position, now)) {
+            pending.attempts++;
+            pending.last_request_us = now;
+            nacks->push_back(it->first);
+        }
+        ++it;
+    }
+    
+    if (unrecoverable > 0) {
+        std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+        stats_.retransmits_unrecoverable += unrecoverable;
+    }
+}
+
+bool AudioSync::before_deadline(uint64_t sample_position, uint64_t now) const {
+    if (!playback_started_) {
+        return true;    // Nothing is due yet
+    }
+    if (sample_position < next_play_position_) {
+        return false;
+    }
+    
+    uint32_t rtt_us = clock_sync_ ? clock_sync_->get_stats().last_rtt_us : 0;
+    uint64_t playout_us = playout_origin_us_ +
+                          protocol::samples_to_us(sample_position - playout_origin_position_);
+    return playout_us > now + (rtt_us > 0 ? rtt_us : DEFAULT_RTT_US) + NACK_GUARD_US;
+}
+
+void AudioSync::send_nack(const std::vector<uint32_t>& sequences) {
+    if (sequences.empty()) {
+        return;
+    }
+    
+    std::vector<uint32_t> sorted(sequences);
+    std::sort(sorted.begin(), sorted.end());
+    protocol::NackEntry entries[protocol::MAX_NACK_ENTRIES];
+    size_t count = protocol::pack_nack_entries(sorted.data(), sorted.size(),
+                                               entries, protocol::MAX_NACK_ENTRIES);
+    
+    protocol::Packet packet;
+    packet.set_type(protocol::PacketType::AUDIO_RETRANSMIT);
+    packet.set_sequence(nack_sequence_.fetch_add(1));
+    packet.set_timestamp(protocol::get_timestamp_us());
+    packet.set_payload(entries, static_cast<uint16_t>(count * sizeof(protocol::NackEntry)));
+    
+    if (transport_->send_packet(packet)) {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.nack_packets_sent++;
+    }
+}
+
+bool AudioSync::record_ack(const protocol::Packet& packet, size_t frames, uint64_t now,
+                           protocol::AckPayload* ack) {
+    uint32_t sequence = packet.header.sequence;
+    int32_t ahead = static_cast<int32_t>(sequence - ack_highest_);
+    bool duplicate = false;
+    if (!ack_valid_ || ahead > 0) {
+        // Slide the window; the old highest becomes bit ahead - 1
+        if (!ack_valid_ || ahead > 32) {
+            ack_bitmap_ = 0;
+        } else {
+            ack_bitmap_ = (ahead == 32 ? 0 : ack_bitmap_ << ahead) | (1u << (ahead - 1));
+        }
+        ack_highest_ = sequence;
+        ack_highest_received_us_ = now;
+        ack_valid_ = true;
+    } else if (ahead == 0) {
+        duplicate = true;
+    } else if (ahead >= -32) {
+        uint32_t bit = 1u << (-ahead - 1);
+        duplicate = (ack_bitmap_ & bit) != 0;
+        ack_bitmap_ |= bit;
+    }
+    if (duplicate) {
+        return false;
+    }
+    
+    if (!(packet.header.flags & protocol::FLAG_RETRANSMIT)) {
+        ack_packets_received_++;
+    }
+    if (ack_pending_frames_ == 0) {
+        ack_pending_since_us_ = now;
+    }
+    ack_pending_frames_ += static_cast<uint32_t>(frames);
+    if (ack_pending_frames_ < ack_batch_frames_.load()) {
+        return false;
+    }
+    build_ack(now, ack);
+    return true;
+}
+
+void AudioSync::build_ack(uint64_t now, protocol::AckPayload* ack) {
+    ack->highest_sequence = ack_highest_;
+    ack->received_bitmap = ack_bitmap_;
+    ack->ack_delay_us = static_cast<uint32_t>(now - ack_highest_received_us_);
+    ack->packets_received = ack_packets_received_;
+    ack_pending_frames_ = 0;
+}
+
+void AudioSync::send_ack(const protocol::AckPayload& ack) {
+    protocol::Packet packet;
+    packet.set_type(protocol::PacketType::AUDIO_ACK);
+    packet.set_sequence(nack_sequence_.fetch_add(1));
+    packet.set_timestamp(protocol::get_timestamp_us());
+    packet.set_payload(&ack, sizeof(ack));
+    
+    if (transport_->send_packet(packet)) {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.acks_sent++;
+    }
+}
+
+void AudioSync::set_ack_batch(uint32_t frames, uint32_t interval_us) {
+    ack_batch_frames_.store(std::max<uint32_t>(frames, 1));
+    ack_interval_us_.store(interval_us);
+}
+
+bool AudioSync::update_loss_window(uint64_t now, protocol::FecConfigPayload* config) {
+    if (loss_window_start_us_ == 0) {
+        loss_window_start_us_ = now;
+    } else if (now - loss_window_start_us_ >= LOSS_WINDOW_US) {
+        if (loss_window_expected_ >= MIN_LOSS_WINDOW_PACKETS) {
+            uint64_t lost = loss_window_expected_ > loss_window_received_
+                ? loss_window_expected_ - loss_window_received_ : 0;
+            loss_rate_ = static_cast<double>(lost) / loss_window_expected_;
+        }
+        loss_window_start_us_ = now;
+        loss_window_expected_ = 0;
+        loss_window_received_ = 0;
+    }
+    
+    protocol::FecConfigPayload desired = choose_fec_config();
+    uint32_t packed = pack_fec_config(static_cast<protocol::FecScheme>(desired.scheme),
+                                      desired.data_count, desired.parity_count);
+    bool changed = memcmp(&desired, &fec_config_, sizeof(desired)) != 0;
+    bool unconfirmed = fec_seen_config_.load() != packed &&
+                       (fec_config_sent_us_ == 0 || now - fec_config_sent_us_ >= FEC_CONFIG_RETRY_US);
+    
+    {
+        std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+        stats_.loss_rate = loss_rate_;
+        stats_.fec_scheme = static_cast<protocol::FecScheme>(desired.scheme);
+        stats_.fec_data_count = desired.data_count;
+        stats_.fec_parity_count = desired.parity_count;
+    }
+    if (!changed && !unconfirmed) {
+        return false;
+    }
+    
+    if (changed) {
+        std::cout << "[Host] 🛡️  FEC " << protocol::fec_scheme_to_string(static_cast<protocol::FecScheme>(desired.scheme));
+        if (desired.scheme != static_cast<uint8_t>(protocol::FecScheme::NONE)) {
+            std::cout << " " << static_cast<int>(desired.data_count) << "+"
+                      << static_cast<int>(desired.parity_count);
+        }
+        std::cout << " (loss " << loss_rate_ * 100.0 << "%)" << std::endl;
+    }
+    fec_config_ = desired;
+    fec_config_sent_us_ = now;
+    fec_seen_config_.store(0);     // Confirmed again by the next parity packet
+    *config = desired;
+    return true;
+}
+
+protocol::FecConfigPayload AudioSync::choose_fec_config() const {
+    protocol::FecConfigPayload config;
+    memset(&config, 0, sizeof(config));
+    protocol::FecScheme scheme = fec_scheme_.load();
+    if (scheme == protocol::FecScheme::NONE) {
+        return config;
+    }
+    
+    // Parity follows the group's last packet, so the first one waits
+    // data_count - 1 packets longer for rebuilding; that must fit the
+    // jitter buffer target
+    uint32_t target = target_depth_samples();
+    uint32_t packet = std::max<uint32_t>(packet_samples_, 1);
+    uint32_t max_data = 1;
+    if (target > frame_samples_ + FEC_GUARD_SAMPLES) {
+        max_data += (target - frame_samples_ - FEC_GUARD_SAMPLES) / packet;
+    }
+    max_data = std::max<uint32_t>(2, std::min<uint32_t>(max_data, protocol::FEC_MAX_DATA_PACKETS));
+    
+    uint32_t data_count;
+    uint32_t parity_count;
+    if (scheme == protocol::FecScheme::XOR) {
+        // One loss per group: the more loss, the smaller the group
+        data_count = loss_rate_ < 0.01 ? 8 : loss_rate_ < 0.03 ? 4 : 2;
+        parity_count = 1;
+    } else {
+        // Long groups, with parity for about twice the expected losses
+        data_count = 8;
+        parity_count = 1 + static_cast<uint32_t>(2.0 * loss_rate_ * data_count + 0.5);
+    }
+    data_count = std::min(data_count, max_data);
+    parity_count = std::min({parity_count, data_count,
+                             static_cast<uint32_t>(protocol::FEC_MAX_PARITY_PACKETS)});
+    
+    config.scheme = static_cast<uint8_t>(scheme);
+    config.data_count = static_cast<uint8_t>(data_count);
+    config.parity_count = static_cast<uint8_t>(parity_count);
+    return config;
+}
+
+void AudioSync::send_fec_config(const protocol::FecConfigPayload& config) {
+    protocol::Packet packet;
+    packet.set_type(protocol::PacketType::AUDIO_FEC_CONFIG);
+    packet.set_sequence(nack_sequence_.fetch_add(1));
+    packet.set_timestamp(protocol::get_timestamp_us());
+    packet.set_payload(&config, sizeof(config));
+    transport_->send_packet(packet);
+}
+
+void AudioSync::set_fec_scheme(protocol::FecScheme scheme) {
+    fec_scheme_.store(scheme);
+    std::cout << "[Host] FEC scheme set to " << protocol::fec_scheme_to_string(scheme) << std::endl;
 }
 
-void AudioSync::sync_loop() {
-    while (running_.load()) {
-        std::unique_lock<std::mutex> lock(buffer_mutex_);
+void AudioSync::on_fec_packet(const protocol::Packet& packet) {
+    if (packet.header.payload_length < sizeof(protocol::FecPayload)) {
+        return;
+    }
+    protocol::FecPayload fec;
+    memcpy(&fec, packet.payload, sizeof(fec));
+    auto scheme = static_cast<protocol::FecScheme>(fec.scheme);
+    bool valid = (scheme == protocol::FecScheme::XOR && fec.parity_count == 1) ||
+                 (scheme == protocol::FecScheme::REED_SOLOMON && fec.parity_count >= 1 &&
+                  fec.parity_count <= protocol::FEC_MAX_PARITY_PACKETS);
+    valid = valid && fec.data_count >= 1 && fec.data_count <= protocol::FEC_MAX_DATA_PACKETS &&
+            fec.parity_index < fec.parity_count &&
+            fec.block_size >= protocol::FEC_BLOCK_HEADER_SIZE &&
+            sizeof(fec) + fec.block_size <= packet.header.payload_length;
+    if (!valid) {
+        return;
+    }
+    fec_seen_config_.store(pack_fec_config(scheme, fec.data_count, fec.parity_count));
+    
+    std::vector<protocol::Packet> recovered;
+    uint64_t groups_failed = 0;
+    {
+        std::lock_guard<std::mutex> lock(fec_mutex_);
         
-        // Wait for buffer to fill to desired size before starting playback
-        if (next_play_sequence_ == 0) {
-            buffer_cv_.wait_for(lock, std::chrono::milliseconds(100), [this] {
-                return jitter_buffer_.size() >= jitter_buffer_size_.load() || !running_.load();
-            });
-            
-            if (!running_.load()) {
+        // Groups this far behind will get no more parity; any losses left
+        // in them were not rebuilt
+        for (auto it = fec_groups_.begin(); it != fec_groups_.end();) {
+            if (static_cast<int32_t>(fec.base_sequence - it->first) <= static_cast<int32_t>(FEC_GROUP_HORIZON)) {
                 break;
             }
-            
-            // Start playback from oldest packet
-            if (!jitter_buffer_.empty()) {
-                next_play_sequence_ = jitter_buffer_.begin()->first;
-                std::cout << "[Host] 🎵 Starting playback from sequence " << next_play_sequence_ << std::endl;
-            }
+            groups_failed++;
+            it = fec_groups_.erase(it);
         }
         
-        // Check if next packet is available
-        auto it = jitter_buffer_.find(next_play_sequence_);
-        if (it != jitter_buffer_.end()) {
-            // Packet available - play it
-            AudioPacketInfo packet_info = it->second;
-            jitter_buffer_.erase(it);
-            lock.unlock();
-            
-            play_audio_packet(packet_info);
-            next_play_sequence_++;
-            consecutive_losses_ = 0;
-            
+        FecGroup& group = fec_groups_[fec.base_sequence];
+        if (group.parity.empty() || group.scheme != scheme || group.data_count != fec.data_count ||
+            group.parity_count != fec.parity_count || group.block_size != fec.block_size) {
+            group.scheme = scheme;
+            group.data_count = fec.data_count;
+            group.parity_count = fec.parity_count;
+            group.block_size = fec.block_size;
+            memset(group.parity_present, 0, sizeof(group.parity_present));
+            group.parity.assign(static_cast<size_t>(fec.parity_count) * fec.block_size, 0);
+        }
+        memcpy(&group.parity[fec.parity_index * fec.block_size], packet.payload + sizeof(fec),
+               fec.block_size);
+        group.parity_present[fec.parity_index] = 1;
+        
+        recover_fec_group(fec.base_sequence, &recovered);
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.fec_packets_received++;
+        stats_.fec_groups_failed += groups_failed;
+    }
+    for (protocol::Packet& rebuilt : recovered) {
+        if (open_packet(&rebuilt)) {
+            process_audio_packet(rebuilt, true);
+        }
+    }
+}
+
+void AudioSync::store_fec_block(const protocol::Packet& packet) {
+    FecBlock& block = fec_history_[packet.header.sequence % FEC_HISTORY_PACKETS];
+    uint16_t payload_length = packet.header.payload_length;
+    block.valid = true;
+    block.sequence = packet.header.sequence;
+    block.bytes.resize(protocol::FEC_BLOCK_HEADER_SIZE + payload_length);
+    memcpy(block.bytes.data(), &packet.header.timestamp_us, sizeof(uint64_t));
+    memcpy(block.bytes.data() + sizeof(uint64_t), &payload_length, sizeof(payload_length));
+    memcpy(block.bytes.data() + protocol::FEC_BLOCK_HEADER_SIZE, packet.payload, payload_length);
+}
+
+bool AudioSync::recover_fec_group(uint32_t base_sequence, std::vector<protocol::Packet>* recovered) {
+    auto it = fec_groups_.find(base_sequence);
+    if (it == fec_groups_.end()) {
+        return false;
+    }
+    const FecGroup& group = it->second;
+    const size_t block_size = group.block_size;
+    
+    // Present blocks zero-padded to the group's block size
+    std::vector<uint8_t> work(group.data_count * block_size, 0);
+    uint8_t* data[protocol::FEC_MAX_DATA_PACKETS];
+    bool data_present[protocol::FEC_MAX_DATA_PACKETS];
+    size_t missing = 0;
+    for (size_t i = 0; i < group.data_count; i++) {
+        uint32_t sequence = base_sequence + static_cast<uint32_t>(i);
+        const FecBlock& block = fec_history_[sequence % FEC_HISTORY_PACKETS];
+        data[i] = &work[i * block_size];
+        data_present[i] = block.valid && block.sequence == sequence;
+        if (data_present[i]) {
+            memcpy(data[i], block.bytes.data(), std::min(block.bytes.size(), block_size));
         } else {
-            // Packet missing - wait briefly or skip
-            lock.unlock();
-            
-            uint64_t now = protocol::get_timestamp_us();
-            uint64_t time_since_last = (now - last_packet_time_) / 1000;  // ms
-            
-            if (time_since_last > 100) {  // More than 100ms since last packet
-                // Packet is late or lost
-                std::cout << "[Host] ⚠️  Packet loss detected: sequence " << next_play_sequence_ << std::endl;
-                handle_packet_loss(next_play_sequence_);
-                next_play_sequence_++;
-                consecutive_losses_++;
-                
-                // Adjust buffer size if many consecutive losses
-                if (consecutive_losses_ >= 3) {
-                    adjust_buffer_size();
-                    consecutive_losses_ = 0;
-                }
-            } else {
-                // Wait a bit longer for the packet
-                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            missing++;
+        }
+    }
+    if (missing == 0) {
+        fec_groups_.erase(it);
+        return false;
+    }
+    
+    const uint8_t* parity[protocol::FEC_MAX_PARITY_PACKETS];
+    bool parity_present[protocol::FEC_MAX_PARITY_PACKETS];
+    size_t parity_available = 0;
+    for (size_t j = 0; j < group.parity_count; j++) {
+        parity[j] = &group.parity[j * block_size];
+        parity_present[j] = group.parity_present[j] != 0;
+        parity_available += parity_present[j] ? 1 : 0;
+    }
+    if (parity_available < missing) {
+        return false;   // Wait for more parity, or give up at the horizon
+    }
+    if (!common::fec_decode(group.scheme, data, data_present, group.data_count,
+                            parity, parity_present, group.parity_count, block_size)) {
+        return false;
+    }
+    
+    // Unpack the rebuilt blocks into packets as the accessory sent them
+    for (size_t i = 0; i < group.data_count; i++) {
+        if (data_present[i]) {
+            continue;
+        }
+        uint64_t timestamp_us;
+        uint16_t payload_length;
+        memcpy(&timestamp_us, data[i], sizeof(timestamp_us));
+        memcpy(&payload_length, data[i] + sizeof(timestamp_us), sizeof(payload_length));
+        if (protocol::FEC_BLOCK_HEADER_SIZE + payload_length > block_size ||
+            payload_length < sizeof(protocol::AudioPayload)) {
+            continue;
+        }
+        
+        recovered->emplace_back();
+        protocol::Packet& packet = recovered->back();
+        packet.set_type(protocol::PacketType::AUDIO_DATA);
+        packet.set_sequence(base_sequence + static_cast<uint32_t>(i));
+        packet.set_timestamp(timestamp_us);
+        if (cipher_.has_key()) {
+            // Blocks are kept as sent; the sender protects every packet alike
+            packet.set_flags(protection_flag_);
+        }
+        packet.set_payload(data[i] + protocol::FEC_BLOCK_HEADER_SIZE, payload_length);
+        store_fec_block(packet);
+    }
+    fec_groups_.erase(it);
+    return true;
+}
+
+bool AudioSync::decode_frames(const protocol::Packet& packet,
+                              const protocol::AudioPayload& audio_payload,
+                              uint64_t received_time, std::vector<AudioFrameInfo>* frames) {
+    auto encoding = static_cast<protocol::AudioEncoding>(audio_payload.encoding);
+    const uint8_t* data = packet.payload + sizeof(protocol::AudioPayload);
+    size_t remaining = packet.header.payload_length - sizeof(protocol::AudioPayload);
+    size_t encoded_size = remaining;
+    size_t sample_count = audio_payload.sample_count;
+    size_t frame_count = std::max<size_t>(audio_payload.frame_count, 1);
+    
+    protocol::StreamFormat format;
+    bool format_valid = protocol::unpack_stream_format(audio_payload.channels, audio_payload.format,
+                                                       &format);
+    uint32_t channel_samples = format_valid
+        ? protocol::stream_frame_samples(format, audio_payload.sample_count) : 0;
+    
+    common::AudioCodec* decoder = nullptr;
+    size_t slot = static_cast<size_t>(encoding);
+    if (format_valid && slot < sizeof(decoders_) / sizeof(decoders_[0])) {
+        if (!decoders_[slot] || decoders_[slot]->format() != format) {
+            decoders_[slot] = common::create_audio_codec(encoding, format);
+        }
+        decoder = decoders_[slot].get();
+    }
+    
+    bool decoded = decoder && protocol::is_valid_frame_samples(audio_payload.sample_count) &&
+                   channel_samples > 0 && frame_count <= protocol::MAX_FRAMES_PER_PACKET;
+    if (decoded) {
+        frames->resize(frame_count);
+    }
+    for (size_t i = 0; decoded && i < frame_count; i++) {
+        // Aggregated frames are prefixed by their size; a lone frame is the
+        // whole remaining payload
+        size_t frame_size = remaining;
+        if (frame_count > 1) {
+            uint16_t prefix = 0;
+            decoded = remaining >= sizeof(prefix);
+            if (decoded) {
+                memcpy(&prefix, data, sizeof(prefix));
+                data += sizeof(prefix);
+                remaining -= sizeof(prefix);
+                frame_size = prefix;
+                decoded = frame_size <= remaining;
             }
         }
+        
+        AudioFrameInfo& frame = (*frames)[i];
+        frame.sequence = packet.header.sequence;
+        frame.first_in_packet = (i == 0);
+        frame.sample_position = audio_payload.sample_position + i * sample_count;
+        frame.stream_timestamp = audio_payload.stream_timestamp + protocol::samples_to_us(i * sample_count);
+        frame.received_timestamp_us = received_time;
+        frame.sample_count = audio_payload.sample_count;
+        frame.format = format;
+        if (decoded) {
+            size_t samples = channel_samples * format.channels;
+            frame.audio_data.resize(samples * common::sample_size(format.sample_format));
+            decoded = decoder->decode(data, frame_size, frame.audio_data.data(), samples);
+            data += frame_size;
+            remaining -= frame_size;
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.audio_bytes_received += encoded_size;
+    stats_.encoding = encoding;
+    if (format_valid) {
+        stats_.stream_format = format;
+    }
+    if (!decoded) {
+        stats_.decode_errors++;
+        if (stats_.decode_errors == 1 || stats_.decode_errors % 100 == 0) {
+            std::cout << "[Host] ⚠️  Cannot decode " << protocol::audio_encoding_to_string(encoding)
+                      << " audio (errors: " << stats_.decode_errors << ")" << std::endl;
+        }
+    }
+    return decoded;
+}
+
+void AudioSync::playout_tick() {
+    std::vector<uint32_t> nacks;
+    protocol::AckPayload ack;
+    bool ack_due = false;
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex_);
+        uint64_t now = protocol::get_timestamp_us();
+        advance_playout(now);
+        retry_retransmits(now, &nacks);
+        
+        // Flush a partial ACK batch once it has waited the interval
+        ack_due = ack_pending_frames_ > 0 && now - ack_pending_since_us_ >= ack_interval_us_.load();
+        if (ack_due) {
+            build_ack(now, &ack);
+        }
+    }
+    if (ack_due) {
+        send_ack(ack);
     }
+    send_nack(nacks);
 }
 
-void AudioSync::play_audio_packet(const AudioPacketInfo& packet_info) {
+void AudioSync::advance_playout(uint64_t now) {
+    if (!playback_started_) {
+        // Aligned playout was scheduled for the first packet's capture time
+        // plus the target delay; otherwise wait for the buffer to fill
+        if (jitter_buffer_.empty() ||
+            (!playout_aligned_ && buffered_samples_ < target_depth_samples())) {
+            return;
+        }
+        
+        // Start playback from oldest frame
+        next_play_position_ = jitter_buffer_.begin()->first;
+        playout_origin_us_ = now;
+        playout_origin_position_ = next_play_position_;
+        playback_started_ = true;
+        std::cout << "[Host] 🎵 Starting playback from sample " << next_play_position_
+                  << " (sequence " << jitter_buffer_.begin()->second.sequence << ")" << std::endl;
+    }
+    
+    // Playout follows a sample clock, so a late or skipped tick plays every
+    // frame that has come due instead of falling behind for good
+    uint64_t due_position = playout_origin_position_ +
+                            (now - playout_origin_us_) * protocol::AUDIO_SAMPLE_RATE / 1000000;
+    if (due_position > next_play_position_ + protocol::MAX_JITTER_BUFFER_SAMPLES) {
+        playout_origin_us_ = now;
+        playout_origin_position_ = next_play_position_;
+        due_position = next_play_position_;
+    }
+    
+    do {
+        if (!play_next_frame(now)) {
+            return;
+        }
+    } while (playback_started_ && next_play_position_ <= due_position);
+}
+
+bool AudioSync::play_next_frame(uint64_t now) {
+    // Check if next frame is available
+    auto it = jitter_buffer_.find(next_play_position_);
+    if (it != jitter_buffer_.end()) {
+        // Frame available - play it
+        buffered_samples_ -= it->second.sample_count;
+        next_play_position_ += it->second.sample_count;
+        play_audio_frame(it->second);
+        jitter_buffer_.erase(it);
+        consecutive_losses_ = 0;
+        return true;
+    }
+    
+    // Frame missing at its playout slot. If later frames are already
+    // buffered it is lost; otherwise hold playout, and once the stream has
+    // stalled wait for the buffer to refill as at start
+    uint64_t missing_position = next_play_position_;
+    if (jitter_buffer_.empty()) {
+        uint64_t stall_us = std::max(STALL_TIMEOUT_US, 2 * protocol::samples_to_us(packet_samples_));
+        if (now - last_packet_time_ > stall_us) {
+            playback_started_ = false;
+            playout_aligned_ = false;
+            
+            std::cout << "[Host] ⏸️  Audio stream stalled at sample " << missing_position
+                      << ", rebuffering" << std::endl;
+            std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+            stats_.stalls++;
+        }
+        return false;
+    }
+    
+    // Conceal one frame, never past the next buffered one
+    uint16_t lost_samples = frame_samples_;
+    if (jitter_buffer_.begin()->first - missing_position < lost_samples) {
+        lost_samples = static_cast<uint16_t>(jitter_buffer_.begin()->first - missing_position);
+    }
+    next_play_position_ += lost_samples;
+    
+    handle_frame_loss(missing_position, lost_samples);
+    consecutive_losses_++;
+    
+    // Adjust buffer size if many consecutive losses
+    if (consecutive_losses_ >= 3) {
+        adjust_buffer_size();
+        consecutive_losses_ = 0;
+    }
+    return true;
+}
+
+void AudioSync::play_audio_frame(const AudioFrameInfo& frame) {
     // Simulate audio playback (in real system: send to audio device)
+    if (latency_trace_ && frame.first_in_packet) {
+        latency_trace_->stamp(common::LatencyTrace::Stage::PLAYOUT, frame.sequence);
+    }
+    meter_frame(frame);
     
     std::lock_guard<std::mutex> lock(stats_mutex_);
-    stats_.packets_played++;
+    stats_.frames_played++;
+    stats_.samples_played += frame.sample_count;
     
-    if (stats_.packets_played % 100 == 0) {
-        std::cout << "[Host] 🔊 Playing audio - Packets: " << stats_.packets_played
-                  << ", Latency: " << stats_.current_latency_ms << "ms"
-                  << ", Buffer: " << jitter_buffer_.size() << "/" << static_cast<int>(jitter_buffer_size_.load())
+    // Publish the meter about once a second
+    if (meter_samples_ >= protocol::AUDIO_SAMPLE_RATE) {
+        memcpy(stats_.channel_peaks, meter_peaks_, sizeof(meter_peaks_));
+        memset(meter_peaks_, 0, sizeof(meter_peaks_));
+        meter_samples_ = 0;
+    }
+    
+    // Log about once a second at any frame duration
+    uint64_t log_every = protocol::AUDIO_SAMPLE_RATE / frame.sample_count;
+    if (stats_.frames_played % log_every == 0) {
+        std::cout << "[Host] 🔊 Playing audio - Frames: " << stats_.frames_played
+                  << ", Transit delay: " << stats_.current_latency_ms << "ms"
+                  << ", Buffer: " << protocol::samples_to_us(buffered_samples_) / 1000.0 << "/"
+                  << protocol::samples_to_us(jitter_buffer_samples_.load()) / 1000.0 << "ms"
                   << std::endl;
     }
 }
 
-void AudioSync::handle_packet_loss(uint32_t lost_sequence) {
+void AudioSync::meter_frame(const AudioFrameInfo& frame) {
+    // One branch on the format per frame; the peak scan is compiled per type
+    const size_t sample_bytes = common::sample_size(frame.format.sample_format);
+    const size_t frames = frame.audio_data.size() / (sample_bytes * frame.format.channels);
+    common::with_sample_format(frame.format.sample_format, [&](auto traits) {
+        using Traits = decltype(traits);
+        common::channel_peaks<Traits::FORMAT>(
+            reinterpret_cast<const typename Traits::Type*>(frame.audio_data.data()),
+            frames, frame.format.channels, meter_peaks_);
+    });
+    meter_samples_ += frame.sample_count;
+}
+
+void AudioSync::handle_frame_loss(uint64_t lost_position, uint16_t samples) {
     std::lock_guard<std::mutex> lock(stats_mutex_);
-    stats_.packets_dropped++;
+    stats_.frames_lost++;
+    stats_.samples_lost += samples;
     
-    // Send retransmit request (optional - not implemented in this simulation)
-    
-    std::cout << "[Host] Packet " << lost_sequence << " lost (total: "
-              << stats_.packets_dropped << ")" << std::endl;
+    std::cout << "[Host] ⚠️  Audio lost at sample " << lost_position << " (" << samples
+              << " samples, total lost: " << stats_.samples_lost << ")" << std::endl;
 }
 
 void AudioSync::adjust_buffer_size() {
-    uint8_t current_size = jitter_buffer_size_.load();
-    
-    if (current_size < protocol::MAX_JITTER_BUFFER_PACKETS) {
-        current_size++;
-        jitter_buffer_size_.store(current_size);
-        
-        std::lock_guard<std::mutex> lock(stats_mutex_);
-        stats_.buffer_underruns++;
-        
-        std::cout << "[Host] 📊 Increasing jitter buffer size to " << static_cast<int>(current_size)
-                  << " packets (latency now ~" << (current_size * protocol::AUDIO_PACKET_DURATION_MS)
-                  << "ms)" << std::endl;
+    // Grow by one frame of the current stream
+    uint32_t current = jitter_buffer_samples_.load();
+    if (current >= protocol::MAX_JITTER_BUFFER_SAMPLES) {
+        return;
     }
+    current = std::min(current + frame_samples_, protocol::MAX_JITTER_BUFFER_SAMPLES);
+    jitter_buffer_samples_.store(current);
+    
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.buffer_underruns++;
+    
+    std::cout << "[Host] 📊 Increasing jitter buffer to " << current << " samples (latency now ~"
+              << protocol::samples_to_us(current) / 1000.0 << "ms)" << std::endl;
 }
 
-void AudioSync::set_jitter_buffer_size(uint8_t packets) {
-    if (packets < protocol::MIN_JITTER_BUFFER_PACKETS) {
-        packets = protocol::MIN_JITTER_BUFFER_PACKETS;
-    }
-    if (packets > protocol::MAX_JITTER_BUFFER_PACKETS) {
-        packets = protocol::MAX_JITTER_BUFFER_PACKETS;
-    }
+void AudioSync::set_jitter_buffer_samples(uint32_t samples) {
+    samples = std::max(samples, protocol::MIN_JITTER_BUFFER_SAMPLES);
+    samples = std::min(samples, protocol::MAX_JITTER_BUFFER_SAMPLES);
     
-    jitter_buffer_size_.store(packets);
-    std::cout << "[Host] Jitter buffer size set to " << static_cast<int>(packets) << " packets" << std::endl;
+    jitter_buffer_samples_.store(samples);
+    std::cout << "[Host] Jitter buffer set to " << samples << " samples ("
+              << protocol::samples_to_us(samples) / 1000.0 << "ms)" << std::endl;
 }
 
 AudioSync::Stats AudioSync::get_stats() const {
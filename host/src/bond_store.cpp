@@ -0,0 +1,596 @@
+#include "host/bond_store.h"
+#include "secure_zero.h"
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <nmmintrin.h>
+#define BOND_STORE_X86_DISPATCH 1
+#endif
+
+namespace host {
+
+namespace {
+
+// File layout: a page of header, then `slots` slots of two record copies.
+// Slots start on a page boundary so flushing one record touches one page.
+constexpr char MAGIC[8] = {'W', 'A', 'B', 'O', 'N', 'D', 'S', '\0'};
+constexpr uint32_t FORMAT_VERSION = 1;
+constexpr size_t HEADER_SIZE = 4096;
+constexpr size_t COUNTERS_OFFSET = 64;
+constexpr size_t COPY_SIZE = 128;
+constexpr size_t SLOT_SIZE = 2 * COPY_SIZE;
+constexpr uint32_t MIN_SLOTS = 16;
+
+constexpr uint8_t STATE_EMPTY = 0;
+constexpr uint8_t STATE_LIVE = 1;
+constexpr uint8_t STATE_DELETED = 2;
+
+#pragma pack(push, 1)
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t slots;
+    uint32_t slot_size;
+    uint32_t checksum;          // Of the fields above
+};
+
+// Bond and tombstone counts, double-buffered like the records. Written
+// after each change, so a crash in between can leave them one out.
+struct Counters {
+    uint32_t sequence;
+    uint32_t bonds;
+    uint32_t tombstones;
+    uint32_t checksum;          // Of the fields above
+};
+
+struct RecordCopy {
+    uint32_t sequence;          // 0: never written
+    uint32_t checksum;          // Of the sequence and everything after
+    uint8_t state;
+    Bond bond;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(RecordCopy) <= COPY_SIZE, "a record copy must fit its half of a slot");
+static_assert(sizeof(FileHeader) <= COUNTERS_OFFSET, "header overlaps the counters");
+
+// CRC-32C: the SSE4.2 instruction where there is one, else bytewise from
+// a table (records are about a hundred bytes)
+const uint32_t* crc_table() {
+    static uint32_t table[256];
+    static bool built = [] {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1)));
+            }
+            table[i] = crc;
+        }
+        return true;
+    }();
+    (void)built;
+    return table;
+}
+
+uint32_t crc32c_portable(uint32_t crc, const uint8_t* p, size_t length) {
+    const uint32_t* table = crc_table();
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(BOND_STORE_X86_DISPATCH)
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42(uint32_t crc, const uint8_t* p, size_t length) {
+#if defined(__x86_64__)
+    uint64_t wide = crc;
+    for (; length >= 8; p += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = static_cast<uint32_t>(wide);
+#endif
+    for (; length > 0; p++, length--) {
+        crc = _mm_crc32_u8(crc, *p);
+    }
+    return crc;
+}
+#endif
+
+using Crc32cFunction = uint32_t (*)(uint32_t, const uint8_t*, size_t);
+
+Crc32cFunction detect_crc32c() {
+#if defined(BOND_STORE_X86_DISPATCH)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        return crc32c_sse42;
+    }
+#endif
+    return crc32c_portable;
+}
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t length) {
+    static const Crc32cFunction implementation = detect_crc32c();
+    return ~implementation(~crc, static_cast<const uint8_t*>(data), length);
+}
+
+uint32_t record_checksum(const RecordCopy& copy) {
+    uint32_t crc = crc32c(0, &copy.sequence, sizeof(copy.sequence));
+    return crc32c(crc, &copy.state, sizeof(copy) - offsetof(RecordCopy, state));
+}
+
+// Sequence numbers wrap; the newer is the one less than half the range ahead
+bool newer(uint32_t a, uint32_t b) {
+    return static_cast<int32_t>(a - b) > 0;
+}
+
+// Device ids are random, but mix them anyway so a poor source cannot
+// cluster the table
+uint32_t hash_device_id(const uint8_t* device_id) {
+    uint64_t x;
+    memcpy(&x, device_id, sizeof(x));
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return static_cast<uint32_t>(x);
+}
+
+struct SlotView {
+    uint8_t state;              // Of the current copy; damaged slots read as deleted
+    int current;                // Copy index, -1 when neither is valid
+    uint32_t sequence;          // Highest seen, valid or not
+    uint32_t damaged;           // Copies failing their checksum
+    RecordCopy record;          // The current copy
+};
+
+uint8_t* slot_at(uint8_t* base, uint32_t slot) {
+    return base + HEADER_SIZE + static_cast<size_t>(slot) * SLOT_SIZE;
+}
+
+constexpr size_t DEVICE_ID_OFFSET = offsetof(RecordCopy, bond) + offsetof(Bond, device_id);
+
+// Without checking anything: was either copy ever written, and does either
+// name the device. Probing only checks the slots that do.
+bool slot_written(const uint8_t* slot) {
+    uint32_t first, second;
+    memcpy(&first, slot, sizeof(first));
+    memcpy(&second, slot + COPY_SIZE, sizeof(second));
+    return (first | second) != 0;
+}
+
+bool slot_names(const uint8_t* slot, const uint8_t* device_id) {
+    for (size_t c = 0; c < 2; c++) {
+        const uint8_t* copy = slot + c * COPY_SIZE;
+        uint32_t sequence;
+        memcpy(&sequence, copy, sizeof(sequence));
+        if (sequence != 0 && memcmp(copy + DEVICE_ID_OFFSET, device_id, 8) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+SlotView read_slot(const uint8_t* slot) {
+    SlotView view;
+    view.current = -1;
+    view.sequence = 0;
+    view.damaged = 0;
+    for (int c = 0; c < 2; c++) {
+        RecordCopy copy;
+        memcpy(&copy, slot + c * COPY_SIZE, sizeof(copy));
+        if (copy.sequence == 0) {
+            continue;
+        }
+        if (view.sequence == 0 || newer(copy.sequence, view.sequence)) {
+            view.sequence = copy.sequence;
+        }
+        if (record_checksum(copy) != copy.checksum || copy.state == STATE_EMPTY) {
+            view.damaged++;
+            continue;
+        }
+        if (view.current < 0 || newer(copy.sequence, view.record.sequence)) {
+            view.current = c;
+            view.record = copy;
+        }
+    }
+    if (view.current >= 0) {
+        view.state = view.record.state;
+    } else {
+        // A slot that was written keeps probe chains through it going
+        view.state = view.damaged > 0 ? STATE_DELETED : STATE_EMPTY;
+    }
+    return view;
+}
+
+void flush(uint8_t* address, size_t length) {
+    static const uintptr_t page_mask = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE)) - 1;
+    uintptr_t start = reinterpret_cast<uintptr_t>(address) & ~page_mask;
+    uintptr_t end = reinterpret_cast<uintptr_t>(address) + length;
+    msync(reinterpret_cast<void*>(start), end - start, MS_SYNC);
+}
+
+void store_counters(uint8_t* base, uint32_t sequence, uint32_t bonds, uint32_t tombstones) {
+    Counters counters;
+    counters.sequence = sequence;
+    counters.bonds = bonds;
+    counters.tombstones = tombstones;
+    counters.checksum = crc32c(0, &counters, offsetof(Counters, checksum));
+    memcpy(base + COUNTERS_OFFSET + (sequence & 1) * sizeof(Counters), &counters, sizeof(counters));
+}
+
+bool load_counters(const uint8_t* base, Counters* counters) {
+    bool found = false;
+    for (size_t c = 0; c < 2; c++) {
+        Counters copy;
+        memcpy(&copy, base + COUNTERS_OFFSET + c * sizeof(Counters), sizeof(copy));
+        if (copy.checksum != crc32c(0, &copy, offsetof(Counters, checksum))) {
+            continue;
+        }
+        if (!found || newer(copy.sequence, counters->sequence)) {
+            *counters = copy;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void sync_directory(const std::string& path) {
+    size_t slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        ::close(fd);
+    }
+}
+
+} // namespace
+
+BondStore::BondStore()
+    : counter_sequence_(0) {
+    table_.base = nullptr;
+    table_.size = 0;
+    table_.slots = 0;
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+BondStore::~BondStore() {
+    close();
+}
+
+bool BondStore::open(const std::string& path, uint32_t slots) {
+    uint64_t start_us = protocol::get_timestamp_us();
+    std::lock_guard<std::mutex> lock(mutex_);
+    unmap();
+    path_ = path;
+
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && st.st_size > 0 && !map_file(path)) {
+        std::string aside = path + ".bad";
+        std::cout << "[Host] " << path << " is not a bond store, moved to " << aside << std::endl;
+        std::rename(path.c_str(), aside.c_str());
+    }
+    if (!table_.base) {
+        uint32_t rounded = MIN_SLOTS;
+        while (rounded < slots && rounded < (1u << 30)) {
+            rounded <<= 1;
+        }
+        if (!create_file(path, rounded, nullptr) || !map_file(path)) {
+            std::cout << "[Host] Cannot create bond store " << path << std::endl;
+            return false;
+        }
+    }
+    stats_.open_us = protocol::get_timestamp_us() - start_us;
+    return true;
+}
+
+void BondStore::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    unmap();
+}
+
+bool BondStore::is_open() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return table_.base != nullptr;
+}
+
+void BondStore::unmap() {
+    if (table_.base) {
+        munmap(table_.base, table_.size);
+    }
+    table_.base = nullptr;
+    table_.size = 0;
+    table_.slots = 0;
+}
+
+bool BondStore::map_file(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDWR);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < HEADER_SIZE) {
+        ::close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);    // The mapping keeps the file
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    // Only the header is checked; records are checked as they are read
+    uint8_t* base = static_cast<uint8_t*>(map);
+    FileHeader header;
+    memcpy(&header, base, sizeof(header));
+    bool valid = memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                 header.version == FORMAT_VERSION && header.slot_size == SLOT_SIZE &&
+                 header.checksum == crc32c(0, &header, offsetof(FileHeader, checksum)) &&
+                 header.slots >= MIN_SLOTS && (header.slots & (header.slots - 1)) == 0 &&
+                 size == HEADER_SIZE + static_cast<size_t>(header.slots) * SLOT_SIZE;
+    if (!valid) {
+        munmap(map, size);
+        return false;
+    }
+    madvise(map, size, MADV_RANDOM);
+
+    table_.base = base;
+    table_.size = size;
+    table_.slots = header.slots;
+    Counters counters;
+    if (!load_counters(base, &counters)) {
+        memset(&counters, 0, sizeof(counters));
+    }
+    counter_sequence_ = counters.sequence;
+    stats_.slots = header.slots;
+    stats_.bonds = counters.bonds;
+    stats_.tombstones = counters.tombstones;
+    return true;
+}
+
+bool BondStore::create_file(const std::string& path, uint32_t slots, const Table* source) {
+    // Built aside and renamed into place, so the old file (or none) stays
+    // whole until the new one is
+    std::string temporary = path + ".tmp";
+    int fd = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    size_t size = HEADER_SIZE + static_cast<size_t>(slots) * SLOT_SIZE;
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+        map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        ::close(fd);
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    Table table;
+    table.base = static_cast<uint8_t*>(map);
+    table.size = size;
+    table.slots = slots;
+    FileHeader header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.slots = slots;
+    header.slot_size = SLOT_SIZE;
+    header.checksum = crc32c(0, &header, offsetof(FileHeader, checksum));
+    memcpy(table.base, &header, sizeof(header));
+
+    uint32_t bonds = 0;
+    if (source) {
+        for (uint32_t i = 0; i < source->slots; i++) {
+            SlotView view = read_slot(slot_at(source->base, i));
+            uint32_t slot;
+            bool found;
+            if (view.state == STATE_LIVE &&
+                probe(table, view.record.bond.device_id, &slot, &found, nullptr) && !found) {
+                write_record(table, slot, STATE_LIVE, view.record.bond, false);
+                bonds++;
+            }
+        }
+    }
+    store_counters(table.base, 1, bonds, 0);
+
+    msync(map, size, MS_SYNC);
+    munmap(map, size);
+    bool written = fsync(fd) == 0;
+    ::close(fd);
+    if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        unlink(temporary.c_str());
+        return false;
+    }
+    sync_directory(path);
+    return true;
+}
+
+bool BondStore::rebuild() {
+    // Dropping the tombstones is enough when they are most of the load
+    uint32_t slots = table_.slots;
+    if (stats_.tombstones < stats_.bonds) {
+        if (slots >= (1u << 30)) {
+            return false;
+        }
+        slots *= 2;
+    }
+    if (!create_file(path_, slots, &table_)) {
+        return false;
+    }
+    unmap();
+    if (!map_file(path_)) {
+        return false;
+    }
+    stats_.rebuilds++;
+    std::cout << "[Host] Bond store rebuilt with " << table_.slots << " slots" << std::endl;
+    return true;
+}
+
+bool BondStore::probe(const Table& table, const uint8_t* device_id, uint32_t* slot,
+                      bool* found, Bond* bond) const {
+    // Lookups (bond set) skip the checksums of other devices' slots;
+    // inserts check them until they meet a tombstone to reuse
+    const uint32_t mask = table.slots - 1;
+    const uint32_t start = hash_device_id(device_id) & mask;
+    const uint32_t none = table.slots;
+    bool want_free = bond == nullptr;
+    uint32_t free_slot = none;
+    for (uint32_t i = 0; i < table.slots; i++) {
+        uint32_t index = (start + i) & mask;
+        const uint8_t* raw = slot_at(table.base, index);
+        stats_.probes++;
+        if (!slot_written(raw)) {
+            *slot = free_slot != none ? free_slot : index;
+            *found = false;
+            return true;
+        }
+        bool named = slot_names(raw, device_id);
+        if (!named && !(want_free && free_slot == none)) {
+            continue;
+        }
+        SlotView view = read_slot(raw);
+        stats_.damaged_copies += view.damaged;
+        if (named && view.state == STATE_LIVE &&
+            memcmp(view.record.bond.device_id, device_id, sizeof(view.record.bond.device_id)) == 0) {
+            if (bond) {
+                *bond = view.record.bond;
+            }
+            *slot = index;
+            *found = true;
+            return true;
+        }
+        if (want_free && view.state == STATE_DELETED && free_slot == none) {
+            free_slot = index;          // Reused unless the device is further on
+        }
+    }
+    *slot = free_slot;
+    *found = false;
+    return free_slot != none;
+}
+
+void BondStore::write_record(Table& table, uint32_t slot, uint8_t state, const Bond& bond,
+                             bool durable) {
+    uint8_t* target = slot_at(table.base, slot);
+    SlotView view = read_slot(target);
+
+    // The copy that is not current: the current one survives a torn write
+    RecordCopy copy;
+    memset(&copy, 0, sizeof(copy));
+    copy.sequence = view.sequence + 1;
+    if (copy.sequence == 0) {
+        copy.sequence = 1;
+    }
+    copy.state = state;
+    copy.bond = bond;
+    copy.checksum = record_checksum(copy);
+    uint8_t* destination = target + (view.current == 0 ? COPY_SIZE : 0);
+    memcpy(destination, &copy, sizeof(copy));
+    common::secure_zero(&copy, sizeof(copy));
+
+    stats_.writes++;
+    if (durable) {
+        flush(destination, sizeof(copy));
+        stats_.syncs++;
+    }
+}
+
+void BondStore::write_counters(bool durable) {
+    counter_sequence_++;
+    store_counters(table_.base, counter_sequence_, stats_.bonds, stats_.tombstones);
+    if (durable) {
+        flush(table_.base, HEADER_SIZE);
+    }
+}
+
+bool BondStore::find(const uint8_t* device_id, Bond* bond) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!table_.base) {
+        return false;
+    }
+    stats_.lookups++;
+    uint32_t slot;
+    bool found;
+    return probe(table_, device_id, &slot, &found, bond) && found;
+}
+
+bool BondStore::put(const Bond& bond, bool durable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!table_.base) {
+        return false;
+    }
+    uint32_t slot;
+    bool found;
+    bool fits = probe(table_, bond.device_id, &slot, &found, nullptr);
+    if (!found) {
+        // Keep probe chains short: at most three quarters of the slots
+        // hold bonds or tombstones
+        bool reuse = fits && read_slot(slot_at(table_.base, slot)).state == STATE_DELETED;
+        uint64_t taken = static_cast<uint64_t>(stats_.bonds) + stats_.tombstones + (reuse ? 0 : 1);
+        if (!fits || taken * 4 > static_cast<uint64_t>(table_.slots) * 3) {
+            if (rebuild()) {
+                fits = probe(table_, bond.device_id, &slot, &found, nullptr);
+                reuse = false;
+            }
+            if (!fits) {
+                return false;
+            }
+        }
+        if (reuse && stats_.tombstones > 0) {
+            stats_.tombstones--;
+        }
+        stats_.bonds++;
+    }
+    write_record(table_, slot, STATE_LIVE, bond, durable);
+    if (!found) {
+        write_counters(durable);
+    }
+    return true;
+}
+
+bool BondStore::erase(const uint8_t* device_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!table_.base) {
+        return false;
+    }
+    uint32_t slot;
+    bool found;
+    if (!probe(table_, device_id, &slot, &found, nullptr) || !found) {
+        return false;
+    }
+    // Both copies become tombstones, so the key is gone from the file
+    Bond tombstone;
+    memset(&tombstone, 0, sizeof(tombstone));
+    memcpy(tombstone.device_id, device_id, sizeof(tombstone.device_id));
+    write_record(table_, slot, STATE_DELETED, tombstone, false);
+    write_record(table_, slot, STATE_DELETED, tombstone, true);
+    if (stats_.bonds > 0) {
+        stats_.bonds--;
+    }
+    stats_.tombstones++;
+    write_counters(true);
+    return true;
+}
+
+size_t BondStore::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_.bonds;
+}
+
+BondStore::Stats BondStore::get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace host
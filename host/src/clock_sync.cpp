@@ -0,0 +1,235 @@
+#include "host/clock_sync.h"
+#include "host/transport.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+namespace host {
+
+namespace {
+
+constexpr uint64_t SYNC_TICK_US = 100000;               // Burst spacing
+constexpr uint32_t SYNC_BURST_COUNT = 8;                // Exchanges right after start()
+constexpr size_t SYNC_WINDOW = 32;                      // Samples kept for the fit
+constexpr size_t SYNC_MIN_SAMPLES = 4;                  // Before reporting synchronized
+constexpr uint64_t SYNC_RTT_SLACK_US = 200;             // Accept up to min RTT + slack
+constexpr uint64_t SYNC_MIN_DRIFT_SPAN_US = 20000000;   // Fit drift only over >= 20 s of samples
+constexpr double SYNC_MAX_DRIFT = 500e-6;               // Clamp to crystal tolerance
+
+} // namespace
+
+ClockSync::ClockSync(Transport* transport, common::TimerWheel* scheduler)
+    : transport_(transport)
+    , scheduler_(scheduler)
+    , running_(false)
+    , sync_timer_(common::TimerWheel::INVALID_TIMER)
+    , next_sequence_(0)
+    , last_request_us_(0)
+    , base_offset_us_(0)
+    , base_time_us_(0)
+    , drift_(0.0)
+    , synchronized_(false) {
+
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+ClockSync::~ClockSync() {
+    stop();
+}
+
+void ClockSync::start() {
+    if (running_.load()) {
+        return;
+    }
+
+    std::cout << "[Host] Starting clock synchronization" << std::endl;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        samples_.clear();
+        base_offset_us_ = 0;
+        base_time_us_ = 0;
+        drift_ = 0.0;
+        synchronized_.store(false);
+        memset(&stats_, 0, sizeof(stats_));
+    }
+    last_request_us_ = 0;
+
+    running_.store(true);
+
+    // Ticks at the burst spacing; sync_tick() drops to the keepalive
+    // interval once the start-up burst has been sent
+    sync_timer_ = scheduler_->schedule_periodic(SYNC_TICK_US, [this] { sync_tick(); }, 0);
+}
+
+void ClockSync::stop() {
+    if (!running_.load()) {
+        return;
+    }
+
+    std::cout << "[Host] Stopping clock synchronization" << std::endl;
+    running_.store(false);
+
+    scheduler_->cancel(sync_timer_);
+    sync_timer_ = common::TimerWheel::INVALID_TIMER;
+}
+
+void ClockSync::sync_tick() {
+    uint64_t now = protocol::get_timestamp_us();
+    uint64_t requests_sent;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        requests_sent = stats_.requests_sent;
+    }
+
+    if (requests_sent < SYNC_BURST_COUNT ||
+        now - last_request_us_ >= protocol::KEEPALIVE_INTERVAL_MS * 1000ull) {
+        send_request();
+        last_request_us_ = now;
+    }
+}
+
+void ClockSync::send_request() {
+    protocol::TimeSyncPayload sync;
+    memset(&sync, 0, sizeof(sync));
+
+    protocol::Packet packet;
+    packet.set_type(protocol::PacketType::TIME_SYNC_REQUEST);
+    packet.set_sequence(next_sequence_++);
+    sync.origin_us = protocol::get_timestamp_us();
+    packet.set_timestamp(sync.origin_us);
+    packet.set_payload(&sync, sizeof(sync));
+
+    if (transport_->send_packet(packet)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.requests_sent++;
+    }
+}
+
+void ClockSync::on_time_sync_response(const protocol::Packet& packet) {
+    uint64_t t4 = protocol::get_timestamp_us();
+
+    if (packet.header.payload_length < sizeof(protocol::TimeSyncPayload)) {
+        return;
+    }
+
+    protocol::TimeSyncPayload sync;
+    memcpy(&sync, packet.payload, sizeof(sync));
+
+    uint64_t t1 = sync.origin_us;
+    uint64_t t2 = sync.receive_us;
+    uint64_t t3 = sync.transmit_us;
+    if (t4 < t1 || t3 < t2 || (t3 - t2) > (t4 - t1)) {
+        return;  // Malformed or not one of ours
+    }
+
+    Sample sample;
+    sample.host_us = t1 + (t4 - t1) / 2;
+    sample.rtt_us = (t4 - t1) - (t3 - t2);
+    sample.offset_us = ((static_cast<int64_t>(t2) - static_cast<int64_t>(t1)) +
+                        (static_cast<int64_t>(t3) - static_cast<int64_t>(t4))) / 2;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.responses_received++;
+    stats_.last_rtt_us = static_cast<uint32_t>(sample.rtt_us);
+
+    samples_.push_back(sample);
+    if (samples_.size() > SYNC_WINDOW) {
+        samples_.pop_front();
+    }
+
+    update_estimate();
+}
+
+void ClockSync::update_estimate() {
+    uint64_t min_rtt = UINT64_MAX;
+    for (const Sample& sample : samples_) {
+        min_rtt = std::min(min_rtt, sample.rtt_us);
+    }
+    stats_.min_rtt_us = static_cast<uint32_t>(min_rtt);
+
+    uint64_t threshold = min_rtt + SYNC_RTT_SLACK_US;
+    if (samples_.back().rtt_us > threshold) {
+        stats_.samples_rejected++;
+    }
+
+    if (samples_.size() < SYNC_MIN_SAMPLES) {
+        return;
+    }
+
+    // Least-squares fit of offset against host time over the fast exchanges,
+    // with time relative to the newest accepted sample
+    uint64_t ref_time = 0;
+    uint64_t first_time = 0;
+    for (const Sample& sample : samples_) {
+        if (sample.rtt_us <= threshold) {
+            if (first_time == 0) {
+                first_time = sample.host_us;
+            }
+            ref_time = sample.host_us;
+        }
+    }
+
+    double n = 0.0;
+    double sum_x = 0.0;
+    double sum_y = 0.0;
+    for (const Sample& sample : samples_) {
+        if (sample.rtt_us <= threshold) {
+            n += 1.0;
+            sum_x += static_cast<double>(sample.host_us) - static_cast<double>(ref_time);
+            sum_y += static_cast<double>(sample.offset_us);
+        }
+    }
+    double mean_x = sum_x / n;
+    double mean_y = sum_y / n;
+
+    double slope = 0.0;
+    if (n >= 3.0 && ref_time - first_time >= SYNC_MIN_DRIFT_SPAN_US) {
+        double sxx = 0.0;
+        double sxy = 0.0;
+        for (const Sample& sample : samples_) {
+            if (sample.rtt_us <= threshold) {
+                double dx = static_cast<double>(sample.host_us) - static_cast<double>(ref_time) - mean_x;
+                double dy = static_cast<double>(sample.offset_us) - mean_y;
+                sxx += dx * dx;
+                sxy += dx * dy;
+            }
+        }
+        if (sxx > 0.0) {
+            slope = std::max(-SYNC_MAX_DRIFT, std::min(SYNC_MAX_DRIFT, sxy / sxx));
+        }
+    }
+
+    base_time_us_ = ref_time;
+    base_offset_us_ = static_cast<int64_t>(mean_y - slope * mean_x);
+    drift_ = slope;
+
+    stats_.offset_us = base_offset_us_;
+    stats_.drift_ppm = drift_ * 1e6;
+
+    if (!synchronized_.load()) {
+        synchronized_.store(true);
+        stats_.synchronized = true;
+        std::cout << "[Host] ⏱  Clock synchronized: offset " << base_offset_us_
+                  << "us, min RTT " << min_rtt << "us" << std::endl;
+    }
+}
+
+uint64_t ClockSync::to_host_time(uint64_t accessory_us) const {
+    if (!synchronized_.load()) {
+        return accessory_us;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t approx_host = static_cast<int64_t>(accessory_us) - base_offset_us_;
+    double elapsed = static_cast<double>(approx_host - static_cast<int64_t>(base_time_us_));
+    int64_t offset = base_offset_us_ + static_cast<int64_t>(drift_ * elapsed);
+    return static_cast<uint64_t>(static_cast<int64_t>(accessory_us) - offset);
+}
+
+ClockSync::Stats ClockSync::get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace host
@@ -0,0 +1,342 @@
+#include "host/connection_fsm.h"
+#include "csprng.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+namespace host {
+
+namespace {
+
+constexpr uint64_t SUPERVISION_INTERVAL_US = 50000;    // Granularity of every timeout
+
+} // namespace
+
+ConnectionFSM::ConnectionFSM(const uint8_t* device_id, common::TimerWheel* scheduler,
+                             const Config& config)
+    : scheduler_(scheduler)
+    , config_(config)
+    , state_(protocol::ConnectionState::IDLE)
+    , last_heard_us_(0)
+    , last_audio_us_(0)
+    , probe_sent_us_(0)
+    , attempt_sent_us_(0)
+    , attempts_(0)
+    , backoff_ms_(config.backoff_base_ms)
+    , epoch_(0)
+    , downtime_open_(false)
+    , downtime_start_us_(0)
+    , supervision_timer_(common::TimerWheel::INVALID_TIMER)
+    , backoff_timer_(common::TimerWheel::INVALID_TIMER)
+    , total_downtime_us_(0) {
+
+    memcpy(device_id_, device_id, sizeof(device_id_));
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+ConnectionFSM::~ConnectionFSM() {
+    common::TimerWheel::TimerId backoff;
+    common::TimerWheel::TimerId supervision;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        supervision = take_timers_locked(&backoff);
+    }
+    scheduler_->cancel(supervision);
+    scheduler_->cancel(backoff);
+}
+
+protocol::ConnectionState ConnectionFSM::set_state_locked(protocol::ConnectionState state) {
+    protocol::ConnectionState old_state = state_.exchange(state);
+    if (old_state != state) {
+        epoch_++;
+    }
+    return old_state;
+}
+
+void ConnectionFSM::notify(protocol::ConnectionState old_state, protocol::ConnectionState new_state) {
+    if (old_state != new_state && state_change_callback_) {
+        state_change_callback_(old_state, new_state);
+    }
+}
+
+void ConnectionFSM::start_supervision_locked() {
+    if (supervision_timer_ == common::TimerWheel::INVALID_TIMER) {
+        supervision_timer_ = scheduler_->schedule_periodic(SUPERVISION_INTERVAL_US,
+                                                           [this] { check_link(); });
+    }
+}
+
+// Cancelled by the caller after unlocking: a timer callback may be waiting
+// for mutex_
+common::TimerWheel::TimerId ConnectionFSM::take_timers_locked(common::TimerWheel::TimerId* backoff) {
+    *backoff = backoff_timer_;
+    backoff_timer_ = common::TimerWheel::INVALID_TIMER;
+    common::TimerWheel::TimerId supervision = supervision_timer_;
+    supervision_timer_ = common::TimerWheel::INVALID_TIMER;
+    return supervision;
+}
+
+void ConnectionFSM::on_handshake_sent() {
+    common::TimerWheel::TimerId backoff;
+    protocol::ConnectionState old_state;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        old_state = set_state_locked(protocol::ConnectionState::PAIRING);
+        if (old_state == protocol::ConnectionState::IDLE) {
+            attempts_ = 0;
+            backoff_ms_ = config_.backoff_base_ms;
+        }
+        attempt_sent_us_ = protocol::get_timestamp_us();
+        // A handshake sent by hand replaces a pending retry
+        backoff = backoff_timer_;
+        backoff_timer_ = common::TimerWheel::INVALID_TIMER;
+        start_supervision_locked();
+    }
+    scheduler_->cancel(backoff);
+    notify(old_state, protocol::ConnectionState::PAIRING);
+}
+
+void ConnectionFSM::on_connected() {
+    common::TimerWheel::TimerId backoff;
+    protocol::ConnectionState old_state;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        old_state = set_state_locked(protocol::ConnectionState::CONNECTED);
+        last_heard_us_.store(protocol::get_timestamp_us());
+        probe_sent_us_ = 0;
+        attempts_ = 0;
+        backoff_ms_ = config_.backoff_base_ms;
+        backoff = backoff_timer_;
+        backoff_timer_ = common::TimerWheel::INVALID_TIMER;
+        start_supervision_locked();
+    }
+    scheduler_->cancel(backoff);
+    notify(old_state, protocol::ConnectionState::CONNECTED);
+}
+
+void ConnectionFSM::on_packet() {
+    last_heard_us_.store(protocol::get_timestamp_us(), std::memory_order_relaxed);
+}
+
+void ConnectionFSM::on_audio() {
+    uint64_t now = protocol::get_timestamp_us();
+    last_heard_us_.store(now, std::memory_order_relaxed);
+    last_audio_us_.store(now, std::memory_order_relaxed);
+    // Streaming already (every packet but the first), or not up yet
+    if (state_.load() != protocol::ConnectionState::CONNECTED) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (state_.load() != protocol::ConnectionState::CONNECTED) {
+            return;
+        }
+        set_state_locked(protocol::ConnectionState::STREAMING);
+        close_downtime_locked(now, true);
+    }
+    notify(protocol::ConnectionState::CONNECTED, protocol::ConnectionState::STREAMING);
+}
+
+void ConnectionFSM::on_link_lost() {
+    if (is_connected()) {
+        drop(protocol::get_timestamp_us(), last_heard_us_.load());
+    }
+}
+
+void ConnectionFSM::close() {
+    common::TimerWheel::TimerId backoff;
+    common::TimerWheel::TimerId supervision;
+    protocol::ConnectionState old_state;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (state_.load() == protocol::ConnectionState::IDLE) {
+            return;
+        }
+        old_state = set_state_locked(protocol::ConnectionState::DISCONNECTING);
+        close_downtime_locked(protocol::get_timestamp_us(), false);
+        supervision = take_timers_locked(&backoff);
+    }
+    scheduler_->cancel(supervision);
+    scheduler_->cancel(backoff);
+    notify(old_state, protocol::ConnectionState::DISCONNECTING);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (state_.load() != protocol::ConnectionState::DISCONNECTING) {
+            return;
+        }
+        set_state_locked(protocol::ConnectionState::IDLE);
+    }
+    notify(protocol::ConnectionState::DISCONNECTING, protocol::ConnectionState::IDLE);
+}
+
+void ConnectionFSM::check_link() {
+    uint64_t now = protocol::get_timestamp_us();
+    uint64_t heard = last_heard_us_.load();
+    uint64_t silent_us = now > heard ? now - heard : 0;
+    common::TimerWheel::TimerId supervision = common::TimerWheel::INVALID_TIMER;
+    common::TimerWheel::TimerId backoff = common::TimerWheel::INVALID_TIMER;
+    bool probe = false;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    protocol::ConnectionState state = state_.load();
+    protocol::ConnectionState old_state = state;
+    switch (state) {
+        case protocol::ConnectionState::CONNECTED:
+        case protocol::ConnectionState::STREAMING:
+            if (silent_us >= config_.link_timeout_ms * 1000ull) {
+                lock.unlock();
+                drop(now, heard);
+                return;
+            }
+            // Audio stopped: ask once whether the device is still there. An
+            // answered probe waits for audio to come back before the next.
+            if (state == protocol::ConnectionState::STREAMING) {
+                if (probe_sent_us_ != 0 && heard < probe_sent_us_) {
+                    if (now - probe_sent_us_ >= config_.probe_timeout_ms * 1000ull) {
+                        lock.unlock();
+                        drop(now, heard);
+                        return;
+                    }
+                } else if (silent_us >= config_.probe_gap_ms * 1000ull &&
+                           last_audio_us_.load() > probe_sent_us_) {
+                    probe_sent_us_ = now;
+                    stats_.probes++;
+                    probe = true;
+                }
+            }
+            break;
+
+        case protocol::ConnectionState::PAIRING:
+            if (now - attempt_sent_us_ < config_.handshake_timeout_ms * 1000ull) {
+                break;
+            }
+            stats_.attempts_failed++;
+            if (attempts_ >= config_.max_attempts) {
+                std::cout << "[Host] No answer after " << attempts_
+                          << " reconnect attempts, giving up" << std::endl;
+                old_state = set_state_locked(protocol::ConnectionState::IDLE);
+                close_downtime_locked(now, false);
+                supervision = take_timers_locked(&backoff);
+            } else {
+                old_state = set_state_locked(protocol::ConnectionState::ERROR);
+                uint32_t delay_ms = next_backoff_ms_locked();
+                uint64_t epoch = epoch_;
+                std::cout << "[Host] Handshake unanswered, retrying in " << delay_ms << "ms" << std::endl;
+                backoff_timer_ = scheduler_->schedule_after(delay_ms * 1000ull,
+                                                            [this, epoch] { attempt(epoch); });
+            }
+            break;
+
+        case protocol::ConnectionState::IDLE:
+            // Nothing left to supervise
+            supervision = take_timers_locked(&backoff);
+            break;
+
+        default:
+            break;
+    }
+    protocol::ConnectionState new_state = state_.load();
+    lock.unlock();
+
+    // Cancelling this timer from its own callback does not wait
+    scheduler_->cancel(supervision);
+    scheduler_->cancel(backoff);
+    if (probe && probe_callback_) {
+        probe_callback_();
+    }
+    notify(old_state, new_state);
+}
+
+void ConnectionFSM::drop(uint64_t now_us, uint64_t heard_us) {
+    protocol::ConnectionState old_state;
+    uint64_t detect_us = now_us > heard_us ? now_us - heard_us : 0;
+    uint64_t epoch;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (state_.load() != protocol::ConnectionState::CONNECTED &&
+            state_.load() != protocol::ConnectionState::STREAMING) {
+            return;
+        }
+        old_state = set_state_locked(protocol::ConnectionState::ERROR);
+        stats_.drops++;
+        stats_.last_detect_us = detect_us;
+        stats_.max_detect_us = std::max(stats_.max_detect_us, detect_us);
+        // Audio stopped with the last packet, not when the loss was noticed.
+        // A drop before audio came back extends the one still open.
+        if (old_state == protocol::ConnectionState::STREAMING && !downtime_open_) {
+            downtime_open_ = true;
+            downtime_start_us_ = last_audio_us_.load();
+        }
+        probe_sent_us_ = 0;
+        attempts_ = 0;
+        backoff_ms_ = config_.backoff_base_ms;
+        epoch = epoch_;
+    }
+
+    std::cout << "[Host] ❌ Link lost (silent for " << detect_us / 1000.0
+              << "ms), reconnecting" << std::endl;
+    notify(old_state, protocol::ConnectionState::ERROR);
+    attempt(epoch);
+}
+
+void ConnectionFSM::attempt(uint64_t epoch) {
+    uint32_t attempt_number;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Something else moved the FSM on since this was scheduled
+        if (epoch_ != epoch || state_.load() != protocol::ConnectionState::ERROR) {
+            return;
+        }
+        backoff_timer_ = common::TimerWheel::INVALID_TIMER;
+        attempts_++;
+        stats_.attempts++;
+        attempt_number = attempts_;
+        set_state_locked(protocol::ConnectionState::PAIRING);
+        attempt_sent_us_ = protocol::get_timestamp_us();
+        start_supervision_locked();
+    }
+
+    std::cout << "[Host] Reconnect attempt #" << attempt_number << std::endl;
+    notify(protocol::ConnectionState::ERROR, protocol::ConnectionState::PAIRING);
+    if (reconnect_callback_) {
+        reconnect_callback_();
+    }
+}
+
+uint32_t ConnectionFSM::next_backoff_ms_locked() {
+    // Equal jitter: half of each step fixed, half random, so hosts that lost
+    // their devices together do not retry in lockstep
+    uint32_t step_ms = backoff_ms_;
+    backoff_ms_ = std::min(backoff_ms_ * 2, config_.backoff_max_ms);
+    uint32_t random;
+    common::random_bytes(reinterpret_cast<uint8_t*>(&random), sizeof(random));
+    return step_ms / 2 + random % (step_ms - step_ms / 2 + 1);
+}
+
+void ConnectionFSM::close_downtime_locked(uint64_t now_us, bool recovered) {
+    if (!downtime_open_) {
+        return;
+    }
+    downtime_open_ = false;
+    if (!recovered) {
+        stats_.abandoned++;
+        return;
+    }
+
+    uint64_t downtime_us = now_us > downtime_start_us_ ? now_us - downtime_start_us_ : 0;
+    std::cout << "[Host] Audio back after " << downtime_us / 1000.0 << "ms of downtime" << std::endl;
+    stats_.recovered++;
+    stats_.last_downtime_us = downtime_us;
+    stats_.max_downtime_us = std::max(stats_.max_downtime_us, downtime_us);
+    total_downtime_us_ += downtime_us;
+    stats_.avg_downtime_us = total_downtime_us_ / stats_.recovered;
+}
+
+ConnectionFSM::Stats ConnectionFSM::get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace host
@@ -1,25 +1,84 @@
 #include "host/device_manager.h"
 #include "host/transport.h"
+#include "audio_codec.h"
+#include "key_exchange.h"
+#include "csprng.h"
+#include "secure_zero.h"
 #include <iostream>
 #include <cstring>
+#include <ctime>
 #include <algorithm>
-#include <thread>
-#include <chrono>
 
 namespace host {
 
-DeviceManager::DeviceManager(Transport* transport)
+namespace {
+
+constexpr uint64_t DEFAULT_STALE_WINDOW_US = 10000000;    // Five discovery rounds
+
+DeviceInfo to_device_info(const DeviceRecord& record) {
+    DeviceInfo device;
+    device.name = std::string(record.name, strnlen(record.name, sizeof(record.name)));
+    memcpy(device.device_id, record.device_id, sizeof(device.device_id));
+    device.capabilities = record.capabilities;
+    device.battery_level = record.battery_level;
+    device.paired = record.paired;
+    device.connected = false;
+    device.audio_encoding = protocol::AudioEncoding::PCM16;
+    device.frame_samples = protocol::AUDIO_SAMPLES_PER_PACKET;
+    device.frames_per_packet = 1;
+    device.stream_format = protocol::DEFAULT_STREAM_FORMAT;
+    device.last_seen_us = record.last_seen_us;
+    return device;
+}
+
+} // namespace
+
+DeviceManager::DeviceManager(Transport* transport, common::TimerWheel* scheduler)
     : transport_(transport)
+    , scheduler_(scheduler)
     , discovering_(false)
-    , connected_(false)
-    , keepalive_running_(false) {
+    , discovery_timer_(common::TimerWheel::INVALID_TIMER)
+    , stale_window_us_(DEFAULT_STALE_WINDOW_US)
+    , resumption_enabled_(true)
+    , connect_after_pair_(false)
+    , preferred_encoding_(protocol::AudioEncoding::IMA_ADPCM)
+    , frame_samples_(protocol::AUDIO_SAMPLES_PER_PACKET)
+    , frames_per_packet_(1)
+    , stream_format_(protocol::DEFAULT_STREAM_FORMAT)
+    , pair_pending_(false)
+    , has_session_key_(false)
+    , resume_pending_(false)
+    , link_lost_(false)
+    , reconnect_start_us_(0)
+    , awaiting_audio_(false)
+    , reconnect_resumed_(false)
+    , total_reconnect_us_(0)
+    , keepalive_timer_(common::TimerWheel::INVALID_TIMER) {
     
     memset(&connected_device_, 0, sizeof(connected_device_));
+    memset(pair_private_key_, 0, sizeof(pair_private_key_));
+    memset(pair_nonce_, 0, sizeof(pair_nonce_));
+    memset(resume_ticket_id_, 0, sizeof(resume_ticket_id_));
+    memset(resume_nonce_, 0, sizeof(resume_nonce_));
+    memset(&stats_, 0, sizeof(stats_));
 }
 
 DeviceManager::~DeviceManager() {
     stop_discovery();
     disconnect_device();
+    
+    // Their timers call back into this object; destroyed outside the lock
+    // their callbacks take
+    std::unordered_map<uint64_t, std::shared_ptr<ConnectionFSM>> links;
+    {
+        std::lock_guard<std::mutex> lock(links_mutex_);
+        links.swap(links_);
+        link_.reset();
+    }
+    links.clear();
+    
+    common::secure_zero(pair_private_key_, sizeof(pair_private_key_));
+    common::secure_zero(session_key_, sizeof(session_key_));
 }
 
 void DeviceManager::start_discovery() {
@@ -30,12 +89,11 @@ void DeviceManager::start_discovery() {
     std::cout << "[Host] Starting device discovery..." << std::endl;
     discovering_.store(true);
     
-    {
-        std::lock_guard<std::mutex> lock(devices_mutex_);
-        discovered_devices_.clear();
-    }
+    devices_.clear();
     
-    discovery_thread_ = std::thread(&DeviceManager::discovery_loop, this);
+    // Probe immediately, then every 2 seconds
+    discovery_timer_ = scheduler_->schedule_periodic(
+        2000000, [this] { send_discover_request(); }, 0);
 }
 
 void DeviceManager::stop_discovery() {
@@ -46,22 +104,25 @@ void DeviceManager::stop_discovery() {
     std::cout << "[Host] Stopping device discovery" << std::endl;
     discovering_.store(false);
     
-    if (discovery_thread_.joinable()) {
-        discovery_thread_.join();
-    }
-}
-
-void DeviceManager::discovery_loop() {
-    while (discovering_.load()) {
-        send_discover_request();
-        std::this_thread::sleep_for(std::chrono::seconds(2));
-    }
+    scheduler_->cancel(discovery_timer_);
+    discovery_timer_ = common::TimerWheel::INVALID_TIMER;
 }
 
 void DeviceManager::send_discover_request() {
+    // Drop devices that stopped answering
+    uint64_t window_us = stale_window_us_.load();
+    uint64_t now_us = protocol::get_timestamp_us();
+    if (window_us > 0 && now_us > window_us) {
+        size_t evicted = devices_.evict_stale(now_us - window_us);
+        if (evicted > 0) {
+            std::cout << "[Host] Dropped " << evicted << " device(s) not seen for "
+                      << window_us / 1000000 << "s" << std::endl;
+        }
+    }
+    
     protocol::Packet packet;
     packet.set_type(protocol::PacketType::DISCOVER_REQUEST);
-    packet.set_timestamp(static_cast<uint32_t>(protocol::get_timestamp_us()));
+    packet.set_timestamp(protocol::get_timestamp_us());
     packet.set_payload(nullptr, 0);
     
     transport_->send_packet(packet);
@@ -75,62 +136,65 @@ void DeviceManager::on_discover_response(const protocol::Packet& packet) {
     protocol::DiscoverPayload payload;
     memcpy(&payload, packet.payload, sizeof(payload));
     
-    DeviceInfo device;
-    device.name = std::string(payload.device_name);
-    memcpy(device.device_id, payload.device_id, sizeof(device.device_id));
-    device.capabilities = payload.capabilities;
-    device.battery_level = payload.battery_level;
-    device.paired = false;
-    device.connected = false;
-    device.last_seen_us = protocol::get_timestamp_us();
+    DeviceRecord record;
+    memset(&record, 0, sizeof(record));
+    strncpy(record.name, payload.device_name, sizeof(record.name));
+    memcpy(record.device_id, payload.device_id, sizeof(record.device_id));
+    record.capabilities = payload.capabilities;
+    record.battery_level = payload.battery_level;
+    record.last_seen_us = protocol::get_timestamp_us();
+    // The bond store is only asked about devices new to the list
+    record.paired = !devices_.contains(record.device_id) && is_bonded(record.device_id);
     
-    // Check if device already discovered
-    bool is_new = true;
-    {
-        std::lock_guard<std::mutex> lock(devices_mutex_);
-        for (auto& existing : discovered_devices_) {
-            if (memcmp(existing.device_id, device.device_id, sizeof(device.device_id)) == 0) {
-                existing.last_seen_us = device.last_seen_us;
-                is_new = false;
-                break;
-            }
-        }
+    if (devices_.observe(record) == DeviceRegistry::Result::ADDED) {
+        DeviceInfo device = to_device_info(record);
+        std::cout << "[Host] 🔍 Discovered device: " << device.name
+                  << " (Battery: " << static_cast<int>(device.battery_level) << "%)" << std::endl;
         
-        if (is_new) {
-            discovered_devices_.push_back(device);
-            std::cout << "[Host] 🔍 Discovered device: " << device.name
-                      << " (Battery: " << static_cast<int>(device.battery_level) << "%)" << std::endl;
-            
-            if (device_discovered_callback_) {
-                device_discovered_callback_(device);
-            }
+        if (device_discovered_callback_) {
+            device_discovered_callback_(device);
         }
     }
 }
 
 bool DeviceManager::pair_device(const DeviceInfo& device) {
     std::cout << "[Host] Pairing with device: " << device.name << std::endl;
+    mark_reconnect_start();
+    link_for(device)->on_handshake_sent();
     send_pair_request(device);
     return true;
 }
 
+bool DeviceManager::start_session(const DeviceInfo& device) {
+    if (is_connected()) {
+        std::cout << "[Host] Already connected to a device" << std::endl;
+        return false;
+    }
+    
+    if (!resumption_enabled_.load() || !resume_device(device)) {
+        connected_device_ = device;
+        connect_after_pair_.store(true);
+        pair_device(device);
+    }
+    return true;
+}
+
 void DeviceManager::send_pair_request(const DeviceInfo& device) {
     protocol::Packet packet;
     packet.set_type(protocol::PacketType::PAIR_REQUEST);
-    packet.set_timestamp(static_cast<uint32_t>(protocol::get_timestamp_us()));
+    packet.set_timestamp(protocol::get_timestamp_us());
     
     protocol::PairPayload payload;
     memcpy(payload.device_id, device.device_id, sizeof(device.device_id));
     
-    // Generate host key pair (simulated)
-    uint8_t private_key[32];
-    for (int i = 0; i < 32; i++) {
-        private_key[i] = static_cast<uint8_t>(rand() % 256);
-        payload.public_key[i] = private_key[i] ^ 0x55;
-    }
-    
-    for (int i = 0; i < 16; i++) {
-        payload.nonce[i] = static_cast<uint8_t>(rand() % 256);
+    // Ephemeral X25519 key pair, kept for the response
+    {
+        std::lock_guard<std::mutex> lock(pairing_mutex_);
+        common::random_bytes(pair_private_key_, sizeof(pair_private_key_));
+        common::random_bytes(pair_nonce_, sizeof(pair_nonce_));
+        common::x25519_public_key(pair_private_key_, payload.public_key);
+        memcpy(payload.nonce, pair_nonce_, sizeof(payload.nonce));
+        pair_pending_ = true;
     }
     
     packet.set_payload(&payload, sizeof(payload));
@@ -145,23 +209,94 @@ void DeviceManager::on_pair_response(const protocol::Packet& packet) {
         protocol::PairPayload payload;
         memcpy(&payload, packet.payload, sizeof(payload));
         
-        std::lock_guard<std::mutex> lock(devices_mutex_);
-        for (auto& device : discovered_devices_) {
-            if (memcmp(device.device_id, payload.device_id, sizeof(device.device_id)) == 0) {
-                device.paired = true;
-                break;
+        std::unique_lock<std::mutex> pairing_lock(pairing_mutex_);
+        bool paired = false;
+        if (pair_pending_) {
+            // X25519: our private key with the accessory's public one
+            uint8_t shared_secret[common::X25519_KEY_SIZE];
+            has_session_key_ = common::x25519(pair_private_key_, payload.public_key, shared_secret);
+            if (has_session_key_) {
+                common::derive_session_key(shared_secret, pair_nonce_, payload.nonce, session_key_);
+            } else {
+                std::cout << "[Host] Rejected low-order accessory public key" << std::endl;
             }
+            common::secure_zero(shared_secret, sizeof(shared_secret));
+            common::secure_zero(pair_private_key_, sizeof(pair_private_key_));
+            pair_pending_ = false;
+            paired = has_session_key_;
         }
+        pairing_lock.unlock();
+        
+        DeviceRecord info;
+        bool discovered = devices_.set_paired(payload.device_id, true, &info);
+        
+        // Bond the device: the new key replaces any earlier one, with its
+        // ticket. Written through before the connect goes out.
+        if (paired) {
+            update_bond(payload.device_id, true, true, [&](Bond* bond) {
+                if (discovered) {
+                    memcpy(bond->name, info.name, sizeof(bond->name) - 1);
+                    bond->capabilities = info.capabilities;
+                }
+                get_session_key(bond->session_key);
+                memset(bond->ticket_id, 0, sizeof(bond->ticket_id));
+                bond->ticket_expires_s = 0;
+                bond->paired_s = static_cast<uint64_t>(std::time(nullptr));
+            });
+        }
+        
+        // start_session(): connect as soon as the key is agreed
+        if (paired && connect_after_pair_.exchange(false)) {
+            std::cout << "[Host] Connecting to device: " << connected_device_.name << std::endl;
+            if (auto link = active_link()) {
+                link->on_handshake_sent();
+            }
+            send_connect_request();
+        }
+    }
+}
+
+bool DeviceManager::is_bonded(const uint8_t* device_id) const {
+    Bond bond;
+    bool bonded = bonds_.find(device_id, &bond);
+    common::secure_zero(bond.session_key, sizeof(bond.session_key));
+    return bonded;
+}
+
+void DeviceManager::update_bond(const uint8_t* device_id, bool create, bool durable,
+                                const std::function<void(Bond*)>& update) {
+    if (!bonds_.is_open()) {
+        return;
+    }
+    Bond bond;
+    if (!bonds_.find(device_id, &bond)) {
+        if (!create) {
+            return;
+        }
+        memset(&bond, 0, sizeof(bond));
+        memcpy(bond.device_id, device_id, sizeof(bond.device_id));
     }
+    update(&bond);
+    bonds_.put(bond, durable);
+    common::secure_zero(bond.session_key, sizeof(bond.session_key));
+}
+
+bool DeviceManager::get_session_key(uint8_t* key) const {
+    std::lock_guard<std::mutex> lock(pairing_mutex_);
+    if (has_session_key_) {
+        memcpy(key, session_key_, sizeof(session_key_));
+    }
+    return has_session_key_;
 }
 
 bool DeviceManager::connect_device(const DeviceInfo& device) {
-    if (connected_.load()) {
+    if (is_connected()) {
         std::cout << "[Host] Already connected to a device" << std::endl;
         return false;
     }
     
     std::cout << "[Host] Connecting to device: " << device.name << std::endl;
+    link_for(device)->on_handshake_sent();
     connected_device_ = device;
     send_connect_request();
     
@@ -171,20 +306,76 @@ bool DeviceManager::connect_device(const DeviceInfo& device) {
 void DeviceManager::send_connect_request() {
     protocol::Packet packet;
     packet.set_type(protocol::PacketType::CONNECT_REQUEST);
-    packet.set_timestamp(static_cast<uint32_t>(protocol::get_timestamp_us()));
-    packet.set_payload(nullptr, 0);
+    packet.set_timestamp(protocol::get_timestamp_us());
+    
+    protocol::ConnectPayload payload;
+    memset(&payload, 0, sizeof(payload));
+    protocol::AudioEncoding encoding =
+        common::negotiate_encoding(connected_device_.capabilities, preferred_encoding_);
+    if (!common::create_audio_codec(encoding, stream_format_)) {
+        encoding = protocol::AudioEncoding::PCM16;
+    }
+    payload.encoding = static_cast<uint8_t>(encoding);
+    payload.frames_per_packet = frames_per_packet_;
+    payload.frame_samples = frame_samples_;
+    protocol::pack_stream_format(stream_format_, &payload.channels, &payload.format);
+    packet.set_payload(&payload, sizeof(payload));
     
     transport_->send_packet(packet);
 }
 
 void DeviceManager::on_connect_response(const protocol::Packet& packet) {
-    std::cout << "[Host] ✅ Connection established" << std::endl;
-    connected_.store(true);
+    // The accessory echoes the format it will stream (none: PCM16, 10ms,
+    // mono 48kHz INT16)
+    protocol::ConnectPayload payload;
+    memset(&payload, 0, sizeof(payload));
+    memcpy(&payload, packet.payload,
+           std::min<size_t>(packet.header.payload_length, sizeof(payload)));
+    establish_connection(payload, false);
+}
+
+void DeviceManager::establish_connection(const protocol::ConnectPayload& accepted, bool resumed) {
+    auto encoding = static_cast<protocol::AudioEncoding>(accepted.encoding);
+    uint16_t frame_samples = accepted.frame_samples != 0
+        ? accepted.frame_samples : protocol::AUDIO_SAMPLES_PER_PACKET;
+    uint8_t frames_per_packet = std::max<uint8_t>(accepted.frames_per_packet, 1);
+    protocol::StreamFormat format;
+    if (!protocol::unpack_stream_format(accepted.channels, accepted.format, &format)) {
+        format = protocol::DEFAULT_STREAM_FORMAT;
+    }
+    
+    std::cout << "[Host] ✅ " << (resumed ? "Session resumed" : "Connection established")
+              << " (audio: "
+              << protocol::audio_encoding_to_string(encoding) << ", "
+              << static_cast<int>(format.channels) << "ch " << format.sample_rate << "Hz "
+              << protocol::sample_format_to_string(format.sample_format) << ", "
+              << protocol::samples_to_us(frame_samples) / 1000.0 << "ms x "
+              << static_cast<int>(frames_per_packet) << ")" << std::endl;
     connected_device_.connected = true;
+    connected_device_.audio_encoding = encoding;
+    connected_device_.frame_samples = frame_samples;
+    connected_device_.frames_per_packet = frames_per_packet;
+    connected_device_.stream_format = format;
+    
+    update_bond(connected_device_.device_id, false, false, [&](Bond* bond) {
+        bond->params = accepted;
+    });
     
-    // Start keepalive thread
-    keepalive_running_.store(true);
-    keepalive_thread_ = std::thread(&DeviceManager::keepalive_loop, this);
+    // A reconnect lasts until the first audio packet
+    if (reconnect_start_us_.load() != 0) {
+        reconnect_resumed_.store(resumed);
+        awaiting_audio_.store(true);
+    }
+    
+    // Start keepalive timer
+    scheduler_->cancel(keepalive_timer_);
+    keepalive_timer_ = scheduler_->schedule_periodic(
+        protocol::KEEPALIVE_INTERVAL_MS * 1000ull,
+        [this] { send_keepalive(); }, 0);
+        
+    if (auto link = active_link()) {
+        link->on_connected();
+    }
     
     if (connection_state_callback_) {
         connection_state_callback_(true);
@@ -192,26 +383,31 @@ void DeviceManager::on_connect_response(const protocol::Packet& packet) {
 }
 
 bool DeviceManager::disconnect_device() {
-    if (!connected_.load()) {
+    auto link = active_link();
+    if (!link || link->get_state() == protocol::ConnectionState::IDLE) {
         return false;
     }
     
+    // First, so no reconnect races the DISCONNECT; a link that was down
+    // only stops reconnecting
+    bool connected = link->is_connected();
+    link->close();
+    if (!connected) {
+        return true;
+    }
+    
     std::cout << "[Host] Disconnecting from device" << std::endl;
     
     // Stop keepalive
-    keepalive_running_.store(false);
-    if (keepalive_thread_.joinable()) {
-        keepalive_thread_.join();
-    }
+    stop_keepalive();
     
     // Send disconnect packet
     protocol::Packet packet;
     packet.set_type(protocol::PacketType::DISCONNECT);
-    packet.set_timestamp(static_cast<uint32_t>(protocol::get_timestamp_us()));
+    packet.set_timestamp(protocol::get_timestamp_us());
     packet.set_payload(nullptr, 0);
     transport_->send_packet(packet);
     
-    connected_.store(false);
     connected_device_.connected = false;
     
     if (connection_state_callback_) {
@@ -223,39 +419,324 @@ bool DeviceManager::disconnect_device() {
 
 void DeviceManager::on_disconnect(const protocol::Packet& packet) {
     std::cout << "[Host] ❌ Device disconnected" << std::endl;
+    if (auto link = active_link()) {
+        link->on_link_lost();
+    }
+}
+
+void DeviceManager::on_keepalive(const protocol::Packet& packet) {
+    if (auto link = active_link()) {
+        link->on_packet();
+    }
+}
+
+void DeviceManager::handle_connection_loss() {
+    auto link = active_link();
+    if (!link || !link->is_connected()) {
+        return;
+    }
+    std::cout << "[Host] ❌ Connection lost" << std::endl;
+    link->on_link_lost();
+}
+
+std::shared_ptr<ConnectionFSM> DeviceManager::link_for(const DeviceInfo& device) {
+    uint64_t key;
+    memcpy(&key, device.device_id, sizeof(key));
+    std::shared_ptr<ConnectionFSM> previous;
+    std::shared_ptr<ConnectionFSM> link;
+    {
+        std::lock_guard<std::mutex> lock(links_mutex_);
+        std::shared_ptr<ConnectionFSM>& slot = links_[key];
+        if (!slot) {
+            slot = std::make_shared<ConnectionFSM>(device.device_id, scheduler_, link_config_);
+            ConnectionFSM* fsm = slot.get();
+            slot->set_state_change_callback([this, fsm](protocol::ConnectionState old_state,
+                                                        protocol::ConnectionState new_state) {
+                if (active_link().get() == fsm) {
+                    on_link_state(old_state, new_state);
+                }
+            });
+            slot->set_probe_callback([this] { send_keepalive(); });
+            // Straight to the device the link was up with: no discovery
+            slot->set_reconnect_callback([this] { start_session(get_connected_device()); });
+        }
+        if (link_ != slot) {
+            previous = link_;
+            link_ = slot;
+        }
+        link = slot;
+    }
     
-    keepalive_running_.store(false);
-    if (keepalive_thread_.joinable()) {
-        keepalive_thread_.join();
+    // One connection at a time: the last device stops reconnecting
+    if (previous) {
+        previous->close();
+    }
+    return link;
+}
+
+std::shared_ptr<ConnectionFSM> DeviceManager::active_link() const {
+    std::lock_guard<std::mutex> lock(links_mutex_);
+    return link_;
+}
+
+bool DeviceManager::is_connected() const {
+    auto link = active_link();
+    return link && link->is_connected();
+}
+
+void DeviceManager::on_link_state(protocol::ConnectionState old_state,
+                                  protocol::ConnectionState new_state) {
+    // Lost, whether detected, reported by the device or by the caller. The
+    // FSM sends the reconnect right after this returns.
+    bool was_up = old_state == protocol::ConnectionState::CONNECTED ||
+                  old_state == protocol::ConnectionState::STREAMING;
+    if (new_state != protocol::ConnectionState::ERROR || !was_up) {
+        return;
     }
     
-    connected_.store(false);
+    stop_keepalive();
     connected_device_.connected = false;
+    link_lost_.store(true);
     
     if (connection_state_callback_) {
         connection_state_callback_(false);
     }
 }
 
-void DeviceManager::keepalive_loop() {
-    while (keepalive_running_.load()) {
-        send_keepalive();
-        std::this_thread::sleep_for(std::chrono::milliseconds(protocol::KEEPALIVE_INTERVAL_MS));
+protocol::ConnectionState DeviceManager::get_link_state() const {
+    auto link = active_link();
+    return link ? link->get_state() : protocol::ConnectionState::IDLE;
+}
+
+ConnectionFSM::Stats DeviceManager::get_link_stats() const {
+    auto link = active_link();
+    if (link) {
+        return link->get_stats();
+    }
+    ConnectionFSM::Stats stats;
+    memset(&stats, 0, sizeof(stats));
+    return stats;
+}
+
+void DeviceManager::mark_reconnect_start() {
+    // Only the first request after a loss starts the clock; a failed
+    // resume followed by pairing is one reconnect
+    if (link_lost_.exchange(false)) {
+        reconnect_start_us_.store(protocol::get_timestamp_us());
+        awaiting_audio_.store(false);
     }
 }
 
+void DeviceManager::on_session_ticket(const protocol::Packet& packet) {
+    if (packet.header.payload_length < sizeof(protocol::TicketPayload) || !is_connected()) {
+        return;
+    }
+    protocol::TicketPayload payload;
+    memcpy(&payload, packet.payload, sizeof(payload));
+    
+    common::SessionTicket ticket;
+    memset(&ticket, 0, sizeof(ticket));
+    memcpy(ticket.id, payload.ticket_id, sizeof(ticket.id));
+    memcpy(ticket.device_id, connected_device_.device_id, sizeof(ticket.device_id));
+    if (!get_session_key(ticket.session_key)) {
+        return;
+    }
+    uint32_t lifetime_s = std::min<uint32_t>(payload.lifetime_s, protocol::TICKET_LIFETIME_S);
+    ticket.expires_us = protocol::get_timestamp_us() + lifetime_s * 1000000ull;
+    tickets_.store(ticket);
+    
+    // With the ticket on disk a restarted host resumes instead of pairing
+    update_bond(ticket.device_id, false, true, [&](Bond* bond) {
+        memcpy(bond->ticket_id, ticket.id, sizeof(bond->ticket_id));
+        memcpy(bond->session_key, ticket.session_key, sizeof(bond->session_key));
+        bond->ticket_expires_s = static_cast<uint64_t>(std::time(nullptr)) + lifetime_s;
+    });
+    common::secure_zero(ticket.session_key, sizeof(ticket.session_key));
+}
+
+bool DeviceManager::resume_device(const DeviceInfo& device) {
+    if (is_connected()) {
+        return false;
+    }
+    common::SessionTicket ticket;
+    if (!tickets_.find_device(device.device_id, &ticket)) {
+        // A ticket from before a restart, if the bond holds a live one.
+        // Tickets expire on the steady clock; bonds keep Unix time.
+        Bond bond;
+        uint64_t now_s = static_cast<uint64_t>(std::time(nullptr));
+        bool bonded = bonds_.find(device.device_id, &bond);
+        if (!bonded || bond.ticket_expires_s <= now_s) {
+            common::secure_zero(bond.session_key, sizeof(bond.session_key));
+            return false;
+        }
+        memset(&ticket, 0, sizeof(ticket));
+        memcpy(ticket.id, bond.ticket_id, sizeof(ticket.id));
+        memcpy(ticket.device_id, bond.device_id, sizeof(ticket.device_id));
+        memcpy(ticket.session_key, bond.session_key, sizeof(ticket.session_key));
+        ticket.params = bond.params;
+        ticket.expires_us = protocol::get_timestamp_us() + (bond.ticket_expires_s - now_s) * 1000000ull;
+        tickets_.store(ticket);
+        common::secure_zero(bond.session_key, sizeof(bond.session_key));
+    }
+    
+    std::cout << "[Host] Resuming session with device: " << device.name << std::endl;
+    mark_reconnect_start();
+    link_for(device)->on_handshake_sent();
+    connected_device_ = device;
+    
+    protocol::ResumeRequestPayload payload;
+    memcpy(payload.device_id, device.device_id, sizeof(payload.device_id));
+    memcpy(payload.ticket_id, ticket.id, sizeof(payload.ticket_id));
+    common::random_bytes(payload.nonce, sizeof(payload.nonce));
+    common::resume_request_mac(ticket.session_key, payload, payload.mac);
+    common::secure_zero(ticket.session_key, sizeof(ticket.session_key));
+    {
+        std::lock_guard<std::mutex> lock(pairing_mutex_);
+        memcpy(resume_ticket_id_, ticket.id, sizeof(resume_ticket_id_));
+        memcpy(resume_nonce_, payload.nonce, sizeof(resume_nonce_));
+        resume_pending_ = true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.resumes_attempted++;
+    }
+    
+    protocol::Packet packet;
+    packet.set_type(protocol::PacketType::RESUME_REQUEST);
+    packet.set_timestamp(protocol::get_timestamp_us());
+    packet.set_payload(&payload, sizeof(payload));
+    transport_->send_packet(packet);
+    return true;
+}
+
+bool DeviceManager::on_resume_response(const protocol::Packet& packet) {
+    if (packet.header.payload_length < sizeof(protocol::ResumeResponsePayload)) {
+        return false;
+    }
+    protocol::ResumeResponsePayload response;
+    memcpy(&response, packet.payload, sizeof(response));
+    
+    std::unique_lock<std::mutex> lock(pairing_mutex_);
+    common::SessionTicket ticket;
+    if (!resume_pending_ || !tickets_.find(resume_ticket_id_, &ticket)) {
+        return false;
+    }
+    
+    // A rejected ticket is gone for good; pair and connect instead
+    if (response.status != static_cast<uint8_t>(protocol::ResumeStatus::OK)) {
+        tickets_.erase(resume_ticket_id_);
+        resume_pending_ = false;
+        lock.unlock();
+        update_bond(ticket.device_id, false, false, [](Bond* bond) {
+            memset(bond->ticket_id, 0, sizeof(bond->ticket_id));
+            bond->ticket_expires_s = 0;
+        });
+        common::secure_zero(ticket.session_key, sizeof(ticket.session_key));
+        std::cout << "[Host] Resumption rejected, pairing instead" << std::endl;
+        {
+            std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+            stats_.resumes_rejected++;
+        }
+        connect_after_pair_.store(true);
+        pair_device(connected_device_);
+        return false;
+}
+
+    // Only the ticket's holder can answer this request
+    uint8_t expected[protocol::RESUME_MAC_SIZE];
+    common::resume_response_mac(ticket.session_key, resume_nonce_, response, expected);
+    if (!common::resume_mac_equal(expected, response.mac)) {
+        common::secure_zero(ticket.session_key, sizeof(ticket.session_key));
+        std::cout << "[Host] Ignored RESUME_RESPONSE with a bad MAC" << std::endl;
+        return false;
+    }
+    
+    common::derive_resumed_key(ticket.session_key, resume_nonce_, response.nonce,
+                               ticket.session_key);
+    ticket.expires_us = protocol::get_timestamp_us() + protocol::TICKET_LIFETIME_S * 1000000ull;
+    tickets_.store(ticket);
+    memcpy(session_key_, ticket.session_key, sizeof(session_key_));
+    has_session_key_ = true;
+    resume_pending_ = false;
+    lock.unlock();
+    
+    // Left to writeback: a flush here would delay the first audio. Losing
+    // it to a power cut costs a pairing (the stored key no longer matches).
+    update_bond(ticket.device_id, false, false, [&](Bond* bond) {
+        memcpy(bond->session_key, ticket.session_key, sizeof(bond->session_key));
+        bond->ticket_expires_s = static_cast<uint64_t>(std::time(nullptr)) + protocol::TICKET_LIFETIME_S;
+    });
+    common::secure_zero(ticket.session_key, sizeof(ticket.session_key));
+    {
+        std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+        stats_.resumes_succeeded++;
+    }
+    
+    establish_connection(response.accepted, true);
+    return true;
+}
+
+void DeviceManager::on_audio_received() {
+    if (auto link = active_link()) {
+        link->on_audio();
+    }
+    if (!awaiting_audio_.exchange(false)) {
+        return;
+    }
+    uint64_t start_us = reconnect_start_us_.exchange(0);
+    if (start_us == 0) {
+        return;
+    }
+    uint64_t elapsed_us = protocol::get_timestamp_us() - start_us;
+    bool resumed = reconnect_resumed_.load();
+    std::cout << "[Host] Audio back " << elapsed_us / 1000.0 << "ms after reconnecting ("
+              << (resumed ? "resumed" : "paired") << ")" << std::endl;
+    
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.reconnects++;
+    stats_.last_resumed = resumed;
+    stats_.last_reconnect_us = elapsed_us;
+    stats_.max_reconnect_us = std::max(stats_.max_reconnect_us, elapsed_us);
+    total_reconnect_us_ += elapsed_us;
+    stats_.avg_reconnect_us = total_reconnect_us_ / stats_.reconnects;
+}
+
+DeviceManager::Stats DeviceManager::get_stats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+void DeviceManager::stop_keepalive() {
+    scheduler_->cancel(keepalive_timer_);
+    keepalive_timer_ = common::TimerWheel::INVALID_TIMER;
+}
+
 void DeviceManager::send_keepalive() {
     protocol::Packet packet;
     packet.set_type(protocol::PacketType::KEEPALIVE);
-    packet.set_timestamp(static_cast<uint32_t>(protocol::get_timestamp_us()));
+    packet.set_timestamp(protocol::get_timestamp_us());
     packet.set_payload(nullptr, 0);
     
     transport_->send_packet(packet);
 }
 
 std::vector<DeviceInfo> DeviceManager::get_discovered_devices() const {
-    std::lock_guard<std::mutex> lock(devices_mutex_);
-    return discovered_devices_;
+    std::vector<DeviceRecord> records = devices_.snapshot();
+    std::vector<DeviceInfo> devices;
+    devices.reserve(records.size());
+    for (const DeviceRecord& record : records) {
+        devices.push_back(to_device_info(record));
+    }
+    return devices;
+}
+
+bool DeviceManager::find_discovered_device(const uint8_t* device_id, DeviceInfo* device) const {
+    DeviceRecord record;
+    if (!devices_.find(device_id, &record)) {
+        return false;
+    }
+    *device = to_device_info(record);
+    return true;
 }
 
 DeviceInfo DeviceManager::get_connected_device() const {
@@ -0,0 +1,316 @@
+#include "host/device_registry.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+namespace host {
+
+namespace {
+
+constexpr uint32_t MIN_SLOTS = 16;
+
+// Device ids are random, but mix them anyway so a poor source cannot
+// cluster the table
+uint32_t hash_device_id(const uint8_t* device_id) {
+    uint64_t x;
+    memcpy(&x, device_id, sizeof(x));
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return static_cast<uint32_t>(x);
+}
+
+uint32_t round_up_pow2(uint32_t n) {
+    uint32_t slots = MIN_SLOTS;
+    while (slots < n) {
+        slots <<= 1;
+    }
+    return slots;
+}
+
+// What a discover response carries, apart from the id
+bool same_advertisement(const DeviceRecord& a, const DeviceRecord& b) {
+    return memcmp(a.name, b.name, sizeof(a.name)) == 0 &&
+           a.capabilities == b.capabilities &&
+           a.battery_level == b.battery_level;
+}
+
+// Concurrent refreshes may land out of order; keep the latest
+void advance_last_seen(std::atomic<uint64_t>& last_seen_us, uint64_t seen_us) {
+    uint64_t current = last_seen_us.load(std::memory_order_relaxed);
+    while (current < seen_us &&
+           !last_seen_us.compare_exchange_weak(current, seen_us, std::memory_order_relaxed)) {
+    }
+}
+
+} // namespace
+
+DeviceRegistry::DeviceRegistry(uint32_t slots, size_t feed_capacity)
+    : slots_(new Slot[round_up_pow2(slots)])
+    , slot_count_(round_up_pow2(slots))
+    , device_count_(0)
+    , feed_(std::max<size_t>(feed_capacity, 1))
+    , version_(0)
+    , feed_count_(0)
+    , lookups_(0)
+    , probes_(0)
+    , refreshes_(0)
+    , added_(0)
+    , updated_(0)
+    , evicted_(0)
+    , rehashes_(0) {
+
+    for (uint32_t i = 0; i < slot_count_; i++) {
+        slots_[i].used = false;
+    }
+}
+
+DeviceRegistry::~DeviceRegistry() = default;
+
+uint32_t DeviceRegistry::probe(const uint8_t* device_id, bool* found) const {
+    const uint32_t mask = slot_count_ - 1;
+    uint32_t index = hash_device_id(device_id) & mask;
+    uint64_t probes = 1;
+    // Never full: the table grows first
+    while (slots_[index].used &&
+           memcmp(slots_[index].device.device_id, device_id, sizeof(slots_[index].device.device_id)) != 0) {
+        index = (index + 1) & mask;
+        probes++;
+    }
+    lookups_.fetch_add(1, std::memory_order_relaxed);
+    probes_.fetch_add(probes, std::memory_order_relaxed);
+    *found = slots_[index].used;
+    return index;
+}
+
+void DeviceRegistry::read_slot(const Slot& slot, DeviceRecord* device) const {
+    *device = slot.device;
+    device->last_seen_us = slot.last_seen_us.load(std::memory_order_relaxed);
+}
+
+DeviceRegistry::Result DeviceRegistry::observe(const DeviceRecord& device) {
+    // Known and unchanged: the reader lock is enough
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        bool found;
+        uint32_t index = probe(device.device_id, &found);
+        if (found && same_advertisement(slots_[index].device, device)) {
+            advance_last_seen(slots_[index].last_seen_us, device.last_seen_us);
+            refreshes_.fetch_add(1, std::memory_order_relaxed);
+            return Result::REFRESHED;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    bool found;
+    uint32_t index = probe(device.device_id, &found);
+    if (found) {
+        Slot& slot = slots_[index];
+        advance_last_seen(slot.last_seen_us, device.last_seen_us);
+        if (same_advertisement(slot.device, device)) {
+            // Another observer got here first
+            refreshes_.fetch_add(1, std::memory_order_relaxed);
+            return Result::REFRESHED;
+        }
+        memcpy(slot.device.name, device.name, sizeof(slot.device.name));
+        slot.device.capabilities = device.capabilities;
+        slot.device.battery_level = device.battery_level;
+        updated_++;
+        DeviceRecord current;
+        read_slot(slot, &current);
+        publish(DeviceChange::Kind::UPDATED, current);
+        return Result::UPDATED;
+    }
+
+    if ((device_count_ + 1) * 4 > slot_count_ * 3) {
+        grow();
+        index = probe(device.device_id, &found);
+    }
+    Slot& slot = slots_[index];
+    slot.used = true;
+    slot.device = device;
+    slot.last_seen_us.store(device.last_seen_us, std::memory_order_relaxed);
+    device_count_++;
+    added_++;
+    publish(DeviceChange::Kind::ADDED, device);
+    return Result::ADDED;
+}
+
+bool DeviceRegistry::find(const uint8_t* device_id, DeviceRecord* device) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    bool found;
+    uint32_t index = probe(device_id, &found);
+    if (found && device) {
+        read_slot(slots_[index], device);
+    }
+    return found;
+}
+
+bool DeviceRegistry::set_paired(const uint8_t* device_id, bool paired, DeviceRecord* device) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    bool found;
+    uint32_t index = probe(device_id, &found);
+    if (!found) {
+        return false;
+    }
+
+    Slot& slot = slots_[index];
+    DeviceRecord current;
+    if (slot.device.paired != paired) {
+        slot.device.paired = paired;
+        updated_++;
+        read_slot(slot, &current);
+        publish(DeviceChange::Kind::UPDATED, current);
+    } else {
+        read_slot(slot, &current);
+    }
+    if (device) {
+        *device = current;
+    }
+    return true;
+}
+
+void DeviceRegistry::grow() {
+    const uint32_t new_count = slot_count_ * 2;
+    const uint32_t mask = new_count - 1;
+    std::unique_ptr<Slot[]> slots(new Slot[new_count]);
+    for (uint32_t i = 0; i < new_count; i++) {
+        slots[i].used = false;
+    }
+
+    for (uint32_t i = 0; i < slot_count_; i++) {
+        const Slot& old_slot = slots_[i];
+        if (!old_slot.used) {
+            continue;
+        }
+        uint32_t index = hash_device_id(old_slot.device.device_id) & mask;
+        while (slots[index].used) {
+            index = (index + 1) & mask;
+        }
+        slots[index].used = true;
+        slots[index].device = old_slot.device;
+        slots[index].last_seen_us.store(old_slot.last_seen_us.load(std::memory_order_relaxed),
+                                        std::memory_order_relaxed);
+    }
+
+    slots_ = std::move(slots);
+    slot_count_ = new_count;
+    rehashes_++;
+}
+
+void DeviceRegistry::remove_slot(uint32_t index) {
+    // Backward shift: pull each later entry of the run into the hole unless
+    // its home slot lies after the hole, so probes never cross a gap
+    const uint32_t mask = slot_count_ - 1;
+    uint32_t hole = index;
+    uint32_t next = index;
+    while (true) {
+        next = (next + 1) & mask;
+        Slot& slot = slots_[next];
+        if (!slot.used) {
+            break;
+        }
+        uint32_t home = hash_device_id(slot.device.device_id) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            slots_[hole].device = slot.device;
+            slots_[hole].last_seen_us.store(slot.last_seen_us.load(std::memory_order_relaxed),
+                                            std::memory_order_relaxed);
+            hole = next;
+        }
+    }
+    slots_[hole].used = false;
+    device_count_--;
+}
+
+size_t DeviceRegistry::evict_stale(uint64_t cutoff_us) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    size_t evicted = 0;
+    uint32_t index = 0;
+    while (index < slot_count_) {
+        Slot& slot = slots_[index];
+        if (!slot.used || slot.last_seen_us.load(std::memory_order_relaxed) >= cutoff_us) {
+            index++;
+            continue;
+        }
+        DeviceRecord device;
+        read_slot(slot, &device);
+        // The shift may move a later entry here: look at this slot again
+        remove_slot(index);
+        publish(DeviceChange::Kind::REMOVED, device);
+        evicted++;
+    }
+    evicted_ += evicted;
+    return evicted;
+}
+
+void DeviceRegistry::clear() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    for (uint32_t i = 0; i < slot_count_; i++) {
+        slots_[i].used = false;
+    }
+    device_count_ = 0;
+    version_++;
+    feed_count_ = 0;
+}
+
+size_t DeviceRegistry::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return device_count_;
+}
+
+std::vector<DeviceRecord> DeviceRegistry::snapshot(uint64_t* version) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<DeviceRecord> devices;
+    devices.reserve(device_count_);
+    for (uint32_t i = 0; i < slot_count_; i++) {
+        if (slots_[i].used) {
+            devices.emplace_back();
+            read_slot(slots_[i], &devices.back());
+        }
+    }
+    if (version) {
+        *version = version_;
+    }
+    return devices;
+}
+
+bool DeviceRegistry::changes_since(uint64_t* version, std::vector<DeviceChange>* changes) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (*version > version_ || *version + feed_count_ < version_) {
+        return false;
+    }
+    for (uint64_t v = *version + 1; v <= version_; v++) {
+        changes->push_back(feed_[v % feed_.size()]);
+    }
+    *version = version_;
+    return true;
+}
+
+void DeviceRegistry::publish(DeviceChange::Kind kind, const DeviceRecord& device) {
+    version_++;
+    DeviceChange& change = feed_[version_ % feed_.size()];
+    change.version = version_;
+    change.kind = kind;
+    change.device = device;
+    feed_count_ = std::min(feed_count_ + 1, feed_.size());
+}
+
+DeviceRegistry::Stats DeviceRegistry::get_stats() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    Stats stats;
+    stats.devices = device_count_;
+    stats.slots = slot_count_;
+    stats.lookups = lookups_.load(std::memory_order_relaxed);
+    stats.probes = probes_.load(std::memory_order_relaxed);
+    stats.refreshes = refreshes_.load(std::memory_order_relaxed);
+    stats.added = added_;
+    stats.updated = updated_;
+    stats.evicted = evicted_;
+    stats.rehashes = rehashes_;
+    stats.version = version_;
+    return stats;
+}
+
+} // namespace host
@@ -1,7 +1,9 @@
 #include "host/device_manager.h"
 #include "host/audio_sync.h"
+#include "host/clock_sync.h"
 #include "host/telemetry_processor.h"
 #include "host/transport.h"
+#include "timer_wheel.h"
 #include <iostream>
 #include <csignal>
 #include <atomic>
@@ -24,6 +26,10 @@ int main() {
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
     
+    // Shared scheduler for discovery, keepalive and playout timing
+    common::TimerWheel scheduler;
+    scheduler.start();
+    
     // Create transport layer
     host::Transport transport;
     if (!transport.start("127.0.0.1", 8888)) {
@@ -31,18 +37,28 @@ int main() {
         return 1;
     }
     
-    // Create device manager
-    host::DeviceManager device_manager(&transport);
+    // Create device manager; bonds survive restarts
+    host::DeviceManager device_manager(&transport, &scheduler);
+    if (device_manager.open_bond_store("/tmp/wireless_audio_bonds.db")) {
+        auto bond_stats = device_manager.get_bond_stats();
+        std::cout << "[Host] Bond store: " << bond_stats.bonds << " bonds in "
+                  << bond_stats.slots << " slots, opened in " << bond_stats.open_us << "us" << std::endl;
+    }
     
     // Create audio sync
-    host::AudioSync audio_sync(&transport);
+    host::AudioSync audio_sync(&transport, &scheduler);
+    
+    // Create clock synchronization (maps accessory timestamps to host time)
+    host::ClockSync clock_sync(&transport, &scheduler);
+    audio_sync.set_clock_sync(&clock_sync);
     
     // Create telemetry processor
     host::TelemetryProcessor telemetry;
+    telemetry.set_clock_sync(&clock_sync);
     telemetry.open_log("/tmp/wireless_audio_telemetry.log");
     
     // Set up packet routing
-    transport.set_packet_callback([&](const protocol::Packet& packet) {
+    transport.set_packet_callback([&](protocol::Packet& packet) {
         switch (packet.header.type) {
             case protocol::PacketType::DISCOVER_RESPONSE:
                 device_manager.on_discover_response(packet);
@@ -54,19 +70,53 @@ int main() {
                 
             case protocol::PacketType::CONNECT_RESPONSE:
                 device_manager.on_connect_response(packet);
-                // Start audio sync when connected
+                // Audio is decrypted under the key from pairing
+                {
+                    uint8_t key[protocol::SESSION_KEY_SIZE];
+                    audio_sync.set_session_key(device_manager.get_session_key(key) ? key : nullptr);
+                }
+                // Start clock and audio sync when connected
+                clock_sync.start();
                 audio_sync.start();
                 break;
                 
+            case protocol::PacketType::SESSION_TICKET:
+                device_manager.on_session_ticket(packet);
+                break;
+                
+            case protocol::PacketType::RESUME_RESPONSE:
+                // A resumed session starts like a connect, under the new key
+                if (device_manager.on_resume_response(packet)) {
+                    uint8_t key[protocol::SESSION_KEY_SIZE];
+                    audio_sync.set_session_key(device_manager.get_session_key(key) ? key : nullptr);
+                    clock_sync.start();
+                    audio_sync.start();
+                }
+                break;
+                
             case protocol::PacketType::DISCONNECT:
                 device_manager.on_disconnect(packet);
                 audio_sync.stop();
+                clock_sync.stop();
+                break;
+                
+            case protocol::PacketType::KEEPALIVE:
+                device_manager.on_keepalive(packet);
+                break;
+                
+            case protocol::PacketType::TIME_SYNC_RESPONSE:
+                clock_sync.on_time_sync_response(packet);
                 break;
                 
             case protocol::PacketType::AUDIO_DATA:
+                device_manager.on_audio_received();
                 audio_sync.on_audio_packet(packet);
                 break;
                 
+            case protocol::PacketType::AUDIO_FEC:
+                audio_sync.on_fec_packet(packet);
+                break;
+                
             case protocol::PacketType::BATTERY_STATUS:
                 telemetry.process_battery_status(packet);
                 break;
@@ -84,6 +134,7 @@ int main() {
     device_manager.set_connection_state_callback([&](bool connected) {
         if (!connected) {
             audio_sync.stop();
+            clock_sync.stop();
             std::cout << "[Host] Connection lost, stopped audio sync" << std::endl;
         }
     });
@@ -111,13 +162,9 @@ int main() {
             std::cout << "\n[Host] Auto-connecting to: " << devices[0].name << std::endl;
             device_manager.stop_discovery();
             
-            // Pair first
-            device_manager.pair_device(devices[0]);
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
-            
-            // Then connect
-            device_manager.connect_device(devices[0]);
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            // A bonded device resumes its session from the stored ticket;
+            // the rest pair and connect
+            device_manager.start_session(devices[0]);
         }
     }
     
@@ -139,35 +186,98 @@ int main() {
             std::cout << "  Device: " << device_manager.get_connected_device().name << std::endl;
             std::cout << "  Battery: " << static_cast<int>(battery.level) << "%" << std::endl;
             std::cout << "  Audio Packets: RX=" << audio_stats.packets_received
-                      << ", Played=" << audio_stats.packets_played
-                      << ", Lost=" << audio_stats.packets_dropped << std::endl;
-            std::cout << "  Latency: Current=" << audio_stats.current_latency_ms
+                      << " (" << static_cast<int>(audio_stats.frames_per_packet) << " x "
+                      << protocol::samples_to_us(audio_stats.frame_samples) / 1000.0 << "ms frames)"
+                      << ", Frames played=" << audio_stats.frames_played
+                      << ", Lost=" << audio_stats.frames_lost
+                      << " (" << protocol::samples_to_us(audio_stats.samples_lost) / 1000 << "ms)"
+                      << std::endl;
+            std::cout << "  Codec: " << protocol::audio_encoding_to_string(audio_stats.encoding)
+                      << ", RX " << audio_stats.audio_bytes_received / 1024 << " KiB"
+                      << ", Decode errors=" << audio_stats.decode_errors << std::endl;
+            std::cout << "  Retransmission: NACKed=" << audio_stats.retransmits_requested
+                      << ", Recovered=" << audio_stats.retransmits_recovered
+                      << ", Unrecoverable=" << audio_stats.retransmits_unrecoverable << std::endl;
+            if (audio_stats.fec_scheme != protocol::FecScheme::NONE) {
+                std::cout << "  FEC: " << protocol::fec_scheme_to_string(audio_stats.fec_scheme) << " "
+                          << static_cast<int>(audio_stats.fec_data_count) << "+"
+                          << static_cast<int>(audio_stats.fec_parity_count)
+                          << ", Loss=" << audio_stats.loss_rate * 100.0 << "%"
+                          << ", Rebuilt=" << audio_stats.fec_packets_recovered
+                          << ", Failed groups=" << audio_stats.fec_groups_failed << std::endl;
+            }
+            std::cout << "  Transit Delay: Current=" << audio_stats.current_latency_ms
                       << "ms, Avg=" << audio_stats.avg_latency_ms
                       << "ms, Max=" << audio_stats.max_latency_ms << "ms" << std::endl;
-            std::cout << "  Buffer Size: " << static_cast<int>(audio_sync.get_jitter_buffer_size())
-                      << " packets (" << (audio_sync.get_jitter_buffer_size() * protocol::AUDIO_PACKET_DURATION_MS)
+            
+            auto sync_stats = clock_sync.get_stats();
+            if (sync_stats.synchronized) {
+                std::cout << "  One-way Latency: Current=" << audio_stats.one_way_latency_us
+                          << "us, Avg=" << audio_stats.avg_one_way_latency_us
+                          << "us, Max=" << audio_stats.max_one_way_latency_us << "us"
+                          << (audio_stats.playout_aligned ? " (playout aligned)" : "") << std::endl;
+                std::cout << "  Clock: offset=" << sync_stats.offset_us
+                          << "us, drift=" << sync_stats.drift_ppm
+                          << "ppm, min RTT=" << sync_stats.min_rtt_us << "us" << std::endl;
+            } else {
+                std::cout << "  Clock: not synchronized" << std::endl;
+            }
+            std::cout << "  Buffer Size: " << audio_sync.get_jitter_buffer_samples()
+                      << " samples (" << protocol::samples_to_us(audio_sync.get_jitter_buffer_samples()) / 1000.0
                       << "ms)" << std::endl;
+            auto device_stats = device_manager.get_stats();
+            if (device_stats.reconnects > 0 || device_stats.resumes_attempted > 0) {
+                std::cout << "  Reconnects: " << device_stats.reconnects
+                          << " (resumed " << device_stats.resumes_succeeded << "/"
+                          << device_stats.resumes_attempted << ", rejected "
+                          << device_stats.resumes_rejected << "), to first audio last="
+                          << device_stats.last_reconnect_us / 1000.0 << "ms, avg="
+                          << device_stats.avg_reconnect_us / 1000.0 << "ms, max="
+                          << device_stats.max_reconnect_us / 1000.0 << "ms" << std::endl;
+            }
+            auto link_stats = device_manager.get_link_stats();
+            if (link_stats.drops > 0) {
+                std::cout << "  Link Drops: " << link_stats.drops << " (detected "
+                          << link_stats.last_detect_us / 1000.0 << "ms after the last packet, max "
+                          << link_stats.max_detect_us / 1000.0 << "ms; " << link_stats.attempts
+                          << " attempts, " << link_stats.attempts_failed << " unanswered)" << std::endl;
+                std::cout << "  Audio Downtime: last=" << link_stats.last_downtime_us / 1000.0
+                          << "ms, avg=" << link_stats.avg_downtime_us / 1000.0
+                          << "ms, max=" << link_stats.max_downtime_us / 1000.0 << "ms ("
+                          << link_stats.recovered << " recovered, " << link_stats.abandoned
+                          << " abandoned)" << std::endl;
+            }
             std::cout << "========================\n" << std::endl;
             
             last_stats_time = now;
         }
         
-        // Recheck for devices if not connected
-        if (!device_manager.is_connected() && !device_manager.is_discovering()) {
-            std::cout << "[Host] Not connected. Restarting discovery..." << std::endl;
-            device_manager.start_discovery();
+        // Drops are reconnected by the device's connection FSM. Search
+        // again only once it has let go (or nothing was ever connected).
+        if (device_manager.get_link_state() == protocol::ConnectionState::IDLE) {
+            if (!device_manager.is_discovering()) {
+                std::cout << "[Host] Not connected. Restarting discovery..." << std::endl;
+                device_manager.start_discovery();
+            } else {
+                devices = device_manager.get_discovered_devices();
+                if (!devices.empty()) {
+                    std::cout << "[Host] Auto-connecting to: " << devices[0].name << std::endl;
+                    device_manager.stop_discovery();
+                    device_manager.start_session(devices[0]);
+                }
+            }
         }
     }
     
     // Cleanup
     std::cout << "\n[Host] Cleaning up..." << std::endl;
-    if (device_manager.is_connected()) {
-        device_manager.disconnect_device();
-    }
+    device_manager.disconnect_device();
     device_manager.stop_discovery();
     audio_sync.stop();
+    clock_sync.stop();
     telemetry.close_log();
     transport.stop();
+    scheduler.stop();
     
     std::cout << "[Host] Shutdown complete" << std::endl;
     return 0;
@@ -1,4 +1,5 @@
 #include "host/telemetry_processor.h"
+#include "host/clock_sync.h"
 #include <iostream>
 #include <iomanip>
 #include <cstring>
@@ -6,7 +7,8 @@
 
 namespace host {
 
-TelemetryProcessor::TelemetryProcessor() {
+TelemetryProcessor::TelemetryProcessor()
+    : clock_sync_(nullptr) {
     memset(&latest_battery_, 0, sizeof(latest_battery_));
     memset(&latest_diagnostics_, 0, sizeof(latest_diagnostics_));
 }
@@ -67,6 +69,19 @@ void TelemetryProcessor::log_message(const std::string& message) {
     log_file_.flush();
 }
 
+std::string TelemetryProcessor::one_way_delay(const protocol::Packet& packet) const {
+    if (!clock_sync_ || !clock_sync_->is_synchronized()) {
+        return "";
+    }
+    
+    uint64_t now = protocol::get_timestamp_us();
+    uint64_t sent = clock_sync_->to_host_time(packet.header.timestamp_us);
+    std::stringstream ss;
+    ss << " | OWD=" << std::fixed << std::setprecision(2)
+       << (now > sent ? now - sent : 0) / 1000.0 << "ms";
+    return ss.str();
+}
+
 void TelemetryProcessor::process_battery_status(const protocol::Packet& packet) {
     if (packet.header.payload_length < sizeof(protocol::BatteryPayload)) {
         return;
@@ -95,6 +110,7 @@ void TelemetryProcessor::process_battery_status(const protocol::Packet& packet)
         uint32_t minutes = (battery.time_remaining_s % 3600) / 60;
         ss << hours << "h " << minutes << "m remaining";
     }
+    ss << one_way_delay(packet);
     
     log_message(ss.str());
     
@@ -117,11 +133,11 @@ void TelemetryProcessor::process_diagnostics(const protocol::Packet& packet) {
         latest_diagnostics_ = diag;
     }
     
-    // Calculate packet loss rate
-    uint32_t total_expected = diag.packets_received + diag.packets_lost;
+    // Packet loss rate: packets_lost counts our unacknowledged audio out of
+    // everything the accessory sent
     float loss_rate = 0.0f;
-    if (total_expected > 0) {
-        loss_rate = (100.0f * diag.packets_lost) / total_expected;
+    if (diag.packets_sent > 0) {
+        loss_rate = (100.0f * diag.packets_lost) / diag.packets_sent;
     }
     
     // Log diagnostics
@@ -132,7 +148,9 @@ void TelemetryProcessor::process_diagnostics(const protocol::Packet& packet) {
        << "LOST=" << diag.packets_lost << " (" << std::fixed << std::setprecision(1) << loss_rate << "%) "
        << "RSSI=" << static_cast<int>(diag.rssi_dbm) << "dBm "
        << "LQ=" << static_cast<int>(diag.link_quality) << "% "
-       << "LAT=" << diag.avg_latency_us / 1000.0f << "ms";
+       << "RETX=" << diag.packets_retransmitted << " "
+       << "RTT=" << diag.avg_latency_us / 1000.0f << "ms"
+       << one_way_delay(packet);
     
     log_message(ss.str());
     
@@ -7,8 +7,10 @@ namespace host {
 Transport::Transport()
     : socket_fd_(-1)
     , running_(false)
+    , latency_trace_(nullptr)
     , packets_sent_(0)
-    , packets_received_(0) {
+    , packets_received_(0)
+    , datagrams_sent_(0) {
 #ifdef _WIN32
     WSAStartup(MAKEWORD(2, 2), &wsa_data_);
 #endif
@@ -113,7 +115,6 @@ void Transport::cleanup_socket() {
 }
 
 void Transport::receive_loop() {
-    uint8_t buffer[protocol::MAX_PACKET_SIZE];
     sockaddr_in from_addr;
     
 #ifdef _WIN32
@@ -125,19 +126,29 @@ void Transport::receive_loop() {
     while (running_.load()) {
         memset(&from_addr, 0, sizeof(from_addr));
         
-        int received = recvfrom(socket_fd_, reinterpret_cast<char*>(buffer),
-                               sizeof(buffer), 0,
+        // Straight into the reassembler's packet buffer
+        int received = recvfrom(socket_fd_, reinterpret_cast<char*>(reassembler_.receive_buffer()),
+                               static_cast<int>(common::Reassembler::receive_capacity()), 0,
                                reinterpret_cast<sockaddr*>(&from_addr),
                                &from_len);
         
         if (received > 0) {
-            // Deserialize packet
-            protocol::Packet packet;
-            if (protocol::deserialize_packet(buffer, received, &packet)) {
+            uint64_t received_time = protocol::get_timestamp_us();
+            
+            // Whole packets are checked in place; fragments wait for the
+            // rest, and a reassembled packet counts as received with its last
+            protocol::Packet* packet =
+                reassembler_.on_datagram(static_cast<size_t>(received), received_time);
+            if (packet) {
                 packets_received_++;
                 
+                if (latency_trace_ && packet->header.type == protocol::PacketType::AUDIO_DATA) {
+                    latency_trace_->stamp(common::LatencyTrace::Stage::RECV,
+                                          packet->header.sequence, received_time);
+                }
+                
                 if (packet_callback_) {
-                    packet_callback_(packet);
+                    packet_callback_(*packet);
                 }
             }
         } else {
@@ -148,6 +159,8 @@ void Transport::receive_loop() {
 }
 
 void Transport::send_loop() {
+    uint8_t buffer[protocol::MAX_DATAGRAM_SIZE];
+    
     while (running_.load()) {
         std::unique_lock<std::mutex> lock(send_mutex_);
         
@@ -161,21 +174,22 @@ void Transport::send_loop() {
         }
         
         while (!send_queue_.empty()) {
-            protocol::Packet packet = send_queue_.front();
+            // Copy out only the datagram's bytes
+            const common::Datagram& datagram = send_queue_.front();
+            size_t length = datagram.length;
+            bool last = datagram.last;
+            memcpy(buffer, datagram.bytes, length);
             send_queue_.pop();
             lock.unlock();
             
-            // Serialize packet
-            uint8_t buffer[protocol::MAX_PACKET_SIZE];
-            size_t bytes_written;
+            int sent = sendto(socket_fd_, reinterpret_cast<const char*>(buffer),
+                              static_cast<int>(length), 0,
+                              reinterpret_cast<const sockaddr*>(&accessory_addr_),
+                              sizeof(accessory_addr_));
             
-            if (protocol::serialize_packet(packet, buffer, sizeof(buffer), &bytes_written)) {
-                int sent = sendto(socket_fd_, reinterpret_cast<const char*>(buffer),
-                                static_cast<int>(bytes_written), 0,
-                                reinterpret_cast<const sockaddr*>(&accessory_addr_),
-                                sizeof(accessory_addr_));
-                
-                if (sent > 0) {
+            if (sent > 0) {
+                datagrams_sent_++;
+                if (last) {
                     packets_sent_++;
                 }
             }
@@ -190,8 +204,15 @@ bool Transport::send_packet(const protocol::Packet& packet) {
         return false;
     }
     
+    // Split on the caller's thread, straight into the queue
     std::lock_guard<std::mutex> lock(send_mutex_);
-    send_queue_.push(packet);
+    size_t datagrams = fragmenter_.split(packet, [this] {
+        send_queue_.emplace();
+        return &send_queue_.back();
+    });
+    if (datagrams == 0) {
+        return false;
+    }
     send_cv_.notify_one();
     
     return true;